@@ -0,0 +1,138 @@
+/*
+ * Generated by tools/at_automaton.py, do not edit.
+ */
+
+#include "at_automaton.h"
+
+const at_State at_automaton[AT_AUTOMATON_STATES] = {
+    { 0,       0,   1, 1, AT_NONE          },  //   0
+    { '\r',    0,   2, 1, AT_NONE          },  //   1
+    { '\n',    0,   3, 8, AT_NONE          },  //   2
+    { '+',     0,  11, 2, AT_NONE          },  //   3
+    { '>',     0,  13, 1, AT_NONE          },  //   4
+    { 'C',     0,  14, 2, AT_NONE          },  //   5
+    { 'D',     0,  16, 1, AT_NONE          },  //   6
+    { 'E',     0,  17, 1, AT_NONE          },  //   7
+    { 'N',     0,  18, 1, AT_NONE          },  //   8
+    { 'O',     0,  19, 1, AT_NONE          },  //   9
+    { 'S',     0,  20, 2, AT_NONE          },  //  10
+    { 'C',     0,  22, 1, AT_NONE          },  //  11
+    { 'I',     0,  23, 1, AT_NONE          },  //  12
+    { ' ',     0,   0, 0, AT_PROMPT        },  //  13
+    { 'L',     0,  24, 1, AT_NONE          },  //  14
+    { 'O',     0,  25, 1, AT_NONE          },  //  15
+    { 'A',     0,  26, 1, AT_NONE          },  //  16
+    { 'R',     0,  27, 1, AT_NONE          },  //  17
+    { 'O',     0,  28, 1, AT_NONE          },  //  18
+    { 'K',     0,  29, 1, AT_NONE          },  //  19
+    { 'E',     0,  30, 1, AT_NONE          },  //  20
+    { 'H',     0,  31, 1, AT_NONE          },  //  21
+    { 'M',     0,  32, 1, AT_NONE          },  //  22
+    { 'P',     0,  33, 1, AT_NONE          },  //  23
+    { 'O',     0,  34, 1, AT_NONE          },  //  24
+    { 'N',     0,  35, 1, AT_NONE          },  //  25
+    { 'T',     0,  36, 1, AT_NONE          },  //  26
+    { 'R',     0,  37, 1, AT_NONE          },  //  27
+    { ' ',     0,  38, 1, AT_NONE          },  //  28
+    { '\r',    1,  39, 1, AT_NONE          },  //  29
+    { 'N',     0,  40, 1, AT_NONE          },  //  30
+    { 'U',     0,  41, 1, AT_NONE          },  //  31
+    { 'E',     0,  42, 1, AT_NONE          },  //  32
+    { 'D',     0,  43, 1, AT_NONE          },  //  33
+    { 'S',     0,  44, 1, AT_NONE          },  //  34
+    { 'N',     0,  45, 1, AT_NONE          },  //  35
+    { 'A',     0,  46, 1, AT_NONE          },  //  36
+    { 'O',     0,  47, 1, AT_NONE          },  //  37
+    { 'C',     0,  48, 1, AT_NONE          },  //  38
+    { '\n',    2,   0, 0, AT_OK            },  //  39
+    { 'D',     0,  49, 1, AT_NONE          },  //  40
+    { 'T',     0,  50, 1, AT_NONE          },  //  41
+    { ' ',     0,  51, 1, AT_NONE          },  //  42
+    { ',',     0,   0, 0, AT_IPD           },  //  43
+    { 'E',     0,  52, 2, AT_NONE          },  //  44
+    { 'E',     0,  54, 1, AT_NONE          },  //  45
+    { ' ',     0,  55, 1, AT_NONE          },  //  46
+    { 'R',     0,  56, 1, AT_NONE          },  //  47
+    { 'A',     0,  57, 1, AT_NONE          },  //  48
+    { ' ',     0,  58, 2, AT_NONE          },  //  49
+    { ' ',     0,  60, 1, AT_NONE          },  //  50
+    { 'E',     0,  61, 1, AT_NONE          },  //  51
+    { ' ',     0,  62, 1, AT_NONE          },  //  52
+    { 'D',     0,  63, 1, AT_NONE          },  //  53
+    { 'C',     0,  64, 1, AT_NONE          },  //  54
+    { 'A',     0,  65, 1, AT_NONE          },  //  55
+    { '\r',    1,  66, 1, AT_NONE          },  //  56
+    { 'R',     0,  67, 1, AT_NONE          },  //  57
+    { 'F',     0,  68, 1, AT_NONE          },  //  58
+    { 'O',     0,  69, 1, AT_NONE          },  //  59
+    { 'O',     0,  70, 1, AT_NONE          },  //  60
+    { 'R',     0,  71, 1, AT_NONE          },  //  61
+    { 'O',     0,  72, 1, AT_NONE          },  //  62
+    { '\r',    1,  73, 1, AT_NONE          },  //  63
+    { 'T',     0,  74, 2, AT_NONE          },  //  64
+    { 'C',     0,  76, 1, AT_NONE          },  //  65
+    { '\n',    2,   0, 0, AT_ERROR         },  //  66
+    { 'R',     0,  77, 1, AT_NONE          },  //  67
+    { 'A',     0,  78, 1, AT_NONE          },  //  68
+    { 'K',     0,  79, 1, AT_NONE          },  //  69
+    { 'K',     0,  80, 1, AT_NONE          },  //  70
+    { 'R',     0,  81, 1, AT_NONE          },  //  71
+    { 'K',     0,  82, 1, AT_NONE          },  //  72
+    { '\n',    2,   0, 0, AT_CLOSED        },  //  73
+    { '\r',    1,  83, 1, AT_NONE          },  //  74
+    { ' ',     0,  84, 2, AT_NONE          },  //  75
+    { 'C',     0,  86, 1, AT_NONE          },  //  76
+    { 'I',     0,  87, 1, AT_NONE          },  //  77
+    { 'I',     0,  88, 1, AT_NONE          },  //  78
+    { '\r',    1,  89, 1, AT_NONE          },  //  79
+    { '\r',    1,  90, 1, AT_NONE          },  //  80
+    { 'O',     0,  91, 1, AT_NONE          },  //  81
+    { '\r',    1,  92, 1, AT_NONE          },  //  82
+    { '\n',    2,   0, 0, AT_CONNECT       },  //  83
+    { 'F',     0,  93, 1, AT_NONE          },  //  84
+    { 'O',     0,  94, 1, AT_NONE          },  //  85
+    { 'E',     0,  95, 1, AT_NONE          },  //  86
+    { 'E',     0,  96, 1, AT_NONE          },  //  87
+    { 'L',     0,  97, 1, AT_NONE          },  //  88
+    { '\n',    2,   0, 0, AT_SEND_OK       },  //  89
+    { '\n',    2,   0, 0, AT_SHUT_OK       },  //  90
+    { 'R',     0,  98, 1, AT_NONE          },  //  91
+    { '\n',    2,   0, 0, AT_CLOSE_OK      },  //  92
+    { 'A',     0,  99, 1, AT_NONE          },  //  93
+    { 'K',     0, 100, 1, AT_NONE          },  //  94
+    { 'P',     0, 101, 1, AT_NONE          },  //  95
+    { 'R',     0, 102, 1, AT_NONE          },  //  96
+    { '\r',    1, 103, 1, AT_NONE          },  //  97
+    { ':',     0, 104, 1, AT_NONE          },  //  98
+    { 'I',     0, 105, 1, AT_NONE          },  //  99
+    { '\r',    1, 106, 1, AT_NONE          },  // 100
+    { 'T',     0, 107, 1, AT_NONE          },  // 101
+    { '\r',    1, 108, 1, AT_NONE          },  // 102
+    { '\n',    2,   0, 0, AT_SEND_FAIL     },  // 103
+    { ' ',     0,   0, 0, AT_CME_ERROR     },  // 104
+    { 'L',     0, 109, 1, AT_NONE          },  // 105
+    { '\n',    2,   0, 0, AT_CONNECT_OK    },  // 106
+    { ':',     0,   0, 0, AT_DATA_ACCEPT   },  // 107
+    { '\n',    2,   0, 0, AT_NO_CARRIER    },  // 108
+    { '\r',    1, 110, 1, AT_NONE          },  // 109
+    { '\n',    2,   0, 0, AT_CONNECT_FAIL  },  // 110
+};
+
+const char *const at_result_names[] = {
+    "",
+    "OK",
+    "ERROR",
+    "+CME ERROR:",
+    ">",
+    "SEND OK",
+    "SEND FAIL",
+    "CONNECT OK",
+    "CONNECT FAIL",
+    "CLOSED",
+    "SHUT OK",
+    "CLOSE OK",
+    "DATA ACCEPT:",
+    "+IPD,",
+    "CONNECT",
+    "NO CARRIER",
+};
@@ -0,0 +1,43 @@
+#ifndef AT_AUTOMATON_H_
+#define AT_AUTOMATON_H_
+
+/*
+ * Generated by tools/at_automaton.py, do not edit.
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    AT_NONE,
+    AT_OK,
+    AT_ERROR,
+    AT_CME_ERROR,
+    AT_PROMPT,
+    AT_SEND_OK,
+    AT_SEND_FAIL,
+    AT_CONNECT_OK,
+    AT_CONNECT_FAIL,
+    AT_CLOSED,
+    AT_SHUT_OK,
+    AT_CLOSE_OK,
+    AT_DATA_ACCEPT,
+    AT_IPD,
+    AT_CONNECT,
+    AT_NO_CARRIER,
+} at_Result;
+
+typedef struct {
+    char byte;          // the byte leading to the state
+    uint8_t fail;       // the state of the longest proper suffix that is also a prefix
+    uint8_t children;   // first child state, the children are contiguous
+    uint8_t count;      // number of children
+    uint8_t result;     // at_Result matched once the state is reached
+} at_State;
+
+#define AT_AUTOMATON_STATES 111
+
+extern const at_State at_automaton[AT_AUTOMATON_STATES];
+
+extern const char *const at_result_names[];
+
+#endif
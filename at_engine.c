@@ -0,0 +1,477 @@
+#include "at_engine.h"
+
+#include "at_matcher.h"
+#include "error.h"
+#include "lpm.h"
+#include "timer.h"
+#include "trace.h"
+#include "uart.h"
+#include "uart_hub.h"
+
+#include <string.h>
+
+// what the bytes received are part of
+#define AT_RX_RESPONSE   0 // lines, fed to the matcher
+#define AT_RX_IPD_LENGTH 1 // after +IPD,
+#define AT_RX_IPD_DATA   2
+
+RING_BUFFER(at_data, AT_DATA_LENGTH);
+
+const at_Urc *at_urcs;
+size_t at_urcs_length;
+
+at_Command *at_queue[AT_QUEUE_LENGTH]; // a ring, its head is the command running once written
+size_t at_queue_head;
+size_t at_queue_count;
+timer_Task at_timeout;
+
+at_matcher at_engine_matcher;
+uint8_t at_rx_state;
+size_t at_rx_remaining; // IPD data bytes to come, or the length being parsed
+uint8_t at_transparent;
+
+uint16_t at_scan; // bytes scanned past the tail of the RX ring: the line is what's before the next one
+uint16_t at_scan_discards; // uart_discards_a0 when the scan started
+at_Result at_line_result; // the final result code the line is, if no command was waiting for it
+uint8_t at_line_error; // the line is the text after +CME ERROR:, which ends the command
+uint8_t at_line_cut; // the line was too long, it has been taken already: the rest is dropped
+
+typedef void (*at_sink)(const uint8_t *bytes, size_t length);
+
+char at_line_char(const at_Line *line, size_t index) {
+    return ring_buffer_peek_at(line->ring, line->start + index);
+}
+
+int at_line_starts_with(const at_Line *line, const char *prefix) {
+    size_t i;
+
+    for (i = 0; prefix[i]; i++) {
+        if (i >= line->length || at_line_char(line, i) != prefix[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+size_t at_line_find(const at_Line *line, char c) {
+    size_t i;
+
+    for (i = 0; i < line->length && at_line_char(line, i) != c; i++);
+    return i;
+}
+
+unsigned long at_line_number(const at_Line *line, size_t index) {
+    unsigned long number;
+    char c;
+
+    number = 0;
+    for (; index < line->length && (c = at_line_char(line, index)) >= '0' && c <= '9'; index++) {
+        number = number * 10 + (c - '0');
+    }
+    return number;
+}
+
+void at_line_copy(const at_Line *line, char *buffer, size_t buffer_size) {
+    size_t i;
+
+    for (i = 0; i < line->length && i < buffer_size - 1; i++) {
+        buffer[i] = at_line_char(line, i);
+    }
+    buffer[i] = '\0';
+}
+
+/*
+ * Traces the line as it is in the ring: in two runs when it wraps around.
+ */
+void at_trace_line(trace_Event event, const at_Line *line) {
+    const uint8_t *span;
+    size_t run;
+
+    run = ring_buffer_peek_span_at(line->ring, line->start, &span);
+    if (run > line->length) {
+        run = line->length;
+    }
+
+    trace_begin(event);
+    trace_append_bytes(span, run);
+    if (run < line->length) {
+        ring_buffer_peek_span_at(line->ring, line->start + run, &span);
+        trace_append_bytes(span, line->length - run);
+    }
+    trace_end();
+}
+
+// ***************************************************************** RX ring
+
+/*
+ * The hub drops what has been received when it switches (uart_hub_select()): so does the line scanned.
+ */
+void at_rx_sync() {
+    if (at_scan_discards != uart_discards_a0) {
+        at_scan_discards = uart_discards_a0;
+        at_scan = 0;
+        at_line_result = AT_NONE;
+        at_line_error = 0;
+        at_line_cut = 0;
+    }
+}
+
+/*
+ * Done with every byte scanned: the ISR can write over them.
+ */
+void at_rx_consume() {
+    ring_buffer_consume(&uart_read_buf_a0, at_scan);
+    at_scan = 0;
+}
+
+void at_engine_clear() {
+    at_rx_sync();
+    at_rx_consume();
+
+    at_rx_state = AT_RX_RESPONSE;
+    ring_buffer_clear(&at_data);
+    at_matcher_reset(&at_engine_matcher);
+
+    at_line_result = AT_NONE;
+    at_line_error = 0;
+    at_line_cut = 0;
+}
+
+void at_engine_init(const at_Urc *urcs, size_t urcs_length) {
+    at_urcs = urcs;
+    at_urcs_length = urcs_length;
+
+    timer_task_cancel(&at_timeout);
+    at_queue_head = 0;
+    at_queue_count = 0;
+
+    at_transparent = 0;
+    at_engine_clear();
+}
+
+int at_engine_transparent() {
+    return at_transparent;
+}
+
+int at_submit(at_Command *command) {
+    command->result = AT_NONE;
+    if (at_queue_count == AT_QUEUE_LENGTH) {
+        command->status = AT_DONE;
+        return 0;
+    }
+
+    command->status = AT_QUEUED;
+    at_queue[(at_queue_head + at_queue_count++) % AT_QUEUE_LENGTH] = command;
+    return 1;
+}
+
+/*
+ * The command written and waiting for its terminator, NULL if none.
+ */
+at_Command *at_running() {
+    if (at_queue_count == 0 || at_queue[at_queue_head]->status != AT_RUNNING) {
+        return NULL;
+    }
+    return at_queue[at_queue_head];
+}
+
+/*
+ * Writes a run of the command, no further than room bytes. Returns the room left.
+ */
+size_t at_emit(at_sink sink, const char *text, size_t length, size_t room) {
+    if (length > room) {
+        length = room;
+    }
+    sink((const uint8_t *) text, length);
+    return room - length;
+}
+
+/*
+ * Streams the text of the command to the sink, its arguments in place of the '%': nothing is built
+ * in memory. Bounded to AT_COMMAND_LENGTH.
+ */
+void at_format(const at_Command *command, at_sink sink) {
+    const char *const *argument;
+    const char *text, *mark;
+    size_t room;
+
+    text = command->text;
+    argument = command->arguments;
+    room = AT_COMMAND_LENGTH;
+    while ((mark = argument ? strchr(text, '%') : NULL) != NULL) {
+        room = at_emit(sink, text, mark - text, room);
+        room = at_emit(sink, *argument, strlen(*argument), room);
+        argument++;
+        text = mark + 1;
+    }
+    at_emit(sink, text, strlen(text), room);
+}
+
+void at_sink_modem(const uint8_t *bytes, size_t length) {
+    uart_write_buffer(UART_A0, bytes, length);
+}
+
+void at_write(at_Command *command) {
+    command->status = AT_RUNNING;
+
+    if (command->text) {
+        at_format(command, at_sink_modem);
+        uart_write(UART_A0, '\r');
+
+        if (TRACE_ENABLED(AT, TRACE_INFO)) {
+            trace_begin(TRACE_AT_COMMAND);
+            at_format(command, trace_append_bytes);
+            trace_end();
+        }
+    }
+
+    timer_task_start(&at_timeout, command->timeout);
+}
+
+void at_complete(at_Result result) {
+    at_Command *command;
+
+    command = at_queue[at_queue_head];
+    at_queue_head = (at_queue_head + 1) % AT_QUEUE_LENGTH;
+    at_queue_count--;
+
+    timer_task_cancel(&at_timeout);
+    command->result = result;
+    command->status = AT_DONE;
+
+    if (result == AT_CONNECT) {
+        at_transparent = 1; // what follows is the TCP stream
+    }
+}
+
+void at_engine_leave_transparent(at_Command *escape) {
+    at_transparent = 0;
+    at_matcher_reset(&at_engine_matcher);
+
+    escape->result = AT_NONE;
+    if (at_queue_count == AT_QUEUE_LENGTH) {
+        escape->status = AT_DONE;
+        return;
+    }
+
+    // nothing runs in data mode: the head, if any, is still queued
+    at_queue_head = (at_queue_head + AT_QUEUE_LENGTH - 1) % AT_QUEUE_LENGTH;
+    at_queue[at_queue_head] = escape;
+    at_queue_count++;
+    at_write(escape);
+}
+
+/*
+ * Calls the handler of the URC, returns 0 if there's none.
+ */
+int at_dispatch(const at_Line *line) {
+    size_t i;
+
+    for (i = 0; i < at_urcs_length; i++) {
+        if (at_line_starts_with(line, at_urcs[i].prefix)) {
+            if (TRACE_ENABLED(AT, TRACE_INFO)) {
+                at_trace_line(TRACE_AT_URC, line);
+            }
+            if (at_urcs[i].handler) {
+                at_urcs[i].handler(line);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * A line has been received: the error text of the command, its response, or a URC.
+ */
+void at_on_line(const at_Line *line) {
+    at_Command *command;
+    int response;
+
+    command = at_running();
+
+    if (at_line_error) {
+        if (TRACE_ENABLED(AT, TRACE_ERROR)) {
+            at_trace_line(TRACE_AT_CME_ERROR, line);
+        }
+        if (command) {
+            at_complete(AT_CME_ERROR);
+        }
+        return;
+    }
+    if (line->length == 0) {
+        return;
+    }
+
+    if (command && at_line_result == AT_NONE && !command->prefix) {
+        response = !at_dispatch(line); // any line but the URCs
+    } else {
+        response = command && at_line_result == AT_NONE && at_line_starts_with(line, command->prefix);
+        if (!response && !at_dispatch(line) && TRACE_ENABLED(AT, TRACE_DEBUG)) {
+            at_trace_line(TRACE_AT_LINE, line); // nobody waits for it
+        }
+    }
+    if (!response) {
+        return;
+    }
+
+    if (TRACE_ENABLED(AT, TRACE_INFO)) {
+        at_trace_line(TRACE_AT_RESPONSE, line);
+    }
+    if (command->response) {
+        at_line_copy(line, command->response, command->response_size);
+    }
+    if (command->terminators & AT_INFORMATION) {
+        at_complete(AT_OK);
+    }
+}
+
+/*
+ * The line scanned so far, without its line ending nor the blank of the previous one.
+ */
+void at_take_line() {
+    at_Line line;
+
+    line.ring = &uart_read_buf_a0;
+    line.start = 0;
+    line.length = at_scan;
+    while (line.length > 0 && (at_line_char(&line, line.length - 1) == '\n' || at_line_char(&line, line.length - 1) == '\r')) {
+        line.length--;
+    }
+    while (line.length > 0 && at_line_char(&line, 0) == '\r') {
+        line.start++;
+        line.length--;
+    }
+
+    at_on_line(&line);
+    at_rx_consume();
+}
+
+/*
+ * Takes the byte just scanned. What isn't part of a line in progress is consumed right away.
+ */
+void at_feed(uint8_t byte) {
+    at_Command *command;
+    at_Result result;
+    ring_buffer text;
+    at_Line closed;
+
+    if (at_transparent) {
+        ring_buffer_write(&at_data, byte);
+        at_rx_consume();
+        if (at_matcher_feed(&at_engine_matcher, byte) == AT_CLOSED) {
+            // back in command mode, what came with it is of no use
+            at_transparent = 0;
+            ring_buffer_clear(&at_data);
+
+            // the line is the name of the result, in a ring of its own: it is only peeked
+            text.data = (uint8_t *) at_result_names[AT_CLOSED];
+            text.mask = 0xFFFF;
+            text.tail = 0;
+            text.head = strlen(at_result_names[AT_CLOSED]);
+            closed.ring = &text;
+            closed.start = 0;
+            closed.length = text.head;
+            at_dispatch(&closed);
+        }
+        return;
+    }
+
+    switch (at_rx_state) {
+    case AT_RX_IPD_DATA:
+        ring_buffer_write(&at_data, byte); // dropped if full: the packet won't parse
+        at_rx_consume();
+        if (--at_rx_remaining == 0) {
+            at_rx_state = AT_RX_RESPONSE;
+        }
+        return;
+
+    case AT_RX_IPD_LENGTH:
+        at_rx_consume();
+        if (byte >= '0' && byte <= '9') {
+            at_rx_remaining = at_rx_remaining * 10 + (byte - '0');
+        } else {
+            at_rx_state = byte == ':' && at_rx_remaining ? AT_RX_IPD_DATA : AT_RX_RESPONSE;
+        }
+        return;
+    }
+
+    result = at_matcher_feed(&at_engine_matcher, byte);
+    switch (result) {
+    case AT_NONE:
+    case AT_DATA_ACCEPT: // a line as any other, for its URC handler
+        break;
+
+    case AT_IPD:
+        at_rx_state = AT_RX_IPD_LENGTH;
+        at_rx_remaining = 0;
+        at_rx_consume();
+        at_matcher_reset(&at_engine_matcher);
+        return;
+
+    default:
+        command = at_running();
+        if (command && (command->terminators & AT_TERMINATOR(result))) {
+            at_rx_consume();
+            if (result == AT_CME_ERROR) {
+                at_line_error = 1; // the error text follows, up to the end of the line
+                return;
+            }
+            TRACE1(AT, TRACE_INFO, TRACE_AT_RESULT, result);
+            at_complete(result);
+            return;
+        }
+        at_line_result = result; // the line goes to the URC handlers
+        break;
+    }
+
+    if (byte == '\n') {
+        if (!at_line_cut) {
+            at_take_line();
+        }
+        at_rx_consume();
+        at_line_result = AT_NONE;
+        at_line_error = 0;
+        at_line_cut = 0;
+    } else if (at_line_cut) {
+        at_rx_consume();
+    } else if (at_scan >= AT_LINE_LENGTH) {
+        at_take_line(); // the ring must not fill up
+        at_line_cut = 1;
+    }
+}
+
+int at_poll(at_Command *command) {
+    at_Command *head;
+
+    if (uart_hub_current != UART_HUB_SIM800L) {
+        return command && command->status == AT_DONE;
+    }
+
+    at_rx_sync();
+    while (1) {
+        if (command && command->status == AT_DONE) {
+            return 1; // before the next command is written, its caller may have data to send
+        }
+        head = at_queue_count ? at_queue[at_queue_head] : NULL;
+        if (head && head->status == AT_QUEUED && !at_transparent) {
+            at_write(head); // in data mode it would go to the server
+        }
+
+        if (at_scan < ring_buffer_count(&uart_read_buf_a0)) {
+            at_feed(ring_buffer_peek_at(&uart_read_buf_a0, at_scan++));
+        } else if (head && head->status == AT_RUNNING && at_timeout.satisfied) {
+            at_complete(AT_NONE); // what comes late goes to the URC handlers
+        } else {
+            return 0;
+        }
+    }
+}
+
+at_Result at_run(at_Command *command) {
+    at_submit(command);
+    while (!at_poll(command)) {
+        lpm_wait_event(LPM0_bits);
+    }
+    return command->result;
+}
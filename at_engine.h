@@ -0,0 +1,127 @@
+#ifndef AT_ENGINE_H_
+#define AT_ENGINE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "at_automaton.h"
+#include "ring_buffer.h"
+
+/*
+ * AT command engine of the SIM800L. Commands are queued and written one at a time: each one ends
+ * with one of its terminators or its timeout, the information lines that come meanwhile are its
+ * response. Any other line is an unsolicited result code (URC), dispatched to its handler whenever
+ * it comes, amid a response or not. Nothing waits: at_poll() moves it on with what has been received.
+ */
+#define AT_QUEUE_LENGTH 4
+#define AT_LINE_LENGTH 96 // held in the RX ring, longer lines are cut there
+#define AT_COMMAND_LENGTH 556 // the longest command line the modem takes, the writer stops there
+#define AT_DATA_LENGTH 64 // data received from the server, none of the packets we expect is longer
+
+#define AT_TERMINATOR(result) ((uint16_t) 1 << (result))
+#define AT_FINAL (AT_TERMINATOR(AT_OK) | AT_TERMINATOR(AT_ERROR) | AT_TERMINATOR(AT_CME_ERROR))
+#define AT_INFORMATION AT_TERMINATOR(AT_NONE) // the first information line ends the command, with AT_OK
+
+typedef enum {
+    AT_QUEUED,
+    AT_RUNNING,
+    AT_DONE,
+} at_Status;
+
+typedef struct {
+    const char *text; // written with "\r", NULL: nothing is written, the command just waits for a terminator
+    const char *const *arguments; // written in place of each '%' of the text, in turn, NULL: none
+    uint16_t terminators; // AT_TERMINATOR() of every result code ending the command
+    uint32_t timeout; // ms, from when it is written
+    const char *prefix; // of the information lines that are the response, NULL: any line that isn't a URC
+    char *response; // a copy of the last information line, NULL: not kept
+    size_t response_size;
+
+    at_Status status;
+    at_Result result; // once done, AT_NONE if timed out
+} at_Command;
+
+/*
+ * A received line, left where it is: in the RX ring, until its handler returns. Its bytes are
+ * peeked from start past the tail of the ring, the line ending excluded. Copy what must outlive
+ * it (at_line_copy()).
+ */
+typedef struct {
+    const ring_buffer *ring;
+    uint16_t start;
+    uint16_t length;
+} at_Line;
+
+typedef void (*at_urc_handler)(const at_Line *line);
+
+typedef struct {
+    const char *prefix;
+    at_urc_handler handler; // NULL: the line is just logged
+} at_Urc;
+
+/*
+ * Data received from the server, after +IPD or in the data mode of a transparent connection.
+ */
+extern ring_buffer at_data;
+
+char at_line_char(const at_Line *line, size_t index);
+
+int at_line_starts_with(const at_Line *line, const char *prefix);
+
+/*
+ * Index of the first occurrence of the character, the length of the line if none.
+ */
+size_t at_line_find(const at_Line *line, char c);
+
+/*
+ * The decimal number at the given index of the line, up to the first non digit.
+ */
+unsigned long at_line_number(const at_Line *line, size_t index);
+
+/*
+ * Copies the line into the buffer, cut to its size and '\0' terminated.
+ */
+void at_line_copy(const at_Line *line, char *buffer, size_t buffer_size);
+
+/*
+ * Sets the URC handlers (looked up in order, by the prefix of the line), dropping the queue.
+ * Final result codes that no command is waiting for go to them too, e.g. CLOSED.
+ */
+void at_engine_init(const at_Urc *urcs, size_t urcs_length);
+
+/*
+ * Forgets what has been received, the data and the framing in progress.
+ */
+void at_engine_clear();
+
+/*
+ * Whether the UART is in the data mode of a transparent connection: CONNECT enters it,
+ * leaving it is up to the caller (+++), or to the CLOSED that ends it.
+ */
+int at_engine_transparent();
+
+/*
+ * Out of the data mode, +++ just written: the escape command, with no text, waits for its OK ahead of
+ * the commands queued meanwhile (e.g. by a URC handler), which would break the silence that must follow.
+ * If the queue is full, it ends right away as timed out.
+ */
+void at_engine_leave_transparent(at_Command *escape);
+
+/*
+ * Queues the command. If the queue is full, it ends right away as timed out: returns 0.
+ */
+int at_submit(at_Command *command);
+
+/*
+ * Writes the queued commands and dispatches the bytes received, stopping right after the given
+ * command ends (NULL: none) so that what follows is left to its caller. Returns whether it has ended.
+ * Does nothing while the UART hub is not on the modem.
+ */
+int at_poll(at_Command *command);
+
+/*
+ * Queues the command and waits for its end, sleeping meanwhile. Returns its result.
+ */
+at_Result at_run(at_Command *command);
+
+#endif
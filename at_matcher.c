@@ -0,0 +1,25 @@
+#include "at_matcher.h"
+
+void at_matcher_reset(at_matcher *matcher) {
+    *matcher = 0;
+}
+
+at_Result at_matcher_feed(at_matcher *matcher, uint8_t byte) {
+    uint8_t state, i, last;
+
+    state = *matcher;
+    while (1) {
+        last = at_automaton[state].children + at_automaton[state].count;
+        for (i = at_automaton[state].children; i < last; i++) {
+            if ((uint8_t) at_automaton[i].byte == byte) {
+                *matcher = i;
+                return (at_Result) at_automaton[i].result;
+            }
+        }
+        if (state == 0) {
+            *matcher = 0;
+            return AT_NONE;
+        }
+        state = at_automaton[state].fail; // falls back to the longest suffix still matching
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef AT_MATCHER_H_
+#define AT_MATCHER_H_
+
+#include <stdint.h>
+
+#include "at_automaton.h"
+
+/*
+ * Streaming matcher of the AT final result codes (see tools/at_automaton.py for the patterns).
+ * It is fed a byte at a time and tells which result code, if any, the byte completes:
+ * all of them are recognised in a single pass, overlapping prefixes included.
+ */
+typedef uint8_t at_matcher;
+
+void at_matcher_reset(at_matcher *matcher);
+
+/*
+ * Returns the result code completed by the byte, AT_NONE otherwise.
+ */
+at_Result at_matcher_feed(at_matcher *matcher, uint8_t byte);
+
+#endif
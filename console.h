@@ -1,7 +1,6 @@
 #ifndef CONSOLE_H_
 #define CONSOLE_H_
 
-#define CONSOLE_LOG_ENABLED
 #define CONSOLE_ERR_ENABLED
 #define CONSOLE_ERR_INTERVAL 5
 
@@ -5,49 +5,74 @@
 
 #include "timer.h"
 
-typedef enum {
-    DHT22_IDLE,
-    DHT22_ACK,
-    DHT22_STREAM,
-} dht22_State;
-
-dht22_State dht22_state;
+/*
+ * The answer, every edge captured: the line goes low, then the preamble (80us low, 80us high),
+ * then 40 bits, each a 50us low and a 26us (0) or 70us (1) high.
+ */
+#define DHT22_BITS  40
+#define DHT22_EDGES (3 + 2 * DHT22_BITS)
+
+// accepted widths, in us: the datasheet timings give or take the jitter of the sensor
+#define DHT22_PREAMBLE_MIN 60
+#define DHT22_PREAMBLE_MAX 100
+#define DHT22_LOW_MIN      35
+#define DHT22_LOW_MAX      70
+#define DHT22_HIGH_MIN     15
+#define DHT22_HIGH_MAX     90
+#define DHT22_HIGH_ONE     48 // halfway between a 0 and a 1
+
+#define DHT22_WITHIN(delta, min, max) ((delta) >= DHT22_TICKS(min) && (delta) <= DHT22_TICKS(max))
+
+uint8_t dht22_busy;
 uint16_t dht22_timestamp;
-uint64_t dht22_stream;
+uint16_t dht22_deltas[DHT22_EDGES]; // ticks from the previous edge, the first one from the release
+volatile uint8_t dht22_edges;
+uint8_t dht22_overrun; // an edge came before the previous one was stored
+
+PMCU_Error dht22_decode(uint8_t *buffer) {
+    const uint16_t *pulse;
+    uint8_t i;
 
-PMCU_Error dht22_decode_stream(uint64_t stream, uint8_t *buffer) {
-    buffer[0] = (uint8_t) ((stream & 0xff00000000) >> (8 * 4));
-    buffer[1] = (uint8_t) ((stream & 0x00ff000000) >> (8 * 3));
-    buffer[2] = (uint8_t) ((stream & 0x0000ff0000) >> (8 * 2));
-    buffer[3] = (uint8_t) ((stream & 0x000000ff00) >> 8);
+    if (dht22_overrun || !DHT22_WITHIN(dht22_deltas[1], DHT22_PREAMBLE_MIN, DHT22_PREAMBLE_MAX)
+            || !DHT22_WITHIN(dht22_deltas[2], DHT22_PREAMBLE_MIN, DHT22_PREAMBLE_MAX)) {
+        return DHT22_WRONG_PREAMBLE;
+    }
 
-    buffer[4] = (uint8_t) (stream & 0x00000000ff);
+    pulse = dht22_deltas + 3;
+    for (i = 0; i < DHT22_BITS; i++, pulse += 2) {
+        if (!DHT22_WITHIN(pulse[0], DHT22_LOW_MIN, DHT22_LOW_MAX) || !DHT22_WITHIN(pulse[1], DHT22_HIGH_MIN, DHT22_HIGH_MAX)) {
+            return DHT22_WRONG_PULSE;
+        }
+        buffer[i >> 3] = (buffer[i >> 3] << 1) | (pulse[1] >= DHT22_TICKS(DHT22_HIGH_ONE));
+    }
 
     if ((uint8_t) (buffer[0] + buffer[1] + buffer[2] + buffer[3]) != buffer[4]) {
         return DHT22_WRONG_CHECKSUM;
-    } else {
-        return PMCU_OK;
     }
+    return PMCU_OK;
 }
 
-PMCU_Error dht22_read(uint8_t *buffer) {
-    timer_Task timeout;
-    PMCU_Error error;
+timer_Task dht22_timeout;
+
+PT_THREAD(dht22_read_pt(pt *thread, uint8_t *buffer, PMCU_Error *error)) {
+    PT_BEGIN(thread);
 
-    if (dht22_state != DHT22_IDLE) {
-        return DHT22_OPERATION_NOT_ALLOWED;
+    if (dht22_busy) {
+        *error = DHT22_OPERATION_NOT_ALLOWED;
+        PT_EXIT(thread);
     }
 
-    dht22_stream = 1;
-    dht22_state = DHT22_IDLE;
+    dht22_busy = 1;
+    dht22_edges = 0;
+    dht22_overrun = 0;
 
-    // low signal of 1ms
+    // low signal of at least 1ms
     P1DIR |= BIT2;
     P1SEL &= ~BIT2;
     P1OUT &= ~BIT2;
-    __delay_cycles(13000);
 
-    dht22_state = DHT22_ACK;
+    timer_task_start(&dht22_timeout, DHT22_START_DELAY);
+    PT_WAIT_UNTIL(thread, dht22_timeout.satisfied);
 
     // sets as input, that will make the signal go high
     P1REN |= BIT2;
@@ -55,70 +80,55 @@ PMCU_Error dht22_read(uint8_t *buffer) {
     P1SEL |= BIT2;
     P1OUT |= BIT2;
 
-    // the timer will count every 325ns
+    // the timer counts SMCLK / 4: 325.5ns a tick at 12.288MHz
     dht22_timestamp = TA0R;
     TA0CTL = TASSEL__SMCLK | MC__CONTINOUS | ID__4;
-    TA0CCTL1 = CAP | CM_1 | CCIS_0 | SCS | CCIE; // caputres on rising edge
-
-    timer_task_start(&timeout, 3); // after 3s goes timeout
-
-    while (1) { // loops until all data is read or timeout is reached
-        if (dht22_stream & 0x0000010000000000 || timeout.satisfied) {
-            break;
-        }
-    }
+    TA0CCTL1 = CAP | CM_3 | CCIS_0 | SCS | CCIE; // captures on both edges
 
-    timer_task_cancel(&timeout);
+    // waits until every edge is captured or timeout is reached (TA0 runs on SMCLK: LPM0 at most)
+    timer_task_start(&dht22_timeout, DHT22_TIMEOUT_DELAY);
+    PT_WAIT_UNTIL(thread, dht22_edges == DHT22_EDGES || dht22_timeout.satisfied);
+    timer_task_cancel(&dht22_timeout);
 
-    TA0CCTL1 &= ~CAP;
+    TA0CCTL1 = 0;
     TA0CTL = MC_0;
+    dht22_busy = 0;
 
-    if (timeout.satisfied) {
-        dht22_state = DHT22_IDLE;
-        return DHT22_TIMEOUT;
+    if (dht22_edges != DHT22_EDGES) {
+        *error = DHT22_TIMEOUT;
+        PT_EXIT(thread);
     }
 
-    if ((error = dht22_decode_stream(dht22_stream, buffer)) != PMCU_OK) {
-        dht22_state = DHT22_IDLE;
-        return error;
-    }
+    *error = dht22_decode(buffer);
 
-    dht22_state = DHT22_IDLE;
+    PT_END(thread);
+}
 
-    return PMCU_OK;
+PMCU_Error dht22_read(uint8_t *buffer) {
+    PMCU_Error error;
+    pt thread;
+
+    PT_INIT(&thread);
+    PT_RUN(dht22_read_pt(&thread, buffer, &error));
+
+    return error;
 }
 
 #pragma vector=TIMER0_A1_VECTOR  // interrupt vector for TA0CCR1 to TA0CCR4
 __interrupt void dht22_on_tick (void) {
-    TA0CCTL1 &= ~CCIFG;
-
-    switch (dht22_state) {
-    case DHT22_ACK:
-        dht22_state = DHT22_STREAM;
-        TA0CCTL1 = CAP | CM_1 | CCIS_0 | SCS | CCIE; // captures on rising edge
-        break;
-
-    case DHT22_STREAM:
-        // if was capturing on falling edge, measure is finished
-        if (TA0CCTL1 & CM_2) {
-            unsigned int delta;
-
-            delta = TA0CCR1 - dht22_timestamp;
-            TA0CCTL1 = CAP | CM_1 | CCIS_0 | SCS | CCIE;
-
-            dht22_stream <<= 1;
-
-            // The timer counts every 325.6ns.
-            // A logical 1, in dht22 protocol, corresponds to 70us.
-            // So 70us / 325.6ns = 214.98 timer cycles, which rounded is 214.
-            if (delta >= 214) {
-                dht22_stream |= 1;
-            }
-        } else {
-            dht22_timestamp = TA0CCR1;
-            TA0CCTL1 = CAP | CM_2 | CCIS_0 | SCS | CCIE; // captures on falling edge
+    uint16_t capture;
+
+    capture = TA0CCR1;
+    if (TA0CCTL1 & COV) {
+        dht22_overrun = 1;
+    }
+    TA0CCTL1 &= ~(CCIFG | COV);
+
+    if (dht22_edges < DHT22_EDGES) {
+        dht22_deltas[dht22_edges] = capture - dht22_timestamp; // the timer wraps at 16 bits
+        dht22_timestamp = capture;
+        if (++dht22_edges == DHT22_EDGES) {
+            lpm_wake_on_exit();
         }
-        break;
     }
 }
-
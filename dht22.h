@@ -6,6 +6,28 @@
 
 #include "error.h"
 
+#include "pt.h"
+
+#define DHT22_START_DELAY   2  // ms, the start signal lasts at least 1ms
+#define DHT22_TIMEOUT_DELAY 20 // ms, a whole transmission lasts about 5ms
+
+/*
+ * SMCLK, which TA0 counts divided by 4 while it captures the edges: the pulse widths, in ticks,
+ * derive from it. The default is the overclock of main.c.
+ */
+#ifndef DHT22_SMCLK_HZ
+#define DHT22_SMCLK_HZ 12288000UL
+#endif
+
+#define DHT22_TICKS(us) ((uint16_t) (((DHT22_SMCLK_HZ / 4000) * (us) + 500) / 1000))
+
+/*
+ * Reads humidity and temperature (4 bytes) as a protothread: the error is set once it ends.
+ * The capture interrupt only stores the time between edges, the answer is checked and decoded once complete:
+ * a preamble or a pulse out of the timings of the DHT22 (a glitch on the line) rejects it.
+ */
+PT_THREAD(dht22_read_pt(pt *thread, uint8_t *buffer, PMCU_Error *error));
+
 PMCU_Error dht22_read(uint8_t *buffer);
 
 #endif
@@ -1,6 +1,6 @@
 #include "error.h"
 
-#include "timer.h"
+#include "lpm.h"
 #include "uart.h"
 
 #include <string.h>
@@ -11,23 +11,8 @@ inline const char *PMCU_error_str(PMCU_Error error) {
     return pmcu_errors_str[error];
 }
 
-void PMCU_log(const char *message) {
-    char tmp[8];
-    ltoa(timer_timestamp(), tmp);
-
-    uart_write_string(UART_A1, "[");
-    uart_write_string(UART_A1, tmp);
-    uart_write_string(UART_A1, "] ");
-    uart_write_string(UART_A1, message);
-    uart_write_string(UART_A1, "\r\n");
-}
-
 void PMCU_error_print(const char *source, PMCU_Error error, const char *message) {
-    timer_Task task;
-
-    do {
-        repeat:
-
+    while (1) { // runs forever
         uart_write_string(UART_A1, "\r\n");
         uart_write_string(UART_A1, source);
         uart_write_string(UART_A1, ": ");
@@ -39,12 +24,8 @@ void PMCU_error_print(const char *source, PMCU_Error error, const char *message)
         uart_write_string(UART_A1, "\r\n");
         uart_write_string(UART_A1, "\r\n");
 
-        timer_task_start(&task, 3);
-
-        while (1) {
-            if (task.satisfied) {
-                goto repeat; // sorry mom
-            }
-        }
-    } while (1); // runs forever
+        // LPM3 stops SMCLK, that clocks the console
+        uart_flush(UART_A1, UART_WRITE_TIMEOUT);
+        lpm_wait(NULL, NULL, LPM3_bits, 3000);
+    }
 }
@@ -31,16 +31,22 @@
     ACTION(PMCU_GENERIC_ERROR) \
     \
     ACTION(UART_TIMEOUT_ERROR) \
-    ACTION(UART_UNEXPECTED_BYTE_ERROR) \
-    ACTION(UART_BUFFER_TOO_SMALL_ERROR) \
+    \
+    ACTION(TIMER_NO_SLOT_AVAILABLE) \
     \
     ACTION(DHT22_OPERATION_NOT_ALLOWED) \
     ACTION(DHT22_TIMEOUT) \
     ACTION(DHT22_WRONG_CHECKSUM) \
+    ACTION(DHT22_WRONG_PREAMBLE) \
+    ACTION(DHT22_WRONG_PULSE) \
+    \
+    ACTION(GPS_NO_FIX) \
+    ACTION(GPS_CONFIGURATION_REJECTED) \
     \
     ACTION(SIM800L_TIMEOUT_ERROR) \
     ACTION(SIM800L_UNEXPECTED_RESPONSE_ERROR) \
     ACTION(SIM800L_MAX_RETRIALS_REACHED_ERROR) \
+    ACTION(SIM800L_NOT_REGISTERED) \
     \
     ACTION(SPS30_START_BYTE_EXPECTED) \
     ACTION(SPS30_BUFFER_TOO_SMALL) \
@@ -54,8 +60,16 @@
     ACTION(SPS30_UNKNOWN_STATE) \
     ACTION(SPS30_STOP_BYTE_EXPECTED) \
     ACTION(SPS30_INVALID_STUFFED_BYTE) \
+    ACTION(SPS30_WRONG_FRAME_LENGTH) \
+    ACTION(SPS30_UNEXPECTED_RESPONSE) \
     \
-    ACTION(MQTT_UNEXPECTED_RESPONSE_ERROR)
+    ACTION(FLASH_ACCESS_VIOLATION) \
+    ACTION(FLASH_LOG_RECORD_TOO_LONG) \
+    \
+    ACTION(MQTT_UNEXPECTED_RESPONSE_ERROR) \
+    ACTION(MQTT_RECONNECT_BACKOFF) \
+    ACTION(MQTT_PACKET_TOO_LONG) \
+    ACTION(MQTT_INFLIGHT_WINDOW_FULL)
 
 #define GENERATE_STRING(STRING) #STRING,
 #define GENERATE_ENUM(ENUM) ENUM,
@@ -68,8 +82,6 @@ PMCU_Error pmcu_error;
 
 const char *PMCU_error_str(PMCU_Error error);
 
-void PMCU_log(const char *message);
-
 void PMCU_error_print(const char *source, PMCU_Error error, const char *message);
 
 #endif
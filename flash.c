@@ -0,0 +1,45 @@
+#include "flash.h"
+
+/*
+ * Locks the flash again, and reports whether the operation has been refused.
+ */
+PMCU_Error flash_lock() {
+    PMCU_Error error;
+
+    error = (FCTL3 & (KEYV | ACCVIFG)) ? FLASH_ACCESS_VIOLATION : PMCU_OK;
+
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY | LOCK;
+
+    return error;
+}
+
+PMCU_Error flash_erase_segment(uint32_t address) {
+    FCTL3 = FWKEY; // unlocks
+    FCTL1 = FWKEY | ERASE;
+    FLASH_WRITE(address, 0); // a dummy write starts the erase
+    while (FCTL3 & BUSY);
+
+    return flash_lock();
+}
+
+PMCU_Error flash_write(uint32_t address, const uint8_t *buffer, size_t buffer_length) {
+    size_t i;
+
+    FCTL3 = FWKEY; // unlocks
+    FCTL1 = FWKEY | WRT;
+    for (i = 0; i < buffer_length; i++) {
+        FLASH_WRITE(address + i, buffer[i]);
+        while (FCTL3 & BUSY);
+    }
+
+    return flash_lock();
+}
+
+void flash_read(uint32_t address, uint8_t *buffer, size_t buffer_length) {
+    size_t i;
+
+    for (i = 0; i < buffer_length; i++) {
+        buffer[i] = FLASH_READ(address + i);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef FLASH_H_
+#define FLASH_H_
+
+#include <msp430.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "error.h"
+
+/*
+ * Main flash is erased by segments of 512 bytes, to 0xFF: a write can only clear bits.
+ * Addresses are 20 bits wide, FLASH2 lies above 64KB (restricted data model).
+ */
+#define FLASH_SEGMENT_SIZE 512
+
+#ifndef FLASH_READ // the host simulation provides its own flash
+#define FLASH_READ(address)        (*((const volatile uint8_t *) (address)))
+#define FLASH_WRITE(address, byte) (*((volatile uint8_t *) (address)) = (byte))
+#endif
+
+/*
+ * Erases the segment containing address.
+ * The CPU is held for up to 32ms meanwhile: interrupts are served only afterwards.
+ */
+PMCU_Error flash_erase_segment(uint32_t address);
+
+/*
+ * Programs the bytes, which must have been erased (only 1 bits can be cleared).
+ */
+PMCU_Error flash_write(uint32_t address, const uint8_t *buffer, size_t buffer_length);
+
+void flash_read(uint32_t address, uint8_t *buffer, size_t buffer_length);
+
+#endif
@@ -0,0 +1,333 @@
+#include "flash_log.h"
+
+#include "trace.h"
+
+uint8_t flash_log_empty; // no segment has been written yet
+uint8_t flash_log_head; // the segment being appended to
+uint8_t flash_log_tail; // the oldest segment
+uint32_t flash_log_sequence; // of the head segment
+uint16_t flash_log_offset; // where the next record goes, in the head segment
+
+uint8_t flash_log_cursor_segment;
+uint16_t flash_log_cursor_offset;
+
+size_t flash_log_count;
+
+uint32_t flash_log_address(uint8_t segment, uint16_t offset) {
+    return FLASH_LOG_ORIGIN + (uint32_t) segment * FLASH_SEGMENT_SIZE + offset;
+}
+
+uint16_t flash_log_read_word(uint32_t address) {
+    return FLASH_READ(address) | ((uint16_t) FLASH_READ(address + 1) << 8);
+}
+
+/*
+ * Whether the segment header is complete, then its sequence number is read.
+ */
+int flash_log_segment_valid(uint8_t segment, uint32_t *sequence) {
+    uint32_t address;
+
+    address = flash_log_address(segment, 0);
+    if (flash_log_read_word(address + 6) != FLASH_LOG_MAGIC) {
+        return 0;
+    }
+    *sequence = flash_log_read_word(address) | ((uint32_t) flash_log_read_word(address + 2) << 16);
+    return 1;
+}
+
+/*
+ * The length of the record at offset, 0 if there is none: free space, or a length cut short.
+ */
+uint16_t flash_log_record_length(uint8_t segment, uint16_t offset) {
+    uint16_t length;
+
+    if (offset + FLASH_LOG_RECORD_HEADER > FLASH_SEGMENT_SIZE) {
+        return 0;
+    }
+    length = flash_log_read_word(flash_log_address(segment, offset));
+    if (length == 0xFFFF || offset + FLASH_LOG_RECORD_HEADER + length > FLASH_SEGMENT_SIZE) {
+        return 0;
+    }
+    return length;
+}
+
+uint8_t flash_log_record_state(uint8_t segment, uint16_t offset) {
+    return FLASH_READ(flash_log_address(segment, offset) + 3);
+}
+
+uint8_t flash_log_checksum(const uint8_t *record, size_t record_length) {
+    uint8_t checksum;
+    size_t i;
+
+    checksum = 0;
+    for (i = 0; i < record_length; i++) {
+        checksum += record[i];
+    }
+    return ~checksum;
+}
+
+/*
+ * Counts the records of the segment not delivered yet, and returns where its free space starts
+ * (FLASH_SEGMENT_SIZE if there is none left).
+ */
+uint16_t flash_log_scan(uint8_t segment, size_t *pending) {
+    uint16_t offset, length;
+
+    *pending = 0;
+    offset = FLASH_LOG_SEGMENT_HEADER;
+    while ((length = flash_log_record_length(segment, offset))) {
+        if (flash_log_record_state(segment, offset) == FLASH_LOG_COMMITTED) {
+            (*pending)++;
+        }
+        offset += FLASH_LOG_RECORD_HEADER + length;
+    }
+
+    if (offset + 2 > FLASH_SEGMENT_SIZE || flash_log_read_word(flash_log_address(segment, offset)) != 0xFFFF) {
+        return FLASH_SEGMENT_SIZE; // cut short by a reset: the rest of the segment is lost
+    }
+    return offset;
+}
+
+void flash_log_init() {
+    uint32_t sequence, oldest;
+    size_t pending;
+    uint8_t segment;
+
+    flash_log_empty = 1;
+    flash_log_count = 0;
+    oldest = 0;
+
+    for (segment = 0; segment < FLASH_LOG_SEGMENTS; segment++) {
+        if (!flash_log_segment_valid(segment, &sequence)) {
+            continue;
+        }
+        if (flash_log_empty || sequence > flash_log_sequence) {
+            flash_log_head = segment;
+            flash_log_sequence = sequence;
+        }
+        if (flash_log_empty || sequence < oldest) {
+            flash_log_tail = segment;
+            oldest = sequence;
+        }
+        flash_log_empty = 0;
+    }
+
+    if (flash_log_empty) {
+        // the first append opens segment 0
+        flash_log_head = FLASH_LOG_SEGMENTS - 1;
+        flash_log_tail = 0;
+        flash_log_sequence = 0;
+        flash_log_offset = FLASH_SEGMENT_SIZE;
+    } else {
+        segment = flash_log_tail;
+        while (1) {
+            flash_log_offset = flash_log_scan(segment, &pending);
+            flash_log_count += pending;
+            if (segment == flash_log_head) {
+                break;
+            }
+            segment = (segment + 1) % FLASH_LOG_SEGMENTS;
+        }
+    }
+
+    flash_log_cursor_segment = flash_log_empty ? flash_log_head : flash_log_tail;
+    flash_log_cursor_offset = flash_log_empty ? FLASH_SEGMENT_SIZE : FLASH_LOG_SEGMENT_HEADER;
+}
+
+/*
+ * Drops the oldest segment, with the records it still holds.
+ */
+void flash_log_drop_tail() {
+    size_t pending;
+
+    flash_log_scan(flash_log_tail, &pending);
+    if (pending) {
+        TRACE(FLASH, TRACE_ERROR, TRACE_FLASH_FULL);
+        flash_log_count -= pending;
+    }
+
+    if (flash_log_cursor_segment == flash_log_tail) {
+        flash_log_cursor_segment = (flash_log_tail + 1) % FLASH_LOG_SEGMENTS;
+        flash_log_cursor_offset = FLASH_LOG_SEGMENT_HEADER;
+    }
+    flash_log_tail = (flash_log_tail + 1) % FLASH_LOG_SEGMENTS;
+}
+
+/*
+ * Erases the segment after the head, and makes it the head.
+ */
+PMCU_Error flash_log_open_segment() {
+    uint8_t header[FLASH_LOG_SEGMENT_HEADER];
+    uint32_t sequence, address;
+    uint16_t erases;
+    uint8_t next;
+
+    next = (flash_log_head + 1) % FLASH_LOG_SEGMENTS;
+    address = flash_log_address(next, 0);
+
+    if (!flash_log_empty && next == flash_log_tail) {
+        flash_log_drop_tail();
+    }
+
+    erases = flash_log_segment_valid(next, &sequence) ? flash_log_read_word(address + 4) + 1 : 1;
+    __pmcu_handle(flash_erase_segment(address));
+
+    sequence = flash_log_sequence + 1;
+    header[0] = sequence & 0xff;
+    header[1] = (sequence >> 8) & 0xff;
+    header[2] = (sequence >> 16) & 0xff;
+    header[3] = (sequence >> 24) & 0xff;
+    header[4] = erases & 0xff;
+    header[5] = (erases >> 8) & 0xff;
+    header[6] = FLASH_LOG_MAGIC & 0xff;
+    header[7] = (FLASH_LOG_MAGIC >> 8) & 0xff;
+    __pmcu_handle(flash_write(address, header, FLASH_LOG_SEGMENT_HEADER)); // the magic goes last
+
+    flash_log_head = next;
+    flash_log_sequence = sequence;
+    flash_log_offset = FLASH_LOG_SEGMENT_HEADER;
+    flash_log_empty = 0;
+
+    return PMCU_OK;
+}
+
+PMCU_Error flash_log_append(const uint8_t *record, size_t record_length) {
+    uint8_t header[FLASH_LOG_RECORD_HEADER];
+    uint32_t address;
+
+    if (record_length == 0 || record_length > FLASH_LOG_RECORD_LENGTH) {
+        return FLASH_LOG_RECORD_TOO_LONG;
+    }
+
+    if (flash_log_offset + FLASH_LOG_RECORD_HEADER + record_length > FLASH_SEGMENT_SIZE) {
+        __pmcu_handle(flash_log_open_segment());
+    }
+
+    address = flash_log_address(flash_log_head, flash_log_offset);
+    flash_log_offset += FLASH_LOG_RECORD_HEADER + record_length; // taken, even if cut short
+
+    header[0] = record_length & 0xff;
+    header[1] = (record_length >> 8) & 0xff;
+    header[2] = flash_log_checksum(record, record_length);
+    header[3] = FLASH_LOG_COMMITTED;
+
+    __pmcu_handle(flash_write(address, header, 3));
+    __pmcu_handle(flash_write(address + FLASH_LOG_RECORD_HEADER, record, record_length));
+    __pmcu_handle(flash_write(address + 3, &header[3], 1));
+
+    flash_log_count++;
+    return PMCU_OK;
+}
+
+/*
+ * Moves the read cursor up to the next record not delivered yet, or to the end of the log.
+ * Returns whether there is such a record.
+ */
+int flash_log_seek() {
+    uint16_t length;
+
+    while (1) {
+        if (flash_log_cursor_segment == flash_log_head && flash_log_cursor_offset >= flash_log_offset) {
+            return 0;
+        }
+
+        length = flash_log_record_length(flash_log_cursor_segment, flash_log_cursor_offset);
+        if (length == 0) {
+            if (flash_log_cursor_segment == flash_log_head) {
+                flash_log_cursor_offset = flash_log_offset;
+                return 0;
+            }
+            flash_log_cursor_segment = (flash_log_cursor_segment + 1) % FLASH_LOG_SEGMENTS;
+            flash_log_cursor_offset = FLASH_LOG_SEGMENT_HEADER;
+        } else if (flash_log_record_state(flash_log_cursor_segment, flash_log_cursor_offset) == FLASH_LOG_COMMITTED) {
+            return 1;
+        } else {
+            flash_log_cursor_offset += FLASH_LOG_RECORD_HEADER + length;
+        }
+    }
+}
+
+/*
+ * A tag is the low 12 bits of the segment sequence number, the number of records (4 bits),
+ * then the segment and the offset of the first one (16 bits).
+ */
+uint32_t flash_log_tag(uint32_t sequence, size_t count, uint8_t segment, uint16_t offset) {
+    return ((sequence & 0xfff) << 20) | ((uint32_t) count << 16) | ((uint32_t) segment << 9) | offset;
+}
+
+int flash_log_peek(uint8_t *record, size_t record_size, size_t *record_length, uint32_t *tag) {
+    uint32_t address, sequence;
+
+    while (flash_log_seek()) {
+        address = flash_log_address(flash_log_cursor_segment, flash_log_cursor_offset);
+        flash_log_segment_valid(flash_log_cursor_segment, &sequence);
+
+        *record_length = flash_log_read_word(address);
+        *tag = flash_log_tag(sequence, 1, flash_log_cursor_segment, flash_log_cursor_offset);
+        if (*record_length <= record_size) {
+            flash_read(address + FLASH_LOG_RECORD_HEADER, record, *record_length);
+            if (flash_log_checksum(record, *record_length) == FLASH_READ(address + 2)) {
+                return 1;
+            }
+        }
+
+        TRACE(FLASH, TRACE_ERROR, TRACE_FLASH_CORRUPTED);
+        flash_log_mark_sent(*tag);
+        flash_log_advance();
+    }
+    return 0;
+}
+
+void flash_log_advance() {
+    uint16_t length;
+
+    if ((length = flash_log_record_length(flash_log_cursor_segment, flash_log_cursor_offset))) {
+        flash_log_cursor_offset += FLASH_LOG_RECORD_HEADER + length;
+    }
+}
+
+uint32_t flash_log_run(uint32_t first, size_t count) {
+    return (first & 0xfff0ffffUL) | ((uint32_t) count << 16);
+}
+
+void flash_log_mark_sent(uint32_t tag) {
+    uint32_t sequence;
+    uint16_t offset, length;
+    uint8_t segment, state;
+    size_t count;
+
+    count = (tag >> 16) & 0xf;
+    segment = (tag >> 9) & 0x7f; // FLASH_LOG_SEGMENTS fits in 7 bits
+    offset = tag & 0x1ff;
+    tag >>= 20; // the sequence number the segment must have
+
+    state = FLASH_LOG_SENT;
+    while (count) {
+        if (!flash_log_segment_valid(segment, &sequence) || (sequence & 0xfff) != tag) {
+            return; // dropped meanwhile, the segment holds other records now
+        }
+        if (segment == flash_log_head && offset >= flash_log_offset) {
+            return;
+        }
+
+        if (!(length = flash_log_record_length(segment, offset))) {
+            // the run goes on in the next segment
+            segment = (segment + 1) % FLASH_LOG_SEGMENTS;
+            offset = FLASH_LOG_SEGMENT_HEADER;
+            tag = (tag + 1) & 0xfff;
+            continue;
+        }
+
+        if (flash_log_record_state(segment, offset) == FLASH_LOG_COMMITTED) {
+            if (flash_write(flash_log_address(segment, offset) + 3, &state, 1) == PMCU_OK) {
+                flash_log_count--;
+            }
+            count--;
+        }
+        offset += FLASH_LOG_RECORD_HEADER + length;
+    }
+}
+
+size_t flash_log_pending() {
+    return flash_log_count;
+}
@@ -0,0 +1,74 @@
+#ifndef FLASH_LOG_H_
+#define FLASH_LOG_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "flash.h"
+
+/*
+ * A persistent, append-only log of records, kept in FLASH_LOG of lnk_msp430f5529.cmd.
+ *
+ * The segments are used as a ring, oldest first: each one starts with a header carrying an
+ * increasing sequence number, written last so that a torn erase leaves the segment free.
+ * Going round the ring erases every segment in turn, which levels the wear.
+ *
+ * A record is a header followed by the payload:
+ * - length (2 bytes) and checksum, written first;
+ * - state, cleared to COMMITTED once the payload is in, then to SENT once delivered.
+ * A record cut short by a reset is never committed, and skipped. The read cursor is the oldest
+ * committed record: it is found again at boot.
+ */
+#define FLASH_LOG_ORIGIN   0x14400UL
+#define FLASH_LOG_SEGMENTS 128 // 64KB
+
+#define FLASH_LOG_MAGIC 0x474C // "LG"
+
+#define FLASH_LOG_SEGMENT_HEADER 8 // sequence (4), erases (2), magic (2)
+#define FLASH_LOG_RECORD_HEADER  4 // length (2), checksum, state
+#define FLASH_LOG_RECORD_LENGTH  (FLASH_SEGMENT_SIZE - FLASH_LOG_SEGMENT_HEADER - FLASH_LOG_RECORD_HEADER)
+
+#define FLASH_LOG_COMMITTED 0xF0
+#define FLASH_LOG_SENT      0x00
+
+#define FLASH_LOG_RUN_LENGTH 15 // records under a single tag, at most
+
+/*
+ * Recovers the log left by the previous run.
+ */
+void flash_log_init();
+
+/*
+ * Appends the record, if the log is full the oldest segment is dropped.
+ */
+PMCU_Error flash_log_append(const uint8_t *record, size_t record_length);
+
+/*
+ * Reads the record under the read cursor, if any. The tag identifies it for flash_log_mark_sent().
+ * A record longer than record_size is taken as corrupted.
+ */
+int flash_log_peek(uint8_t *record, size_t record_size, size_t *record_length, uint32_t *tag);
+
+/*
+ * Moves the read cursor past the record just peeked.
+ */
+void flash_log_advance();
+
+/*
+ * The tag of count records read in a row, from the one tagged first (up to FLASH_LOG_RUN_LENGTH).
+ */
+uint32_t flash_log_run(uint32_t first, size_t count);
+
+/*
+ * Marks the records of the tag as delivered: they won't be read again after a reset.
+ * Those whose segment has been dropped meanwhile are left alone.
+ */
+void flash_log_mark_sent(uint32_t tag);
+
+/*
+ * The number of records not delivered yet.
+ */
+size_t flash_log_pending();
+
+#endif
@@ -0,0 +1,188 @@
+#include "gps.h"
+
+#include "nmea.h"
+#include "timer.h"
+#include "uart.h"
+#include "uart_hub.h"
+#include "ubx.h"
+
+#define GPS_POLLED (GPS_NAV_POSLLH | GPS_NAV_SOL | GPS_NAV_DOP | GPS_NAV_TIMEUTC)
+
+nmea_Parser gps_parser;
+ubx_Decoder gps_decoder;
+uint8_t gps_ubx; // the GPS has been configured, the fix is polled
+volatile uint8_t gps_fixed; // a GGA with a fix, or every message polled, has been received
+volatile uint8_t gps_acked; // an ACK-ACK or ACK-NAK has been received
+timer_Task gps_timeout;
+timer_Task gps_poll;
+
+uint8_t gps_frame[UBX_FRAME_OVERHEAD + 6];
+uint8_t gps_step; // of the configuration
+
+int gps_on_rx(unsigned char byte) {
+    uint16_t message;
+
+    if (!gps_ubx) {
+        if (nmea_parse(&gps_parser, byte) == GPS_GGA && gps_parser.fix.quality) {
+            gps_fixed = 1;
+            return 1;
+        }
+    }
+
+    message = ubx_decode(&gps_decoder, byte);
+    if ((message >> 8) == UBX_ACK) {
+        gps_acked = 1;
+        return 1;
+    } else if (message && (gps_decoder.fix.parts & GPS_POLLED) == GPS_POLLED) {
+        gps_fixed = 1;
+        return 1;
+    }
+    return 0; // nothing to wake up for
+}
+
+/* The frame of a configuration step: off with every NMEA sentence (GGA to VTG), then the rate */
+size_t gps_configuration_frame(uint8_t step) {
+    uint8_t payload[6];
+
+    if (step < 6) {
+        payload[0] = UBX_NMEA;
+        payload[1] = step;
+        payload[2] = 0; // rate on the current port
+        return ubx_frame(gps_frame, UBX_CFG, UBX_CFG_MSG, payload, 3);
+    }
+
+    payload[0] = GPS_POLL_INTERVAL & 0xff; // measurement rate, ms
+    payload[1] = GPS_POLL_INTERVAL >> 8;
+    payload[2] = 1; // a navigation solution per measurement
+    payload[3] = 0;
+    payload[4] = 1; // GPS time
+    payload[5] = 0;
+    return ubx_frame(gps_frame, UBX_CFG, UBX_CFG_RATE, payload, 6);
+}
+
+PT_THREAD(gps_configure_pt(pt *thread, PMCU_Error *error)) {
+    size_t frame_length;
+
+    PT_BEGIN(thread);
+
+    gps_ubx = 0;
+    ubx_init(&gps_decoder);
+    uart_discard(UART_A0);
+    uart_subscribe_rx_listener(UART_A0, gps_on_rx);
+
+    *error = PMCU_OK;
+    for (gps_step = 0; gps_step < 7 && *error == PMCU_OK; gps_step++) {
+        gps_acked = 0;
+        frame_length = gps_configuration_frame(gps_step);
+        uart_write_buffer(UART_A0, gps_frame, frame_length);
+
+        timer_task_start(&gps_timeout, GPS_ACK_TIMEOUT);
+        PT_WAIT_UNTIL(thread, (gps_acked && gps_decoder.ack_class == UBX_CFG && gps_decoder.ack_id == gps_frame[3])
+                              || gps_timeout.satisfied);
+        timer_task_cancel(&gps_timeout);
+
+        if (!gps_acked) {
+            *error = UART_TIMEOUT_ERROR;
+        } else if (gps_decoder.ack != UBX_ACK_ACK) {
+            *error = GPS_CONFIGURATION_REJECTED;
+        }
+    }
+
+    uart_subscribe_rx_listener(UART_A0, NULL);
+    uart_discard(UART_A0);
+
+    gps_ubx = *error == PMCU_OK;
+
+    PT_END(thread);
+}
+
+PMCU_Error gps_configure() {
+    PMCU_Error error;
+    pt thread;
+
+    PT_INIT(&thread);
+    PT_RUN(gps_configure_pt(&thread, &error));
+
+    return error;
+}
+
+/* Polls the navigation messages, no payload */
+void gps_poll_fix() {
+    static const uint8_t messages[] = { UBX_NAV_POSLLH, UBX_NAV_SOL, UBX_NAV_DOP, UBX_NAV_TIMEUTC };
+    size_t i, frame_length;
+
+    for (i = 0; i < sizeof(messages); i++) {
+        frame_length = ubx_frame(gps_frame, UBX_NAV, messages[i], NULL, 0);
+        uart_write_buffer(UART_A0, gps_frame, frame_length);
+    }
+}
+
+PT_THREAD(gps_read_fix_pt(pt *thread, gps_Fix *fix, PMCU_Error *error)) {
+    PT_BEGIN(thread);
+
+    PT_WAIT_UNTIL(thread, uart_hub_acquire(UART_HUB_GPS));
+
+    nmea_init(&gps_parser);
+    ubx_init(&gps_decoder);
+    gps_fixed = 0;
+    uart_subscribe_rx_listener(UART_A0, gps_on_rx);
+
+    timer_task_start(&gps_timeout, GPS_TIMEOUT);
+    if (gps_ubx) {
+        while (!gps_timeout.satisfied) {
+            gps_decoder.fix.parts = 0;
+            gps_fixed = 0;
+            gps_poll_fix();
+
+            timer_task_start(&gps_poll, GPS_POLL_INTERVAL);
+            PT_WAIT_UNTIL(thread, gps_fixed || gps_poll.satisfied || gps_timeout.satisfied);
+            if (gps_fixed && gps_decoder.fix.quality) {
+                timer_task_cancel(&gps_poll);
+                break;
+            }
+            // no fix yet: the next solution comes with the next measurement
+            PT_WAIT_UNTIL(thread, gps_poll.satisfied || gps_timeout.satisfied);
+            timer_task_cancel(&gps_poll);
+        }
+    } else {
+        PT_WAIT_UNTIL(thread, gps_fixed || gps_timeout.satisfied);
+    }
+    timer_task_cancel(&gps_timeout);
+
+    uart_subscribe_rx_listener(UART_A0, NULL);
+    uart_discard(UART_A0); // already parsed
+
+    if (gps_ubx) {
+        *fix = gps_decoder.fix;
+        if (gps_fixed && fix->quality) {
+            *error = PMCU_OK;
+        } else if (fix->parts & GPS_NAV_SOL) {
+            *error = GPS_NO_FIX;
+        } else {
+            *error = UART_TIMEOUT_ERROR;
+        }
+    } else {
+        *fix = gps_parser.fix;
+        if (gps_fixed) {
+            *error = PMCU_OK;
+        } else if (fix->parts & GPS_GGA) {
+            *error = GPS_NO_FIX;
+        } else {
+            *error = UART_TIMEOUT_ERROR;
+        }
+    }
+
+    uart_hub_release();
+
+    PT_END(thread);
+}
+
+PMCU_Error gps_read_fix(gps_Fix *fix) {
+    PMCU_Error error;
+    pt thread;
+
+    PT_INIT(&thread);
+    PT_RUN(gps_read_fix_pt(&thread, fix, &error));
+
+    return error;
+}
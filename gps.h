@@ -1,21 +1,31 @@
 #ifndef GPS_H_
 #define GPS_H_
 
-#include <string.h>
+#include "error.h"
+#include "gps_fix.h"
+#include "pt.h"
 
-#include "uart.h"
-#include "uart_hub.h"
+#define GPS_TIMEOUT 3000 // ms, without a fix: sentences come every second
+#define GPS_ACK_TIMEOUT 1000 // ms, for a CFG message to be acknowledged
+#define GPS_POLL_INTERVAL 1000 // ms, a navigation solution per second (CFG-RATE)
 
-PMCU_Error gps_read_sentence(const char *sentence_type, char *buffer) { // i.e. sentence_type = $GPGGA,
-    size_t i;
+/*
+ * Turns off the NMEA sentences of the GPS and sets its navigation rate, over UBX: then the fix
+ * is polled instead. The hub has to be on the GPS.
+ * If the GPS doesn't acknowledge, its NMEA sentences are parsed as before.
+ */
+PT_THREAD(gps_configure_pt(pt *thread, PMCU_Error *error));
 
-    __pmcu_handle(uart_read_until_string(UART_A0, sentence_type, NULL, NULL, 10));
-    __pmcu_handle(uart_read_until_string(UART_A0, "*", buffer, 64, 10)); // a sentence shouldn't be longer than 64 chars
+PMCU_Error gps_configure();
 
-    for (i = 0; buffer[i] != '*'; i++);
-    buffer[i] = '\0';
+/*
+ * Reads a fix, up to GPS_TIMEOUT, as a protothread: the error is set once it ends.
+ * Over UBX, polls NAV-POSLLH, NAV-SOL, NAV-DOP and NAV-TIMEUTC until they report a fix.
+ * Otherwise parses the sentences as they are received, up to a GGA with a fix: the fix also has
+ * the RMC and GSA fields met.
+ */
+PT_THREAD(gps_read_fix_pt(pt *thread, gps_Fix *fix, PMCU_Error *error));
 
-    return PMCU_OK;
-}
+PMCU_Error gps_read_fix(gps_Fix *fix);
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef GPS_FIX_H_
+#define GPS_FIX_H_
+
+#include <stdint.h>
+
+/*
+ * A position fix in fixed point, as decoded from the NMEA sentences (nmea.h) or the UBX
+ * messages (ubx.h) of the GPS.
+ */
+#define GPS_GGA         0x01
+#define GPS_RMC         0x02
+#define GPS_GSA         0x04
+#define GPS_NAV_POSLLH  0x10
+#define GPS_NAV_SOL     0x20
+#define GPS_NAV_DOP     0x40
+#define GPS_NAV_TIMEUTC 0x80
+
+typedef struct {
+    uint8_t parts; // GPS_* of the sentences and messages folded in
+
+    uint32_t time; // s since midnight UTC
+    uint16_t date; // days since 2000-01-01
+    uint8_t status; // RMC, 'A' if the data are valid
+
+    int32_t latitude; // 1e-7 °
+    int32_t longitude; // 1e-7 °
+    int16_t altitude; // 0.1 m above mean sea level
+
+    uint8_t quality; // GGA fix quality, 0 if none
+    uint8_t satellites; // in use
+    uint8_t mode; // GSA: 1 no fix, 2 2D, 3 3D (NAV-SOL gpsFix)
+
+    uint8_t hdop; // 0.1, saturated
+    uint8_t pdop; // 0.1
+    uint8_t vdop; // 0.1
+
+    uint16_t horizontal_accuracy; // 0.1 m, NAV-POSLLH only
+    uint16_t vertical_accuracy; // 0.1 m, NAV-POSLLH only
+} gps_Fix;
+
+#endif
@@ -0,0 +1,46 @@
+#include "lpm.h"
+
+#include <stdlib.h>
+
+#include "timer.h"
+
+volatile uint8_t lpm_events;
+
+int lpm_has_events(const void *context) {
+    return lpm_events;
+}
+
+int lpm_wait(lpm_condition condition, const void *context, unsigned int mode, uint32_t timeout_delay) {
+    timer_Task timeout = { 0 }; // not queued
+    int satisfied;
+
+    if (timeout_delay) {
+        timer_task_start(&timeout, timeout_delay);
+    }
+
+    while (1) {
+        // An interrupt between the check and the sleep would be missed: interrupts are enabled
+        // along with the low power mode, by the same instruction.
+        __disable_interrupt();
+
+        satisfied = condition && condition(context);
+        if (satisfied || (timeout_delay && timeout.satisfied)) {
+            break;
+        }
+
+        __bis_SR_register(mode | GIE);
+        __no_operation();
+    }
+
+    __enable_interrupt();
+
+    if (timeout_delay) {
+        timer_task_cancel(&timeout);
+    }
+    return satisfied;
+}
+
+void lpm_wait_event(unsigned int mode) {
+    lpm_wait(lpm_has_events, NULL, mode, 0);
+    lpm_events = 0;
+}
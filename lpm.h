@@ -0,0 +1,41 @@
+#ifndef LPM_H_
+#define LPM_H_
+
+#include <msp430.h>
+#include <stdint.h>
+
+/*
+ * Set by the ISRs that wake the CPU up: something happened since the last lpm_wait_event.
+ */
+extern volatile uint8_t lpm_events;
+
+/*
+ * To be used by ISRs, in place of __bic_SR_register_on_exit, when what they did could be awaited.
+ */
+#define lpm_wake_on_exit() \
+    do { \
+        lpm_events = 1; \
+        __bic_SR_register_on_exit(LPM3_bits); \
+    } while (0)
+
+/*
+ * A condition awaited in low power mode, checked with interrupts disabled.
+ */
+typedef int (*lpm_condition)(const void *context);
+
+/*
+ * Sleeps in the given low power mode (LPM0_bits or LPM3_bits) until the condition holds,
+ * or the timeout (in ms, 0 waits forever) is reached.
+ * The ISRs that can make the condition true must wake the CPU up with __bic_SR_register_on_exit.
+ * LPM3 stops SMCLK: use it only when the awaited interrupts come from ACLK peripherals.
+ * A NULL condition just waits for the timeout.
+ * Returns whether the condition holds.
+ */
+int lpm_wait(lpm_condition condition, const void *context, unsigned int mode, uint32_t timeout_delay);
+
+/*
+ * Sleeps until an ISR signals an event (with lpm_wake_on_exit), unless one already did since the last call.
+ */
+void lpm_wait_event(unsigned int mode);
+
+#endif
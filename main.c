@@ -1,16 +1,20 @@
 #include <msp430.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "console.h"
 #include "timer.h"
 #include "uart_hub.h"
 #include "error.h"
 
+#include "flash_log.h"
 #include "modem.h"
 #include "dht22.h"
 #include "gps.h"
 #include "mqtt.h"
+#include "record.h"
 #include "sps30.h"
+#include "trace.h"
 
 #include "settings.h"
 
@@ -29,117 +33,352 @@ void overclock_to_12mhz() {
     __delay_cycles(375000);
 }
 
-size_t pmcu_read_dht22(uint8_t *buffer) {
-    PMCU_log("Reading from DHT22...");
+uint8_t pmcu_dht22_data[5]; // with the checksum
+gps_Fix pmcu_gps_fix;
+char pmcu_location_data[MODEM_LOCATION_LENGTH];
+uint8_t pmcu_sps30_data[SPS30_MEASURED_VALUES_LENGTH];
+
+/*
+ * The fan and laser of the SPS30 draw about 60 mA while it measures. Unless PMCU_SPS30_PERIOD is 0
+ * (always measuring), the SPS30 sleeps between sampling windows: woken up every period, it measures
+ * for the warm-up, then is read in every loop for the sampling time, and goes back to sleep.
+ * The fan is cleaned every PMCU_SPS30_CLEANING ms, by us: the automatic cleaning of the SPS30 counts
+ * measuring time only, and starts over at every sleep.
+ */
+#ifndef PMCU_SPS30_PERIOD
+#define PMCU_SPS30_PERIOD 300000UL // ms, from a wake-up to the next
+#endif
+#ifndef PMCU_SPS30_WARM_UP
+#define PMCU_SPS30_WARM_UP 30000UL // ms, for the airflow and the readings to settle
+#endif
+#ifndef PMCU_SPS30_SAMPLING
+#define PMCU_SPS30_SAMPLING 10000UL // ms
+#endif
+#ifndef PMCU_SPS30_CLEANING
+#define PMCU_SPS30_CLEANING 86400000UL // ms, 0 leaves it to the SPS30 (a week of measurement)
+#endif
+
+#define PMCU_SPS30_ASLEEP  0
+#define PMCU_SPS30_WARMING 1
+#define PMCU_SPS30_READY   2
+
+uint8_t pmcu_sps30_format;
+uint8_t pmcu_sps30_state;
+uint8_t pmcu_sps30_sleeping; // in SLEEP-MODE, not only stopped: it needs a wake-up
+uint64_t pmcu_sps30_since; // ms, of the state
+uint64_t pmcu_sps30_cleaned; // ms, the last fan cleaning
+
+#define PMCU_BATCH_LENGTH 640 // payload of a PUBLISH, fits MQTT_PACKET_LENGTH and a CIPSEND (1460)
+#define PMCU_BATCH_AGE 60000 // ms, the oldest record of a batch doesn't wait longer
+#define PMCU_DRAIN_PUBLISHES 4 // batches published per loop, at most
+
+uint8_t pmcu_batch[PMCU_BATCH_LENGTH]; // version, record count, then every record after its length
+size_t pmcu_batch_length;
+uint8_t pmcu_batch_count;
+record_Sample pmcu_batch_last; // the records are encoded after the previous one
+uint32_t pmcu_batch_tag; // of its first record
+uint64_t pmcu_batch_since; // ms, when its first record went in
+
+/*
+ * Whether a sensor has been read, else logs its error.
+ */
+int pmcu_read(PMCU_Error error, trace_Event event) {
+    if (error != PMCU_OK) {
+        TRACE1(MAIN, TRACE_ERROR, event, error);
+    }
+    return error == PMCU_OK;
+}
 
-    uart_hub_select(0);
+/*
+ * Reads every sensor at once: the reads run as threads, sleeping while they wait.
+ * The DHT22 capture runs alongside the others, which take turns on the UART hub.
+ * The SPS30 is read only if sps30 is set.
+ * Packs them in a record (RECORD_LENGTH + 1 bytes at most), returns its length, 0 if none could be read.
+ */
+size_t pmcu_measure(uint8_t *buffer, int sps30) {
+    pt dht22_thread, gps_thread, location_thread, sps30_thread;
+    PMCU_Error dht22_error, gps_error, location_error, sps30_error;
+    record_Sample sample;
+    size_t sps30_length;
+    int dht22_running, gps_running, location_running, sps30_running;
+
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_READING);
+
+    PT_INIT(&dht22_thread);
+    PT_INIT(&gps_thread);
+    PT_INIT(&location_thread);
+    PT_INIT(&sps30_thread);
+
+    dht22_running = gps_running = location_running = 1;
+    sps30_running = sps30;
+    sps30_error = PMCU_OK;
+    sps30_length = 0; // no values
 
-    if ((pmcu_error = dht22_read(buffer)) == PMCU_OK) {
-        return 4;
-    } else {
-        PMCU_log("Error during DHT22 data reading:");
-        PMCU_log(PMCU_error_str(pmcu_error));
+    while (1) {
+        // a thread that has finished must not be called again, it would start over
+        if (dht22_running) {
+            dht22_running = PT_SCHEDULE(dht22_read_pt(&dht22_thread, pmcu_dht22_data, &dht22_error));
+        }
+        if (gps_running) {
+            gps_running = PT_SCHEDULE(gps_read_fix_pt(&gps_thread, &pmcu_gps_fix, &gps_error));
+        }
+        if (location_running) {
+            location_running = PT_SCHEDULE(modem_get_location_pt(&location_thread, pmcu_location_data, &location_error));
+        }
+        if (sps30_running) {
+            sps30_running = PT_SCHEDULE(sps30_read_measured_values_pt(&sps30_thread, pmcu_sps30_data, sizeof(pmcu_sps30_data), &sps30_length, &sps30_error));
+        }
 
-        return 0;
+        if (!dht22_running && !gps_running && !location_running && !sps30_running) {
+            break;
+        }
+        lpm_wait_event(LPM0_bits);
+    }
+
+    // a sensor that failed is left out of the record
+    sample.sensors = 0;
+    if (pmcu_read(dht22_error, TRACE_MAIN_DHT22_FAILED)) {
+        record_set_dht22(&sample, pmcu_dht22_data);
     }
+    if (pmcu_read(gps_error, TRACE_MAIN_GPS_FAILED)) {
+        record_set_gps(&sample, &pmcu_gps_fix);
+    }
+    if (pmcu_read(location_error, TRACE_MAIN_LOCATION_FAILED)) {
+        record_set_location(&sample, pmcu_location_data);
+    }
+    if (pmcu_read(sps30_error, TRACE_MAIN_SPS30_FAILED)) {
+        record_set_sps30(&sample, pmcu_sps30_data, sps30_length);
+    }
+
+    return sample.sensors ? record_pack(buffer, &sample) : 0;
 }
 
-size_t pmcu_read_gps(uint8_t *buffer) {
-    PMCU_log("Reading from GY-GPSM6V2...");
+/*
+ * Moves the records of the flash log into the batch, as long as they fit.
+ * Returns whether the batch is ready to go: full, or its oldest record has waited long enough.
+ */
+int pmcu_batch_fill(uint8_t *buffer, size_t buffer_size) {
+    uint8_t record[RECORD_LENGTH];
+    record_Sample sample;
+    size_t len;
+    uint32_t tag;
+
+    while (pmcu_batch_count < FLASH_LOG_RUN_LENGTH && flash_log_peek(buffer, buffer_size, &len, &tag)) {
+        if (!record_unpack(buffer, len, &sample)) {
+            TRACE(MAIN, TRACE_ERROR, TRACE_MAIN_RECORD_VERSION);
+            flash_log_mark_sent(tag);
+            flash_log_advance();
+            continue;
+        }
 
-    uart_hub_select(0);
-    uart_setup(UART_A0, UART_BAUD_RATE_9600_SMCLK_12MHZ);
-    uart_hub_select(2);
+        len = record_encode(record, &sample, pmcu_batch_count ? &pmcu_batch_last : NULL);
+        if (pmcu_batch_count && pmcu_batch_length + 1 + len > PMCU_BATCH_LENGTH) {
+            return 1;
+        }
+        if (pmcu_batch_count == 0) {
+            pmcu_batch[0] = RECORD_VERSION;
+            pmcu_batch_length = 2;
+            pmcu_batch_tag = tag;
+            pmcu_batch_since = timer_timestamp();
+        }
 
-    if ((pmcu_error = gps_read_sentence("$GPGGA,", (char *) buffer)) == PMCU_OK) {
-        return strlen((char *) buffer) + 1;
-    } else {
-        PMCU_log("Error during GY-GPSM6V2 data reading:");
-        PMCU_log(PMCU_error_str(pmcu_error));
+        pmcu_batch[pmcu_batch_length++] = len;
+        memcpy(&pmcu_batch[pmcu_batch_length], record, len);
+        pmcu_batch_length += len;
+        pmcu_batch[1] = ++pmcu_batch_count;
+        pmcu_batch_last = sample;
 
-        return 0;
+        flash_log_advance(); // held by the batch from now on, still in flash until acknowledged
     }
+
+    return pmcu_batch_count == FLASH_LOG_RUN_LENGTH
+        || (pmcu_batch_count && timer_timestamp() - pmcu_batch_since >= PMCU_BATCH_AGE);
 }
 
-size_t pmcu_read_modem_location(uint8_t *buffer) {
-    PMCU_log("Reading from SIM800L...");
+/*
+ * Publishes the oldest records of the flash log in batches, once the broker is reachable.
+ * A record leaves the log only when the PUBACK of its batch comes.
+ */
+void pmcu_drain(const char *topic, uint8_t *buffer, size_t buffer_size) {
+    size_t published;
+    PMCU_Error error;
+    int queued;
+
+    for (published = 0; published < PMCU_DRAIN_PUBLISHES && pmcu_batch_fill(buffer, buffer_size); published++) {
+        if (!mqtt_session_connected() && (error = mqtt_session_connect()) != PMCU_OK) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_BROKER_UNREACHABLE, error);
+            return;
+        }
 
-    uart_hub_select(0);
-    uart_setup(UART_A0, UART_BAUD_RATE_9600_SMCLK_12MHZ);
-    uart_hub_select(1);
+        TRACE(MAIN, TRACE_INFO, TRACE_MAIN_PUBLISHING);
+        error = mqtt_session_publish(topic, pmcu_batch, pmcu_batch_length,
+                                     flash_log_run(pmcu_batch_tag, pmcu_batch_count), &queued);
+        if (!queued) {
+            // the batch is kept, and published later
+            if (error == MQTT_INFLIGHT_WINDOW_FULL) {
+                break;
+            }
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_PUBLISH_FAILED, error);
+            return;
+        }
+        pmcu_batch_count = 0; // in flight: sent again by the session if needed
 
-    if ((pmcu_error = modem_get_location((char *) buffer)) == PMCU_OK) {
-        return strlen((char *) buffer) + 1;
-    } else {
-        PMCU_log("Error during SIM800L location reading:");
-        PMCU_log(PMCU_error_str(pmcu_error));
+        if (error != PMCU_OK) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_PUBLISH_FAILED, error);
+            return;
+        }
+    }
 
-        return 0;
+    // the PUBACKs left would be lost once the hub leaves the modem
+    if ((error = mqtt_session_flush()) != PMCU_OK) {
+        TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_PUBACK_FAILED, error);
     }
 }
 
-size_t pmcu_read_sps30_data(uint8_t *buffer) {
-    size_t payload_length;
+/*
+ * Brings the SPS30 to MEASURING-MODE, with SPS30_FORMAT if its firmware has it, else with floats.
+ */
+PMCU_Error pmcu_sps30_init() {
+    sps30_Version version;
+    char serial[SPS30_SERIAL_LENGTH];
+    uint32_t status;
+    uint8_t format;
+
+    __pmcu_handle(sps30_read_version(&version));
+    if (TRACE_ENABLED(MAIN, TRACE_INFO)) {
+        trace_begin(TRACE_MAIN_SPS30_VERSION);
+        trace_append_number(version.firmware_major);
+        trace_append_number(version.firmware_minor);
+        trace_append_number(version.hardware);
+        trace_end();
+    }
 
-    PMCU_log("Reading from SPS30...");
+    if (sps30_read_serial(serial, sizeof(serial)) == PMCU_OK) {
+        TRACE_TEXT(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_SERIAL, serial, strlen(serial));
+    }
 
-    uart_hub_select(0);
-    uart_setup(UART_A0, UART_BAUD_RATE_115200_SMCLK_12MHZ);
-    uart_hub_select(3);
+    // the status register comes with firmware 2.2
+    if (version.firmware_major > 2 || (version.firmware_major == 2 && version.firmware_minor >= 2)) {
+        if (sps30_read_device_status_register(&status, 1) == PMCU_OK && status) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_STATUS, status);
+        }
+    }
 
-    if ((pmcu_error = sps30_read_measured_values(buffer, 64, &payload_length)) == PMCU_OK) {
-        return payload_length;
-    } else {
-        PMCU_log("Error during SPS30 data reading:");
-        PMCU_log(PMCU_error_str(pmcu_error));
+    if (PMCU_SPS30_CLEANING) {
+        __pmcu_handle(sps30_write_cleaning_interval(0)); // from the next start
+    }
 
-        return 0;
+    format = SPS30_FORMAT;
+    if (format == SPS30_FORMAT_UINT16 && version.firmware_major < 2) {
+        TRACE(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_FLOAT);
+        format = SPS30_FORMAT_FLOAT;
     }
-}
 
-size_t pmcu_measure(uint8_t *buffer) {
-    size_t pos, len;
+    pmcu_error = sps30_start_measurement(format);
+    if (pmcu_error == SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE) {
+        // still measuring since before the MCU reset, maybe with the other format
+        __pmcu_handle(sps30_stop_measurement());
+        pmcu_error = sps30_start_measurement(format);
+    }
 
-    pos = 0;
+    pmcu_sps30_format = format;
+    pmcu_sps30_state = PMCU_SPS30_WARMING;
+    pmcu_sps30_sleeping = 0;
+    pmcu_sps30_since = pmcu_sps30_cleaned = timer_timestamp();
+    return pmcu_error;
+}
 
-    // dht22 measure
-    len = pmcu_read_dht22(buffer);
-    if (len) {
-        pos += len;
-    } else {
-        return 0;
+/* Cleans the fan if it's time to, the SPS30 measuring */
+void pmcu_sps30_clean(uint64_t now) {
+    PMCU_Error error;
+
+    if (!PMCU_SPS30_CLEANING || now - pmcu_sps30_cleaned < PMCU_SPS30_CLEANING) {
+        return;
+    }
+    uart_hub_select(UART_HUB_SPS30);
+    if ((error = sps30_start_fan_cleaning()) != PMCU_OK) {
+        TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_CLEANING_FAILED, error);
+        return; // tried again in the next loop
     }
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_CLEANING);
+    pmcu_sps30_cleaned = now;
+}
 
-    // gps measure
-    len = pmcu_read_gps(&buffer[pos]);
-    if (len) {
-        pos += len;
-    } else {
-        return 0;
+/*
+ * Moves the SPS30 along its duty cycle, to be called in every loop. Returns whether it's to be read.
+ */
+int pmcu_sps30_cycle() {
+    PMCU_Error error;
+    uint64_t now;
+
+    now = timer_timestamp();
+    if (PMCU_SPS30_PERIOD == 0) {
+        pmcu_sps30_clean(now);
+        return 1;
     }
 
-    // modem measure
-    len = pmcu_read_modem_location(&buffer[pos]);
-    if (len) {
-        pos += len;
-    } else {
+    switch (pmcu_sps30_state) {
+    case PMCU_SPS30_ASLEEP:
+        if (now - pmcu_sps30_since < PMCU_SPS30_PERIOD) {
+            return 0;
+        }
+        uart_hub_select(UART_HUB_SPS30);
+        if (pmcu_sps30_sleeping) {
+            if ((error = sps30_wake_up()) != PMCU_OK) {
+                TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_WAKE_UP_FAILED, error);
+                return 0; // tried again in the next loop
+            }
+            pmcu_sps30_sleeping = 0;
+        }
+        // not allowed: already measuring
+        error = sps30_start_measurement(pmcu_sps30_format);
+        if (error != PMCU_OK && error != SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_WAKE_UP_FAILED, error);
+            return 0;
+        }
+        TRACE(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_WAKE_UP);
+        pmcu_sps30_state = PMCU_SPS30_WARMING;
+        pmcu_sps30_since = now;
+        pmcu_sps30_clean(now); // within the warm-up
         return 0;
-    }
 
-    // sps30 measure
-    len = pmcu_read_sps30_data(&buffer[pos]);
-    if (len) {
-        pos += len;
-    } else {
+    case PMCU_SPS30_WARMING:
+        if (now - pmcu_sps30_since < PMCU_SPS30_WARM_UP) {
+            return 0;
+        }
+        pmcu_sps30_state = PMCU_SPS30_READY;
+        return 1;
+
+    case PMCU_SPS30_READY:
+        if (now - pmcu_sps30_since < PMCU_SPS30_WARM_UP + PMCU_SPS30_SAMPLING) {
+            return 1;
+        }
+        uart_hub_select(UART_HUB_SPS30);
+        // not allowed: already idle
+        error = sps30_stop_measurement();
+        if (error != PMCU_OK && error != SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_SLEEP_FAILED, error);
+            return 0; // still measuring, tried again in the next loop
+        }
+        error = sps30_sleep();
+        if (error == PMCU_OK) {
+            pmcu_sps30_sleeping = 1;
+            TRACE(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_SLEEP);
+        } else if (error == SPS30_UNKNOWN_COMMAND) {
+            // an older firmware has no SLEEP-MODE: the SPS30 then idles, fan and laser off all the same
+            TRACE(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_IDLE);
+        } else {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_SPS30_SLEEP_FAILED, error); // stopped anyway
+        }
+        pmcu_sps30_state = PMCU_SPS30_ASLEEP; // the period goes on from the wake-up
         return 0;
     }
-
-    return pos;
+    return 0;
 }
 
 int main() {
     uint8_t buffer[256];
-    size_t pos, pkt_sz, len;
+    size_t len;
 
     char pmcu_id[32];
 
@@ -155,136 +394,97 @@ int main() {
 
     overclock_to_12mhz();
 
-    uart_setup(UART_A1, UART_BAUD_RATE_9600_SMCLK_12MHZ); // logger init
-    PMCU_log("+++ PMCU v1.0 +++");
+    timer_init(); // before any UART: their flushes and waits run on it
+
+    uart_setup(UART_A1, UART_BAUD_RATE_9600_SMCLK_12MHZ); // trace init
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_BOOT);
 
     uart_hub_init();
 
-    timer_init();
+    flash_log_init();
+    if (flash_log_pending()) {
+        TRACE(MAIN, TRACE_INFO, TRACE_MAIN_FLASH_PENDING);
+    }
 
     // ***************************************** SPS30 init
-    PMCU_log("Initializing SPS30...");
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_SPS30_INIT);
 
-    uart_hub_select(0);
-    uart_setup(UART_A0, UART_BAUD_RATE_115200_SMCLK_12MHZ);
-    uart_hub_select(3);
+    uart_hub_select(UART_HUB_SPS30);
 
-    pmcu_error = sps30_start_measurement();
-    if (pmcu_error != PMCU_OK && pmcu_error != SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE) {
+    pmcu_error = pmcu_sps30_init();
+    if (pmcu_error != PMCU_OK) {
         PMCU_error_print("sps30", pmcu_error, NULL);
     }
 
+    // ***************************************** GPS init
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_GPS_INIT);
+
+    uart_hub_select(UART_HUB_GPS);
+
+    pmcu_error = gps_configure();
+    if (pmcu_error != PMCU_OK) {
+        TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_GPS_NMEA, pmcu_error);
+    }
+
     // ***************************************** Modem init
-    PMCU_log("Initializing modem...");
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_MODEM_INIT);
 
-    uart_hub_select(0);
-    uart_setup(UART_A0, UART_BAUD_RATE_9600_SMCLK_12MHZ);
-    uart_hub_select(1);
+    uart_hub_select(UART_HUB_SIM800L);
 
-    PMCU_log("Syncing & resetting modem...");
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_MODEM_SYNC);
     __pmcu_assert("modem", modem_sync());
 
-    PMCU_log("Attaching GPRS service to modem...");
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_MODEM_ATTACH);
     __pmcu_assert("modem", modem_gprs_attach());
 
     // pmcu id
-    PMCU_log("Creating PMCU id...");
     strcpy(pmcu_id, "pmcu/");
     __pmcu_assert("pmcu", modem_get_imei(&pmcu_id[5]));
     pmcu_id[20] = '\0';
 
-    PMCU_log("PMCU id:");
-    PMCU_log(pmcu_id);
+    TRACE_TEXT(MAIN, TRACE_INFO, TRACE_MAIN_ID, pmcu_id, strlen(pmcu_id));
 
     // When looping starts, glows the green led
     P4DIR |= BIT7;
     P4SEL &= ~BIT7;
     P4OUT |= BIT7;
 
-    PMCU_log("--------------------------------");
-    PMCU_log("LOOPING");
-    PMCU_log("--------------------------------");
+    TRACE(MAIN, TRACE_INFO, TRACE_MAIN_LOOPING);
+
 
+    mqtt_session_init(pmcu_id, PMCU_SETTINGS_BROKER_ADDR, PMCU_SETTINGS_BROKER_PORT);
+    mqtt_subscribe_puback_listener(flash_log_mark_sent);
 
     while (1) {
-        // ************** pause of 5 seconds
-        __delay_cycles(12288000 * 5);
+        // ************** pause of 5 seconds, in LPM3: TA1 runs on ACLK
+        lpm_wait(NULL, NULL, LPM3_bits, 5000);
+
+        // ***************************************** MQTT keep-alive
+        uart_hub_select(UART_HUB_SIM800L);
+        if ((pmcu_error = mqtt_session_keep_alive()) != PMCU_OK) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_PING_FAILED, pmcu_error);
+        }
 
         // ***************************************** Measure & pack
-        PMCU_log("Measuring & packing");
+        TRACE(MAIN, TRACE_INFO, TRACE_MAIN_MEASURING);
 
         // When starts measuring turns on the blue led.
         P2DIR |= BIT7;
         P2SEL &= ~BIT7;
         P2OUT |= BIT7;
 
-        pos = 4;
+        // a record is kept as long as a sensor could be read
+        len = pmcu_measure(buffer, pmcu_sps30_cycle());
 
-        pos += mqtt_pack_string(&buffer[pos], pmcu_id);
+        uart_hub_select(UART_HUB_SIM800L); // selects back modem
 
-        // tries to measure, if any error occurs, repeats
-        len = pmcu_measure(&buffer[pos]);
-        if (len) {
-            pos += len;
-        } else {
-            continue;
+        // ***************************************** Store & publish
+        if (len && (pmcu_error = flash_log_append(buffer, len)) != PMCU_OK) {
+            TRACE1(MAIN, TRACE_ERROR, TRACE_MAIN_APPEND_FAILED, pmcu_error);
         }
 
-        pkt_sz = pos;
-        mqtt_pack_fixed_header(buffer, 0b00110000, pkt_sz - 4);
-
-        uart_hub_select(0); // selects back modem
-        uart_setup(UART_A0, UART_BAUD_RATE_9600_SMCLK_12MHZ);
-        uart_hub_select(1);
-
-        // ***************************************** MQTT connect
-
-        PMCU_log("Connecting to broker at "PMCU_SETTINGS_BROKER_ADDR":"PMCU_SETTINGS_BROKER_PORT);
-
-        pos = pkt_sz;
-        pkt_sz = mqtt_create_connect_packet(&buffer[pos], pmcu_id, NULL, NULL);
-        if (modem_tcp_connect(PMCU_SETTINGS_BROKER_ADDR, PMCU_SETTINGS_BROKER_PORT) != PMCU_OK) {
-            PMCU_log("Error occured during TCP broker connection:");
-            PMCU_log(PMCU_error_str(pmcu_error));
-
-            continue;
-        }
-
-        if (mqtt_connect(&buffer[pos], pkt_sz) != PMCU_OK) {
-            PMCU_log("Error occured during MQTT CONNECT packet:");
-            PMCU_log(PMCU_error_str(pmcu_error));
-
-            continue;
-        }
-
-        // ***************************************** MQTT publish
-        PMCU_log("Publishing");
-
-        pkt_sz = pos;
-        if (modem_tcp_send(buffer, pkt_sz) != PMCU_OK) {
-            PMCU_log("Error occured during MQTT PUBLISH packet:");
-            PMCU_log(PMCU_error_str(pmcu_error));
-
-            continue;
-        }
-
-        // ***************************************** MQTT disconnect
-        PMCU_log("Disconnecting");
-
-        pkt_sz = mqtt_create_disconnect_packet(buffer);
-        if (mqtt_disconnect(buffer, pkt_sz)!= PMCU_OK) {
-            PMCU_log("Error occured during MQTT DISCONNECT packet:");
-            PMCU_log(PMCU_error_str(pmcu_error));
-
-            continue;
-        }
-
-        if (modem_tcp_disconnect() != PMCU_OK) {
-            PMCU_log("Error occured during TCP broker disconnect:");
-            PMCU_log(PMCU_error_str(pmcu_error));
-
-            continue;
-        }
+        // the records of earlier loops are published even if this one failed
+        pmcu_drain(pmcu_id, buffer, sizeof(buffer));
 
         // When the whole thing has finished, turns off the blue led.
         P2DIR |= BIT7;
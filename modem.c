@@ -1,252 +1,478 @@
 #include "modem.h"
 
+#include "at_engine.h"
+#include "timer.h"
+#include "trace.h"
 #include "uart.h"
-#include "circular_buffer.h"
+#include "uart_hub.h"
 
 #include <string.h>
 
-#define MODEM_LOG_LENGTH 96
-#define MODEM_SYNC_RETRIALS 10
+#define MODEM_SYNC_TIMEOUT 500 // ms, of an AT while the modem powers up
+#define MODEM_SYNC_TRIES 20
+#define MODEM_RETRY_TRIES 5
+#define MODEM_RETRY_MIN 250 // ms between two tries, doubled after each one
+#define MODEM_RETRY_MAX 4000
+#define MODEM_REGISTRATION_TIMEOUT 120000 // ms
 
-char modem_buffer[MODEM_LOG_LENGTH];
-char modem_log[MODEM_LOG_LENGTH];
-size_t modem_ret;
+uint64_t modem_step_since;
 
-PMCU_Error modem_read(char *buffer) {
-    PMCU_Error error;
-    char *cp_buf;
+uint8_t modem_ready; // RDY, Call Ready or SMS Ready came
+uint8_t modem_registered; // to the home network or roaming, as +CREG tells
+uint8_t modem_gprs_registered; // as +CGREG tells
+uint8_t modem_pdp_active; // the PDP context of the TCP connections is up
+uint8_t modem_tcp_connected;
+uint8_t modem_quick_send; // AT+CIPQSEND=1 has been accepted
 
-    cp_buf = buffer;
+size_t modem_pipeline[MODEM_PIPELINE_LENGTH]; // lengths of the quick sends not accepted yet, a ring
+size_t modem_pipeline_head;
+size_t modem_pipeline_count;
+uint8_t modem_pipeline_failed; // a DATA ACCEPT came with a different length, or SEND FAIL
 
-    if ((error = uart_match_string(UART_A0, "\r\n", MODEM_COMMAND_TIMEOUT)) != PMCU_OK) {
-        return error;
-    }
+at_Command modem_command; // of the blocking calls, one at a time
+at_Command modem_location_command;
+at_Command modem_escape_command;
+at_Command modem_hangup = { "ATH", NULL, AT_FINAL, MODEM_COMMAND_TIMEOUT, NULL, NULL, 0, AT_DONE, AT_NONE };
 
-    while (1) {
-        uart_read(UART_A0, (uint8_t *) buffer, MODEM_COMMAND_TIMEOUT);
-        if (*buffer == '\r') {
-            break;
-        }
-        buffer++;
-    }
+timer_Task modem_timeout;
+pt modem_escape_thread;
+
+// ***************************************************************** URCs
 
-    uart_read(UART_A0, (uint8_t *) buffer, MODEM_COMMAND_TIMEOUT);
-    if (*buffer != '\n') {
-        return UART_UNEXPECTED_BYTE_ERROR;
+/*
+ * Whether the registration status of +CREG or +CGREG is home network (1) or roaming (5):
+ * <stat> as a URC, <n>,<stat> as the response to the query.
+ */
+int modem_parse_registration(const at_Line *line) {
+    size_t stat;
+
+    if ((stat = at_line_find(line, ',')) == line->length) {
+        stat = at_line_find(line, ' ');
     }
+    return stat + 1 < line->length && (at_line_char(line, stat + 1) == '1' || at_line_char(line, stat + 1) == '5');
+}
 
-    *buffer = '\0';
+void modem_on_creg(const at_Line *line) {
+    modem_registered = modem_parse_registration(line);
+}
 
-    strcpy(modem_log, "MODEM AT< ");
-    strcat(modem_log, cp_buf);
-    PMCU_log(modem_log);
+void modem_on_cgreg(const at_Line *line) {
+    modem_gprs_registered = modem_parse_registration(line);
+}
 
-    return PMCU_OK;
+void modem_on_ready(const at_Line *line) {
+    modem_ready = 1;
 }
 
-PMCU_Error modem_read_and_expect(const char *expected) {
-    modem_read(modem_buffer);
-    if (strcmp(modem_buffer, expected) != 0) {
-        return SIM800L_UNEXPECTED_RESPONSE_ERROR;
-    } else {
-        return PMCU_OK;
-    }
+void modem_on_closed(const at_Line *line) {
+    modem_tcp_connected = 0;
 }
 
-void modem_execute(const char *cmd) {
-    size_t i;
-    i = 0;
-    while (cmd[i] != '\0') {
-        uart_write(UART_A0, cmd[i]);
-        i++;
+/*
+ * The network dropped the context, and the connection with it: the next connect activates it again.
+ */
+void modem_on_pdp_deact(const at_Line *line) {
+    modem_pdp_active = 0;
+    modem_tcp_connected = 0;
+}
+
+/*
+ * A quick send has been accepted by the modem: the oldest one, as they are accepted in order.
+ */
+void modem_on_accepted(const at_Line *line) {
+    if (modem_pipeline_count == 0) {
+        return;
+    }
+    if (modem_pipeline[modem_pipeline_head] != at_line_number(line, 12)) {
+        modem_pipeline_failed = 1;
     }
+    modem_pipeline_head = (modem_pipeline_head + 1) % MODEM_PIPELINE_LENGTH;
+    modem_pipeline_count--;
+}
 
-    strcpy(modem_log, "MODEM AT> ");
-    strcat(modem_log, cmd);
-    PMCU_log(modem_log);
+void modem_on_send_fail(const at_Line *line) {
+    modem_pipeline_failed = 1;
+    modem_pipeline_count = 0;
+}
 
-    uart_write(UART_A0, '\r');
+/*
+ * Calls are hung up: the GPRS traffic would be suspended meanwhile.
+ */
+void modem_on_ring(const at_Line *line) {
+    if (modem_hangup.status == AT_DONE) {
+        at_submit(&modem_hangup);
+    }
 }
 
-PMCU_Error modem_sync() {
-    uint8_t tmp;
+/*
+ * The supply is out of range: the modem turns itself off, and everything with it.
+ */
+void modem_on_power_down(const at_Line *line) {
+    modem_ready = 0;
+    modem_registered = 0;
+    modem_gprs_registered = 0;
+    modem_on_pdp_deact(line);
+}
 
-    /*
-     * IMPORTANT:
-     * Wait some time before sending any command!
-     * If during power up SIM800L receives a command will send out
-     * RDY, Call Ready, SIM Ready messages. We want to skip them!
-     */
-    __delay_cycles(12880000 * 6);
+const at_Urc modem_urcs[] = {
+    { "CLOSED", modem_on_closed },
+    { "DATA ACCEPT:", modem_on_accepted },
+    { "SEND FAIL", modem_on_send_fail },
+    { "+PDP: DEACT", modem_on_pdp_deact },
+    { "+CREG:", modem_on_creg },
+    { "+CGREG:", modem_on_cgreg },
+    { "RDY", modem_on_ready },
+    { "Call Ready", modem_on_ready },
+    { "SMS Ready", modem_on_ready },
+    { "RING", modem_on_ring },
+    { "UNDER-VOLTAGE POWER DOWN", modem_on_power_down },
+    { "OVER-VOLTAGE POWER DOWN", modem_on_power_down },
+    { "UNDER-VOLTAGE", NULL }, // just warnings
+    { "OVER-VOLTAGE", NULL },
+};
+
+// ***************************************************************** Commands
 
-    /* Try to exit AT+CIPSEND state if was in */
-    uart_write(UART_A0, 27);
+/*
+ * Runs a command to its end, keeping its response line (with the prefix given, NULL for any).
+ * Returns its result code, AT_NONE if it timed out.
+ */
+at_Result modem_query(const char *cmd, uint16_t terminators, const char *prefix, char *response, size_t response_size) {
+    modem_command.text = cmd;
+    modem_command.arguments = NULL;
+    modem_command.terminators = terminators;
+    modem_command.timeout = MODEM_COMMAND_TIMEOUT;
+    modem_command.prefix = prefix;
+    modem_command.response = response;
+    modem_command.response_size = response_size;
+
+    return at_run(&modem_command);
+}
 
-    /* Wait for SIM800L to respond OK to AT command */
-    while (1) {
-        modem_execute("AT");
-        if (uart_read_until_string(UART_A0, "OK\r\n", NULL, NULL, 3) != PMCU_OK) {
-            continue;
-        }
-        break;
-    }
+/*
+ * Runs a command to its end, with the arguments written in place of the '%' of its text (NULL: none).
+ */
+at_Result modem_run_with(const char *cmd, const char *const *arguments, uint16_t terminators, uint32_t timeout_delay) {
+    modem_command.text = cmd;
+    modem_command.arguments = arguments;
+    modem_command.terminators = terminators;
+    modem_command.timeout = timeout_delay;
+    modem_command.prefix = NULL;
+    modem_command.response = NULL;
+
+    return at_run(&modem_command);
+}
 
-    modem_execute("ATZ");
-    uart_read_until_string(UART_A0, "OK\r\n", NULL, NULL, MODEM_COMMAND_TIMEOUT);
+at_Result modem_run(const char *cmd, uint16_t terminators, uint32_t timeout_delay) {
+    return modem_run_with(cmd, NULL, terminators, timeout_delay);
+}
 
-    /* Force ATE0 */
-    while (1) {
-        modem_execute("ATE0");
-        if ((pmcu_error = uart_read_until_string(UART_A0, "\r", NULL, NULL, MODEM_COMMAND_TIMEOUT)) != PMCU_OK) {
-            continue;
-        }
-        if ((pmcu_error = uart_match_string(UART_A0, "\r\nOK\r\n", MODEM_COMMAND_TIMEOUT)) != PMCU_OK) {
-            continue;
-        }
-        break;
+PMCU_Error modem_check(at_Result result, at_Result expected) {
+    if (result == AT_NONE) {
+        return SIM800L_TIMEOUT_ERROR;
     }
+    if (result != expected) {
+        return SIM800L_UNEXPECTED_RESPONSE_ERROR;
+    }
+    return PMCU_OK;
+}
+
+/*
+ * Runs a command (NULL: just waits) and checks its final result code.
+ */
+PMCU_Error modem_expect_with(const char *cmd, const char *const *arguments, at_Result expected) {
+    return modem_check(modem_run_with(cmd, arguments, AT_FINAL | AT_TERMINATOR(expected), MODEM_COMMAND_TIMEOUT), expected);
+}
+
+PMCU_Error modem_expect(const char *cmd, at_Result expected) {
+    return modem_expect_with(cmd, NULL, expected);
+}
+
+/*
+ * Keeps the engine going until the condition holds (NULL: just the timeout), sleeping meanwhile.
+ * Returns 0 if it times out.
+ */
+int modem_wait(lpm_condition condition, const void *context, uint32_t timeout_delay) {
+    int satisfied;
 
-    /* Force AT+CMEE=2 */
+    timer_task_start(&modem_timeout, timeout_delay);
     while (1) {
-        modem_execute("AT+CMEE=2");
-        if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
-            continue;
+        at_poll(NULL);
+        if ((satisfied = condition && condition(context)) || modem_timeout.satisfied) {
+            break;
         }
-        break;
+        lpm_wait_event(LPM0_bits);
     }
+    timer_task_cancel(&modem_timeout);
 
-    /* Force AT+CIPSPRT=1 */
-    while (1) {
-        modem_execute("AT+CIPSPRT=1");
-        if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
-            continue;
+    return satisfied;
+}
+
+int modem_flag_set(const void *flag) {
+    return *(const uint8_t *) flag;
+}
+
+uint32_t modem_backoff(uint32_t backoff) {
+    return backoff < MODEM_RETRY_MAX / 2 ? 2 * backoff : MODEM_RETRY_MAX;
+}
+
+/*
+ * Runs the command until it gets the expected result, MODEM_RETRY_TRIES times at most, backing off
+ * between the tries.
+ */
+PMCU_Error modem_retry(const char *cmd, at_Result expected) {
+    uint32_t backoff;
+    size_t tries;
+
+    backoff = MODEM_RETRY_MIN;
+    for (tries = 1; modem_expect(cmd, expected) != PMCU_OK; tries++) {
+        if (tries == MODEM_RETRY_TRIES) {
+            return SIM800L_MAX_RETRIALS_REACHED_ERROR;
         }
-        break;
+        modem_wait(NULL, NULL, backoff); // URCs are taken meanwhile
+        backoff = modem_backoff(backoff);
     }
+    return PMCU_OK;
+}
 
-    /* Wait until find an available network */
+/*
+ * Logs how long the step of the bring-up took, since the previous one.
+ */
+void modem_step(trace_Event step) {
+    TRACE1(MODEM, TRACE_INFO, step, timer_timestamp() - modem_step_since);
+
+    modem_step_since = timer_timestamp();
+}
+
+/*
+ * Waits for the registration to the network (AT+CREG?) or to GPRS (AT+CGREG?): the URC wakes it up,
+ * the query covers a registration that came before it was enabled. Queried again after every wait:
+ * its response has the prefix of the URC, it goes to the same handler.
+ */
+PMCU_Error modem_await_registration(const char *query, uint8_t *registered) {
+    uint64_t deadline;
+    uint32_t backoff;
+
+    deadline = timer_timestamp() + MODEM_REGISTRATION_TIMEOUT;
+    backoff = MODEM_RETRY_MIN;
     while (1) {
-        __delay_cycles(12288000 * 3);
-        modem_execute("AT+CREG?");
-        if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
-            continue;
+        modem_run(query, AT_FINAL, MODEM_COMMAND_TIMEOUT);
+        if (*registered) {
+            return PMCU_OK;
         }
-        tmp = strcmp(modem_buffer, "+CREG: 0,1") != 0 && strcmp(modem_buffer, "+CREG: 0,5") != 0;
-        if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
-            continue;
+        if (timer_timestamp() >= deadline) {
+            return SIM800L_NOT_REGISTERED;
         }
-        if (tmp) {
-            continue;
+        if (modem_wait(modem_flag_set, registered, backoff)) {
+            return PMCU_OK;
         }
-        break;
+        backoff = modem_backoff(backoff);
     }
+}
 
-    /* Wait a few seconds to settle */
-    __delay_cycles(12288000 * 3);
+PMCU_Error modem_sync() {
+    uint32_t backoff;
+    size_t tries;
+
+    at_engine_init(modem_urcs, sizeof(modem_urcs) / sizeof(modem_urcs[0]));
+    modem_ready = 0;
+    modem_registered = 0;
+    modem_gprs_registered = 0;
+    modem_pdp_active = 0;
+    modem_tcp_connected = 0;
+    modem_step_since = timer_timestamp();
+
+#if MODEM_TRANSPARENT
+    /* Try to exit the data mode of a connection left open, between two guard times of silence */
+    uart_flush(UART_A0, UART_WRITE_TIMEOUT);
+    modem_wait(NULL, NULL, MODEM_ESCAPE_GUARD);
+    uart_write_string(UART_A0, "+++");
+    uart_flush(UART_A0, UART_WRITE_TIMEOUT);
+    modem_wait(NULL, NULL, MODEM_ESCAPE_GUARD); // what the modem sends meanwhile goes to the URC handlers
+#endif
 
-    return PMCU_OK;
-}
+    /* Try to exit AT+CIPSEND state if was in */
+    uart_write(UART_A0, 27);
 
-PMCU_Error modem_get_imei(char *imei) {
-    modem_execute("AT+CGSN");
-    if ((pmcu_error = modem_read(imei)) != PMCU_OK) {
+    /*
+     * The modem is up once an AT gets through: autobauding, that's how it finds the baud rate.
+     * At a fixed baud rate, RDY comes first and cuts the wait short.
+     * What it sends while powering up goes to the URC handlers.
+     */
+    backoff = MODEM_RETRY_MIN;
+    for (tries = 1; modem_run("AT", AT_FINAL, MODEM_SYNC_TIMEOUT) != AT_OK; tries++) {
+        if (tries == MODEM_SYNC_TRIES) {
+            return SIM800L_MAX_RETRIALS_REACHED_ERROR;
+        }
+        modem_wait(modem_flag_set, &modem_ready, backoff);
+        backoff = modem_backoff(backoff);
+    }
+    modem_step(TRACE_MODEM_SYNC);
+
+    /* Reset, no echo (the command itself is still echoed), verbose errors */
+    if ((pmcu_error = modem_retry("ATZ", AT_OK)) != PMCU_OK
+            || (pmcu_error = modem_retry("ATE0", AT_OK)) != PMCU_OK
+            || (pmcu_error = modem_retry("AT+CMEE=2", AT_OK)) != PMCU_OK
+            || (pmcu_error = modem_retry("AT+CIPSPRT=1", AT_OK)) != PMCU_OK) {
+        return pmcu_error;
+    }
+
+    /* Registration changes come as +CREG: <stat> and +CGREG: <stat> from now on */
+    if ((pmcu_error = modem_retry("AT+CREG=1", AT_OK)) != PMCU_OK
+            || (pmcu_error = modem_retry("AT+CGREG=1", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    modem_step(TRACE_MODEM_SETUP);
+
+    /* Wait until find an available network */
+    if ((pmcu_error = modem_await_registration("AT+CREG?", &modem_registered)) != PMCU_OK) {
         return pmcu_error;
     }
+    modem_step(TRACE_MODEM_REGISTRATION);
 
     return PMCU_OK;
 }
 
-PMCU_Error modem_get_location(char *location) {
-    modem_execute("AT+CIPGSMLOC=1,1");
-    if ((pmcu_error = modem_read(location)) != PMCU_OK) {
-        return pmcu_error;
+PMCU_Error modem_get_imei(char *imei) {
+    return modem_check(modem_query("AT+CGSN", AT_FINAL, NULL, imei, MODEM_IMEI_LENGTH), AT_OK);
+}
+
+PT_THREAD(modem_get_location_pt(pt *thread, char *location, PMCU_Error *error)) {
+    PT_BEGIN(thread);
+
+    PT_WAIT_UNTIL(thread, uart_hub_acquire(UART_HUB_SIM800L));
+
+    PT_SPAWN(thread, &modem_escape_thread, modem_tcp_escape_pt(&modem_escape_thread, error));
+    if (*error != PMCU_OK) {
+        TRACE(MODEM, TRACE_ERROR, TRACE_MODEM_ESCAPE_FAILED);
     }
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
-        return pmcu_error;
+
+    location[0] = '\0';
+    modem_location_command.text = "AT+CIPGSMLOC=1,1";
+    modem_location_command.arguments = NULL;
+    modem_location_command.terminators = AT_FINAL;
+    modem_location_command.timeout = MODEM_COMMAND_TIMEOUT;
+    modem_location_command.prefix = "+CIPGSMLOC:";
+    modem_location_command.response = location;
+    modem_location_command.response_size = MODEM_LOCATION_LENGTH;
+
+    at_submit(&modem_location_command);
+    PT_WAIT_UNTIL(thread, at_poll(&modem_location_command));
+
+    *error = modem_check(modem_location_command.result, AT_OK);
+    if (*error == PMCU_OK && location[0] == '\0') {
+        *error = SIM800L_UNEXPECTED_RESPONSE_ERROR;
     }
 
-    return PMCU_OK;
+    uart_hub_release();
+
+    PT_END(thread);
 }
 
-PMCU_Error modem_gprs_attach() {
-    /* Force AT+CGATT=1 */
-    while (1) {
-        modem_execute("AT+CGATT=1");
-        if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
-            continue;
-        }
-        break;
+PMCU_Error modem_get_location(char *location) {
+    PMCU_Error error;
+    pt thread;
+
+    PT_INIT(&thread);
+    PT_RUN(modem_get_location_pt(&thread, location, &error));
+
+    return error;
+}
+
+/*
+ * Activates the PDP context for TCP/IP from scratch: at attach, and again once the network dropped it.
+ */
+PMCU_Error modem_pdp_activate() {
+    modem_pdp_active = 0;
+
+    // deactivates current pdp context
+    if ((pmcu_error = modem_expect("AT+CIPSHUT", AT_SHUT_OK)) != PMCU_OK) {
+        return pmcu_error;
     }
 
-    // ************************************************** bearer profile creation for at+cipgsmloc
+    // sets single ip connection
+    if ((pmcu_error = modem_expect("AT+CIPMUX=0", AT_OK)) != PMCU_OK) {
+        return pmcu_error;
+    }
 
-    // closes previous opened bearer profile (if any)
-    modem_execute("AT+SAPBR=0,1");
-    if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
+    // prefixes the data received with +IPD,<length>: so that it can't be taken for a response
+    if ((pmcu_error = modem_expect("AT+CIPHEAD=1", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // sets the connection type to gprs
-    modem_execute("AT+SAPBR=3,1,\"Contype\",\"GPRS\"");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+#if MODEM_TRANSPARENT
+    // the connection is a byte pipe, no more +IPD nor DATA ACCEPT
+    if ((pmcu_error = modem_expect("AT+CIPMODE=1", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
+#else
+    // quick send: DATA ACCEPT as soon as the modem has the data, instead of SEND OK once the server has
+    modem_quick_send = modem_expect("AT+CIPQSEND=1", AT_OK) == PMCU_OK;
+#endif
 
-    // sets apn to "TM"
-    modem_execute("AT+SAPBR=3,1,\"APN\",\"TM\"");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    // starts task, sets apn, empty username and password
+    if ((pmcu_error = modem_expect("AT+CSTT=\"TM\",\"\",\"\"", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // opens the created bearer profile
-    modem_execute("AT+SAPBR=1,1");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    // brings up wireless connection
+    if ((pmcu_error = modem_expect("AT+CIICR", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // queries the created bearer
-    modem_execute("AT+SAPBR=2,1");
-    if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
+    // gets pdp ip address (should be equal to bearer profile's one), the only response
+    if ((pmcu_error = modem_check(modem_run("AT+CIFSR", AT_FINAL | AT_INFORMATION, MODEM_COMMAND_TIMEOUT), AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+
+    modem_pdp_active = 1;
+    return PMCU_OK;
+}
+
+PMCU_Error modem_gprs_attach() {
+    modem_step_since = timer_timestamp();
+
+    // the modem attaches by itself once registered to GPRS, CGATT makes sure of it
+    if ((pmcu_error = modem_await_registration("AT+CGREG?", &modem_gprs_registered)) != PMCU_OK
+            || (pmcu_error = modem_retry("AT+CGATT=1", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
+    modem_step(TRACE_MODEM_GPRS_ATTACH);
 
-    // ************************************************** pdp context creation for tcp/ip network
+    // ************************************************** bearer profile creation for at+cipgsmloc
 
-    // deactivates current pdp context
-    modem_execute("AT+CIPSHUT");
-    if ((pmcu_error = modem_read_and_expect("SHUT OK")) != PMCU_OK) {
+    // closes previous opened bearer profile (if any), fails when there is none
+    if (modem_run("AT+SAPBR=0,1", AT_FINAL, MODEM_COMMAND_TIMEOUT) == AT_NONE) {
+        return SIM800L_TIMEOUT_ERROR;
+    }
+
+    // sets the connection type to gprs
+    if ((pmcu_error = modem_expect("AT+SAPBR=3,1,\"Contype\",\"GPRS\"", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // sets single ip connection
-    modem_execute("AT+CIPMUX=0");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    // sets apn to "TM"
+    if ((pmcu_error = modem_expect("AT+SAPBR=3,1,\"APN\",\"TM\"", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // starts task, sets apn, empty username and password
-    modem_execute("AT+CSTT=\"TM\",\"\",\"\"");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    // opens the created bearer profile
+    if ((pmcu_error = modem_expect("AT+SAPBR=1,1", AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
 
-    // brings up wireless connection
-    modem_execute("AT+CIICR");
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    // queries the created bearer
+    if ((pmcu_error = modem_check(modem_query("AT+SAPBR=2,1", AT_FINAL, "+SAPBR:", NULL, 0), AT_OK)) != PMCU_OK) {
         return pmcu_error;
     }
+    modem_step(TRACE_MODEM_BEARER);
 
-    // gets pdp ip address (should be equal to bearer profile's one)
-    modem_execute("AT+CIFSR");
-    if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
+    // ************************************************** pdp context creation for tcp/ip network
+
+    if ((pmcu_error = modem_pdp_activate()) != PMCU_OK) {
         return pmcu_error;
     }
+    modem_step(TRACE_MODEM_PDP_CONTEXT);
 
     return PMCU_OK;
 }
@@ -269,56 +495,215 @@ int modem_gprs_detach() {
 }
 */
 
+int modem_tcp_is_connected() {
+    at_poll(NULL); // a CLOSED waiting to be read
+    return modem_tcp_connected;
+}
+
+/*
+ * Whether the data mode is over, by CLOSED: the data received meanwhile is kept otherwise.
+ */
+int modem_data_mode_ended() {
+    at_poll(NULL);
+    return !at_engine_transparent();
+}
+
+PT_THREAD(modem_tcp_escape_pt(pt *thread, PMCU_Error *error)) {
+    PT_BEGIN(thread);
+
+    *error = PMCU_OK;
+    if (!at_engine_transparent()) {
+        PT_EXIT(thread);
+    }
+
+    uart_flush(UART_A0, UART_WRITE_TIMEOUT);
+    timer_task_start(&modem_timeout, MODEM_ESCAPE_GUARD);
+    PT_WAIT_UNTIL(thread, modem_data_mode_ended() || modem_timeout.satisfied);
+    timer_task_cancel(&modem_timeout);
+    if (!at_engine_transparent()) {
+        PT_EXIT(thread);
+    }
+
+    // OK comes after the silence that follows
+    modem_escape_command.text = NULL;
+    modem_escape_command.arguments = NULL;
+    modem_escape_command.terminators = AT_FINAL;
+    modem_escape_command.timeout = 2 * MODEM_ESCAPE_GUARD;
+    modem_escape_command.prefix = NULL;
+    modem_escape_command.response = NULL;
+
+    uart_write_string(UART_A0, "+++");
+    TRACE(MODEM, TRACE_INFO, TRACE_MODEM_ESCAPE);
+    at_engine_leave_transparent(&modem_escape_command);
+
+    PT_WAIT_UNTIL(thread, at_poll(&modem_escape_command));
+
+    if ((*error = modem_check(modem_escape_command.result, AT_OK)) != PMCU_OK) {
+        modem_tcp_connected = 0; // left in an unknown state: connected again from scratch
+    }
+
+    PT_END(thread);
+}
+
+PMCU_Error modem_tcp_escape() {
+    PMCU_Error error;
+    pt thread;
+
+    PT_INIT(&thread);
+    PT_RUN(modem_tcp_escape_pt(&thread, &error));
+
+    return error;
+}
+
+/*
+ * Back to the data mode of a transparent connection, after an escape.
+ */
+PMCU_Error modem_tcp_resume() {
+    if (!modem_tcp_connected) {
+        return SIM800L_UNEXPECTED_RESPONSE_ERROR;
+    }
+    if (!MODEM_TRANSPARENT || at_engine_transparent()) {
+        return PMCU_OK;
+    }
+
+    // CONNECT puts the engine back in data mode
+    pmcu_error = modem_check(modem_run("ATO", AT_FINAL | AT_TERMINATOR(AT_CONNECT) | AT_TERMINATOR(AT_NO_CARRIER),
+                                       MODEM_COMMAND_TIMEOUT), AT_CONNECT);
+    if (pmcu_error != PMCU_OK) {
+        modem_tcp_connected = 0;
+    }
+    return pmcu_error;
+}
+
 PMCU_Error modem_tcp_connect(const char *host, const char *port) {
-    modem_execute("AT+CIPCLOSE");
-    if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
+    const char *arguments[] = { host, port };
+
+    modem_tcp_escape(); // if it fails, CIPCLOSE below fails too: it's closed
+    modem_tcp_connected = 0;
+
+    if (!modem_pdp_active && (pmcu_error = modem_pdp_activate()) != PMCU_OK) {
         return pmcu_error;
     }
 
+    // nothing of the previous connection is left to come
+    at_engine_clear();
+    modem_pipeline_count = 0;
+    modem_pipeline_failed = 0;
+
+    // closes whatever is left of a previous connection, ERROR if there is none
+    if (modem_run("AT+CIPCLOSE", AT_FINAL | AT_TERMINATOR(AT_CLOSE_OK), MODEM_COMMAND_TIMEOUT) == AT_NONE) {
+        return SIM800L_TIMEOUT_ERROR;
+    }
+
     // connects to the tcp server
-    strcpy(modem_buffer, "AT+CIPSTART=\"TCP\",\"");
-    strcat(modem_buffer, host);
-    strcat(modem_buffer, "\",\"");
-    strcat(modem_buffer, port);
-    strcat(modem_buffer, "\"");
-
-    modem_execute(modem_buffer);
-    if ((pmcu_error = modem_read_and_expect("OK")) != PMCU_OK) {
+    if ((pmcu_error = modem_expect_with("AT+CIPSTART=\"TCP\",\"%\",\"%\"", arguments, AT_OK)) != PMCU_OK) {
+        // the +PDP: DEACT may have come while the hub was on another device
+        modem_pdp_active = 0;
         return pmcu_error;
     }
-    if ((pmcu_error = modem_read_and_expect("CONNECT OK")) != PMCU_OK) {
+
+    // the outcome comes later, by itself
+    pmcu_error = modem_check(modem_run(NULL, AT_FINAL | AT_TERMINATOR(AT_CONNECT_OK) | AT_TERMINATOR(AT_CONNECT_FAIL)
+                                       | AT_TERMINATOR(AT_CONNECT) | AT_TERMINATOR(AT_CLOSED), MODEM_COMMAND_TIMEOUT),
+                             MODEM_TRANSPARENT ? AT_CONNECT : AT_CONNECT_OK);
+    if (pmcu_error != PMCU_OK) {
         return pmcu_error;
     }
 
+    modem_tcp_connected = 1;
     return PMCU_OK;
 }
 
+int modem_accepted(const void *pending) {
+    return modem_pipeline_count <= *(const size_t *) pending || modem_pipeline_failed || !modem_tcp_connected;
+}
+
+/*
+ * Waits until no more than the given number of quick sends are waiting for their DATA ACCEPT.
+ */
+PMCU_Error modem_tcp_await_accepted(size_t pending) {
+    if (!modem_wait(modem_accepted, &pending, MODEM_COMMAND_TIMEOUT)) {
+        modem_pipeline_count = 0;
+        return SIM800L_TIMEOUT_ERROR;
+    }
+    if (modem_pipeline_failed || modem_pipeline_count > pending) {
+        modem_pipeline_failed = 0;
+        modem_pipeline_count = 0; // SEND FAIL, or closed
+        return SIM800L_UNEXPECTED_RESPONSE_ERROR;
+    }
+    return PMCU_OK;
+}
+
+PMCU_Error modem_tcp_flush() {
+    return modem_tcp_await_accepted(0);
+}
+
 PMCU_Error modem_tcp_send(const uint8_t *buffer, size_t buffer_length) {
-    modem_execute("AT+CIPSEND");
-    if ((pmcu_error = uart_read_until_string(UART_A0, "> ", NULL, NULL, MODEM_COMMAND_TIMEOUT)) != PMCU_OK) {
+    char digits[8];
+    const char *arguments[] = { digits };
+
+    if (MODEM_TRANSPARENT) {
+        if ((pmcu_error = modem_tcp_resume()) != PMCU_OK) {
+            return pmcu_error;
+        }
+        uart_write_buffer(UART_A0, buffer, buffer_length);
+        return PMCU_OK;
+    }
+
+    if ((pmcu_error = modem_tcp_await_accepted(MODEM_PIPELINE_LENGTH - 1)) != PMCU_OK) {
+        return pmcu_error;
+    }
+
+    // the length ends the data, ctrl+z and esc would be taken out of binary packets
+    ltoa(buffer_length, digits);
+    if ((pmcu_error = modem_expect_with("AT+CIPSEND=%", arguments, AT_PROMPT)) != PMCU_OK) {
         return pmcu_error;
     }
 
     uart_write_buffer(UART_A0, buffer, buffer_length);
-    uart_write(UART_A0, 0x1a); // ctrl+z
 
-    if ((pmcu_error = modem_read(modem_buffer)) != PMCU_OK) {
-        return pmcu_error;
+    if (modem_quick_send) {
+        // the next send goes right away, its DATA ACCEPT is checked later
+        modem_pipeline[(modem_pipeline_head + modem_pipeline_count++) % MODEM_PIPELINE_LENGTH] = buffer_length;
+        return PMCU_OK;
     }
-    if (strcmp(modem_buffer, "SEND OK") != 0 && strcmp(modem_buffer, "OK") != 0) { // for some strange reason could return OK
+
+    switch (modem_run(NULL, AT_FINAL | AT_TERMINATOR(AT_SEND_OK) | AT_TERMINATOR(AT_SEND_FAIL), MODEM_COMMAND_TIMEOUT)) {
+    case AT_SEND_OK:
+    case AT_OK: // for some strange reason could return OK
+        break;
+    case AT_NONE:
+        return SIM800L_TIMEOUT_ERROR;
+    default:
         return SIM800L_UNEXPECTED_RESPONSE_ERROR;
     }
 
     return PMCU_OK;
 }
 
-inline PMCU_Error modem_tcp_recv(uint8_t *buffer, size_t buffer_length) {
-    uart_read_buffer(UART_A0, buffer, buffer_length, 0);
+int modem_received(const void *length) {
+    return ring_buffer_count(&at_data) >= *(const size_t *) length || modem_pipeline_failed || !modem_tcp_connected;
+}
+
+PMCU_Error modem_tcp_recv(uint8_t *buffer, size_t buffer_length) {
+    if (ring_buffer_count(&at_data) < buffer_length && (pmcu_error = modem_tcp_resume()) != PMCU_OK) {
+        return pmcu_error;
+    }
+
+    if (!modem_wait(modem_received, &buffer_length, MODEM_COMMAND_TIMEOUT)) {
+        return SIM800L_TIMEOUT_ERROR;
+    }
+    if (ring_buffer_count(&at_data) < buffer_length) {
+        return SIM800L_UNEXPECTED_RESPONSE_ERROR; // the rest won't come: closed, or SEND FAIL of a quick send
+    }
+
+    ring_buffer_read_span(&at_data, buffer, buffer_length);
     return PMCU_OK;
 }
 
 PMCU_Error modem_tcp_disconnect() {
-    modem_execute("AT+CIPCLOSE");
-    pmcu_error = modem_read(modem_buffer);
-    return pmcu_error;
+    modem_tcp_escape();
+    modem_tcp_connected = 0;
+
+    return modem_expect("AT+CIPCLOSE", AT_CLOSE_OK);
 }
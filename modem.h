@@ -1,19 +1,43 @@
 #ifndef MODEM_H_
 #define MODEM_H_
 
-#define MODEM_COMMAND_TIMEOUT 10
+#define MODEM_COMMAND_TIMEOUT 10000 // ms
+#define MODEM_PIPELINE_LENGTH 4 // quick sends waiting for their DATA ACCEPT
+#define MODEM_ESCAPE_GUARD 1000 // ms of silence before and after +++
+#define MODEM_IMEI_LENGTH 16 // 15 digits
+#define MODEM_LOCATION_LENGTH 96 // the +CIPGSMLOC: line
+
+/*
+ * 1: the TCP connection is transparent (AT+CIPMODE=1), a raw byte pipe over the UART with no
+ * command per send. Commands meanwhile escape it with +++, the next send or read resumes it with ATO.
+ */
+#ifndef MODEM_TRANSPARENT
+#define MODEM_TRANSPARENT 0
+#endif
 
 #include <stdlib.h>
 #include <stdint.h>
 
 #include "error.h"
+#include "pt.h"
 
+/*
+ * Brings the modem to a known state and waits for the network. The commands go through the AT engine
+ * (at_engine.h), which takes the URCs wherever they come: CLOSED and +PDP: DEACT bring the connection
+ * down as soon as they are read, RING is hung up.
+ */
 PMCU_Error modem_sync();
 
 PMCU_Error modem_reset();
 
 PMCU_Error modem_get_imei(char *imei);
 
+/*
+ * Reads the location of the cell (the +CIPGSMLOC: line, MODEM_LOCATION_LENGTH bytes), as a protothread:
+ * the error is set once it ends.
+ */
+PT_THREAD(modem_get_location_pt(pt *thread, char *location, PMCU_Error *error));
+
 PMCU_Error modem_get_location(char *location);
 
 /**
@@ -23,12 +47,41 @@ PMCU_Error modem_get_location(char *location);
  */
 PMCU_Error modem_gprs_attach();
 
-int sim800l_tcp_is_connected();
+/*
+ * Whether the TCP connection is up, as far as the modem told: a CLOSED or +PDP: DEACT URC brings it down.
+ * Reads what the modem has sent meanwhile.
+ */
+int modem_tcp_is_connected();
 
+/*
+ * Connects, activating the PDP context first if the network dropped it.
+ */
 PMCU_Error modem_tcp_connect(const char *host, const char *port);
 
+/*
+ * Leaves the data mode of a transparent connection for commands, keeping the connection.
+ * Does nothing if not in data mode.
+ */
+PT_THREAD(modem_tcp_escape_pt(pt *thread, PMCU_Error *error));
+
+PMCU_Error modem_tcp_escape();
+
+/*
+ * Sends the buffer with AT+CIPSEND=<length>, binary safe. A transparent connection takes it as is.
+ * In quick send mode, returns once the modem has been given the data: its DATA ACCEPT is checked
+ * by the next sends, up to MODEM_PIPELINE_LENGTH of them going back to back. Otherwise waits for SEND OK.
+ */
 PMCU_Error modem_tcp_send(const uint8_t *buffer, size_t buffer_length);
 
+/*
+ * Waits for the DATA ACCEPT of every quick send.
+ */
+PMCU_Error modem_tcp_flush();
+
+/*
+ * Reads the given number of bytes received from the server (framed by +IPD, whatever comes
+ * in between), fails if they don't come in time or the connection closes.
+ */
 PMCU_Error modem_tcp_recv(uint8_t *buffer, size_t buffer_length);
 
 PMCU_Error modem_tcp_disconnect();
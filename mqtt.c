@@ -1,8 +1,25 @@
 #include "mqtt.h"
 
 #include "modem.h"
+#include "timer.h"
+#include "trace.h"
 #include <string.h>
 
+const char *mqtt_session_client_id;
+const char *mqtt_session_host;
+const char *mqtt_session_port;
+
+uint8_t mqtt_session_open;
+uint64_t mqtt_session_activity; // ms, when the last packet was sent
+uint64_t mqtt_session_retry_at; // ms
+uint32_t mqtt_session_backoff; // ms
+
+mqtt_Publish mqtt_inflight[MQTT_INFLIGHT_LENGTH]; // a ring, oldest first
+size_t mqtt_inflight_head;
+size_t mqtt_inflight_count;
+uint16_t mqtt_packet_id;
+mqtt_puback_listener mqtt_puback_listener_fn = NULL;
+
 size_t mqtt_pack_string(uint8_t *buffer, const char *string) {
     size_t i;
     for (i = 0; string[i] != '\0'; i++) {
@@ -42,11 +59,11 @@ size_t mqtt_create_connect_packet(uint8_t *buffer, const char *client_id, const
     if (password != NULL) {
         buffer[position] |= 0b01000000;
     }
-    buffer[position] |= 0b10;
+    // no clean session: the broker keeps the in-flight QoS 1 publishes across reconnects
     position++;
 
-    buffer[position++] = 0;
-    buffer[position++] = 0;
+    buffer[position++] = (MQTT_KEEP_ALIVE & 0xff00) >> 8;
+    buffer[position++] = MQTT_KEEP_ALIVE & 0xff;
 
     // **************** Payload
     position += mqtt_pack_string(&buffer[position], client_id);
@@ -63,12 +80,103 @@ size_t mqtt_create_connect_packet(uint8_t *buffer, const char *client_id, const
     return position;
 }
 
+size_t mqtt_create_publish_packet(uint8_t *buffer, const char *topic, uint16_t packet_id, const uint8_t *payload, size_t payload_length) {
+    size_t position;
+    position = 4;
+
+    // **************** Variable header
+    position += mqtt_pack_string(&buffer[position], topic);
+    buffer[position++] = (packet_id & 0xff00) >> 8;
+    buffer[position++] = packet_id & 0xff;
+
+    // **************** Payload
+    memcpy(&buffer[position], payload, payload_length);
+    position += payload_length;
+
+    // **************** Fixed header
+    mqtt_pack_fixed_header(buffer, MQTT_PUBLISH | MQTT_QOS1, position - 4);
+
+    return position;
+}
+
 size_t mqtt_create_disconnect_packet(uint8_t *buffer) {
     buffer[0] = 0b11100000;
     buffer[1] = 0;
     return 2;
 }
 
+size_t mqtt_create_pingreq_packet(uint8_t *buffer) {
+    buffer[0] = 0b11000000;
+    buffer[1] = 0;
+    return 2;
+}
+
+// ***************************************************************** In-flight publishes
+
+mqtt_Publish *mqtt_inflight_at(size_t i) {
+    return &mqtt_inflight[(mqtt_inflight_head + i) % MQTT_INFLIGHT_LENGTH];
+}
+
+int mqtt_inflight_contains(uint16_t packet_id) {
+    size_t i;
+    for (i = 0; i < mqtt_inflight_count; i++) {
+        if (mqtt_inflight_at(i)->packet_id == packet_id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Acknowledges the publish, and frees the slots up to the oldest one still waiting.
+ */
+void mqtt_inflight_release(uint16_t packet_id) {
+    size_t i;
+    for (i = 0; i < mqtt_inflight_count; i++) {
+        if (mqtt_inflight_at(i)->packet_id == packet_id) {
+            mqtt_inflight_at(i)->packet_id = 0;
+            if (mqtt_puback_listener_fn) {
+                mqtt_puback_listener_fn(mqtt_inflight_at(i)->tag);
+            }
+        }
+    }
+    while (mqtt_inflight_count > 0 && mqtt_inflight_at(0)->packet_id == 0) {
+        mqtt_inflight_head = (mqtt_inflight_head + 1) % MQTT_INFLIGHT_LENGTH;
+        mqtt_inflight_count--;
+    }
+}
+
+// *****************************************************************
+
+PMCU_Error mqtt_receive(uint8_t type, uint8_t *packet) {
+    while (1) {
+        __pmcu_handle(modem_tcp_recv(packet, 2));
+        if (packet[1] > 2) {
+            return MQTT_UNEXPECTED_RESPONSE_ERROR; // none of the packets we expect
+        }
+        __pmcu_handle(modem_tcp_recv(&packet[2], packet[1]));
+
+        if ((packet[0] & 0xf0) == MQTT_PUBACK && packet[1] == 2) {
+            mqtt_inflight_release(((uint16_t) packet[2] << 8) | packet[3]);
+        }
+        if ((packet[0] & 0xf0) == type) {
+            return PMCU_OK;
+        }
+    }
+}
+
+/*
+ * Waits for the PUBACK of the given publish, acknowledging the others that come first.
+ */
+PMCU_Error mqtt_await_puback(uint16_t packet_id) {
+    uint8_t res[4];
+
+    while (mqtt_inflight_contains(packet_id)) {
+        __pmcu_handle(mqtt_receive(MQTT_PUBACK, res));
+    }
+    return PMCU_OK;
+}
+
 PMCU_Error mqtt_connect(const uint8_t *connect_packet, size_t packet_size) {
     PMCU_Error err;
     uint8_t res[4];
@@ -76,8 +184,8 @@ PMCU_Error mqtt_connect(const uint8_t *connect_packet, size_t packet_size) {
     if ((err = modem_tcp_send(connect_packet, packet_size)) != PMCU_OK) {
         return err;
     }
-    __pmcu_handle(modem_tcp_recv(res, 4));
-    if (res[0] != 32 || res[3] != 0) {
+    __pmcu_handle(mqtt_receive(MQTT_CONNACK, res));
+    if (res[1] != 2 || res[3] != 0) {
         return MQTT_UNEXPECTED_RESPONSE_ERROR;
     }
     return PMCU_OK;
@@ -88,3 +196,194 @@ PMCU_Error mqtt_disconnect(uint8_t *disconnect_packet, size_t packet_size) {
     return PMCU_OK;
 }
 
+
+PMCU_Error mqtt_ping() {
+    uint8_t packet[2];
+    uint8_t res[4];
+
+    __pmcu_handle(modem_tcp_send(packet, mqtt_create_pingreq_packet(packet)));
+    __pmcu_handle(mqtt_receive(MQTT_PINGRESP, res));
+    return PMCU_OK;
+}
+
+// ***************************************************************** Session
+
+void mqtt_session_init(const char *client_id, const char *host, const char *port) {
+    mqtt_session_client_id = client_id;
+    mqtt_session_host = host;
+    mqtt_session_port = port;
+
+    mqtt_session_open = 0;
+    mqtt_session_retry_at = 0;
+    mqtt_session_backoff = MQTT_BACKOFF_MIN;
+
+    mqtt_inflight_head = 0;
+    mqtt_inflight_count = 0;
+    mqtt_packet_id = 0;
+}
+
+int mqtt_session_connected() {
+    return mqtt_session_open && modem_tcp_is_connected();
+}
+
+PMCU_Error mqtt_session_flush() {
+    PMCU_Error error;
+
+    if (!mqtt_session_connected()) {
+        return PMCU_OK; // sent again once connected
+    }
+
+    while (mqtt_inflight_count > 0) {
+        if ((error = modem_tcp_flush()) != PMCU_OK
+                || (error = mqtt_await_puback(mqtt_inflight_at(0)->packet_id)) != PMCU_OK) {
+            mqtt_session_open = 0;
+            return error;
+        }
+    }
+    return PMCU_OK;
+}
+
+/*
+ * Sends the publishes not acknowledged before the reconnect, flagged as duplicates if they were sent.
+ */
+PMCU_Error mqtt_session_retransmit() {
+    mqtt_Publish *publish;
+    PMCU_Error error;
+    size_t i;
+
+    for (i = 0; i < mqtt_inflight_count; i++) {
+        publish = mqtt_inflight_at(i);
+        if (publish->packet_id == 0) {
+            continue;
+        }
+
+        if (publish->sent) {
+            TRACE(MQTT, TRACE_INFO, TRACE_MQTT_RETRANSMIT);
+            publish->packet[0] |= MQTT_DUP;
+        }
+        publish->sent = 1;
+        if ((error = modem_tcp_send(publish->packet, publish->length)) != PMCU_OK) {
+            mqtt_session_open = 0;
+            return error;
+        }
+        mqtt_session_activity = timer_timestamp();
+    }
+
+    // back to back, then acknowledged
+    return mqtt_session_flush();
+}
+
+/*
+ * Opens the TCP connection and sends CONNECT, unless the last failure is too recent:
+ * every failure in a row doubles the wait before the next attempt.
+ */
+PMCU_Error mqtt_session_connect() {
+    uint8_t packet[MQTT_CONNECT_PACKET_LENGTH];
+    size_t packet_size;
+    PMCU_Error error;
+
+    mqtt_session_open = 0;
+
+    if (timer_timestamp() < mqtt_session_retry_at) {
+        return MQTT_RECONNECT_BACKOFF;
+    }
+
+    TRACE(MQTT, TRACE_INFO, TRACE_MQTT_CONNECTING);
+
+    packet_size = mqtt_create_connect_packet(packet, mqtt_session_client_id, NULL, NULL);
+    if ((error = modem_tcp_connect(mqtt_session_host, mqtt_session_port)) == PMCU_OK) {
+        error = mqtt_connect(packet, packet_size);
+    }
+
+    if (error != PMCU_OK) {
+        mqtt_session_retry_at = timer_timestamp() + mqtt_session_backoff;
+        if (mqtt_session_backoff < MQTT_BACKOFF_MAX / 2) {
+            mqtt_session_backoff *= 2;
+        } else {
+            mqtt_session_backoff = MQTT_BACKOFF_MAX;
+        }
+        return error;
+    }
+
+    mqtt_session_open = 1;
+    mqtt_session_activity = timer_timestamp();
+    mqtt_session_retry_at = 0;
+    mqtt_session_backoff = MQTT_BACKOFF_MIN;
+
+    return mqtt_session_retransmit();
+}
+
+void mqtt_subscribe_puback_listener(mqtt_puback_listener listener) {
+    mqtt_puback_listener_fn = listener;
+}
+
+PMCU_Error mqtt_session_publish(const char *topic, const uint8_t *payload, size_t payload_length, uint32_t tag, int *queued) {
+    mqtt_Publish *publish;
+    PMCU_Error error;
+
+    *queued = 0;
+
+    if (4 + 2 + strlen(topic) + 2 + payload_length > MQTT_PACKET_LENGTH) {
+        return MQTT_PACKET_TOO_LONG;
+    }
+
+    if (mqtt_inflight_count == MQTT_INFLIGHT_LENGTH) {
+        // the broker stopped acknowledging: a reconnect sends the whole window again
+        mqtt_session_open = 0;
+        if (mqtt_session_connect() != PMCU_OK || mqtt_inflight_count == MQTT_INFLIGHT_LENGTH) {
+            return MQTT_INFLIGHT_WINDOW_FULL;
+        }
+    }
+
+    if (++mqtt_packet_id == 0) {
+        mqtt_packet_id = 1;
+    }
+
+    publish = mqtt_inflight_at(mqtt_inflight_count++);
+    publish->packet_id = mqtt_packet_id;
+    publish->sent = 0;
+    publish->tag = tag;
+    publish->length = mqtt_create_publish_packet(publish->packet, topic, mqtt_packet_id, payload, payload_length);
+    *queued = 1;
+
+    if (!mqtt_session_connected()) {
+        // the publish is already in flight: connecting sends it
+        return mqtt_session_connect();
+    }
+
+    publish->sent = 1;
+    if ((error = modem_tcp_send(publish->packet, publish->length)) == PMCU_OK) {
+        mqtt_session_activity = timer_timestamp();
+        // the publishes go back to back: only a full window waits for the oldest PUBACK
+        if (mqtt_inflight_count == MQTT_INFLIGHT_LENGTH) {
+            error = mqtt_await_puback(mqtt_inflight_at(0)->packet_id);
+        }
+    }
+    if (error != PMCU_OK) {
+        // retried right away if the connection just went idle, else after the backoff
+        mqtt_session_open = 0;
+        return mqtt_session_connect();
+    }
+    return PMCU_OK;
+}
+
+PMCU_Error mqtt_session_keep_alive() {
+    PMCU_Error error;
+
+    if (!mqtt_session_connected()) {
+        return PMCU_OK; // reconnects on the next send
+    }
+    if (timer_timestamp() - mqtt_session_activity < MQTT_PING_INTERVAL) {
+        return PMCU_OK;
+    }
+
+    TRACE(MQTT, TRACE_INFO, TRACE_MQTT_PINGING);
+
+    if ((error = mqtt_ping()) != PMCU_OK) {
+        mqtt_session_open = 0;
+        return error;
+    }
+
+    mqtt_session_activity = timer_timestamp();
+    return PMCU_OK;
+}
@@ -6,16 +6,101 @@
 
 #include "error.h"
 
+#define MQTT_KEEP_ALIVE 60 // s, encoded in CONNECT
+#define MQTT_PING_INTERVAL (MQTT_KEEP_ALIVE * 1000UL / 2) // ms, a loop takes tens of seconds
+
+#define MQTT_BACKOFF_MIN 5000 // ms
+#define MQTT_BACKOFF_MAX 300000 // ms
+
+#define MQTT_CONNECT_PACKET_LENGTH 64
+#define MQTT_PACKET_LENGTH 672 // a batch of records, under a topic of 20 characters
+
+#define MQTT_INFLIGHT_LENGTH 2 // unacknowledged QoS 1 publishes held in RAM
+
+#define MQTT_CONNACK  0b00100000
+#define MQTT_PUBLISH  0b00110000
+#define MQTT_PUBACK   0b01000000
+#define MQTT_PINGRESP 0b11010000
+
+#define MQTT_DUP  0b00001000
+#define MQTT_QOS1 0b00000010
+
+/*
+ * A QoS 1 publish waiting for its PUBACK, packet_id is 0 once acknowledged.
+ */
+typedef struct {
+    uint16_t packet_id;
+    uint8_t sent; // it may have reached the broker: sent again, it is a duplicate
+    uint32_t tag; // given back to the PUBACK listener
+    size_t length;
+    uint8_t packet[MQTT_PACKET_LENGTH];
+} mqtt_Publish;
+
+typedef void (*mqtt_puback_listener)(uint32_t tag);
+
 size_t mqtt_pack_string(uint8_t *buffer, const char *string);
 
 size_t mqtt_pack_fixed_header(uint8_t *buffer, uint8_t control_type, size_t remaining_length);
 
 size_t mqtt_create_connect_packet(uint8_t *buffer, const char *client_id, const char *username, const char *password);
 
+size_t mqtt_create_publish_packet(uint8_t *buffer, const char *topic, uint16_t packet_id, const uint8_t *payload, size_t payload_length);
+
 size_t mqtt_create_disconnect_packet(uint8_t *buffer);
 
+size_t mqtt_create_pingreq_packet(uint8_t *buffer);
+
 PMCU_Error mqtt_connect(const uint8_t *connect_packet, size_t packet_size);
 
 PMCU_Error mqtt_disconnect(uint8_t *disconnect_packet, size_t packet_size);
 
+/*
+ * Reads the incoming packets up to one of the given type, into packet (4 bytes at least).
+ * Every PUBACK met on the way acknowledges its publish.
+ */
+PMCU_Error mqtt_receive(uint8_t type, uint8_t *packet);
+
+/*
+ * Sends PINGREQ and waits for PINGRESP.
+ */
+PMCU_Error mqtt_ping();
+
+/*
+ * A long-lived session: connects when needed, with backoff, and stays up across sends.
+ */
+void mqtt_session_init(const char *client_id, const char *host, const char *port);
+
+int mqtt_session_connected();
+
+/*
+ * Connects, then retransmits every publish still in flight with the DUP flag.
+ */
+PMCU_Error mqtt_session_connect();
+
+/*
+ * Publishes with QoS 1: the packet stays in flight until its PUBACK comes, and is sent again
+ * after a reconnect. A failed send is retried at once over a fresh connection, if the backoff allows.
+ * queued tells whether the publish went in flight, whatever the error: if it didn't (MQTT_PACKET_TOO_LONG,
+ * or MQTT_INFLIGHT_WINDOW_FULL when even a reconnect doesn't free a slot), the payload is still the caller's.
+ * Returns once sent, unless the window is full: then the oldest PUBACK is waited for.
+ */
+PMCU_Error mqtt_session_publish(const char *topic, const uint8_t *payload, size_t payload_length, uint32_t tag, int *queued);
+
+/*
+ * Waits for the PUBACK of every publish in flight, e.g. before the modem is left for another device.
+ * A missing one brings the session down.
+ */
+PMCU_Error mqtt_session_flush();
+
+/*
+ * The listener is called with the tag of every publish acknowledged.
+ */
+void mqtt_subscribe_puback_listener(mqtt_puback_listener listener);
+
+/*
+ * Pings the broker once the session has been idle for MQTT_PING_INTERVAL: a missing PINGRESP
+ * brings the session down.
+ */
+PMCU_Error mqtt_session_keep_alive();
+
 #endif
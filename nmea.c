@@ -0,0 +1,235 @@
+#include "nmea.h"
+
+#include <string.h>
+
+#define NMEA_IDLE     0 // up to the next '$'
+#define NMEA_TYPE     1 // talker and sentence type, up to the first ','
+#define NMEA_FIELD    2
+#define NMEA_CHECKSUM 3 // the two hex digits after '*'
+
+void nmea_init(nmea_Parser *parser) {
+    memset(parser, 0, sizeof(*parser));
+}
+
+uint16_t nmea_days(uint16_t year, uint8_t month, uint8_t day) {
+    static const uint8_t month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    uint16_t days;
+    uint8_t i;
+
+    // every 4th year is a leap year, up to 2099
+    days = (year - 2000) * 365 + (year - 2000 + 3) / 4;
+    for (i = 1; i < month && i <= 12; i++) {
+        days += month_days[i - 1] + (i == 2 && year % 4 == 0);
+    }
+    return days + day - 1;
+}
+
+void nmea_field_start(nmea_Parser *parser) {
+    parser->value = 0;
+    parser->decimals = 0;
+    parser->digits = 0;
+    parser->point = 0;
+    parser->negative = 0;
+    parser->first = '\0';
+}
+
+/* The number of the field, scaled by 10^decimals */
+int32_t nmea_field_number(const nmea_Parser *parser, uint8_t decimals) {
+    int32_t value;
+    uint8_t d;
+
+    value = parser->value;
+    for (d = parser->decimals; d < decimals; d++) {
+        value *= 10;
+    }
+    for (; d > decimals; d--) {
+        value /= 10;
+    }
+    return parser->negative ? -value : value;
+}
+
+uint8_t nmea_field_tenths(const nmea_Parser *parser) {
+    int32_t value;
+
+    value = nmea_field_number(parser, 1);
+    return value < 0 ? 0 : (value > UINT8_MAX ? UINT8_MAX : value);
+}
+
+/* hhmmss, as seconds since midnight */
+uint32_t nmea_field_time(const nmea_Parser *parser) {
+    int32_t time;
+
+    time = nmea_field_number(parser, 0);
+    return time / 10000 * 3600 + time / 100 % 100 * 60 + time % 100;
+}
+
+/* (d)ddmm.mmmmm, as 1e-7 ° */
+int32_t nmea_field_coordinate(const nmea_Parser *parser) {
+    int32_t value;
+
+    value = nmea_field_number(parser, 5);
+    return value / 10000000 * 10000000 + value % 10000000 * 100 / 60;
+}
+
+/* Folds the field just ended into the sentence fix, empty fields are left alone */
+void nmea_field_end(nmea_Parser *parser) {
+    gps_Fix *fix;
+    int32_t value;
+
+    fix = &parser->sentence;
+
+    if (parser->digits == 0) {
+        // the hemisphere follows its coordinate
+        if ((parser->first == 'S' && ((parser->type == GPS_GGA && parser->field == 3) || (parser->type == GPS_RMC && parser->field == 4)))) {
+            fix->latitude = -fix->latitude;
+        } else if (parser->first == 'W' && ((parser->type == GPS_GGA && parser->field == 5) || (parser->type == GPS_RMC && parser->field == 6))) {
+            fix->longitude = -fix->longitude;
+        } else if (parser->type == GPS_RMC && parser->field == 2) {
+            fix->status = parser->first;
+        }
+        return;
+    }
+
+    switch (parser->type) {
+    case GPS_GGA:
+        switch (parser->field) {
+        case 1: fix->time = nmea_field_time(parser); break;
+        case 2: fix->latitude = nmea_field_coordinate(parser); break;
+        case 4: fix->longitude = nmea_field_coordinate(parser); break;
+        case 6: fix->quality = nmea_field_number(parser, 0); break;
+        case 7: fix->satellites = nmea_field_number(parser, 0); break;
+        case 8: fix->hdop = nmea_field_tenths(parser); break;
+        case 9:
+            value = nmea_field_number(parser, 1);
+            fix->altitude = value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value);
+            break;
+        }
+        break;
+
+    case GPS_RMC:
+        switch (parser->field) {
+        case 1: fix->time = nmea_field_time(parser); break;
+        case 3: fix->latitude = nmea_field_coordinate(parser); break;
+        case 5: fix->longitude = nmea_field_coordinate(parser); break;
+        case 9:
+            value = nmea_field_number(parser, 0); // ddmmyy
+            fix->date = nmea_days(2000 + value % 100, value / 100 % 100, value / 10000);
+            break;
+        }
+        break;
+
+    case GPS_GSA:
+        switch (parser->field) {
+        case 2: fix->mode = nmea_field_number(parser, 0); break;
+        case 15: fix->pdop = nmea_field_tenths(parser); break;
+        case 16: fix->hdop = nmea_field_tenths(parser); break;
+        case 17: fix->vdop = nmea_field_tenths(parser); break;
+        }
+        break;
+    }
+}
+
+uint8_t nmea_hex(uint8_t byte) {
+    if (byte >= '0' && byte <= '9') {
+        return byte - '0';
+    } else if (byte >= 'A' && byte <= 'F') {
+        return byte - 'A' + 10;
+    }
+    return 0xFF;
+}
+
+uint8_t nmea_parse(nmea_Parser *parser, uint8_t byte) {
+    uint8_t nibble;
+
+    if (byte == '$') {
+        parser->state = NMEA_TYPE;
+        parser->checksum = 0;
+        parser->length = 0;
+        parser->value = 0;
+        return 0;
+    }
+
+    switch (parser->state) {
+    case NMEA_TYPE:
+        parser->checksum ^= byte;
+        if (byte != ',') {
+            // the last 3 characters are the type
+            parser->value = (parser->value << 8) | byte;
+            if (++parser->length > 5) {
+                parser->state = NMEA_IDLE;
+            }
+            break;
+        }
+
+        switch (parser->value & 0xFFFFFF) {
+        case 0x474741: parser->type = GPS_GGA; break; // "GGA"
+        case 0x524D43: parser->type = GPS_RMC; break; // "RMC"
+        case 0x475341: parser->type = GPS_GSA; break; // "GSA"
+        default: parser->type = 0;
+        }
+        if (parser->type == 0 || parser->length < 5) {
+            parser->state = NMEA_IDLE;
+            break;
+        }
+
+        parser->sentence = parser->fix;
+        parser->field = 1;
+        nmea_field_start(parser);
+        parser->state = NMEA_FIELD;
+        break;
+
+    case NMEA_FIELD:
+        if (byte == '*') {
+            nmea_field_end(parser);
+            parser->received = 0;
+            parser->length = 0;
+            parser->state = NMEA_CHECKSUM;
+        } else if (byte == ',') {
+            parser->checksum ^= byte;
+            nmea_field_end(parser);
+            nmea_field_start(parser);
+            if (++parser->field > NMEA_FIELDS) {
+                parser->state = NMEA_IDLE;
+            }
+        } else if (byte < 0x20 || byte > 0x7E) {
+            parser->state = NMEA_IDLE; // cut short
+        } else {
+            parser->checksum ^= byte;
+            if (parser->first == '\0') {
+                parser->first = byte;
+            }
+
+            if (byte >= '0' && byte <= '9') {
+                if (!parser->point && parser->digits < 9) {
+                    parser->value = parser->value * 10 + (byte - '0');
+                } else if (parser->point && parser->decimals < NMEA_DECIMALS) {
+                    parser->value = parser->value * 10 + (byte - '0');
+                    parser->decimals++;
+                }
+                parser->digits++;
+            } else if (byte == '.') {
+                parser->point = 1;
+            } else if (byte == '-') {
+                parser->negative = 1;
+            }
+        }
+        break;
+
+    case NMEA_CHECKSUM:
+        if ((nibble = nmea_hex(byte)) == 0xFF) {
+            parser->state = NMEA_IDLE;
+            break;
+        }
+        parser->received = (parser->received << 4) | nibble;
+        if (++parser->length == 2) {
+            parser->state = NMEA_IDLE;
+            if (parser->received == parser->checksum) {
+                parser->fix = parser->sentence;
+                parser->fix.parts |= parser->type;
+                return parser->type;
+            }
+        }
+        break;
+    }
+    return 0;
+}
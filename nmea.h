@@ -0,0 +1,50 @@
+#ifndef NMEA_H_
+#define NMEA_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "gps_fix.h"
+
+/*
+ * An NMEA 0183 parser fed a byte at a time, e.g. from the RX interrupt: the fields are parsed as
+ * they come, no sentence is buffered. Those of a sentence are folded into the fix only once its
+ * *hh checksum matches. Any talker is accepted ($GP, $GN...).
+ */
+#define NMEA_DECIMALS 5 // fractional digits kept, e.g. ddmm.mmmmm
+#define NMEA_FIELDS   20 // a longer sentence is dropped
+
+typedef struct {
+    uint8_t state;
+    uint8_t type; // GPS_* of the sentence, 0 if not parsed
+    uint8_t field; // index, the type being 0
+    uint8_t checksum;
+    uint8_t received; // the checksum received, as hex digits come
+    uint8_t length; // of the type, then hex digits of the checksum received
+
+    // the field being parsed
+    int32_t value;
+    uint8_t decimals;
+    uint8_t digits;
+    uint8_t point; // the decimal point has been met
+    uint8_t negative;
+    char first;
+
+    gps_Fix sentence; // the fix as the sentence leaves it
+    gps_Fix fix;
+} nmea_Parser;
+
+void nmea_init(nmea_Parser *parser);
+
+/*
+ * Parses the next byte. Returns the GPS_* type of the sentence it completes, if its checksum
+ * matches: parser->fix has just been updated. Otherwise returns 0.
+ */
+uint8_t nmea_parse(nmea_Parser *parser, uint8_t byte);
+
+/*
+ * Days since 2000-01-01, up to 2099.
+ */
+uint16_t nmea_days(uint16_t year, uint8_t month, uint8_t day);
+
+#endif
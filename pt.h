@@ -0,0 +1,68 @@
+#ifndef PT_H_
+#define PT_H_
+
+#include "lpm.h"
+
+/*
+ * Protothreads: stackless cooperative threads, written as functions that return whenever they
+ * have to wait and resume where they left off when called again.
+ * Locals are not kept across waits: the state of a thread lives in static variables.
+ * Threads must not use switch statements themselves, as resuming is a jump into a switch.
+ */
+typedef struct {
+    unsigned int line;
+} pt;
+
+typedef enum {
+    PT_WAITING,
+    PT_EXITED,
+    PT_ENDED,
+} pt_Status;
+
+#define PT_THREAD(declaration) pt_Status declaration
+
+#define PT_INIT(thread) ((thread)->line = 0)
+
+#define PT_BEGIN(thread) switch ((thread)->line) { case 0:
+
+#define PT_END(thread) } (thread)->line = 0; return PT_ENDED
+
+/*
+ * Returns to the caller until the condition holds.
+ */
+#define PT_WAIT_UNTIL(thread, condition) \
+    do { \
+        (thread)->line = __LINE__; case __LINE__: \
+        if (!(condition)) { \
+            return PT_WAITING; \
+        } \
+    } while (0)
+
+/*
+ * Runs the child thread from within the thread, up to its end.
+ */
+#define PT_SPAWN(thread, child, call) \
+    do { \
+        PT_INIT(child); \
+        PT_WAIT_UNTIL(thread, !PT_SCHEDULE(call)); \
+    } while (0)
+
+#define PT_EXIT(thread) do { (thread)->line = 0; return PT_EXITED; } while (0)
+
+/*
+ * Calls the thread once, true while it has not finished.
+ */
+#define PT_SCHEDULE(call) ((call) == PT_WAITING)
+
+/*
+ * Runs the thread to its end, sleeping in LPM0 whenever it waits.
+ * Threads only wait for things that an ISR signals with lpm_wake_on_exit.
+ */
+#define PT_RUN(call) \
+    do { \
+        while (PT_SCHEDULE(call)) { \
+            lpm_wait_event(LPM0_bits); \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,290 @@
+#include "record.h"
+
+#include <string.h>
+
+#include "nmea.h"
+
+#define RECORD_FIELDS 22
+
+const uint8_t record_field_sensors[RECORD_FIELDS] = {
+    RECORD_DHT22, RECORD_DHT22,
+    RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS,
+    RECORD_LOCATION, RECORD_LOCATION, RECORD_LOCATION,
+    RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30,
+    RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30,
+};
+
+/* The fields in encoding order */
+void record_get_fields(const record_Sample *sample, int32_t *fields) {
+    size_t i;
+
+    fields[0] = sample->humidity;
+    fields[1] = sample->temperature;
+    fields[2] = sample->gps_time;
+    fields[3] = sample->gps_latitude;
+    fields[4] = sample->gps_longitude;
+    fields[5] = sample->gps_altitude;
+    fields[6] = sample->gps_hdop;
+    fields[7] = sample->gps_fix;
+    fields[8] = sample->gps_satellites;
+    fields[9] = sample->location_time;
+    fields[10] = sample->location_latitude;
+    fields[11] = sample->location_longitude;
+    for (i = 0; i < 4; i++) {
+        fields[12 + i] = sample->pm_mass[i];
+    }
+    for (i = 0; i < 5; i++) {
+        fields[16 + i] = sample->pm_number[i];
+    }
+    fields[21] = sample->pm_size;
+}
+
+void record_set_fields(record_Sample *sample, const int32_t *fields) {
+    size_t i;
+
+    sample->humidity = fields[0];
+    sample->temperature = fields[1];
+    sample->gps_time = fields[2];
+    sample->gps_latitude = fields[3];
+    sample->gps_longitude = fields[4];
+    sample->gps_altitude = fields[5];
+    sample->gps_hdop = fields[6];
+    sample->gps_fix = fields[7];
+    sample->gps_satellites = fields[8];
+    sample->location_time = fields[9];
+    sample->location_latitude = fields[10];
+    sample->location_longitude = fields[11];
+    for (i = 0; i < 4; i++) {
+        sample->pm_mass[i] = fields[12 + i];
+    }
+    for (i = 0; i < 5; i++) {
+        sample->pm_number[i] = fields[16 + i];
+    }
+    sample->pm_size = fields[21];
+}
+
+// ***************************************************************** Parsing
+
+/*
+ * Parses a decimal number scaled by 10^decimals (the digits beyond are dropped), then skips the
+ * separator after it. Returns 0 if there is no number.
+ */
+int record_parse_number(const char **text, uint8_t decimals, int32_t *value) {
+    const char *c;
+    int negative, digits;
+
+    c = *text;
+    negative = *c == '-';
+    if (negative) {
+        c++;
+    }
+
+    *value = 0;
+    digits = 0;
+    for (; *c >= '0' && *c <= '9'; c++, digits++) {
+        *value = *value * 10 + (*c - '0');
+    }
+    if (*c == '.') {
+        c++;
+    }
+    for (; *c >= '0' && *c <= '9'; c++, digits++) {
+        if (decimals) {
+            *value = *value * 10 + (*c - '0');
+            decimals--;
+        }
+    }
+    for (; decimals; decimals--) {
+        *value *= 10;
+    }
+    if (negative) {
+        *value = -*value;
+    }
+
+    if (*c != '\0') {
+        c++;
+    }
+    *text = c;
+    return digits > 0;
+}
+
+void record_set_dht22(record_Sample *sample, const uint8_t *data) {
+    sample->humidity = ((uint16_t) data[0] << 8) | data[1];
+    sample->temperature = ((uint16_t) (data[2] & 0x7f) << 8) | data[3];
+    if (data[2] & 0x80) {
+        sample->temperature = -sample->temperature; // sign and magnitude
+    }
+    sample->sensors |= RECORD_DHT22;
+}
+
+void record_set_gps(record_Sample *sample, const gps_Fix *fix) {
+    if (fix->quality == 0) {
+        return;
+    }
+
+    sample->gps_time = fix->time;
+    sample->gps_latitude = fix->latitude;
+    sample->gps_longitude = fix->longitude;
+    sample->gps_altitude = fix->altitude;
+    sample->gps_hdop = fix->hdop;
+    sample->gps_fix = fix->quality;
+    sample->gps_satellites = fix->satellites;
+    sample->sensors |= RECORD_GPS;
+}
+
+void record_set_location(record_Sample *sample, const char *line) {
+    int32_t code, longitude, latitude, year, month, day, hours, minutes, seconds;
+
+    if (!(line = strchr(line, ' '))) {
+        return;
+    }
+    line++;
+    if (!record_parse_number(&line, 0, &code) || code != 0
+            || !record_parse_number(&line, 7, &longitude)
+            || !record_parse_number(&line, 7, &latitude)
+            || !record_parse_number(&line, 0, &year) || year < 2000
+            || !record_parse_number(&line, 0, &month) || month < 1 || month > 12
+            || !record_parse_number(&line, 0, &day)
+            || !record_parse_number(&line, 0, &hours)
+            || !record_parse_number(&line, 0, &minutes)
+            || !record_parse_number(&line, 0, &seconds)) {
+        return;
+    }
+
+    sample->location_time = (uint32_t) nmea_days(year, month, day) * 86400 + hours * 3600 + minutes * 60 + seconds;
+    sample->location_latitude = latitude;
+    sample->location_longitude = longitude;
+    sample->sensors |= RECORD_LOCATION;
+}
+
+/* A big endian float, scaled and rounded */
+uint16_t record_float(const uint8_t *data, float scale) {
+    uint32_t bits;
+    float value;
+
+    bits = ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+    memcpy(&value, &bits, sizeof(value));
+
+    value = value * scale + 0.5f;
+    return value <= 0 ? 0 : (value >= UINT16_MAX ? UINT16_MAX : (uint16_t) value);
+}
+
+/* A big endian uint16, scaled */
+uint16_t record_u16(const uint8_t *data, uint16_t scale) {
+    uint32_t value;
+
+    value = (uint32_t) (((uint16_t) data[0] << 8) | data[1]) * scale;
+    return value >= UINT16_MAX ? UINT16_MAX : (uint16_t) value;
+}
+
+void record_set_sps30(record_Sample *sample, const uint8_t *data, size_t data_length) {
+    size_t i;
+
+    if (data_length >= 40) { // float format: µg/m³, #/cm³, µm
+        for (i = 0; i < 4; i++) {
+            sample->pm_mass[i] = record_float(&data[4 * i], 10);
+        }
+        for (i = 0; i < 5; i++) {
+            sample->pm_number[i] = record_float(&data[16 + 4 * i], 10);
+        }
+        sample->pm_size = record_float(&data[36], 1000);
+    } else if (data_length >= 20) { // uint16 format: µg/m³, #/cm³, nm
+        for (i = 0; i < 4; i++) {
+            sample->pm_mass[i] = record_u16(&data[2 * i], 10);
+        }
+        for (i = 0; i < 5; i++) {
+            sample->pm_number[i] = record_u16(&data[8 + 2 * i], 10);
+        }
+        sample->pm_size = record_u16(&data[18], 1);
+    } else {
+        return; // no new measurement
+    }
+    sample->sensors |= RECORD_SPS30;
+}
+
+// ***************************************************************** Encoding
+
+size_t record_encode(uint8_t *buffer, const record_Sample *sample, const record_Sample *previous) {
+    int32_t fields[RECORD_FIELDS], before[RECORD_FIELDS];
+    uint32_t delta;
+    size_t i, pos;
+
+    record_get_fields(sample, fields);
+    memset(before, 0, sizeof(before));
+    if (previous) {
+        record_get_fields(previous, before);
+    }
+
+    pos = 0;
+    buffer[pos++] = sample->sensors;
+    for (i = 0; i < RECORD_FIELDS; i++) {
+        if (!(sample->sensors & record_field_sensors[i])) {
+            continue;
+        }
+        delta = (uint32_t) fields[i];
+        if (previous && (previous->sensors & record_field_sensors[i])) {
+            delta -= (uint32_t) before[i];
+        }
+
+        delta = (delta << 1) ^ ((delta & 0x80000000UL) ? 0xFFFFFFFFUL : 0); // zigzag
+        while (delta >= 0x80) {
+            buffer[pos++] = (delta & 0x7f) | 0x80;
+            delta >>= 7;
+        }
+        buffer[pos++] = delta;
+    }
+    return pos;
+}
+
+size_t record_decode(const uint8_t *buffer, size_t buffer_length, record_Sample *sample, const record_Sample *previous) {
+    int32_t fields[RECORD_FIELDS], before[RECORD_FIELDS];
+    uint32_t delta;
+    size_t i, pos;
+    uint8_t shift;
+
+    if (buffer_length < 1 || (buffer[0] & ~(RECORD_DHT22 | RECORD_GPS | RECORD_LOCATION | RECORD_SPS30))) {
+        return 0;
+    }
+
+    memset(fields, 0, sizeof(fields));
+    memset(before, 0, sizeof(before));
+    if (previous) {
+        record_get_fields(previous, before);
+    }
+
+    pos = 0;
+    sample->sensors = buffer[pos++];
+    for (i = 0; i < RECORD_FIELDS; i++) {
+        if (!(sample->sensors & record_field_sensors[i])) {
+            continue;
+        }
+
+        delta = 0;
+        shift = 0;
+        do {
+            if (pos == buffer_length || shift > 28) {
+                return 0;
+            }
+            delta |= (uint32_t) (buffer[pos] & 0x7f) << shift;
+            shift += 7;
+        } while (buffer[pos++] & 0x80);
+
+        delta = (delta >> 1) ^ ((delta & 1) ? 0xFFFFFFFFUL : 0);
+        if (previous && (previous->sensors & record_field_sensors[i])) {
+            delta += (uint32_t) before[i];
+        }
+        fields[i] = (int32_t) delta;
+    }
+
+    record_set_fields(sample, fields);
+    return pos;
+}
+
+size_t record_pack(uint8_t *buffer, const record_Sample *sample) {
+    buffer[0] = RECORD_VERSION;
+    return 1 + record_encode(&buffer[1], sample, NULL);
+}
+
+int record_unpack(const uint8_t *buffer, size_t buffer_length, record_Sample *sample) {
+    return buffer_length > 1 && buffer[0] == RECORD_VERSION
+        && record_decode(&buffer[1], buffer_length - 1, sample, NULL) == buffer_length - 1;
+}
@@ -0,0 +1,90 @@
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "gps_fix.h"
+
+/*
+ * A measurement in fixed point, as kept in the flash log and published.
+ *
+ * Encoded, a record is the mask of the sensors read, then the fields of those sensors in the
+ * order below, each one as the difference with the same field of the previous record of the
+ * batch (0 if none, or if it lacks the sensor): zigzag, then LEB128 varint.
+ * See tools/record.py for the reference decoder.
+ */
+#define RECORD_VERSION 1
+
+#define RECORD_LENGTH 112 // an encoded record, at most: the mask and 22 varints of 5 bytes
+
+#define RECORD_DHT22    0x01
+#define RECORD_GPS      0x02 // with a fix only
+#define RECORD_LOCATION 0x04
+#define RECORD_SPS30    0x08
+
+typedef struct {
+    uint8_t sensors; // RECORD_* of the sensors read
+
+    int16_t humidity; // 0.1 %RH
+    int16_t temperature; // 0.1 °C
+
+    uint32_t gps_time; // s since midnight UTC, GGA has no date
+    int32_t gps_latitude; // 1e-7 °
+    int32_t gps_longitude; // 1e-7 °
+    int16_t gps_altitude; // 0.1 m above mean sea level
+    uint8_t gps_hdop; // 0.1, saturated
+    uint8_t gps_fix; // GGA fix quality, 1 for a NAV-SOL fix
+    uint8_t gps_satellites;
+
+    uint32_t location_time; // s since 2000-01-01 UTC
+    int32_t location_latitude; // 1e-7 °
+    int32_t location_longitude; // 1e-7 °
+
+    uint16_t pm_mass[4]; // 0.1 µg/m³: PM1.0, PM2.5, PM4.0, PM10
+    uint16_t pm_number[5]; // 0.1 #/cm³: PM0.5, PM1.0, PM2.5, PM4.0, PM10
+    uint16_t pm_size; // nm, typical particle size
+} record_Sample;
+
+/*
+ * From the 4 bytes read by dht22_read_pt().
+ */
+void record_set_dht22(record_Sample *sample, const uint8_t *data);
+
+/*
+ * From the fix read by gps_read_fix_pt(), from GGA or NAV-SOL. Nothing is set without a fix.
+ */
+void record_set_gps(record_Sample *sample, const gps_Fix *fix);
+
+/*
+ * From the +CIPGSMLOC line. Nothing is set if the location failed.
+ */
+void record_set_location(record_Sample *sample, const char *line);
+
+/*
+ * From the SPS30 measured values, 40 bytes of big endian floats or 20 of uint16: the format is told by the length.
+ */
+void record_set_sps30(record_Sample *sample, const uint8_t *data, size_t data_length);
+
+/*
+ * Encodes the sample after the previous record of the batch (NULL for the first one).
+ * Returns the length, RECORD_LENGTH at most.
+ */
+size_t record_encode(uint8_t *buffer, const record_Sample *sample, const record_Sample *previous);
+
+/*
+ * Decodes a record encoded after previous. Returns the length read, 0 if malformed.
+ */
+size_t record_decode(const uint8_t *buffer, size_t buffer_length, record_Sample *sample, const record_Sample *previous);
+
+/*
+ * A record standing alone, as kept in the flash log: the version then the record.
+ */
+size_t record_pack(uint8_t *buffer, const record_Sample *sample);
+
+/*
+ * Returns 0 if the record is malformed, or of another version.
+ */
+int record_unpack(const uint8_t *buffer, size_t buffer_length, record_Sample *sample);
+
+#endif
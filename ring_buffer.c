@@ -0,0 +1,135 @@
+#include "ring_buffer.h"
+
+#include <string.h>
+
+/*
+ * Keeps the compiler from moving the accesses to the storage across the indexes: the bytes are written
+ * before head publishes them and read after head has been seen, and tail frees them once they are read.
+ */
+#ifdef __GNUC__
+#define RING_BUFFER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+#define RING_BUFFER_BARRIER() __asm(" ") // CCS doesn't move memory accesses across an asm statement
+#endif
+
+void ring_buffer_clear(ring_buffer *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint16_t ring_buffer_count(const ring_buffer *ring) {
+    return (uint16_t) (ring->head - ring->tail);
+}
+
+uint16_t ring_buffer_room(const ring_buffer *ring) {
+    return (uint16_t) (ring->mask + 1 - ring_buffer_count(ring));
+}
+
+int ring_buffer_is_empty(const ring_buffer *ring) {
+    return ring->head == ring->tail;
+}
+
+int ring_buffer_is_full(const ring_buffer *ring) {
+    return ring_buffer_count(ring) > ring->mask;
+}
+
+int ring_buffer_write(ring_buffer *ring, uint8_t byte) {
+    uint16_t head;
+
+    head = ring->head;
+    if ((uint16_t) (head - ring->tail) > ring->mask) {
+        return 0;
+    }
+    ring->data[head & ring->mask] = byte;
+    RING_BUFFER_BARRIER();
+    ring->head = head + 1; // publishes the byte
+    return 1;
+}
+
+size_t ring_buffer_write_span(ring_buffer *ring, const uint8_t *bytes, size_t length) {
+    uint16_t head, room, offset, run;
+
+    head = ring->head;
+    room = ring_buffer_room(ring); // once: the consumer may free more meanwhile
+    if (length > room) {
+        length = room;
+    }
+
+    // at most two copies: up to the end of the storage, then from its start
+    offset = head & ring->mask;
+    run = ring->mask + 1 - offset;
+    if (run > length) {
+        run = length;
+    }
+    memcpy(&ring->data[offset], bytes, run);
+    memcpy(ring->data, &bytes[run], length - run);
+
+    RING_BUFFER_BARRIER();
+    ring->head = head + length;
+    return length;
+}
+
+int ring_buffer_read(ring_buffer *ring, uint8_t *byte) {
+    uint16_t tail;
+
+    tail = ring->tail;
+    if (ring->head == tail) {
+        return 0;
+    }
+    RING_BUFFER_BARRIER();
+    if (byte != NULL) {
+        *byte = ring->data[tail & ring->mask];
+    }
+    RING_BUFFER_BARRIER();
+    ring->tail = tail + 1; // frees the byte
+    return 1;
+}
+
+size_t ring_buffer_read_span(ring_buffer *ring, uint8_t *bytes, size_t length) {
+    uint16_t tail, count, offset, run;
+
+    tail = ring->tail;
+    count = ring_buffer_count(ring); // once: the producer may add more meanwhile
+    if (length > count) {
+        length = count;
+    }
+
+    RING_BUFFER_BARRIER();
+    offset = tail & ring->mask;
+    run = ring->mask + 1 - offset;
+    if (run > length) {
+        run = length;
+    }
+    memcpy(bytes, &ring->data[offset], run);
+    memcpy(&bytes[run], ring->data, length - run);
+
+    RING_BUFFER_BARRIER();
+    ring->tail = tail + length;
+    return length;
+}
+
+uint8_t ring_buffer_peek_at(const ring_buffer *ring, uint16_t offset) {
+    RING_BUFFER_BARRIER(); // the caller has seen head, through the count
+    return ring->data[(uint16_t) (ring->tail + offset) & ring->mask];
+}
+
+size_t ring_buffer_peek_span(const ring_buffer *ring, const uint8_t **span) {
+    return ring_buffer_peek_span_at(ring, 0, span);
+}
+
+size_t ring_buffer_peek_span_at(const ring_buffer *ring, uint16_t offset, const uint8_t **span) {
+    uint16_t count, index, run;
+
+    count = ring_buffer_count(ring) - offset;
+    RING_BUFFER_BARRIER();
+    index = (uint16_t) (ring->tail + offset) & ring->mask;
+    run = ring->mask + 1 - index;
+
+    *span = &ring->data[index];
+    return count < run ? count : run;
+}
+
+void ring_buffer_consume(ring_buffer *ring, size_t length) {
+    RING_BUFFER_BARRIER(); // the peeked bytes have been read
+    ring->tail += length;
+}
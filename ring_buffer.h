@@ -0,0 +1,80 @@
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * A single-producer/single-consumer ring buffer of bytes.
+ * The producer only moves head and the consumer only moves tail, so an ISR and the main context
+ * can share it without disabling interrupts. Indexes run free and are masked on access:
+ * the size must be a power of two (up to 32768).
+ */
+typedef struct {
+    volatile uint16_t head;
+    volatile uint16_t tail;
+    uint16_t mask;
+    uint8_t *data;
+} ring_buffer;
+
+/*
+ * Defines a ring buffer with its own storage of the given size.
+ */
+#define RING_BUFFER(name, size) \
+    _Static_assert((size) > 0 && (size) <= 32768 && ((size) & ((size) - 1)) == 0, "ring buffer size must be a power of two"); \
+    uint8_t name##_data[size]; \
+    ring_buffer name = { 0, 0, (size) - 1, name##_data }
+
+/*
+ * Empties the buffer. Neither side must be using it meanwhile.
+ */
+void ring_buffer_clear(ring_buffer *ring);
+
+uint16_t ring_buffer_count(const ring_buffer *ring);
+
+uint16_t ring_buffer_room(const ring_buffer *ring);
+
+int ring_buffer_is_empty(const ring_buffer *ring);
+
+int ring_buffer_is_full(const ring_buffer *ring);
+
+// ***************************************************************** Producer
+
+int ring_buffer_write(ring_buffer *ring, uint8_t byte);
+
+/*
+ * Writes as many bytes as there is room for, returns how many were written.
+ */
+size_t ring_buffer_write_span(ring_buffer *ring, const uint8_t *bytes, size_t length);
+
+// ***************************************************************** Consumer
+
+int ring_buffer_read(ring_buffer *ring, uint8_t *byte);
+
+/*
+ * Reads up to length bytes, returns how many were read.
+ */
+size_t ring_buffer_read_span(ring_buffer *ring, uint8_t *bytes, size_t length);
+
+/*
+ * The byte at offset past the tail, without consuming it. The offset must be less than the count.
+ */
+uint8_t ring_buffer_peek_at(const ring_buffer *ring, uint16_t offset);
+
+/*
+ * Points span to the contiguous run of bytes at the tail, without consuming them.
+ * Returns the length of the run: less than the count when the bytes wrap around.
+ */
+size_t ring_buffer_peek_span(const ring_buffer *ring, const uint8_t **span);
+
+/*
+ * Same as ring_buffer_peek_span(), from offset past the tail (no more than the count).
+ */
+size_t ring_buffer_peek_span_at(const ring_buffer *ring, uint16_t offset, const uint8_t **span);
+
+/*
+ * Consumes length bytes (no more than the count), e.g. after having peeked them.
+ */
+void ring_buffer_consume(ring_buffer *ring, size_t length);
+
+#endif
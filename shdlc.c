@@ -0,0 +1,140 @@
+#include "shdlc.h"
+
+#include <string.h>
+
+#define SHDLC_IDLE    0 // up to the opening flag
+#define SHDLC_FRAME   1
+#define SHDLC_ESCAPED 2
+#define SHDLC_POSTED  3
+
+#define SHDLC_HEADER_LENGTH 4 // address, command, state, length
+
+// bytes 0x00 to 0x7F that are stuffed, a bit each: XON 0x11, XOFF 0x13, escape 0x7D, flag 0x7E
+const uint8_t shdlc_stuffed[16] = { 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60 };
+
+#define SHDLC_STUFFED(byte) ((byte) < 0x80 && (shdlc_stuffed[(byte) >> 3] & (1 << ((byte) & 7))))
+
+void shdlc_init(shdlc_Decoder *decoder) {
+    decoder->state = SHDLC_IDLE;
+    decoder->error = PMCU_OK;
+}
+
+uint8_t *shdlc_put(uint8_t *buffer, uint8_t byte) {
+    if (SHDLC_STUFFED(byte)) {
+        *buffer++ = SHDLC_ESCAPE;
+        byte ^= 0x20;
+    }
+    *buffer++ = byte;
+    return buffer;
+}
+
+size_t shdlc_frame(uint8_t *buffer, uint8_t address, uint8_t command, const uint8_t *payload, uint8_t length) {
+    uint8_t *end, sum;
+    uint8_t i;
+
+    sum = address + command + length;
+
+    end = buffer;
+    *end++ = SHDLC_FLAG;
+    end = shdlc_put(end, address);
+    end = shdlc_put(end, command);
+    end = shdlc_put(end, length);
+    for (i = 0; i < length; i++) {
+        end = shdlc_put(end, payload[i]);
+        sum += payload[i];
+    }
+    end = shdlc_put(end, ~sum);
+    *end++ = SHDLC_FLAG;
+
+    return end - buffer;
+}
+
+/* Posts the frame the closing flag ends */
+void shdlc_post(shdlc_Decoder *decoder) {
+    decoder->state = SHDLC_POSTED;
+    if (decoder->error != PMCU_OK) {
+        return;
+    }
+    if (decoder->received != SHDLC_HEADER_LENGTH + decoder->length + 1) {
+        decoder->error = SPS30_WRONG_FRAME_LENGTH;
+    } else if (decoder->sum != 0xFF) { // the sum of the bytes and of their inverted sum
+        decoder->error = SPS30_WRONG_CHECKSUM;
+    }
+}
+
+/* Takes the next unstuffed byte of the frame */
+void shdlc_take(shdlc_Decoder *decoder, uint8_t byte) {
+    uint8_t i;
+
+    i = decoder->received;
+    if (i < 0xFF) {
+        decoder->received++;
+    }
+    decoder->sum += byte;
+
+    switch (i) {
+    case 0:
+        decoder->address = byte;
+        break;
+    case 1:
+        decoder->command = byte;
+        break;
+    case 2:
+        decoder->status = byte;
+        break;
+    case 3:
+        decoder->length = byte;
+        if (byte > SHDLC_PAYLOAD_LENGTH) {
+            decoder->error = SPS30_BUFFER_TOO_SMALL; // still up to the closing flag
+        }
+        break;
+    default:
+        i -= SHDLC_HEADER_LENGTH;
+        if (i < decoder->length && decoder->error == PMCU_OK) {
+            decoder->payload[i] = byte;
+        }
+        break;
+    }
+}
+
+int shdlc_decode(shdlc_Decoder *decoder, uint8_t byte) {
+    switch (decoder->state) {
+    case SHDLC_IDLE:
+        if (byte == SHDLC_FLAG) {
+            decoder->state = SHDLC_FRAME;
+            decoder->received = 0;
+            decoder->sum = 0;
+        }
+        break;
+
+    case SHDLC_FRAME:
+    case SHDLC_ESCAPED:
+        if (byte == SHDLC_FLAG) {
+            if (decoder->received == 0) {
+                break; // the closing flag of something else, this one opens
+            }
+            if (decoder->state == SHDLC_ESCAPED) {
+                decoder->error = SPS30_INVALID_STUFFED_BYTE;
+            }
+            shdlc_post(decoder);
+            return 1;
+        }
+        if (decoder->state == SHDLC_ESCAPED) {
+            decoder->state = SHDLC_FRAME;
+            byte ^= 0x20;
+            if (!SHDLC_STUFFED(byte)) {
+                decoder->error = SPS30_INVALID_STUFFED_BYTE;
+            }
+        } else if (byte == SHDLC_ESCAPE) {
+            decoder->state = SHDLC_ESCAPED;
+            break;
+        }
+        shdlc_take(decoder, byte);
+        break;
+
+    case SHDLC_POSTED:
+        break;
+    }
+    return 0;
+}
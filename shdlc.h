@@ -0,0 +1,51 @@
+#ifndef SHDLC_H_
+#define SHDLC_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "error.h"
+
+/*
+ * The Sensirion SHDLC framing of the SPS30: a frame is the address, the command, (in a response only)
+ * the state, the length, the payload and the inverted 8-bit sum of them all, between two flags.
+ * Inside, the flag, the escape and XON/XOFF are stuffed as the escape then the byte ^ 0x20.
+ * The decoder is fed a byte at a time from the RX interrupt: it unstuffs, sums and checks the length
+ * as the bytes come, and posts the frame once the closing flag has been received.
+ */
+#define SHDLC_FLAG   0x7E
+#define SHDLC_ESCAPE 0x7D
+
+#define SHDLC_PAYLOAD_LENGTH 48 // the measured values, the longest response decoded
+
+// MOSI frame of the given payload length, every byte stuffed at worst
+#define SHDLC_FRAME_LENGTH(length) (2 + 2 * (4 + (length)))
+
+typedef struct {
+    uint8_t state;
+    uint8_t received; // unstuffed, from the address on
+    uint8_t sum;
+
+    // the frame posted, until the decoder is reset
+    uint8_t address;
+    uint8_t command;
+    uint8_t status; // the state byte: 0, or the error of the command
+    uint8_t length;
+    uint8_t payload[SHDLC_PAYLOAD_LENGTH];
+    PMCU_Error error; // of the framing: the fields above hold only if PMCU_OK
+} shdlc_Decoder;
+
+void shdlc_init(shdlc_Decoder *decoder);
+
+/*
+ * Decodes the next byte. Returns 1 when it completes a frame, valid or not: decoder->error tells.
+ * The bytes after it are ignored until shdlc_init.
+ */
+int shdlc_decode(shdlc_Decoder *decoder, uint8_t byte);
+
+/*
+ * Builds the stuffed MOSI frame of a command, at most SHDLC_FRAME_LENGTH(length) bytes. Returns its length.
+ */
+size_t shdlc_frame(uint8_t *buffer, uint8_t address, uint8_t command, const uint8_t *payload, uint8_t length);
+
+#endif
@@ -0,0 +1,162 @@
+#include "sim.h"
+
+#include <msp430.h>
+
+/*
+ * DHT22 on P1.2 (TA0.1 capture input).
+ * After the host holds the line low for at least 1ms and releases it, the
+ * sensor answers with an 80us low + 80us high preamble followed by 40 bits,
+ * each one a 50us low and a 26us (0) or 70us (1) high pulse.
+ * With --dht22-glitches, every Nth answer is damaged (sim_dht22_fault): the
+ * firmware must reject it rather than decode it.
+ */
+
+#define DHT22_EDGES (3 + 2 * 40 + 1 + 2) // and a glitch
+#define DHT22_SPIKE (-1) // an edge level: low and back high at once, both captured before the ISR runs
+
+static struct {
+    sim_time low_since;
+    sim_time last_read;
+    int line;
+
+    sim_time edges_at[DHT22_EDGES];
+    int edges_level[DHT22_EDGES];
+    int edges, next_edge;
+    sim_event event;
+
+    int16_t humidity;    // tenths of %RH
+    int16_t temperature; // tenths of Celsius
+    uint32_t seed;
+
+    unsigned long answers;
+    unsigned long damaged;
+} dht22;
+
+static int dht22_host_drives_low() {
+    uint8_t dir, sel, out;
+
+    dir = sim_reg8(0x0204);
+    sel = sim_reg8(0x020A);
+    out = sim_reg8(0x0202);
+    return (dir & BIT2) && !(sel & BIT2) && !(out & BIT2);
+}
+
+static void dht22_set_line(int level) {
+    if (level == dht22.line) {
+        return;
+    }
+    dht22.line = level;
+    // TA0.1 samples the pin only when P1.2 is selected as a timer input
+    if ((sim_reg8(0x020A) & BIT2) && !(sim_reg8(0x0204) & BIT2)) {
+        sim_ta0_capture(1, level);
+    }
+}
+
+static void dht22_on_edge(void *context) {
+    (void) context;
+
+    if (dht22.edges_level[dht22.next_edge] == DHT22_SPIKE) {
+        dht22_set_line(0);
+        dht22_set_line(1);
+    } else {
+        dht22_set_line(dht22.edges_level[dht22.next_edge]);
+    }
+    dht22.next_edge++;
+    if (dht22.next_edge < dht22.edges) {
+        sim_event_schedule(&dht22.event, dht22.edges_at[dht22.next_edge]);
+    }
+}
+
+static void dht22_push_edge(sim_time *at, sim_time after, int level) {
+    *at += after;
+    dht22.edges_at[dht22.edges] = *at;
+    dht22.edges_level[dht22.edges] = level;
+    dht22.edges++;
+}
+
+static void dht22_respond(sim_time start) {
+    sim_dht22_fault fault;
+    uint8_t data[5];
+    sim_time at, high;
+    int i, glitched;
+
+    // slowly drifting readings
+    dht22.seed = dht22.seed * 1103515245 + 12345;
+    dht22.humidity += (int16_t) ((dht22.seed >> 16) % 5) - 2;
+    dht22.temperature += (int16_t) ((dht22.seed >> 20) % 3) - 1;
+
+    fault = SIM_DHT22_FAULTS; // none
+    glitched = (dht22.seed >> 8) % 40; // the bit of a glitch or a spike
+    dht22.answers++;
+    if (sim_config.dht22_glitches && dht22.answers % sim_config.dht22_glitches == 0) {
+        fault = (sim_dht22_fault) (dht22.damaged++ % SIM_DHT22_FAULTS);
+        sim_statistics.dht22_damaged[fault]++;
+    }
+
+    data[0] = (uint8_t) (dht22.humidity >> 8);
+    data[1] = (uint8_t) dht22.humidity;
+    data[2] = (uint8_t) (dht22.temperature >> 8);
+    data[3] = (uint8_t) dht22.temperature;
+    data[4] = (uint8_t) (data[0] + data[1] + data[2] + data[3]);
+
+    at = start;
+    dht22.edges = 0;
+    dht22.next_edge = 0;
+    dht22_push_edge(&at, SIM_US(30), 0);
+    dht22_push_edge(&at, fault == SIM_DHT22_SHORT_PREAMBLE ? SIM_US(40) : SIM_US(80), 1);
+    dht22_push_edge(&at, SIM_US(80), 0);
+    for (i = 0; i < 40; i++) {
+        dht22_push_edge(&at, SIM_US(50), 1);
+        high = ((data[i / 8] >> (7 - i % 8)) & 1) ? SIM_US(70) : SIM_US(26);
+        if (i == glitched && fault == SIM_DHT22_GLITCH) {
+            dht22_push_edge(&at, SIM_US(10), 0);
+            dht22_push_edge(&at, SIM_US(4), 1);
+            high -= SIM_US(14);
+        } else if (i == glitched && fault == SIM_DHT22_SPIKE) {
+            dht22_push_edge(&at, SIM_US(10), DHT22_SPIKE);
+            high -= SIM_US(10);
+        }
+        dht22_push_edge(&at, high, 0);
+    }
+    dht22_push_edge(&at, SIM_US(50), 1);
+
+    sim_event_schedule(&dht22.event, dht22.edges_at[0]);
+    dht22.last_read = sim_now;
+}
+
+void sim_dht22_poll() {
+    if (dht22_host_drives_low()) {
+        if (!dht22.low_since) {
+            dht22.low_since = sim_now;
+            sim_event_cancel(&dht22.event);
+        }
+        dht22.line = 0;
+        return;
+    }
+
+    if (dht22.low_since) {
+        // start signal released: the sensor answers if it was long enough and it's rested
+        if (sim_now - dht22.low_since >= SIM_US(800) && (dht22.last_read == 0 || sim_now - dht22.last_read >= SIM_S(2))) {
+            /*
+             * A tick preempting the firmware right after the release would run
+             * the whole preamble before the firmware arms the capture, a few
+             * instructions later: the answer then starts after the tick.
+             */
+            dht22.line = 1;
+            dht22_respond(sim_preempting() ? sim_now + sim_config.quantum : sim_now);
+        }
+        dht22.low_since = 0;
+    }
+}
+
+void sim_dht22_init() {
+    dht22.low_since = 0;
+    dht22.last_read = 0;
+    dht22.line = 1;
+    dht22.humidity = 553;
+    dht22.temperature = 217;
+    dht22.seed = 1;
+    dht22.answers = 0;
+    dht22.damaged = 0;
+    sim_event_init(&dht22.event, dht22_on_edge, NULL);
+}
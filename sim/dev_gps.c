@@ -0,0 +1,277 @@
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * GY-GPSM6V2 (u-blox NEO-6M) with its factory configuration: 9600 baud and
+ * the default NMEA sentences once per second. It gets a fix some seconds
+ * after power-up.
+ * Over UBX it acknowledges every CFG message, turns the NMEA sentences on and
+ * off (CFG-MSG) and answers the NAV polls. With --gps-stream it replays a
+ * recorded stream instead of its sentences, a second of bytes per epoch.
+ */
+
+#define GPS_FIX_AFTER SIM_S(8)
+#define GPS_UBX_PAYLOAD 64
+#define GPS_STREAM_EPOCH 960 // bytes per second at 9600 baud
+
+// NMEA sentences by CFG-MSG id
+#define GPS_NMEA_GGA 0
+#define GPS_NMEA_GLL 1
+#define GPS_NMEA_GSA 2
+#define GPS_NMEA_GSV 3
+#define GPS_NMEA_RMC 4
+#define GPS_NMEA_VTG 5
+
+sim_serial sim_gps = {
+    .name = "gps",
+    .endpoint = SIM_ENDPOINT_GPS,
+    .baud = 9600,
+};
+
+static sim_event gps_epoch;
+static unsigned long gps_seconds = 0;
+static unsigned gps_nmea = 0x3F; // the sentences on, by CFG-MSG id
+
+static FILE *gps_stream;
+
+// the UBX frame being received
+static int gps_ubx_state = 0;
+static uint8_t gps_ubx_class, gps_ubx_id;
+static uint16_t gps_ubx_length, gps_ubx_received;
+static uint8_t gps_ubx_payload[GPS_UBX_PAYLOAD];
+static uint8_t gps_ubx_ck_a, gps_ubx_ck_b;
+
+static void gps_sentence(const char *body) {
+    char sentence[128];
+    uint8_t checksum;
+    const char *c;
+
+    checksum = 0;
+    for (c = body; *c; c++) {
+        checksum ^= (uint8_t) *c;
+    }
+    snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+    sim_serial_send_string(&sim_gps, sentence, 0);
+}
+
+#define GPS_ON(id) (gps_nmea & (1u << (id)))
+
+static void gps_sentences(unsigned long t, int fix) {
+    char body[112];
+
+    if (fix) {
+        snprintf(body, sizeof(body), "GPRMC,%02lu%02lu%02lu.00,A,4527.87986,N,00911.42070,E,0.052,,171026,,,A",
+                 t / 3600 % 24, t / 60 % 60, t % 60);
+        if (GPS_ON(GPS_NMEA_RMC)) gps_sentence(body);
+        if (GPS_ON(GPS_NMEA_VTG)) gps_sentence("GPVTG,,T,,M,0.052,N,0.096,K,A");
+        snprintf(body, sizeof(body), "GPGGA,%02lu%02lu%02lu.00,4527.87986,N,00911.42070,E,1,07,1.21,122.4,M,47.6,M,,",
+                 t / 3600 % 24, t / 60 % 60, t % 60);
+        if (GPS_ON(GPS_NMEA_GGA)) gps_sentence(body);
+        if (GPS_ON(GPS_NMEA_GSA)) gps_sentence("GPGSA,A,3,05,13,15,18,20,24,29,,,,,,2.25,1.21,1.90");
+        if (GPS_ON(GPS_NMEA_GSV)) {
+            gps_sentence("GPGSV,3,1,10,05,32,301,32,13,52,058,38,15,71,174,40,18,24,265,30");
+            gps_sentence("GPGSV,3,2,10,20,42,101,35,24,17,046,29,29,11,315,27,30,05,130,");
+            gps_sentence("GPGSV,3,3,10,41,33,221,,44,28,147,");
+        }
+        snprintf(body, sizeof(body), "GPGLL,4527.87986,N,00911.42070,E,%02lu%02lu%02lu.00,A,A",
+                 t / 3600 % 24, t / 60 % 60, t % 60);
+        if (GPS_ON(GPS_NMEA_GLL)) gps_sentence(body);
+    } else {
+        if (GPS_ON(GPS_NMEA_RMC)) gps_sentence("GPRMC,,V,,,,,,,,,,N");
+        if (GPS_ON(GPS_NMEA_VTG)) gps_sentence("GPVTG,,,,,,,,,N");
+        if (GPS_ON(GPS_NMEA_GGA)) gps_sentence("GPGGA,,,,,,0,00,99.99,,,,,,");
+        if (GPS_ON(GPS_NMEA_GSA)) gps_sentence("GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+        if (GPS_ON(GPS_NMEA_GSV)) gps_sentence("GPGSV,1,1,00");
+        if (GPS_ON(GPS_NMEA_GLL)) gps_sentence("GPGLL,,,,,,V,N");
+    }
+}
+
+/* The next second of the recorded stream, from the start again at its end */
+static void gps_replay() {
+    uint8_t bytes[GPS_STREAM_EPOCH];
+    size_t length;
+
+    length = fread(bytes, 1, sizeof(bytes), gps_stream);
+    if (length < sizeof(bytes)) {
+        rewind(gps_stream);
+    }
+    sim_serial_send(&sim_gps, bytes, length, 0);
+}
+
+static void gps_on_epoch(void *context) {
+    (void) context;
+
+    if (gps_stream) {
+        gps_replay();
+    } else {
+        gps_sentences(80000 + gps_seconds, sim_now >= GPS_FIX_AFTER);
+    }
+
+    gps_seconds++;
+    sim_event_schedule(&gps_epoch, sim_now + SIM_S(1));
+}
+
+// ***************************************************************** UBX
+
+static void gps_ubx_send(uint8_t class, uint8_t id, const uint8_t *payload, uint16_t length) {
+    uint8_t frame[8 + GPS_UBX_PAYLOAD];
+    uint8_t ck_a, ck_b;
+    size_t i;
+
+    frame[0] = 0xB5;
+    frame[1] = 0x62;
+    frame[2] = class;
+    frame[3] = id;
+    frame[4] = length & 0xff;
+    frame[5] = length >> 8;
+    memcpy(&frame[6], payload, length);
+    ck_a = ck_b = 0;
+    for (i = 2; i < 6u + length; i++) {
+        ck_a += frame[i];
+        ck_b += ck_a;
+    }
+    frame[6 + length] = ck_a;
+    frame[7 + length] = ck_b;
+
+    sim_serial_send(&sim_gps, frame, 8 + length, SIM_MS(2));
+}
+
+static void gps_put(uint8_t *payload, size_t offset, uint32_t value, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        payload[offset + i] = value >> (8 * i);
+    }
+}
+
+/* Answers a NAV poll with the same solution as the NMEA sentences */
+static void gps_ubx_poll(uint8_t id) {
+    uint8_t payload[52];
+    unsigned long t;
+    uint32_t itow;
+    int fix;
+
+    t = 80000 + gps_seconds;
+    fix = sim_now >= GPS_FIX_AFTER;
+    itow = (t + 6 * 86400) * 1000; // Saturday of GPS week
+    memset(payload, 0, sizeof(payload));
+    gps_put(payload, 0, itow, 4);
+
+    switch (id) {
+    case 0x02: // NAV-POSLLH
+        gps_put(payload, 4, fix ? 91903450 : 0, 4);
+        gps_put(payload, 8, fix ? 454646643 : 0, 4);
+        gps_put(payload, 12, fix ? 170000 : 0, 4);
+        gps_put(payload, 16, fix ? 122400 : 0, 4);
+        gps_put(payload, 20, fix ? 2500 : 0xFFFFFFFF, 4);
+        gps_put(payload, 24, fix ? 3800 : 0xFFFFFFFF, 4);
+        gps_ubx_send(0x01, id, payload, 28);
+        break;
+    case 0x06: // NAV-SOL
+        payload[10] = fix ? 3 : 0;
+        payload[11] = fix ? 0x0D : 0x0C; // gpsFixOK, WKNSET, TOWSET
+        gps_put(payload, 44, fix ? 225 : 9999, 2);
+        payload[47] = fix ? 7 : 0;
+        gps_ubx_send(0x01, id, payload, 52);
+        break;
+    case 0x04: // NAV-DOP
+        gps_put(payload, 6, fix ? 225 : 9999, 2);
+        gps_put(payload, 10, fix ? 190 : 9999, 2);
+        gps_put(payload, 12, fix ? 121 : 9999, 2);
+        gps_ubx_send(0x01, id, payload, 18);
+        break;
+    case 0x21: // NAV-TIMEUTC
+        gps_put(payload, 12, 2026, 2);
+        payload[14] = 10;
+        payload[15] = 17;
+        payload[16] = t / 3600 % 24;
+        payload[17] = t / 60 % 60;
+        payload[18] = t % 60;
+        payload[19] = fix ? 0x07 : 0x03;
+        gps_ubx_send(0x01, id, payload, 20);
+        break;
+    }
+}
+
+static void gps_ubx_message() {
+    uint8_t ack[2];
+
+    if (gps_ubx_class == 0x06) { // CFG
+        if (gps_ubx_id == 0x01 && gps_ubx_length >= 3 && gps_ubx_payload[0] == 0xF0 && gps_ubx_payload[1] < 6) {
+            // CFG-MSG, the rate on the current port is the last one given
+            if (gps_ubx_payload[gps_ubx_length == 3 ? 2 : 3]) {
+                gps_nmea |= 1u << gps_ubx_payload[1];
+            } else {
+                gps_nmea &= ~(1u << gps_ubx_payload[1]);
+            }
+        }
+        ack[0] = gps_ubx_class;
+        ack[1] = gps_ubx_id;
+        gps_ubx_send(0x05, 0x01, ack, 2);
+    } else if (gps_ubx_class == 0x01 && gps_ubx_length == 0 && !gps_stream) {
+        gps_ubx_poll(gps_ubx_id);
+    }
+}
+
+static void gps_receive(uint8_t byte) {
+    switch (gps_ubx_state) {
+    case 0:
+        gps_ubx_state = byte == 0xB5;
+        return;
+    case 1:
+        gps_ubx_state = byte == 0x62 ? 2 : (byte == 0xB5);
+        return;
+    case 6:
+        if (gps_ubx_received < GPS_UBX_PAYLOAD) {
+            gps_ubx_payload[gps_ubx_received] = byte;
+        }
+        gps_ubx_received++;
+        break;
+    case 7:
+        gps_ubx_state = byte == gps_ubx_ck_a ? 8 : 0;
+        return;
+    case 8:
+        gps_ubx_state = 0;
+        if (byte == gps_ubx_ck_b && gps_ubx_length <= GPS_UBX_PAYLOAD) {
+            gps_ubx_message();
+        }
+        return;
+    }
+
+    if (gps_ubx_state == 2) {
+        gps_ubx_class = byte;
+        gps_ubx_ck_a = gps_ubx_ck_b = 0;
+    } else if (gps_ubx_state == 3) {
+        gps_ubx_id = byte;
+    } else if (gps_ubx_state == 4) {
+        gps_ubx_length = byte;
+    } else if (gps_ubx_state == 5) {
+        gps_ubx_length |= (uint16_t) byte << 8;
+        gps_ubx_received = 0;
+    }
+    gps_ubx_ck_a += byte;
+    gps_ubx_ck_b += gps_ubx_ck_a;
+
+    if (gps_ubx_state < 6) {
+        gps_ubx_state++;
+        if (gps_ubx_state == 6 && gps_ubx_length == 0) {
+            gps_ubx_state = 7;
+        }
+    } else if (gps_ubx_received == gps_ubx_length) {
+        gps_ubx_state = 7;
+    }
+}
+
+void sim_gps_init() {
+    if (sim_config.gps_stream && !(gps_stream = fopen(sim_config.gps_stream, "rb"))) {
+        perror(sim_config.gps_stream);
+        exit(2);
+    }
+
+    sim_gps.receive = gps_receive;
+    sim_serial_init(&sim_gps);
+    sim_event_init(&gps_epoch, gps_on_epoch, NULL);
+    sim_event_schedule(&gps_epoch, SIM_MS(1000));
+}
@@ -0,0 +1,598 @@
+#include "sim.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Scripted SIM800L: a 9600 baud AT command interpreter covering the commands
+ * used by the firmware, with network registration, GPRS, a single TCP
+ * connection to the simulated MQTT broker and GSM location.
+ * Latencies below are typical values observed on the bench.
+ */
+
+#define SIM800L_READY_AFTER      SIM_S(3)
+#define SIM800L_CALL_READY_AFTER SIM_S(6)
+#define SIM800L_REGISTERED_AFTER SIM_S(10)
+#define SIM800L_GPRS_AFTER       SIM_S(11) // registered to GPRS, and attached by itself
+
+#define SIM800L_REPLY_TIME     SIM_MS(10)
+#define SIM800L_PROMPT_TIME    SIM_MS(20)
+#define SIM800L_ATTACH_TIME    SIM_MS(800)
+#define SIM800L_BEARER_TIME    SIM_MS(1200)
+#define SIM800L_CIICR_TIME     SIM_MS(1000)
+#define SIM800L_CONNECT_TIME   SIM_MS(1500)
+#define SIM800L_GSMLOC_TIME    SIM_MS(2500)
+#define SIM800L_RTT            SIM_MS(400)
+#define SIM800L_ESCAPE_GUARD   SIM_MS(1000) // silence around +++
+#define SIM800L_PIPE_WAIT      SIM_MS(200) // AT+CIPCCFG WaitTm: a transparent segment goes after this idle time
+#define SIM800L_REMOTE_CLOSE   SIM_MS(200)
+
+#define SIM800L_TCP_OVERHEAD 40
+#define SIM800L_DOWNLINK_LENGTH 8 // segments from the server on their way
+
+typedef enum {
+    SIM800L_IP_INITIAL,
+    SIM800L_IP_START,
+    SIM800L_IP_GPRSACT,
+    SIM800L_IP_STATUS,
+    SIM800L_TCP_CONNECTING,
+    SIM800L_CONNECT_OK,
+    SIM800L_IP_CLOSE,
+    SIM800L_PDP_DEACT,
+} sim800l_ip_state;
+
+static const char *sim800l_ip_states[] = {
+    "IP INITIAL", "IP START", "IP GPRSACT", "IP STATUS", "TCP CONNECTING", "CONNECT OK", "TCP CLOSED", "PDP DEACT",
+};
+
+sim_serial sim_sim800l;
+
+static struct {
+    int echo;
+    int creg; // AT+CREG=1, registration changes come as +CREG: <stat>
+    int cgreg; // AT+CGREG=1, same for GPRS
+    int attached;
+    int bearer;
+    sim800l_ip_state ip;
+
+    char line[256];
+    size_t line_length;
+
+    int data_mode;
+    uint8_t data[1500];
+    size_t data_length;
+    size_t data_expected; // with AT+CIPSEND=<length>, 0 if ended by ctrl+z
+
+    int head; // AT+CIPHEAD=1, the data received comes after +IPD,<length>:
+    int quick_send; // AT+CIPQSEND=1, DATA ACCEPT instead of SEND OK
+
+    int transparent; // AT+CIPMODE=1
+    int pipe; // in the data mode of the transparent connection
+    int pluses; // of a possible +++ escape, held back meanwhile
+    sim_time last_byte; // when the last byte came from the MCU
+    sim_event pipe_event; // sends the data piped so far, or escapes once +++ is followed by silence
+
+    // the answers of the server, a ring: they reach the modem a round trip after their send,
+    // while the modem keeps answering commands meanwhile
+    struct {
+        uint8_t data[64];
+        size_t length;
+        sim_time at;
+    } downlink[SIM800L_DOWNLINK_LENGTH];
+    size_t downlink_head, downlink_count;
+    sim_event downlink_event;
+
+    sim_event tcp_event;
+    sim800l_ip_state tcp_next;
+
+    sim_event outage_event;
+    sim_event power_up_event;
+    int power_up; // URCs sent so far
+    sim_event register_event;
+    sim_event gprs_event;
+    sim_event urc_event;
+    unsigned long urcs; // sent so far, see --urcs
+} modem;
+
+static void sim800l_send(const char *text, sim_time delay) {
+    sim_serial_send_string(&sim_sim800l, text, delay);
+}
+
+/* Sends "\r\n<line>\r\n" */
+static void sim800l_line(const char *line, sim_time delay) {
+    char buffer[300];
+
+    snprintf(buffer, sizeof(buffer), "\r\n%s\r\n", line);
+    sim800l_send(buffer, delay);
+}
+
+static int sim800l_registered() {
+    return sim_now >= SIM800L_REGISTERED_AFTER;
+}
+
+static int sim800l_gprs_registered() {
+    return sim_now >= SIM800L_GPRS_AFTER;
+}
+
+/* Whether the broker can't be reached, see --outage */
+static int sim800l_outage() {
+    return sim_now >= sim_config.outage_from && sim_now < sim_config.outage_to;
+}
+
+// ***************************************************************** TCP
+
+static void sim800l_downlink_clear() {
+    sim_event_cancel(&modem.downlink_event);
+    modem.downlink_count = 0;
+}
+
+static void sim800l_pipe_end() {
+    modem.pipe = 0;
+    modem.pluses = 0;
+    sim_event_cancel(&modem.pipe_event);
+}
+
+static void sim800l_on_tcp_event(void *context) {
+    (void) context;
+
+    modem.ip = modem.tcp_next;
+    if (modem.ip == SIM800L_CONNECT_OK && sim800l_outage()) {
+        modem.ip = SIM800L_IP_CLOSE;
+        sim800l_line("CONNECT FAIL", 0);
+    } else if (modem.ip == SIM800L_CONNECT_OK) {
+        sim_broker_connect();
+        sim_statistics.gprs_segments += 3;
+        sim800l_line(modem.transparent ? "CONNECT" : "CONNECT OK", 0);
+        if (modem.transparent) {
+            modem.pipe = 1;
+            modem.data_length = 0;
+        }
+    } else if (modem.ip == SIM800L_IP_CLOSE) {
+        sim_broker_disconnect();
+        sim800l_downlink_clear();
+        sim800l_pipe_end();
+        sim800l_line("CLOSED", 0);
+    }
+}
+
+static void sim800l_tcp_later(sim800l_ip_state state, sim_time delay) {
+    modem.tcp_next = state;
+    sim_event_schedule(&modem.tcp_event, sim_now + delay);
+}
+
+/* The outage starts: the network drops the PDP context, and the connection with it */
+static void sim800l_on_outage(void *context) {
+    (void) context;
+
+    if (modem.ip == SIM800L_CONNECT_OK || modem.ip == SIM800L_TCP_CONNECTING) {
+        sim_event_cancel(&modem.tcp_event);
+        sim_broker_disconnect();
+        sim800l_downlink_clear();
+        sim800l_pipe_end();
+        sim800l_line(modem.ip == SIM800L_CONNECT_OK ? "CLOSED" : "CONNECT FAIL", 0);
+        modem.ip = SIM800L_IP_CLOSE;
+    }
+    if (modem.ip >= SIM800L_IP_GPRSACT) {
+        modem.ip = SIM800L_PDP_DEACT;
+        sim800l_line("+PDP: DEACT", 0);
+    }
+}
+
+/* At a fixed baud rate, the modem tells it's up */
+static void sim800l_on_power_up(void *context) {
+    (void) context;
+
+    if (modem.power_up++ == 0) {
+        sim800l_line("RDY", 0);
+        sim800l_line("+CFUN: 1", 0);
+        sim800l_line("+CPIN: READY", 0);
+        sim_event_schedule(&modem.power_up_event, SIM800L_CALL_READY_AFTER);
+    } else {
+        sim800l_line("Call Ready", 0);
+        sim800l_line("SMS Ready", 0);
+    }
+}
+
+static void sim800l_on_register(void *context) {
+    (void) context;
+
+    if (modem.creg) {
+        sim800l_line("+CREG: 1", 0);
+    }
+}
+
+static void sim800l_on_gprs(void *context) {
+    (void) context;
+
+    modem.attached = 1;
+    if (modem.cgreg) {
+        sim800l_line("+CGREG: 1", 0);
+    }
+}
+
+/* Unsolicited result codes of no consequence, see --urcs: the firmware must take them wherever they come */
+static void sim800l_on_urc(void *context) {
+    static const char *urcs[] = { "RING", "+CREG: 1", "UNDER-VOLTAGE WARNNING" };
+    (void) context;
+
+    if (!modem.pipe && (modem.creg || modem.urcs % 3 != 1)) {
+        sim800l_line(urcs[modem.urcs % 3], 0);
+    }
+    modem.urcs++;
+    sim_event_schedule(&modem.urc_event, sim_now + sim_config.urc_interval);
+}
+
+static void sim800l_on_downlink(void *context) {
+    char header[24];
+    size_t i;
+    (void) context;
+
+    i = modem.downlink_head;
+    if (modem.transparent && !modem.pipe) {
+        return; // held until ATO
+    }
+    if (modem.head && !modem.transparent) {
+        snprintf(header, sizeof(header), "\r\n+IPD,%zu:", modem.downlink[i].length);
+        sim800l_send(header, 0);
+    }
+    sim_serial_send(&sim_sim800l, modem.downlink[i].data, modem.downlink[i].length, 0);
+
+    modem.downlink_head = (i + 1) % SIM800L_DOWNLINK_LENGTH;
+    if (--modem.downlink_count) {
+        sim_event_schedule(&modem.downlink_event, modem.downlink[modem.downlink_head].at);
+    }
+}
+
+/* A segment to the server, and its answer on the way back */
+static void sim800l_tcp_segment(const uint8_t *data, size_t length) {
+    uint8_t answer[64];
+    size_t i, n;
+
+    sim_statistics.gprs_up_bytes += length + SIM800L_TCP_OVERHEAD;
+    sim_statistics.gprs_segments++;
+
+    n = sim_broker_receive(data, length, answer, sizeof(answer));
+    if (n && modem.downlink_count < SIM800L_DOWNLINK_LENGTH) {
+        sim_statistics.gprs_down_bytes += n + SIM800L_TCP_OVERHEAD;
+        sim_statistics.gprs_segments++;
+        i = (modem.downlink_head + modem.downlink_count) % SIM800L_DOWNLINK_LENGTH;
+        memcpy(modem.downlink[i].data, answer, n);
+        modem.downlink[i].length = n;
+        modem.downlink[i].at = sim_now + SIM800L_RTT + SIM800L_RTT / 4;
+        if (modem.downlink_count++ == 0) {
+            sim_event_schedule(&modem.downlink_event, modem.downlink[i].at);
+        }
+    }
+    if (!sim_broker_connected()) {
+        sim800l_tcp_later(SIM800L_IP_CLOSE, SIM800L_RTT + SIM800L_REMOTE_CLOSE);
+    } else if (sim_broker_keep_alive()) {
+        sim800l_tcp_later(SIM800L_IP_CLOSE, SIM800L_RTT + sim_broker_keep_alive());
+    }
+}
+
+static void sim800l_tcp_send(const uint8_t *data, size_t length) {
+    char line[32];
+
+    if (modem.quick_send) {
+        snprintf(line, sizeof(line), "DATA ACCEPT:%zu", length);
+        sim800l_line(line, SIM800L_REPLY_TIME);
+    } else {
+        sim800l_line("SEND OK", SIM800L_RTT);
+    }
+    sim800l_tcp_segment(data, length);
+}
+
+static void sim800l_on_pipe_event(void *context) {
+    (void) context;
+
+    if (modem.pluses == 3) {
+        // +++ between two silences: back to command mode, the connection stays up
+        modem.pipe = 0;
+        modem.pluses = 0;
+        sim800l_line("OK", 0);
+    }
+    if (modem.data_length) {
+        sim800l_tcp_segment(modem.data, modem.data_length);
+        modem.data_length = 0;
+    }
+}
+
+static void sim800l_pipe_byte(uint8_t byte) {
+    if (modem.data_length < sizeof(modem.data)) {
+        modem.data[modem.data_length++] = byte;
+    }
+}
+
+/* A byte in data mode: piped to the server, unless it may be part of +++ */
+static void sim800l_on_pipe(uint8_t byte) {
+    int i;
+
+    if (byte == '+' && modem.pluses < 3 && (modem.pluses || sim_now - modem.last_byte >= SIM800L_ESCAPE_GUARD)) {
+        modem.pluses++;
+    } else {
+        for (i = 0; i < modem.pluses; i++) {
+            sim800l_pipe_byte('+');
+        }
+        modem.pluses = 0;
+        sim800l_pipe_byte(byte);
+    }
+    modem.last_byte = sim_now;
+
+    sim_event_schedule(&modem.pipe_event, sim_now + (modem.pluses == 3 ? SIM800L_ESCAPE_GUARD : SIM800L_PIPE_WAIT));
+}
+
+// ***************************************************************** Commands
+
+static void sim800l_ok() {
+    sim800l_line("OK", SIM800L_REPLY_TIME);
+}
+
+static void sim800l_error() {
+    sim800l_line("ERROR", SIM800L_REPLY_TIME);
+}
+
+static void sim800l_execute(const char *command) {
+    char buffer[128];
+
+    sim_statistics.at_commands++;
+
+    if (!strcmp(command, "")) {
+        sim800l_ok();
+    } else if (!strcmp(command, "Z")) {
+        modem.echo = 1;
+        modem.creg = 0;
+        modem.cgreg = 0;
+        sim800l_ok();
+    } else if (!strcmp(command, "E0")) {
+        modem.echo = 0;
+        sim800l_ok();
+    } else if (!strcmp(command, "E1")) {
+        modem.echo = 1;
+        sim800l_ok();
+    } else if (!strncmp(command, "+CIPHEAD=", 9)) {
+        modem.head = atoi(&command[9]);
+        sim800l_ok();
+    } else if (!strncmp(command, "+CIPMODE=", 9)) {
+        if (modem.ip == SIM800L_IP_INITIAL) {
+            modem.transparent = atoi(&command[9]);
+            sim800l_ok();
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "O")) {
+        if (modem.transparent && modem.ip == SIM800L_CONNECT_OK) {
+            sim800l_line("CONNECT", SIM800L_REPLY_TIME);
+            modem.pipe = 1;
+            modem.data_length = 0;
+            if (modem.downlink_count) {
+                sim_event_schedule(&modem.downlink_event, sim_now + SIM800L_REPLY_TIME);
+            }
+        } else {
+            sim800l_line("NO CARRIER", SIM800L_REPLY_TIME);
+        }
+    } else if (!strncmp(command, "+CIPQSEND=", 10)) {
+        modem.quick_send = atoi(&command[10]);
+        sim800l_ok();
+    } else if (!strncmp(command, "+CMEE=", 6) || !strncmp(command, "+CIPSPRT=", 9) || !strncmp(command, "+CIPMUX=", 8)) {
+        sim800l_ok();
+    } else if (!strncmp(command, "+CREG=", 6)) {
+        modem.creg = atoi(&command[6]);
+        sim800l_ok();
+    } else if (!strcmp(command, "+CREG?")) {
+        snprintf(buffer, sizeof(buffer), "+CREG: %d,%d", modem.creg, sim800l_registered() ? 1 : 2);
+        sim800l_line(buffer, SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else if (!strncmp(command, "+CGREG=", 7)) {
+        modem.cgreg = atoi(&command[7]);
+        sim800l_ok();
+    } else if (!strcmp(command, "+CGREG?")) {
+        snprintf(buffer, sizeof(buffer), "+CGREG: %d,%d", modem.cgreg, sim800l_gprs_registered() ? 1 : 2);
+        sim800l_line(buffer, SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else if (!strcmp(command, "H")) {
+        sim800l_ok();
+    } else if (!strcmp(command, "+CSQ")) {
+        sim800l_line("+CSQ: 18,0", SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else if (!strcmp(command, "+CGATT=1")) {
+        if (modem.attached) {
+            sim800l_ok();
+        } else if (sim800l_registered()) {
+            modem.attached = 1;
+            sim800l_line("OK", SIM800L_ATTACH_TIME);
+        } else {
+            sim800l_line("ERROR", SIM800L_ATTACH_TIME);
+        }
+    } else if (!strcmp(command, "+CGSN")) {
+        sim800l_line("869170031234567", SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else if (!strcmp(command, "+SAPBR=0,1")) {
+        if (modem.bearer) {
+            modem.bearer = 0;
+            sim800l_ok();
+        } else {
+            sim800l_error();
+        }
+    } else if (!strncmp(command, "+SAPBR=3,1,", 11)) {
+        sim800l_ok();
+    } else if (!strcmp(command, "+SAPBR=1,1")) {
+        if (modem.attached) {
+            modem.bearer = 1;
+            sim800l_line("OK", SIM800L_BEARER_TIME);
+        } else {
+            sim800l_line("ERROR", SIM800L_BEARER_TIME);
+        }
+    } else if (!strcmp(command, "+SAPBR=2,1")) {
+        sim800l_line(modem.bearer ? "+SAPBR: 1,1,\"10.64.12.7\"" : "+SAPBR: 1,3,\"0.0.0.0\"", SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else if (!strcmp(command, "+CIPSHUT")) {
+        sim_event_cancel(&modem.tcp_event);
+        sim_broker_disconnect();
+        sim800l_downlink_clear();
+        modem.ip = SIM800L_IP_INITIAL;
+        sim800l_line("SHUT OK", SIM800L_REPLY_TIME);
+    } else if (!strncmp(command, "+CSTT=", 6)) {
+        if (modem.ip == SIM800L_IP_INITIAL) {
+            modem.ip = SIM800L_IP_START;
+            sim800l_ok();
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIICR")) {
+        if (modem.ip == SIM800L_IP_START && modem.attached && sim800l_outage()) {
+            sim800l_line("ERROR", SIM800L_CIICR_TIME);
+        } else if (modem.ip == SIM800L_IP_START && modem.attached) {
+            modem.ip = SIM800L_IP_GPRSACT;
+            sim800l_line("OK", SIM800L_CIICR_TIME);
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIFSR")) {
+        if (modem.ip >= SIM800L_IP_GPRSACT && modem.ip != SIM800L_PDP_DEACT) {
+            if (modem.ip == SIM800L_IP_GPRSACT) {
+                modem.ip = SIM800L_IP_STATUS;
+            }
+            sim800l_line("10.64.12.8", SIM800L_REPLY_TIME);
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIPSTATUS")) {
+        sim800l_ok();
+        snprintf(buffer, sizeof(buffer), "STATE: %s", sim800l_ip_states[modem.ip]);
+        sim800l_line(buffer, 0);
+    } else if (!strncmp(command, "+CIPSTART=", 10)) {
+        if (modem.ip == SIM800L_IP_STATUS || modem.ip == SIM800L_IP_CLOSE) {
+            sim_statistics.tcp_connections++;
+            modem.ip = SIM800L_TCP_CONNECTING;
+            sim800l_ok();
+            sim800l_tcp_later(SIM800L_CONNECT_OK, SIM800L_CONNECT_TIME);
+        } else if (modem.ip == SIM800L_CONNECT_OK) {
+            sim800l_line("ALREADY CONNECT", SIM800L_REPLY_TIME);
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIPCLOSE")) {
+        if (modem.ip == SIM800L_CONNECT_OK || modem.ip == SIM800L_TCP_CONNECTING) {
+            sim_event_cancel(&modem.tcp_event);
+            sim_broker_disconnect();
+            sim800l_downlink_clear();
+            modem.ip = SIM800L_IP_CLOSE;
+            sim800l_line("CLOSE OK", SIM800L_REPLY_TIME);
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIPSEND") || !strncmp(command, "+CIPSEND=", 9)) {
+        modem.data_expected = command[8] == '=' ? (size_t) atoi(&command[9]) : 0;
+        if (modem.ip == SIM800L_CONNECT_OK && !modem.transparent && modem.data_expected <= sizeof(modem.data)) {
+            modem.data_mode = 1;
+            modem.data_length = 0;
+            sim800l_send("\r\n> ", SIM800L_PROMPT_TIME);
+        } else {
+            sim800l_error();
+        }
+    } else if (!strcmp(command, "+CIPGSMLOC=1,1")) {
+        sim800l_line(modem.bearer ? "+CIPGSMLOC: 0,9.190345,45.464664,2026/10/17,08:00:00" : "+CIPGSMLOC: 601",
+                     modem.bearer ? SIM800L_GSMLOC_TIME : SIM800L_REPLY_TIME);
+        sim800l_ok();
+    } else {
+        sim800l_error();
+    }
+}
+
+// ***************************************************************** Receiver
+
+static void sim800l_on_data(uint8_t byte) {
+    if (modem.data_expected) {
+        // binary safe: the length ends the data
+        modem.data[modem.data_length++] = byte;
+        if (modem.data_length == modem.data_expected) {
+            modem.data_mode = 0;
+            sim800l_tcp_send(modem.data, modem.data_length);
+        }
+        return;
+    }
+
+    switch (byte) {
+    case 0x1A: // ctrl+z sends
+        modem.data_mode = 0;
+        sim800l_tcp_send(modem.data, modem.data_length);
+        break;
+    case 0x1B: // esc cancels
+        modem.data_mode = 0;
+        break;
+    default:
+        if (modem.data_length < sizeof(modem.data)) {
+            modem.data[modem.data_length++] = byte;
+        }
+        break;
+    }
+}
+
+static void sim800l_receive(uint8_t byte) {
+    char *command;
+    size_t i;
+
+    if (sim_now < SIM800L_READY_AFTER) {
+        return;
+    }
+    if (modem.data_mode) {
+        sim800l_on_data(byte);
+        return;
+    }
+    if (modem.pipe) {
+        sim800l_on_pipe(byte);
+        return;
+    }
+
+    if (modem.echo && byte != 0x1B) {
+        sim_serial_send(&sim_sim800l, &byte, 1, 0);
+    }
+
+    if (byte == '\r') {
+        modem.line[modem.line_length] = '\0';
+        modem.line_length = 0;
+
+        command = modem.line;
+        if (toupper((unsigned char) command[0]) != 'A' || toupper((unsigned char) command[1]) != 'T') {
+            return;
+        }
+        command += 2;
+        for (i = 0; command[i] && command[i] != '"'; i++) {
+            command[i] = (char) toupper((unsigned char) command[i]);
+        }
+        sim800l_execute(command);
+    } else if (byte >= 0x20 && byte < 0x7F && modem.line_length < sizeof(modem.line) - 1) {
+        modem.line[modem.line_length++] = (char) byte;
+    }
+}
+
+void sim_sim800l_init() {
+    sim_sim800l.name = "sim800l";
+    sim_sim800l.endpoint = SIM_ENDPOINT_MODEM;
+    sim_sim800l.baud = 9600;
+    sim_sim800l.receive = sim800l_receive;
+    sim_serial_init(&sim_sim800l);
+
+    memset(&modem, 0, sizeof(modem));
+    modem.echo = 1;
+    modem.ip = SIM800L_IP_INITIAL;
+    sim_event_init(&modem.tcp_event, sim800l_on_tcp_event, NULL);
+    sim_event_init(&modem.downlink_event, sim800l_on_downlink, NULL);
+    sim_event_init(&modem.pipe_event, sim800l_on_pipe_event, NULL);
+    sim_event_init(&modem.outage_event, sim800l_on_outage, NULL);
+    sim_event_init(&modem.power_up_event, sim800l_on_power_up, NULL);
+    sim_event_init(&modem.register_event, sim800l_on_register, NULL);
+    sim_event_init(&modem.gprs_event, sim800l_on_gprs, NULL);
+    sim_event_schedule(&modem.power_up_event, SIM800L_READY_AFTER);
+    sim_event_schedule(&modem.register_event, SIM800L_REGISTERED_AFTER);
+    sim_event_schedule(&modem.gprs_event, SIM800L_GPRS_AFTER);
+    sim_event_init(&modem.urc_event, sim800l_on_urc, NULL);
+    if (sim_config.outage_to) {
+        sim_event_schedule(&modem.outage_event, sim_config.outage_from);
+    }
+    if (sim_config.urc_interval) {
+        sim_event_schedule(&modem.urc_event, SIM800L_READY_AFTER + sim_config.urc_interval);
+    }
+}
@@ -0,0 +1,323 @@
+#include "sim.h"
+
+#include <string.h>
+
+/*
+ * Sensirion SPS30 on its SHDLC UART interface (115200 baud).
+ * MOSI frame: 0x7E ADR CMD L DATA... CHK 0x7E
+ * MISO frame: 0x7E ADR CMD STATE L DATA... CHK 0x7E
+ * with 0x7E, 0x7D, 0x11 and 0x13 byte-stuffed as 0x7D, byte ^ 0x20.
+ */
+
+#define SPS30_RESPONSE_TIME SIM_MS(20)
+
+#define SPS30_STATE_OK               0x00
+#define SPS30_STATE_WRONG_LENGTH     0x01
+#define SPS30_STATE_UNKNOWN_COMMAND  0x02
+#define SPS30_STATE_ILLEGAL_PARAM    0x04
+#define SPS30_STATE_NOT_ALLOWED      0x43
+
+typedef enum {
+    SPS30_MODE_IDLE,
+    SPS30_MODE_MEASURING,
+    SPS30_MODE_SLEEP,
+} sps30_mode;
+
+sim_serial sim_sps30;
+
+static struct {
+    sps30_mode mode;
+    uint8_t format;
+    sim_time measuring_since;
+    sim_time measuring; // before measuring_since
+    sim_time last_read;
+    sim_time woken_at;
+
+    uint8_t frame[64];
+    size_t length;
+    int in_frame, escaped;
+
+    uint32_t cleaning_interval;
+    uint32_t seed;
+} sps30;
+
+static void sps30_send_frame(uint8_t command, uint8_t state, const uint8_t *data, uint8_t length) {
+    uint8_t raw[5 + 255], stuffed[2 * sizeof(raw)];
+    size_t i, n, m;
+    uint8_t checksum;
+
+    n = 0;
+    raw[n++] = 0x00;
+    raw[n++] = command;
+    raw[n++] = state;
+    raw[n++] = length;
+    if (length) {
+        memcpy(&raw[n], data, length);
+        n += length;
+    }
+
+    checksum = 0;
+    for (i = 0; i < n; i++) {
+        checksum += raw[i];
+    }
+    raw[n++] = (uint8_t) ~checksum;
+
+    m = 0;
+    stuffed[m++] = 0x7E;
+    for (i = 0; i < n; i++) {
+        if (raw[i] == 0x7E || raw[i] == 0x7D || raw[i] == 0x11 || raw[i] == 0x13) {
+            stuffed[m++] = 0x7D;
+            stuffed[m++] = raw[i] ^ 0x20;
+        } else {
+            stuffed[m++] = raw[i];
+        }
+    }
+    stuffed[m++] = 0x7E;
+
+    sim_serial_send(&sim_sps30, stuffed, m, SPS30_RESPONSE_TIME);
+}
+
+static void sps30_put_float(uint8_t *data, float value) {
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    data[0] = (uint8_t) (bits >> 24);
+    data[1] = (uint8_t) (bits >> 16);
+    data[2] = (uint8_t) (bits >> 8);
+    data[3] = (uint8_t) bits;
+}
+
+static void sps30_put_u16(uint8_t *data, uint16_t value) {
+    data[0] = (uint8_t) (value >> 8);
+    data[1] = (uint8_t) value;
+}
+
+static uint8_t sps30_measured_values(uint8_t *data) {
+    float values[10];
+    float base;
+    int i;
+
+    sps30.seed = sps30.seed * 1103515245 + 12345;
+    base = 8.0f + (float) ((sps30.seed >> 16) % 400) / 100.0f;
+
+    values[0] = base * 0.80f; // mass PM1.0
+    values[1] = base;         // mass PM2.5
+    values[2] = base * 1.10f; // mass PM4.0
+    values[3] = base * 1.15f; // mass PM10
+    values[4] = base * 5.0f;  // number PM0.5
+    values[5] = base * 6.0f;  // number PM1.0
+    values[6] = base * 6.2f;  // number PM2.5
+    values[7] = base * 6.3f;  // number PM4.0
+    values[8] = base * 6.3f;  // number PM10
+    values[9] = 0.54f;        // typical particle size
+
+    if (sps30.format == 0x05) {
+        for (i = 0; i < 10; i++) {
+            sps30_put_u16(&data[2 * i], (uint16_t) (i == 9 ? values[i] * 1000.0f : values[i]));
+        }
+        return 20;
+    }
+    for (i = 0; i < 10; i++) {
+        sps30_put_float(&data[4 * i], values[i]);
+    }
+    return 40;
+}
+
+static void sps30_execute(uint8_t command, const uint8_t *data, uint8_t length) {
+    static const char product_type[] = "00080000";
+    static const char serial_number[] = "4F1B2A3C5D6E7F80";
+    uint8_t answer[64];
+    uint8_t n;
+
+    switch (command) {
+    case 0x00: // start measurement
+        if (length != 2 || data[0] != 0x01 || (data[1] != 0x03 && data[1] != 0x05)) {
+            sps30_send_frame(command, SPS30_STATE_ILLEGAL_PARAM, NULL, 0);
+        } else if (sps30.mode != SPS30_MODE_IDLE) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else {
+            sps30.mode = SPS30_MODE_MEASURING;
+            sps30.format = data[1];
+            sps30.measuring_since = sim_now;
+            sps30.last_read = sim_now;
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        }
+        break;
+
+    case 0x01: // stop measurement
+        if (sps30.mode != SPS30_MODE_MEASURING) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else {
+            sps30.mode = SPS30_MODE_IDLE;
+            sps30.measuring += sim_now - sps30.measuring_since;
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        }
+        break;
+
+    case 0x03: // read measured values, empty if there's no new measurement since the last read
+        if (sps30.mode != SPS30_MODE_MEASURING) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else if (sim_now - sps30.last_read < SIM_S(1)) {
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        } else {
+            sps30.last_read = sim_now;
+            n = sps30_measured_values(answer);
+            sps30_send_frame(command, SPS30_STATE_OK, answer, n);
+        }
+        break;
+
+    case 0x10: // sleep
+        if (sps30.mode != SPS30_MODE_IDLE) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else {
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+            sps30.mode = SPS30_MODE_SLEEP;
+        }
+        break;
+
+    case 0x11: // wake-up
+        if (sps30.mode != SPS30_MODE_SLEEP) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else {
+            sps30.mode = SPS30_MODE_IDLE;
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        }
+        break;
+
+    case 0x56: // start fan cleaning
+        if (sps30.mode != SPS30_MODE_MEASURING) {
+            sps30_send_frame(command, SPS30_STATE_NOT_ALLOWED, NULL, 0);
+        } else {
+            sim_statistics.sps30_cleanings++;
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        }
+        break;
+
+    case 0x80: // read/write auto cleaning interval
+        if (length == 1) {
+            answer[0] = (uint8_t) (sps30.cleaning_interval >> 24);
+            answer[1] = (uint8_t) (sps30.cleaning_interval >> 16);
+            answer[2] = (uint8_t) (sps30.cleaning_interval >> 8);
+            answer[3] = (uint8_t) sps30.cleaning_interval;
+            sps30_send_frame(command, SPS30_STATE_OK, answer, 4);
+        } else if (length == 5) {
+            sps30.cleaning_interval = ((uint32_t) data[1] << 24) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 8) | data[4];
+            sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        } else {
+            sps30_send_frame(command, SPS30_STATE_WRONG_LENGTH, NULL, 0);
+        }
+        break;
+
+    case 0xD0: // device information
+        if (length != 1) {
+            sps30_send_frame(command, SPS30_STATE_WRONG_LENGTH, NULL, 0);
+        } else if (data[0] == 0x00) {
+            sps30_send_frame(command, SPS30_STATE_OK, (const uint8_t *) product_type, sizeof(product_type));
+        } else if (data[0] == 0x03) {
+            sps30_send_frame(command, SPS30_STATE_OK, (const uint8_t *) serial_number, sizeof(serial_number));
+        } else {
+            sps30_send_frame(command, SPS30_STATE_ILLEGAL_PARAM, NULL, 0);
+        }
+        break;
+
+    case 0xD1: // read version: firmware 2.2, hardware 7, SHDLC 2.0
+        answer[0] = 2;
+        answer[1] = 2;
+        answer[2] = 0;
+        answer[3] = 7;
+        answer[4] = 0;
+        answer[5] = 2;
+        answer[6] = 0;
+        sps30_send_frame(command, SPS30_STATE_OK, answer, 7);
+        break;
+
+    case 0xD2: // read device status register
+        memset(answer, 0, 5);
+        sps30_send_frame(command, SPS30_STATE_OK, answer, 5);
+        break;
+
+    case 0xD3: // device reset
+        sps30_send_frame(command, SPS30_STATE_OK, NULL, 0);
+        if (sps30.mode == SPS30_MODE_MEASURING) {
+            sps30.measuring += sim_now - sps30.measuring_since;
+        }
+        sps30.mode = SPS30_MODE_IDLE;
+        break;
+
+    default:
+        sps30_send_frame(command, SPS30_STATE_UNKNOWN_COMMAND, NULL, 0);
+        break;
+    }
+}
+
+static void sps30_on_frame() {
+    uint8_t checksum;
+    size_t i;
+
+    if (sps30.length < 4 || sps30.frame[2] != sps30.length - 4) {
+        return; // malformed frames are ignored
+    }
+    checksum = 0;
+    for (i = 0; i < sps30.length - 1; i++) {
+        checksum += sps30.frame[i];
+    }
+    if ((uint8_t) ~checksum != sps30.frame[sps30.length - 1]) {
+        return;
+    }
+
+    if (sps30.mode == SPS30_MODE_SLEEP && (sps30.frame[1] != 0x11 || sim_now - sps30.woken_at > SIM_MS(100))) {
+        return; // sleeping: only a wake-up command, right after the wake-up pulse, is understood
+    }
+    sps30_execute(sps30.frame[1], &sps30.frame[3], sps30.frame[2]);
+}
+
+static void sps30_receive(uint8_t byte) {
+    if (sps30.mode == SPS30_MODE_SLEEP && !sps30.in_frame && byte != 0x7E) {
+        // any low pulse on RX activates the UART interface
+        sps30.woken_at = sim_now;
+        return;
+    }
+
+    if (byte == 0x7E) {
+        if (sps30.in_frame && sps30.length > 0) {
+            sps30_on_frame();
+            sps30.in_frame = 0;
+        } else {
+            sps30.in_frame = 1;
+        }
+        sps30.length = 0;
+        sps30.escaped = 0;
+        return;
+    }
+    if (!sps30.in_frame) {
+        return;
+    }
+    if (byte == 0x7D) {
+        sps30.escaped = 1;
+        return;
+    }
+    if (sps30.escaped) {
+        byte ^= 0x20;
+        sps30.escaped = 0;
+    }
+    if (sps30.length < sizeof(sps30.frame)) {
+        sps30.frame[sps30.length++] = byte;
+    }
+}
+
+sim_time sim_sps30_measuring() {
+    return sps30.measuring + (sps30.mode == SPS30_MODE_MEASURING ? sim_now - sps30.measuring_since : 0);
+}
+
+void sim_sps30_init() {
+    sim_sps30.name = "sps30";
+    sim_sps30.endpoint = SIM_ENDPOINT_SPS30;
+    sim_sps30.baud = 115200;
+    sim_sps30.receive = sps30_receive;
+    sim_serial_init(&sim_sps30);
+
+    memset(&sps30, 0, sizeof(sps30));
+    sps30.mode = SPS30_MODE_IDLE;
+    sps30.cleaning_interval = 604800;
+    sps30.seed = 7;
+}
@@ -0,0 +1,383 @@
+#ifndef SIM_MSP430_H_
+#define SIM_MSP430_H_
+
+/*
+ * Host replacement for TI's <msp430.h>.
+ * Every peripheral register used by the firmware lives in a simulated 4KB
+ * peripheral space and is reached through sim_sfr8()/sim_sfr16(), so the
+ * simulator can observe accesses (TXBUF writes, RXBUF reads, TAxR reads...)
+ * and keep its peripheral models in sync.
+ */
+
+#include <stdint.h>
+
+#define __MSP430F5529__
+
+volatile uint8_t *sim_sfr8(uint16_t address);
+volatile uint16_t *sim_sfr16(uint16_t address);
+
+#define SFR_8BIT(address)  (*sim_sfr8(address))
+#define SFR_16BIT(address) (*sim_sfr16(address))
+
+/* Used by uart.h: routes USCI accesses through the simulated register file */
+#define UART_REGISTER(module, offset) SFR_8BIT((module) + (offset))
+
+/************************************************************
+* STANDARD BITS
+************************************************************/
+
+#define BIT0 (0x0001)
+#define BIT1 (0x0002)
+#define BIT2 (0x0004)
+#define BIT3 (0x0008)
+#define BIT4 (0x0010)
+#define BIT5 (0x0020)
+#define BIT6 (0x0040)
+#define BIT7 (0x0080)
+#define BIT8 (0x0100)
+#define BIT9 (0x0200)
+#define BITA (0x0400)
+#define BITB (0x0800)
+#define BITC (0x1000)
+#define BITD (0x2000)
+#define BITE (0x4000)
+#define BITF (0x8000)
+
+/************************************************************
+* STATUS REGISTER BITS
+************************************************************/
+
+#define C      (0x0001)
+#define Z      (0x0002)
+#define N      (0x0004)
+#define V      (0x0100)
+#define GIE    (0x0008)
+#define CPUOFF (0x0010)
+#define OSCOFF (0x0020)
+#define SCG0   (0x0040)
+#define SCG1   (0x0080)
+
+#define LPM0_bits (CPUOFF)
+#define LPM1_bits (SCG0 + CPUOFF)
+#define LPM2_bits (SCG1 + CPUOFF)
+#define LPM3_bits (SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits (SCG1 + SCG0 + OSCOFF + CPUOFF)
+
+/************************************************************
+* INTRINSICS
+************************************************************/
+
+void sim_delay_cycles(unsigned long cycles);
+void sim_bis_sr(unsigned int bits);
+void sim_bic_sr(unsigned int bits);
+void sim_bic_sr_on_exit(unsigned int bits);
+void sim_bis_sr_on_exit(unsigned int bits);
+unsigned int sim_get_sr(void);
+
+#define __delay_cycles(cycles)          sim_delay_cycles(cycles)
+#define __bis_SR_register(bits)         sim_bis_sr(bits)
+#define __bic_SR_register(bits)         sim_bic_sr(bits)
+#define __bis_SR_register_on_exit(bits) sim_bis_sr_on_exit(bits)
+#define __bic_SR_register_on_exit(bits) sim_bic_sr_on_exit(bits)
+#define __get_SR_register()             sim_get_sr()
+#define __enable_interrupt()            sim_bis_sr(GIE)
+#define __disable_interrupt()           sim_bic_sr(GIE)
+#define __no_operation()                ((void) 0)
+#define __even_in_range(value, bound)   (value)
+
+#define __interrupt
+
+/************************************************************
+* WATCHDOG TIMER A
+************************************************************/
+
+#define WDTCTL SFR_16BIT(0x015C)
+
+#define WDTPW   (0x5A00)
+#define WDTHOLD (0x0080)
+
+/************************************************************
+* FLASH MEMORY CONTROLLER
+************************************************************/
+
+#define FCTL1 SFR_16BIT(0x0140)
+#define FCTL3 SFR_16BIT(0x0144)
+#define FCTL4 SFR_16BIT(0x0146)
+
+#define FRKEY (0x9600)
+#define FWKEY (0xA500)
+
+/* FCTL1 */
+#define ERASE  (0x0002)
+#define MERAS  (0x0004)
+#define WRT    (0x0040)
+#define BLKWRT (0x0080)
+
+/* FCTL3 */
+#define BUSY    (0x0001)
+#define KEYV    (0x0002)
+#define ACCVIFG (0x0004)
+#define WAIT    (0x0008)
+#define LOCK    (0x0010)
+#define EMEX    (0x0020)
+#define LOCKA   (0x0040)
+
+uint8_t sim_flash_read(uint32_t address);
+void sim_flash_write(uint32_t address, uint8_t byte);
+
+/* Used by flash.h: routes the flash accesses through the simulated flash */
+#define FLASH_READ(address)        sim_flash_read(address)
+#define FLASH_WRITE(address, byte) sim_flash_write(address, byte)
+
+/************************************************************
+* UNIFIED CLOCK SYSTEM
+************************************************************/
+
+#define UCSCTL0 SFR_16BIT(0x0160)
+#define UCSCTL1 SFR_16BIT(0x0162)
+#define UCSCTL2 SFR_16BIT(0x0164)
+#define UCSCTL3 SFR_16BIT(0x0166)
+#define UCSCTL4 SFR_16BIT(0x0168)
+#define UCSCTL5 SFR_16BIT(0x016A)
+#define UCSCTL6 SFR_16BIT(0x016C)
+#define UCSCTL7 SFR_16BIT(0x016E)
+#define UCSCTL8 SFR_16BIT(0x0170)
+
+#define SELREF_0  (0x0000)
+#define SELREF_2  (0x0020)
+#define DCORSEL_0 (0x0000)
+#define DCORSEL_5 (0x0050)
+#define FLLD_0    (0x0000)
+#define FLLD_1    (0x1000)
+
+/************************************************************
+* DIGITAL I/O PORTS
+************************************************************/
+
+#define P1IN  SFR_8BIT(0x0200)
+#define P1OUT SFR_8BIT(0x0202)
+#define P1DIR SFR_8BIT(0x0204)
+#define P1REN SFR_8BIT(0x0206)
+#define P1SEL SFR_8BIT(0x020A)
+
+#define P2IN  SFR_8BIT(0x0201)
+#define P2OUT SFR_8BIT(0x0203)
+#define P2DIR SFR_8BIT(0x0205)
+#define P2REN SFR_8BIT(0x0207)
+#define P2SEL SFR_8BIT(0x020B)
+
+#define P3IN  SFR_8BIT(0x0220)
+#define P3OUT SFR_8BIT(0x0222)
+#define P3DIR SFR_8BIT(0x0224)
+#define P3REN SFR_8BIT(0x0226)
+#define P3SEL SFR_8BIT(0x022A)
+
+#define P4IN  SFR_8BIT(0x0221)
+#define P4OUT SFR_8BIT(0x0223)
+#define P4DIR SFR_8BIT(0x0225)
+#define P4REN SFR_8BIT(0x0227)
+#define P4SEL SFR_8BIT(0x022B)
+
+/************************************************************
+* TIMER A / TIMER B
+************************************************************/
+
+#define TA0CTL   SFR_16BIT(0x0340)
+#define TA0CCTL0 SFR_16BIT(0x0342)
+#define TA0CCTL1 SFR_16BIT(0x0344)
+#define TA0CCTL2 SFR_16BIT(0x0346)
+#define TA0CCTL3 SFR_16BIT(0x0348)
+#define TA0CCTL4 SFR_16BIT(0x034A)
+#define TA0R     SFR_16BIT(0x0350)
+#define TA0CCR0  SFR_16BIT(0x0352)
+#define TA0CCR1  SFR_16BIT(0x0354)
+#define TA0CCR2  SFR_16BIT(0x0356)
+#define TA0CCR3  SFR_16BIT(0x0358)
+#define TA0CCR4  SFR_16BIT(0x035A)
+#define TA0EX0   SFR_16BIT(0x0360)
+#define TA0IV    SFR_16BIT(0x036E)
+
+#define TA1CTL   SFR_16BIT(0x0380)
+#define TA1CCTL0 SFR_16BIT(0x0382)
+#define TA1CCTL1 SFR_16BIT(0x0384)
+#define TA1CCTL2 SFR_16BIT(0x0386)
+#define TA1R     SFR_16BIT(0x0390)
+#define TA1CCR0  SFR_16BIT(0x0392)
+#define TA1CCR1  SFR_16BIT(0x0394)
+#define TA1CCR2  SFR_16BIT(0x0396)
+#define TA1EX0   SFR_16BIT(0x03A0)
+#define TA1IV    SFR_16BIT(0x03AE)
+
+#define TB0CTL   SFR_16BIT(0x03C0)
+#define TB0CCTL0 SFR_16BIT(0x03C2)
+#define TB0CCTL1 SFR_16BIT(0x03C4)
+#define TB0CCTL2 SFR_16BIT(0x03C6)
+#define TB0R     SFR_16BIT(0x03D0)
+#define TB0CCR0  SFR_16BIT(0x03D2)
+#define TB0CCR1  SFR_16BIT(0x03D4)
+#define TB0CCR2  SFR_16BIT(0x03D6)
+#define TB0EX0   SFR_16BIT(0x03E0)
+#define TB0IV    SFR_16BIT(0x03EE)
+
+/* TAxCTL / TBxCTL */
+#define TASSEL_0 (0x0000)
+#define TASSEL_1 (0x0100)
+#define TASSEL_2 (0x0200)
+#define TASSEL_3 (0x0300)
+#define TASSEL__TACLK (TASSEL_0)
+#define TASSEL__ACLK  (TASSEL_1)
+#define TASSEL__SMCLK (TASSEL_2)
+#define TASSEL__INCLK (TASSEL_3)
+
+#define ID_0 (0x0000)
+#define ID_1 (0x0040)
+#define ID_2 (0x0080)
+#define ID_3 (0x00C0)
+#define ID__1 (ID_0)
+#define ID__2 (ID_1)
+#define ID__4 (ID_2)
+#define ID__8 (ID_3)
+
+#define MC_0 (0x0000)
+#define MC_1 (0x0010)
+#define MC_2 (0x0020)
+#define MC_3 (0x0030)
+#define MC__STOP       (MC_0)
+#define MC__UP         (MC_1)
+#define MC__CONTINUOUS (MC_2)
+#define MC__CONTINOUS  (MC_2)
+#define MC__UPDOWN     (MC_3)
+
+#define TACLR (0x0004)
+#define TAIE  (0x0002)
+#define TAIFG (0x0001)
+
+#define TBSSEL_1 (0x0100)
+#define TBSSEL_2 (0x0200)
+#define TBSSEL__ACLK  (TBSSEL_1)
+#define TBSSEL__SMCLK (TBSSEL_2)
+#define TBCLR (0x0004)
+#define TBIE  (0x0002)
+#define TBIFG (0x0001)
+
+/* TAxCCTLx / TBxCCTLx */
+#define CM_0 (0x0000)
+#define CM_1 (0x4000)
+#define CM_2 (0x8000)
+#define CM_3 (0xC000)
+#define CCIS_0 (0x0000)
+#define CCIS_1 (0x1000)
+#define CCIS_2 (0x2000)
+#define CCIS_3 (0x3000)
+#define SCS   (0x0800)
+#define SCCI  (0x0400)
+#define CAP   (0x0100)
+#define CCIE  (0x0010)
+#define CCI   (0x0008)
+#define OUT   (0x0004)
+#define COV   (0x0002)
+#define CCIFG (0x0001)
+
+/* TAxIV */
+#define TA0IV_NONE    (0x0000)
+#define TA0IV_TA0CCR1 (0x0002)
+#define TA0IV_TA0CCR2 (0x0004)
+#define TA0IV_TA0CCR3 (0x0006)
+#define TA0IV_TA0CCR4 (0x0008)
+#define TA0IV_TA0IFG  (0x000E)
+#define TA1IV_NONE    (0x0000)
+#define TA1IV_TA1CCR1 (0x0002)
+#define TA1IV_TA1CCR2 (0x0004)
+#define TA1IV_TA1IFG  (0x000E)
+
+/************************************************************
+* USCI A0 / A1 (UART mode)
+************************************************************/
+
+#define UCA0CTL1  SFR_8BIT(0x05C0)
+#define UCA0CTL0  SFR_8BIT(0x05C1)
+#define UCA0BR0   SFR_8BIT(0x05C6)
+#define UCA0BR1   SFR_8BIT(0x05C7)
+#define UCA0MCTL  SFR_8BIT(0x05C8)
+#define UCA0STAT  SFR_8BIT(0x05CA)
+#define UCA0RXBUF SFR_8BIT(0x05CC)
+#define UCA0TXBUF SFR_8BIT(0x05CE)
+#define UCA0IE    SFR_8BIT(0x05DC)
+#define UCA0IFG   SFR_8BIT(0x05DD)
+#define UCA0IV    SFR_16BIT(0x05DE)
+
+#define UCA1CTL1  SFR_8BIT(0x0600)
+#define UCA1CTL0  SFR_8BIT(0x0601)
+#define UCA1BR0   SFR_8BIT(0x0606)
+#define UCA1BR1   SFR_8BIT(0x0607)
+#define UCA1MCTL  SFR_8BIT(0x0608)
+#define UCA1STAT  SFR_8BIT(0x060A)
+#define UCA1RXBUF SFR_8BIT(0x060C)
+#define UCA1TXBUF SFR_8BIT(0x060E)
+#define UCA1IE    SFR_8BIT(0x061C)
+#define UCA1IFG   SFR_8BIT(0x061D)
+#define UCA1IV    SFR_16BIT(0x061E)
+
+/* UCAxCTL0 */
+#define UCPEN  (0x80)
+#define UCPAR  (0x40)
+#define UCMSB  (0x20)
+#define UC7BIT (0x10)
+#define UCSPB  (0x08)
+#define UCMODE_0 (0x00)
+#define UCSYNC (0x01)
+
+/* UCAxCTL1 */
+#define UCSSEL_0 (0x00)
+#define UCSSEL_1 (0x40)
+#define UCSSEL_2 (0x80)
+#define UCSSEL_3 (0xC0)
+#define UCSSEL__UCLK  (UCSSEL_0)
+#define UCSSEL__ACLK  (UCSSEL_1)
+#define UCSSEL__SMCLK (UCSSEL_2)
+#define UCSWRST (0x01)
+
+/* UCAxMCTL */
+#define UCOS16 (0x01)
+#define UCBRS_0 (0x00)
+#define UCBRS_1 (0x02)
+#define UCBRS_2 (0x04)
+#define UCBRS_3 (0x06)
+#define UCBRS_4 (0x08)
+#define UCBRS_5 (0x0A)
+#define UCBRS_6 (0x0C)
+#define UCBRS_7 (0x0E)
+#define UCBRF_0 (0x00)
+#define UCBRF_1 (0x10)
+
+/* UCAxSTAT */
+#define UCBUSY (0x01)
+#define UCRXERR (0x04)
+#define UCOE   (0x20)
+#define UCFE   (0x40)
+
+/* UCAxIE / UCAxIFG */
+#define UCRXIE  (0x01)
+#define UCTXIE  (0x02)
+#define UCRXIFG (0x01)
+#define UCTXIFG (0x02)
+
+/* UCAxIV */
+#define USCI_NONE    (0x0000)
+#define USCI_UCRXIFG (0x0002)
+#define USCI_UCTXIFG (0x0004)
+
+/************************************************************
+* INTERRUPT VECTORS (only used by #pragma vector, ignored on host)
+************************************************************/
+
+#define TIMER0_B1_VECTOR (59)
+#define TIMER0_B0_VECTOR (60)
+#define USCI_A0_VECTOR   (56)
+#define TIMER0_A1_VECTOR (53)
+#define TIMER0_A0_VECTOR (54)
+#define TIMER1_A1_VECTOR (48)
+#define TIMER1_A0_VECTOR (49)
+#define USCI_A1_VECTOR   (46)
+
+#endif
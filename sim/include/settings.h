@@ -0,0 +1,12 @@
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+/*
+ * Settings used by the host simulation, the simulated SIM800L routes every
+ * TCP connection to its built-in MQTT broker regardless of the address.
+ */
+
+#define PMCU_SETTINGS_BROKER_ADDR "broker.pmcu.sim"
+#define PMCU_SETTINGS_BROKER_PORT "1883"
+
+#endif
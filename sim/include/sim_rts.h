@@ -0,0 +1,11 @@
+#ifndef SIM_RTS_H_
+#define SIM_RTS_H_
+
+/*
+ * Pieces of the TI MSP430 runtime support library that glibc doesn't provide.
+ * Force-included in every firmware translation unit of the host build.
+ */
+
+int ltoa(long value, char *buffer);
+
+#endif
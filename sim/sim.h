@@ -0,0 +1,290 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Virtual time, in picoseconds since power-up.
+ * Picoseconds keep timer ticks exact enough at 12.288MHz and still give us
+ * more than 200 days of simulated time.
+ */
+typedef uint64_t sim_time;
+
+#define SIM_PS(x) ((sim_time) (x))
+#define SIM_NS(x) ((sim_time) (x) * 1000ULL)
+#define SIM_US(x) ((sim_time) (x) * 1000000ULL)
+#define SIM_MS(x) ((sim_time) (x) * 1000000000ULL)
+#define SIM_S(x)  ((sim_time) (x) * 1000000000000ULL)
+
+#define SIM_TIME_NEVER UINT64_MAX
+
+extern sim_time sim_now;
+
+/* ***************************************************************** Events */
+
+typedef void (*sim_event_handler)(void *context);
+
+typedef struct sim_event {
+    sim_time at;
+    sim_event_handler handler;
+    void *context;
+    int queued;
+    struct sim_event *next;
+} sim_event;
+
+void sim_event_init(sim_event *event, sim_event_handler handler, void *context);
+
+void sim_event_schedule(sim_event *event, sim_time at);
+
+void sim_event_cancel(sim_event *event);
+
+/* ***************************************************************** Core */
+
+typedef enum {
+    SIM_ACTIVITY_RUNNING, // the CPU is executing (busy-waits included)
+    SIM_ACTIVITY_DELAY,   // the CPU is inside __delay_cycles()
+    SIM_ACTIVITY_SLEEP,   // the CPU is in a low power mode
+    SIM_ACTIVITIES
+} sim_activity;
+
+/* Enters/leaves the simulator, the tick signal is deferred in between */
+void sim_enter();
+void sim_leave();
+
+int sim_in_isr();
+
+/* Whether the simulator is running inside the tick signal, preempting the main context */
+int sim_preempting();
+
+/* Advances the virtual time, processing events and dispatching interrupts */
+void sim_advance(sim_time until, sim_activity activity);
+
+/* Advances up to the next pending event (busy-wait fast forward) */
+void sim_advance_to_next_event(sim_activity activity);
+
+/* Stops the simulation right away and prints the report */
+void sim_stop(const char *reason);
+
+/* Holds the CPU, as the flash controller does: interrupts wait until it is over */
+void sim_stall(sim_time duration);
+
+/* ***************************************************************** MCU */
+
+#define SIM_ACLK 32768UL
+
+typedef enum {
+    SIM_USCI_A0,
+    SIM_USCI_A1,
+    SIM_USCI_MODULES
+} sim_usci_id;
+
+void sim_mcu_reset();
+
+uint32_t sim_mcu_mclk();
+
+uint32_t sim_mcu_smclk();
+
+/* Earliest time at which a timer will raise a flag */
+sim_time sim_mcu_next_event();
+
+/* Raises the timer flags due at sim_now */
+void sim_mcu_fire();
+
+/* Commits the register writes done since the last sync, from_tick starts a new tick epoch */
+void sim_mcu_sync(int from_tick);
+
+/* Calls the ISRs of every pending and enabled interrupt (when GIE is set) */
+void sim_mcu_dispatch();
+
+int sim_mcu_gie();
+
+/* Delivers a byte, sent by a device at the given baud rate, to a USCI module */
+void sim_usci_receive(sim_usci_id id, uint8_t byte, uint32_t baud);
+
+uint32_t sim_usci_baud(sim_usci_id id);
+
+/* Latches a capture input edge of TA0 */
+void sim_ta0_capture(int ccr, int rising);
+
+/* Raw register access, without side effects */
+uint8_t sim_reg8(uint16_t address);
+uint16_t sim_reg16(uint16_t address);
+void sim_reg8_set(uint16_t address, uint8_t value);
+void sim_reg16_set(uint16_t address, uint16_t value);
+
+/* ***************************************************************** Flash */
+
+/* Erased, or loaded from the image file */
+void sim_flash_init();
+
+/* Saves to the image file, if any */
+void sim_flash_save();
+
+/* The highest erase count among the segments */
+uint32_t sim_flash_max_erases();
+
+/* ***************************************************************** UART hub */
+
+typedef enum {
+    SIM_ENDPOINT_NONE,
+    SIM_ENDPOINT_MODEM,
+    SIM_ENDPOINT_GPS,
+    SIM_ENDPOINT_SPS30,
+    SIM_ENDPOINTS
+} sim_endpoint;
+
+extern const char *sim_endpoint_names[SIM_ENDPOINTS];
+
+sim_endpoint sim_hub_endpoint();
+
+/* Called by USCI_A0 when a byte has been shifted out */
+void sim_hub_transmit(uint8_t byte, uint32_t baud);
+
+/* ***************************************************************** Serial devices */
+
+#define SIM_SERIAL_FIFO_SIZE 4096
+
+/*
+ * The transmitting side of a simulated serial device.
+ * Bytes are shifted out at the device baud rate and delivered to USCI_A0 only
+ * if the UART hub is routing the device when the stop bit is sent.
+ */
+typedef struct {
+    const char *name;
+    sim_endpoint endpoint;
+    uint32_t baud;
+    void (*receive)(uint8_t byte);
+
+    uint8_t fifo[SIM_SERIAL_FIFO_SIZE];
+    sim_time not_before[SIM_SERIAL_FIFO_SIZE];
+    size_t head, tail;
+    sim_event event;
+
+    uint64_t bytes_sent;
+    uint64_t bytes_lost;
+} sim_serial;
+
+void sim_serial_init(sim_serial *serial);
+
+/* Queues bytes to be sent, the first one not before now + delay */
+void sim_serial_send(sim_serial *serial, const void *data, size_t length, sim_time delay);
+
+void sim_serial_send_string(sim_serial *serial, const char *string, sim_time delay);
+
+void sim_serial_flush(sim_serial *serial);
+
+sim_time sim_serial_byte_time(uint32_t baud);
+
+/* ***************************************************************** Devices */
+
+extern sim_serial sim_sim800l;
+extern sim_serial sim_gps;
+extern sim_serial sim_sps30;
+
+void sim_sim800l_init();
+void sim_gps_init();
+void sim_sps30_init();
+void sim_dht22_init();
+
+/* Time the SPS30 has spent in MEASURING-MODE, fan and laser on */
+sim_time sim_sps30_measuring();
+
+/* Watches the DHT22 data line (P1.2) */
+void sim_dht22_poll();
+
+/* How an answer of the DHT22 is damaged, in turn, with --dht22-glitches */
+typedef enum {
+    SIM_DHT22_SHORT_PREAMBLE, // its low half is 40us
+    SIM_DHT22_GLITCH,         // a 4us dip within the high of a bit
+    SIM_DHT22_SPIKE,          // a dip narrower than the capture ISR: the capture overruns
+    SIM_DHT22_FAULTS
+} sim_dht22_fault;
+
+/* Console output of USCI_A1, the trace of the firmware (sim_trace.c) */
+void sim_console_receive(uint8_t byte);
+
+/* ***************************************************************** Broker */
+
+void sim_broker_connect();
+
+void sim_broker_disconnect();
+
+int sim_broker_connected();
+
+/* How long the broker waits for the next packet before dropping the client, 0 if forever */
+sim_time sim_broker_keep_alive();
+
+/* Feeds the broker with bytes sent by the client, returns the broker's answer */
+size_t sim_broker_receive(const uint8_t *data, size_t length, uint8_t *answer, size_t answer_size);
+
+/* ***************************************************************** Statistics */
+
+typedef struct {
+    sim_time time[SIM_ACTIVITIES];
+    uint64_t switches;
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+} sim_endpoint_stats;
+
+typedef struct {
+    sim_endpoint_stats endpoints[SIM_ENDPOINTS];
+
+    uint64_t console_bytes;
+    uint64_t framing_errors;
+    uint64_t overruns;
+
+    uint64_t at_commands;
+    uint64_t tcp_connections;
+    uint64_t gprs_up_bytes;
+    uint64_t gprs_down_bytes;
+    uint64_t gprs_segments;
+
+    uint64_t flash_erases;
+    uint64_t flash_writes;
+    uint64_t flash_violations;
+
+    uint64_t sps30_cleanings;
+    uint64_t dht22_damaged[SIM_DHT22_FAULTS];
+
+    uint64_t mqtt_packets;
+    uint64_t publishes;
+    uint64_t publish_duplicates;
+    uint64_t publish_payload_bytes;
+    uint64_t records_received;
+    uint64_t records_malformed;
+    sim_time first_publish;
+    sim_time last_publish;
+    sim_time min_cycle;
+    sim_time max_cycle;
+} sim_stats;
+
+extern sim_stats sim_statistics;
+
+typedef struct {
+    int quiet;
+    int wire;
+    unsigned long publishes;
+    sim_time time_limit;
+    sim_time quantum;
+    long tick_ns;
+    const char *flash_image;
+    unsigned long power_cut;
+    sim_time outage_from;
+    sim_time outage_to;
+    const char *payloads;
+    const char *console;
+    const char *gps_stream;
+    sim_time urc_interval;
+    unsigned long dht22_glitches;
+} sim_options;
+
+extern sim_options sim_config;
+
+void sim_stats_account(sim_time duration, sim_activity activity);
+
+void sim_stats_publish();
+
+void sim_stats_report();
+
+#endif
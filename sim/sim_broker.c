@@ -0,0 +1,173 @@
+#include "sim.h"
+#include "../record.h" // the reference decoder is the firmware one
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * A minimal MQTT 3.1.1 broker sitting at the other end of the simulated
+ * SIM800L TCP connection. It understands the packets the firmware sends,
+ * answers CONNACK/PUBACK/PINGRESP and accounts every PUBLISH, whose records
+ * are decoded as a subscriber would. Like a real broker, it drops a client
+ * silent for 1.5 times its keep-alive.
+ */
+
+static struct {
+    int connected;
+    unsigned int keep_alive; // s, 0 if disabled
+    uint8_t buffer[2048];
+    size_t length;
+} broker;
+
+void sim_broker_connect() {
+    broker.connected = 1;
+    broker.keep_alive = 0;
+    broker.length = 0;
+}
+
+void sim_broker_disconnect() {
+    broker.connected = 0;
+    broker.length = 0;
+}
+
+int sim_broker_connected() {
+    return broker.connected;
+}
+
+sim_time sim_broker_keep_alive() {
+    return SIM_MS((sim_time) broker.keep_alive * 1500);
+}
+
+/* Decodes the remaining length, returns the number of bytes it takes or 0 if incomplete */
+static size_t broker_remaining_length(const uint8_t *data, size_t length, size_t *value) {
+    size_t i, multiplier;
+
+    *value = 0;
+    multiplier = 1;
+    for (i = 0; i < 4 && i < length; i++) {
+        *value += (data[i] & 0x7F) * multiplier;
+        multiplier *= 128;
+        if (!(data[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* Decodes a batch of records, see record.h, and keeps it in the payload file if any */
+static void broker_records(const uint8_t *payload, size_t length) {
+    static FILE *payloads;
+    record_Sample sample, previous;
+    size_t i, pos, count, n;
+
+    if (sim_config.payloads && !payloads && !(payloads = fopen(sim_config.payloads, "w"))) {
+        perror(sim_config.payloads);
+        sim_config.payloads = NULL;
+    }
+    if (payloads) {
+        for (i = 0; i < length; i++) {
+            fprintf(payloads, "%02x", payload[i]);
+        }
+        fputc('\n', payloads);
+        fflush(payloads);
+    }
+
+    if (length < 2 || payload[0] != RECORD_VERSION) {
+        sim_statistics.records_malformed++;
+        return;
+    }
+    count = payload[1];
+    for (i = 0, pos = 2; i < count; i++, pos += 1 + n) {
+        if (pos >= length || pos + 1 + payload[pos] > length
+                || (n = record_decode(&payload[pos + 1], payload[pos], &sample, i ? &previous : NULL)) != payload[pos]) {
+            sim_statistics.records_malformed++;
+            return;
+        }
+        previous = sample;
+        sim_statistics.records_received++;
+    }
+    if (pos != length) {
+        sim_statistics.records_malformed++;
+    }
+}
+
+static size_t broker_packet(const uint8_t *packet, size_t header, size_t length, uint8_t *answer) {
+    const uint8_t *variable;
+    size_t topic_length, id_length;
+
+    sim_statistics.mqtt_packets++;
+    variable = &packet[1 + header];
+
+    switch (packet[0] >> 4) {
+    case 1: // CONNECT
+        broker.keep_alive = ((unsigned int) variable[8] << 8) | variable[9];
+        answer[0] = 0x20;
+        answer[1] = 0x02;
+        answer[2] = 0x00;
+        answer[3] = 0x00;
+        return 4;
+
+    case 3: // PUBLISH
+        topic_length = ((size_t) variable[0] << 8) | variable[1];
+        id_length = (packet[0] & 0x06) ? 2 : 0;
+        sim_statistics.publish_payload_bytes += length - (1 + header) - (2 + topic_length) - id_length;
+        if (packet[0] & 0x08) {
+            sim_statistics.publish_duplicates++;
+        } else {
+            broker_records(&variable[2 + topic_length + id_length], length - (1 + header) - (2 + topic_length) - id_length);
+        }
+        sim_stats_publish();
+        if ((packet[0] & 0x06) == 0x02) {
+            // QoS 1: acknowledges the packet identifier
+            answer[0] = 0x40;
+            answer[1] = 0x02;
+            answer[2] = variable[2 + topic_length];
+            answer[3] = variable[3 + topic_length];
+            return 4;
+        }
+        return 0;
+
+    case 12: // PINGREQ
+        answer[0] = 0xD0;
+        answer[1] = 0x00;
+        return 2;
+
+    case 14: // DISCONNECT
+        broker.connected = 0;
+        return 0;
+    }
+    return 0;
+}
+
+size_t sim_broker_receive(const uint8_t *data, size_t length, uint8_t *answer, size_t answer_size) {
+    size_t header, remaining, total, produced, consumed;
+
+    if (broker.length + length > sizeof(broker.buffer)) {
+        fprintf(stderr, "pmcu-sim: broker buffer overflow\n");
+        broker.length = 0;
+        return 0;
+    }
+    memcpy(&broker.buffer[broker.length], data, length);
+    broker.length += length;
+
+    produced = 0;
+    consumed = 0;
+    while (broker.length - consumed >= 2) {
+        header = broker_remaining_length(&broker.buffer[consumed + 1], broker.length - consumed - 1, &remaining);
+        if (!header) {
+            break;
+        }
+        total = 1 + header + remaining;
+        if (broker.length - consumed < total) {
+            break;
+        }
+        if (produced + 4 <= answer_size) {
+            produced += broker_packet(&broker.buffer[consumed], header, total, &answer[produced]);
+        }
+        consumed += total;
+    }
+    memmove(broker.buffer, &broker.buffer[consumed], broker.length - consumed);
+    broker.length -= consumed;
+
+    return produced;
+}
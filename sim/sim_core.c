@@ -0,0 +1,416 @@
+#include "sim.h"
+
+#include <msp430.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The firmware runs on the host main thread, exactly as it runs on the MCU.
+ * A periodic host signal plays the role of the passing time: every tick
+ * advances the virtual clock by one quantum, lets peripherals and devices
+ * progress and calls the firmware ISRs, preempting the main loop like real
+ * interrupts do. __delay_cycles() and low power modes skip virtual time
+ * directly, so the simulation runs much faster than real time.
+ */
+
+sim_time sim_now = 0;
+
+sim_options sim_config = {
+    .quiet = 0,
+    .wire = 0,
+    .publishes = 3,
+    .time_limit = SIM_S(900),
+    .quantum = SIM_US(250),
+    .tick_ns = 20000,
+};
+
+static sim_event *sim_events = NULL;
+
+static volatile sig_atomic_t sim_depth = 0;
+static volatile sig_atomic_t sim_tick_deferred = 0;
+static int sim_isr_depth = 0;
+static int sim_preempted = 0;
+
+static unsigned int sim_sr = 0;
+static int sim_woken = 0;
+static int sim_stalled = 0;
+
+// ***************************************************************** Events
+
+void sim_event_init(sim_event *event, sim_event_handler handler, void *context) {
+    event->at = 0;
+    event->handler = handler;
+    event->context = context;
+    event->queued = 0;
+    event->next = NULL;
+}
+
+void sim_event_schedule(sim_event *event, sim_time at) {
+    sim_event **cursor;
+
+    if (event->queued) {
+        sim_event_cancel(event);
+    }
+    event->at = at < sim_now ? sim_now : at;
+    event->queued = 1;
+
+    for (cursor = &sim_events; *cursor && (*cursor)->at <= event->at; cursor = &(*cursor)->next);
+    event->next = *cursor;
+    *cursor = event;
+}
+
+void sim_event_cancel(sim_event *event) {
+    sim_event **cursor;
+
+    if (!event->queued) {
+        return;
+    }
+    for (cursor = &sim_events; *cursor; cursor = &(*cursor)->next) {
+        if (*cursor == event) {
+            *cursor = event->next;
+            break;
+        }
+    }
+    event->queued = 0;
+    event->next = NULL;
+}
+
+static sim_time sim_next_event_time() {
+    sim_time next;
+
+    next = sim_mcu_next_event();
+    if (sim_events && sim_events->at < next) {
+        next = sim_events->at;
+    }
+    return next;
+}
+
+/* Runs everything that is due at sim_now */
+static void sim_process() {
+    sim_event *event;
+
+    sim_mcu_fire();
+
+    while (sim_events && sim_events->at <= sim_now) {
+        event = sim_events;
+        sim_events = event->next;
+        event->queued = 0;
+        event->next = NULL;
+        event->handler(event->context);
+        sim_mcu_dispatch();
+    }
+
+    sim_mcu_dispatch();
+}
+
+// ***************************************************************** Core
+
+static void sim_tick();
+static void sim_arm_tick();
+
+void sim_enter() {
+    sim_depth++;
+}
+
+/* Main context code running with interrupts disabled: a critical section, which takes no time */
+static int sim_critical() {
+    return sim_isr_depth == 0 && !(sim_sr & GIE);
+}
+
+void sim_leave() {
+    if (sim_depth == 1 && sim_tick_deferred && !sim_critical()) {
+        // a tick arrived while inside the simulator: it still preempts the caller
+        sim_tick_deferred = 0;
+        sim_preempted = !sim_in_isr();
+        sim_tick();
+        sim_preempted = 0;
+    }
+    sim_depth--;
+}
+
+int sim_in_isr() {
+    return sim_isr_depth > 0;
+}
+
+int sim_preempting() {
+    return sim_preempted;
+}
+
+void sim_advance(sim_time until, sim_activity activity) {
+    sim_time next, start;
+
+    sim_enter();
+    start = sim_now;
+
+    while (1) {
+        sim_mcu_sync(0);
+        sim_mcu_dispatch(); // interrupts enabled by the firmware since the last event
+        sim_dht22_poll();
+        next = sim_next_event_time();
+        if (next > until) {
+            break;
+        }
+        if (next > sim_now) {
+            sim_stats_account(next - sim_now, activity);
+            sim_now = next;
+        }
+        sim_process();
+    }
+
+    if (until > sim_now) {
+        sim_stats_account(until - sim_now, activity);
+        sim_now = until;
+    }
+    if (sim_now - start > 0 && sim_now >= sim_config.time_limit) {
+        sim_stop("time limit reached");
+    }
+
+    sim_leave();
+}
+
+void sim_advance_to_next_event(sim_activity activity) {
+    sim_time next;
+
+    sim_enter();
+    sim_mcu_sync(0);
+    next = sim_next_event_time();
+    if (next == SIM_TIME_NEVER) {
+        next = sim_now + sim_config.quantum;
+    }
+    sim_advance(next, activity);
+    sim_leave();
+}
+
+void sim_stop(const char *reason) {
+    sim_flash_save();
+    fflush(stdout);
+    fprintf(stderr, "\npmcu-sim: %s\n", reason);
+    sim_stats_report();
+    exit(0);
+}
+
+static void sim_tick() {
+    sim_mcu_sync(1);
+    sim_advance(sim_now + sim_config.quantum, SIM_ACTIVITY_RUNNING);
+    sim_arm_tick();
+}
+
+static void sim_on_signal(int signal) {
+    (void) signal;
+
+    if (sim_depth > 0 || sim_critical()) {
+        sim_tick_deferred = 1;
+        return;
+    }
+    sim_enter();
+    sim_preempted = 1;
+    sim_tick();
+    sim_preempted = 0;
+    sim_leave();
+}
+
+// ***************************************************************** Interrupt glue
+
+void sim_isr_call(void (*isr)(void)) {
+    unsigned int sr;
+
+    sr = sim_sr;
+    sim_sr &= ~(GIE | LPM4_bits);
+    sim_isr_depth++;
+    isr();
+    sim_isr_depth--;
+
+    // the ISR may have changed the SR to be restored (e.g. to leave a low power mode)
+    sim_sr = (sr & ~LPM4_bits) | (sim_woken ? 0 : (sr & LPM4_bits));
+}
+
+int sim_mcu_gie() {
+    return (sim_sr & GIE) != 0 && !sim_stalled;
+}
+
+void sim_stall(sim_time duration) {
+    sim_enter();
+    sim_stalled = 1;
+    sim_advance(sim_now + duration, SIM_ACTIVITY_RUNNING);
+    sim_stalled = 0;
+    sim_leave();
+}
+
+// ***************************************************************** Intrinsics
+
+void sim_delay_cycles(unsigned long cycles) {
+    sim_time duration;
+
+    sim_enter();
+    duration = (sim_time) ((unsigned __int128) cycles * SIM_S(1) / sim_mcu_mclk());
+    sim_advance(sim_now + duration, SIM_ACTIVITY_DELAY);
+    sim_leave();
+}
+
+void sim_bis_sr(unsigned int bits) {
+    sim_enter();
+    if (sim_isr_depth == 0) {
+        // GIE and the low power bits are set atomically, like a single BIS instruction
+        sim_woken = 0;
+        sim_sr |= bits;
+        sim_mcu_dispatch();
+
+        if (bits & CPUOFF) {
+            // sleeps until an ISR clears the low power bits on exit
+            while (!sim_woken) {
+                sim_advance_to_next_event(SIM_ACTIVITY_SLEEP);
+            }
+            sim_sr &= ~LPM4_bits;
+        }
+        sim_woken = 0;
+    }
+    sim_leave();
+}
+
+void sim_bic_sr(unsigned int bits) {
+    sim_enter();
+    if (sim_isr_depth == 0) {
+        sim_sr &= ~bits;
+    }
+    sim_leave();
+}
+
+void sim_bic_sr_on_exit(unsigned int bits) {
+    if (sim_isr_depth > 0 && (bits & CPUOFF)) {
+        sim_woken = 1;
+    }
+}
+
+void sim_bis_sr_on_exit(unsigned int bits) {
+    (void) bits;
+}
+
+unsigned int sim_get_sr() {
+    return sim_sr;
+}
+
+// ***************************************************************** RTS
+
+int ltoa(long value, char *buffer) {
+    return sprintf(buffer, "%ld", value);
+}
+
+// ***************************************************************** Entry point
+
+extern int pmcu_main();
+
+static void sim_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -p, --publishes N   stops after N MQTT publishes (default %lu, 0 = never)\n"
+            "  -t, --time S        stops after S seconds of virtual time (default %llu)\n"
+            "  -q, --quiet         doesn't print the firmware console\n"
+            "  -w, --wire          prints every byte exchanged through the UART hub\n"
+            "  --quantum US        virtual microseconds per host tick (default %llu)\n"
+            "  -f, --flash FILE    loads FLASH2 from FILE, if any, and saves it back on exit\n"
+            "  --power-cut N       stops right before the Nth flash erase or write, as a reset would\n"
+            "  --outage S-S        the network is unreachable between these seconds\n"
+            "  --payloads FILE     writes every payload published to FILE, in hex, for tools/record.py\n"
+            "  --console FILE      writes the console stream to FILE as is, the binary trace for tools/trace.py\n"
+            "  --gps-stream FILE   the GPS replays FILE (UBX and NMEA, as recorded) instead of its messages\n"
+            "  --urcs S            the modem sends an unsolicited result code (RING, +CREG, UNDER-VOLTAGE)\n"
+            "                      every S seconds, amid whatever it is doing\n"
+            "  --dht22-glitches N  every Nth answer of the DHT22 is damaged, in turn by a short preamble,\n"
+            "                      a glitch in a bit and a spike narrower than the capture ISR\n",
+            name, sim_config.publishes,
+            (unsigned long long) (sim_config.time_limit / SIM_S(1)),
+            (unsigned long long) (sim_config.quantum / SIM_US(1)));
+}
+
+static timer_t sim_tick_timer;
+
+/*
+ * Ticks are one-shot and re-armed at the end of each tick: the main context
+ * always gets a whole period to execute between two ticks, however long the
+ * previous tick took.
+ */
+static void sim_arm_tick() {
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_nsec = sim_config.tick_ns;
+    timer_settime(sim_tick_timer, 0, &spec, NULL);
+}
+
+static void sim_start_ticks() {
+    struct sigaction action;
+    struct sigevent event;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sim_on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, NULL);
+
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGALRM;
+    if (timer_create(CLOCK_MONOTONIC, &event, &sim_tick_timer) != 0) {
+        perror("timer_create");
+        exit(1);
+    }
+    sim_arm_tick();
+}
+
+int main(int argc, char **argv) {
+    unsigned long long outage_from, outage_to;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if ((!strcmp(argv[i], "-p") || !strcmp(argv[i], "--publishes")) && i + 1 < argc) {
+            sim_config.publishes = strtoul(argv[++i], NULL, 10);
+        } else if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--time")) && i + 1 < argc) {
+            sim_config.time_limit = SIM_S(strtoull(argv[++i], NULL, 10));
+        } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quiet")) {
+            sim_config.quiet = 1;
+        } else if (!strcmp(argv[i], "-w") || !strcmp(argv[i], "--wire")) {
+            sim_config.wire = 1;
+        } else if (!strcmp(argv[i], "--quantum") && i + 1 < argc) {
+            sim_config.quantum = SIM_US(strtoull(argv[++i], NULL, 10));
+        } else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--flash")) && i + 1 < argc) {
+            sim_config.flash_image = argv[++i];
+        } else if (!strcmp(argv[i], "--power-cut") && i + 1 < argc) {
+            sim_config.power_cut = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--outage") && i + 1 < argc
+                && sscanf(argv[++i], "%llu-%llu", &outage_from, &outage_to) == 2 && outage_from < outage_to) {
+            sim_config.outage_from = SIM_S(outage_from);
+            sim_config.outage_to = SIM_S(outage_to);
+        } else if (!strcmp(argv[i], "--payloads") && i + 1 < argc) {
+            sim_config.payloads = argv[++i];
+        } else if (!strcmp(argv[i], "--console") && i + 1 < argc) {
+            sim_config.console = argv[++i];
+        } else if (!strcmp(argv[i], "--gps-stream") && i + 1 < argc) {
+            sim_config.gps_stream = argv[++i];
+        } else if (!strcmp(argv[i], "--urcs") && i + 1 < argc) {
+            sim_config.urc_interval = SIM_S(strtoull(argv[++i], NULL, 10));
+        } else if (!strcmp(argv[i], "--dht22-glitches") && i + 1 < argc) {
+            sim_config.dht22_glitches = strtoul(argv[++i], NULL, 10);
+        } else {
+            sim_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    sim_mcu_reset();
+    sim_flash_init();
+    sim_sim800l_init();
+    sim_gps_init();
+    sim_sps30_init();
+    sim_dht22_init();
+
+    sim_start_ticks();
+
+    pmcu_main();
+
+    sim_stop("main returned");
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "sim.h"
+
+#include <msp430.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The FLASH2 bank (0x10000-0x243FF) behind the flash controller. It behaves
+ * like the real one:
+ * - erasing is by 512 byte segments, to 0xFF, and programming can only
+ *   clear bits;
+ * - both need the controller unlocked and set to ERASE or WRT, otherwise
+ *   ACCVIFG is raised and the flash is left untouched;
+ * - the CPU is held meanwhile, for typical datasheet timings.
+ * The bank can be kept in an image file across runs, and a power cut can be
+ * simulated right before any erase or write, to test the recovery at boot.
+ */
+
+#define SIM_FLASH_ORIGIN   0x10000UL
+#define SIM_FLASH_SIZE     0x14400UL
+#define SIM_FLASH_SEGMENT  512
+#define SIM_FLASH_SEGMENTS (SIM_FLASH_SIZE / SIM_FLASH_SEGMENT)
+
+#define SIM_FLASH_ERASE_TIME SIM_MS(25)
+#define SIM_FLASH_WRITE_TIME SIM_US(75)
+
+#define SIM_FCTL1 0x0140
+#define SIM_FCTL3 0x0144
+
+static uint8_t sim_flash[SIM_FLASH_SIZE];
+static uint32_t sim_flash_erases[SIM_FLASH_SEGMENTS];
+static unsigned long sim_flash_operations;
+
+void sim_flash_init() {
+    FILE *image;
+
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    memset(sim_flash_erases, 0, sizeof(sim_flash_erases));
+
+    if (sim_config.flash_image && (image = fopen(sim_config.flash_image, "rb"))) {
+        if (fread(sim_flash, 1, sizeof(sim_flash), image) != sizeof(sim_flash)) {
+            fprintf(stderr, "pmcu-sim: %s is not a FLASH2 image, starting erased\n", sim_config.flash_image);
+            memset(sim_flash, 0xFF, sizeof(sim_flash));
+        }
+        fclose(image);
+    }
+}
+
+void sim_flash_save() {
+    FILE *image;
+
+    if (!sim_config.flash_image) {
+        return;
+    }
+    if (!(image = fopen(sim_config.flash_image, "wb"))) {
+        perror(sim_config.flash_image);
+        return;
+    }
+    fwrite(sim_flash, 1, sizeof(sim_flash), image);
+    fclose(image);
+}
+
+uint32_t sim_flash_max_erases() {
+    uint32_t max;
+    size_t i;
+
+    max = 0;
+    for (i = 0; i < SIM_FLASH_SEGMENTS; i++) {
+        max = sim_flash_erases[i] > max ? sim_flash_erases[i] : max;
+    }
+    return max;
+}
+
+static int sim_flash_contains(uint32_t address) {
+    return address >= SIM_FLASH_ORIGIN && address < SIM_FLASH_ORIGIN + SIM_FLASH_SIZE;
+}
+
+uint8_t sim_flash_read(uint32_t address) {
+    if (!sim_flash_contains(address)) {
+        fprintf(stderr, "pmcu-sim: flash read at 0x%05lx, out of FLASH2\n", (unsigned long) address);
+        return 0xFF;
+    }
+    return sim_flash[address - SIM_FLASH_ORIGIN];
+}
+
+static void sim_flash_violation(uint16_t flag) {
+    sim_statistics.flash_violations++;
+    sim_reg16_set(SIM_FCTL3, sim_reg16(SIM_FCTL3) | flag);
+}
+
+void sim_flash_write(uint32_t address, uint8_t byte) {
+    uint16_t fctl1, fctl3;
+    uint8_t *cell;
+    size_t segment;
+
+    sim_enter();
+
+    fctl1 = sim_reg16(SIM_FCTL1);
+    fctl3 = sim_reg16(SIM_FCTL3);
+
+    if (!sim_flash_contains(address)) {
+        fprintf(stderr, "pmcu-sim: flash write at 0x%05lx, out of FLASH2\n", (unsigned long) address);
+        sim_flash_violation(ACCVIFG);
+    } else if ((fctl1 & 0xFF00) != FWKEY || (fctl3 & 0xFF00) != FWKEY) {
+        sim_flash_violation(KEYV);
+    } else if ((fctl3 & LOCK) || !(fctl1 & (ERASE | WRT))) {
+        sim_flash_violation(ACCVIFG);
+    } else {
+        if (sim_config.power_cut && ++sim_flash_operations >= sim_config.power_cut) {
+            sim_stop("power cut");
+        }
+
+        segment = (address - SIM_FLASH_ORIGIN) / SIM_FLASH_SEGMENT;
+        cell = &sim_flash[address - SIM_FLASH_ORIGIN];
+        if (fctl1 & ERASE) {
+            memset(&sim_flash[segment * SIM_FLASH_SEGMENT], 0xFF, SIM_FLASH_SEGMENT);
+            sim_flash_erases[segment]++;
+            sim_statistics.flash_erases++;
+            sim_stall(SIM_FLASH_ERASE_TIME);
+        } else {
+            if (byte & ~*cell) {
+                sim_statistics.flash_violations++; // a 0 bit can't be programmed back to 1
+            }
+            *cell &= byte;
+            sim_statistics.flash_writes++;
+            sim_stall(SIM_FLASH_WRITE_TIME);
+        }
+    }
+
+    sim_leave();
+}
@@ -0,0 +1,123 @@
+#include "sim.h"
+
+#include <msp430.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The UART hub multiplexes USCI_A0 between the devices: SEL_A (P4.1) and
+ * SEL_B (P4.2) pick the endpoint. USCI_A1 goes straight to the console.
+ */
+
+const char *sim_endpoint_names[SIM_ENDPOINTS] = { "none", "sim800l", "gps", "sps30" };
+
+static sim_serial *const sim_serials[SIM_ENDPOINTS] = { NULL, &sim_sim800l, &sim_gps, &sim_sps30 };
+
+static sim_endpoint sim_last_endpoint = SIM_ENDPOINT_NONE;
+
+sim_endpoint sim_hub_endpoint() {
+    sim_endpoint endpoint;
+
+    endpoint = (sim_endpoint) ((sim_reg8(0x0223) >> 1) & 0x03); // P4OUT
+    if (endpoint != sim_last_endpoint) {
+        sim_statistics.endpoints[endpoint].switches++;
+        sim_last_endpoint = endpoint;
+    }
+    return endpoint;
+}
+
+static void sim_hub_trace(const char *direction, sim_endpoint endpoint, uint8_t byte) {
+    if (sim_config.wire) {
+        printf("%10.6f %s %-7s %02X %c\n", (double) sim_now / SIM_S(1), direction, sim_endpoint_names[endpoint],
+               byte, (byte >= 0x20 && byte < 0x7F) ? byte : '.');
+    }
+}
+
+void sim_hub_transmit(uint8_t byte, uint32_t baud) {
+    sim_endpoint endpoint;
+    sim_serial *serial;
+
+    endpoint = sim_hub_endpoint();
+    sim_statistics.endpoints[endpoint].tx_bytes++;
+    sim_hub_trace(">>", endpoint, byte);
+
+    serial = sim_serials[endpoint];
+    if (!serial || !serial->receive) {
+        return;
+    }
+    if (baud * 100 < serial->baud * 95 || baud * 100 > serial->baud * 105) {
+        sim_statistics.framing_errors++;
+        return;
+    }
+    serial->receive(byte);
+}
+
+// ***************************************************************** Serial devices
+
+sim_time sim_serial_byte_time(uint32_t baud) {
+    // start bit, 8 data bits, stop bit
+    return SIM_S(10) / baud;
+}
+
+static void sim_serial_on_byte(void *context) {
+    sim_serial *serial = context;
+    uint8_t byte;
+
+    byte = serial->fifo[serial->tail];
+    serial->tail = (serial->tail + 1) % SIM_SERIAL_FIFO_SIZE;
+    serial->bytes_sent++;
+
+    if (sim_hub_endpoint() == serial->endpoint) {
+        sim_statistics.endpoints[serial->endpoint].rx_bytes++;
+        sim_hub_trace("<<", serial->endpoint, byte);
+        sim_usci_receive(SIM_USCI_A0, byte, serial->baud);
+    } else {
+        serial->bytes_lost++;
+    }
+
+    if (serial->head != serial->tail) {
+        sim_time at = sim_now + sim_serial_byte_time(serial->baud);
+        sim_time not_before = serial->not_before[serial->tail];
+        sim_event_schedule(&serial->event, at > not_before ? at : not_before);
+    }
+}
+
+void sim_serial_init(sim_serial *serial) {
+    serial->head = 0;
+    serial->tail = 0;
+    serial->bytes_sent = 0;
+    serial->bytes_lost = 0;
+    sim_event_init(&serial->event, sim_serial_on_byte, serial);
+}
+
+void sim_serial_send(sim_serial *serial, const void *data, size_t length, sim_time delay) {
+    const uint8_t *bytes = data;
+    sim_time not_before;
+    size_t i, next;
+
+    not_before = sim_now + delay + sim_serial_byte_time(serial->baud);
+    for (i = 0; i < length; i++) {
+        next = (serial->head + 1) % SIM_SERIAL_FIFO_SIZE;
+        if (next == serial->tail) {
+            fprintf(stderr, "pmcu-sim: %s output overflow\n", serial->name);
+            break;
+        }
+        serial->fifo[serial->head] = bytes[i];
+        serial->not_before[serial->head] = not_before;
+        serial->head = next;
+    }
+    if (!serial->event.queued && serial->head != serial->tail) {
+        sim_event_schedule(&serial->event, serial->not_before[serial->tail]);
+    }
+}
+
+void sim_serial_send_string(sim_serial *serial, const char *string, sim_time delay) {
+    sim_serial_send(serial, string, strlen(string), delay);
+}
+
+void sim_serial_flush(sim_serial *serial) {
+    sim_event_cancel(&serial->event);
+    serial->head = 0;
+    serial->tail = 0;
+}
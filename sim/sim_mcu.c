@@ -0,0 +1,681 @@
+#include "sim.h"
+
+#include <msp430.h>
+
+#include <string.h>
+
+/*
+ * Simulated MSP430F5529 peripherals: the register file, the clock system,
+ * USCI_A0/A1 in UART mode, TA0/TA1/TB0 and the interrupt controller.
+ */
+
+#define SIM_SFR_SPACE 0x1000
+
+static union {
+    uint8_t bytes[SIM_SFR_SPACE];
+    uint16_t words[SIM_SFR_SPACE / 2];
+} sim_sfr;
+
+static uint32_t sim_tick_epoch = 0;
+
+void sim_isr_call(void (*isr)(void));
+
+// ***************************************************************** ISRs
+
+/*
+ * The vector table: #pragma vector is ignored on the host, so every ISR of the
+ * firmware must be listed here. Weak references let the firmware drop an ISR
+ * without breaking the host build.
+ */
+
+extern void uart_on_a0(void) __attribute__((weak));
+extern void uart_on_a1(void) __attribute__((weak));
+extern void timer_on_tick(void) __attribute__((weak));
+extern void timer_on_overflow(void) __attribute__((weak));
+extern void dht22_on_tick(void) __attribute__((weak));
+extern void timer0_b1(void) __attribute__((weak));
+
+#define SIM_VECTOR_USCI_A0   uart_on_a0
+#define SIM_VECTOR_USCI_A1   uart_on_a1
+#define SIM_VECTOR_TIMER0_A0 NULL
+#define SIM_VECTOR_TIMER0_A1 dht22_on_tick
+#define SIM_VECTOR_TIMER1_A0 timer_on_tick
+#define SIM_VECTOR_TIMER1_A1 timer_on_overflow
+#define SIM_VECTOR_TIMER0_B0 NULL
+#define SIM_VECTOR_TIMER0_B1 timer0_b1
+
+// ***************************************************************** Registers
+
+uint8_t sim_reg8(uint16_t address) {
+    return sim_sfr.bytes[address];
+}
+
+uint16_t sim_reg16(uint16_t address) {
+    return sim_sfr.words[address >> 1];
+}
+
+void sim_reg8_set(uint16_t address, uint8_t value) {
+    sim_sfr.bytes[address] = value;
+}
+
+void sim_reg16_set(uint16_t address, uint16_t value) {
+    sim_sfr.words[address >> 1] = value;
+}
+
+// ***************************************************************** Clocks
+
+uint32_t sim_mcu_mclk() {
+    // MCLK and SMCLK are sourced by DCOCLKDIV = (FLLN + 1) * FLLREF
+    return ((sim_reg16(0x0164) & 0x03FF) + 1) * SIM_ACLK;
+}
+
+uint32_t sim_mcu_smclk() {
+    return sim_mcu_mclk();
+}
+
+// ***************************************************************** USCI
+
+#define SIM_USCI_CTL1  0x00
+#define SIM_USCI_CTL0  0x01
+#define SIM_USCI_BR0   0x06
+#define SIM_USCI_BR1   0x07
+#define SIM_USCI_MCTL  0x08
+#define SIM_USCI_STAT  0x0A
+#define SIM_USCI_RXBUF 0x0C
+#define SIM_USCI_TXBUF 0x0E
+#define SIM_USCI_IE    0x1C
+#define SIM_USCI_IFG   0x1D
+#define SIM_USCI_IV    0x1E
+
+typedef struct {
+    uint16_t base;
+    void (*isr)(void);
+
+    uint8_t shadow_ctl1;
+
+    int tx_pending;          // TXBUF has been accessed and must be committed
+    uint32_t tx_pending_epoch;
+    int tx_pending_isr;
+
+    int tx_buffered;         // a byte is waiting in TXBUF for the shift register
+    uint8_t tx_buffer;
+    int tx_shifting;
+    uint8_t tx_shift;
+    sim_event tx_done;
+} sim_usci;
+
+static sim_usci sim_uscis[SIM_USCI_MODULES];
+
+static uint8_t sim_usci_reg(sim_usci *usci, uint16_t offset) {
+    return sim_reg8(usci->base + offset);
+}
+
+static void sim_usci_reg_set(sim_usci *usci, uint16_t offset, uint8_t value) {
+    sim_reg8_set(usci->base + offset, value);
+}
+
+uint32_t sim_usci_baud(sim_usci_id id) {
+    sim_usci *usci;
+    uint32_t clock, divider;
+
+    usci = &sim_uscis[id];
+    switch (sim_usci_reg(usci, SIM_USCI_CTL1) & UCSSEL_3) {
+    case UCSSEL_1:
+        clock = SIM_ACLK;
+        break;
+    case UCSSEL_2:
+    case UCSSEL_3:
+        clock = sim_mcu_smclk();
+        break;
+    default:
+        return 0;
+    }
+    divider = sim_usci_reg(usci, SIM_USCI_BR0) | (sim_usci_reg(usci, SIM_USCI_BR1) << 8);
+    if (sim_usci_reg(usci, SIM_USCI_MCTL) & UCOS16) {
+        divider *= 16;
+    }
+    return divider ? clock / divider : 0;
+}
+
+static void sim_usci_start_shift(sim_usci *usci, uint8_t byte) {
+    sim_usci_id id = (sim_usci_id) (usci - sim_uscis);
+    uint32_t baud;
+
+    baud = sim_usci_baud(id);
+    usci->tx_shifting = 1;
+    usci->tx_shift = byte;
+    sim_event_schedule(&usci->tx_done, sim_now + sim_serial_byte_time(baud ? baud : 9600));
+
+    // the buffer is free again
+    sim_usci_reg_set(usci, SIM_USCI_IFG, sim_usci_reg(usci, SIM_USCI_IFG) | UCTXIFG);
+}
+
+static void sim_usci_on_tx_done(void *context) {
+    sim_usci *usci = context;
+    sim_usci_id id = (sim_usci_id) (usci - sim_uscis);
+    uint8_t byte;
+
+    byte = usci->tx_shift;
+    usci->tx_shifting = 0;
+
+    if (id == SIM_USCI_A0) {
+        sim_hub_transmit(byte, sim_usci_baud(id));
+    } else {
+        sim_console_receive(byte);
+    }
+
+    if (usci->tx_buffered) {
+        usci->tx_buffered = 0;
+        sim_usci_start_shift(usci, usci->tx_buffer);
+    }
+}
+
+static void sim_usci_commit(sim_usci *usci) {
+    uint8_t byte;
+
+    usci->tx_pending = 0;
+    if (sim_usci_reg(usci, SIM_USCI_CTL1) & UCSWRST) {
+        return;
+    }
+
+    byte = sim_usci_reg(usci, SIM_USCI_TXBUF);
+    if (!usci->tx_shifting) {
+        sim_usci_start_shift(usci, byte);
+    } else {
+        // overwriting a full TXBUF loses the previous byte, like on the real USCI
+        usci->tx_buffered = 1;
+        usci->tx_buffer = byte;
+    }
+}
+
+static void sim_usci_sync(sim_usci *usci) {
+    uint8_t ctl1;
+
+    ctl1 = sim_usci_reg(usci, SIM_USCI_CTL1);
+    if ((ctl1 ^ usci->shadow_ctl1) & UCSWRST) {
+        if (ctl1 & UCSWRST) {
+            // entering reset: flags and interrupt enables are cleared, TXIFG is set
+            sim_event_cancel(&usci->tx_done);
+            usci->tx_shifting = 0;
+            usci->tx_buffered = 0;
+            usci->tx_pending = 0;
+            sim_usci_reg_set(usci, SIM_USCI_IE, 0);
+            sim_usci_reg_set(usci, SIM_USCI_IFG, UCTXIFG);
+            sim_usci_reg_set(usci, SIM_USCI_STAT, 0);
+        }
+        usci->shadow_ctl1 = ctl1;
+    }
+
+    if (usci->tx_pending) {
+        /*
+         * A TXBUF access from the main context is committed once the store
+         * has surely been executed: on the next access, or once a whole tick
+         * has elapsed (the tick right after the access may have preempted it).
+         */
+        if (!sim_preempting() || usci->tx_pending_isr || sim_tick_epoch - usci->tx_pending_epoch >= 2) {
+            sim_usci_commit(usci);
+        }
+    }
+}
+
+static void sim_usci_access(sim_usci *usci, uint16_t offset) {
+    uint8_t ifg, stat;
+
+    switch (offset) {
+    case SIM_USCI_TXBUF:
+        sim_usci_sync(usci);
+        usci->tx_pending = 1;
+        usci->tx_pending_epoch = sim_tick_epoch;
+        usci->tx_pending_isr = sim_in_isr();
+        sim_usci_reg_set(usci, SIM_USCI_IFG, sim_usci_reg(usci, SIM_USCI_IFG) & ~UCTXIFG);
+        break;
+
+    case SIM_USCI_STAT:
+        stat = sim_usci_reg(usci, SIM_USCI_STAT) & ~UCBUSY;
+        sim_usci_reg_set(usci, SIM_USCI_STAT, stat | ((usci->tx_shifting || usci->tx_buffered || usci->tx_pending) ? UCBUSY : 0));
+        break;
+
+    case SIM_USCI_RXBUF:
+        sim_usci_reg_set(usci, SIM_USCI_IFG, sim_usci_reg(usci, SIM_USCI_IFG) & ~UCRXIFG);
+        sim_usci_reg_set(usci, SIM_USCI_STAT, sim_usci_reg(usci, SIM_USCI_STAT) & ~(UCOE | UCFE | UCRXERR));
+        break;
+
+    case SIM_USCI_IFG:
+        ifg = sim_usci_reg(usci, SIM_USCI_IFG);
+        if (!sim_in_isr() && !(ifg & UCTXIFG) && (usci->tx_shifting || usci->tx_pending)) {
+            // the main context is polling for TXIFG: fast forwards to when the USCI frees TXBUF
+            sim_advance_to_next_event(SIM_ACTIVITY_RUNNING);
+        }
+        break;
+
+    case SIM_USCI_IV:
+        ifg = sim_usci_reg(usci, SIM_USCI_IFG) & sim_usci_reg(usci, SIM_USCI_IE);
+        if (ifg & UCRXIFG) {
+            sim_reg16_set(usci->base + SIM_USCI_IV, USCI_UCRXIFG);
+            sim_usci_reg_set(usci, SIM_USCI_IFG, sim_usci_reg(usci, SIM_USCI_IFG) & ~UCRXIFG);
+        } else if (ifg & UCTXIFG) {
+            sim_reg16_set(usci->base + SIM_USCI_IV, USCI_UCTXIFG);
+            sim_usci_reg_set(usci, SIM_USCI_IFG, sim_usci_reg(usci, SIM_USCI_IFG) & ~UCTXIFG);
+        } else {
+            sim_reg16_set(usci->base + SIM_USCI_IV, USCI_NONE);
+        }
+        break;
+    }
+}
+
+void sim_usci_receive(sim_usci_id id, uint8_t byte, uint32_t baud) {
+    sim_usci *usci;
+    uint32_t own_baud;
+    uint8_t ifg;
+
+    usci = &sim_uscis[id];
+    sim_usci_sync(usci);
+    if (sim_usci_reg(usci, SIM_USCI_CTL1) & UCSWRST) {
+        return;
+    }
+
+    // more than 5% of baud rate mismatch makes the receiver sample garbage
+    own_baud = sim_usci_baud(id);
+    if (own_baud * 100 < baud * 95 || own_baud * 100 > baud * 105) {
+        sim_statistics.framing_errors++;
+        byte = (uint8_t) ~byte;
+        sim_usci_reg_set(usci, SIM_USCI_STAT, sim_usci_reg(usci, SIM_USCI_STAT) | UCFE | UCRXERR);
+    }
+
+    ifg = sim_usci_reg(usci, SIM_USCI_IFG);
+    if (ifg & UCRXIFG) {
+        sim_statistics.overruns++;
+        sim_usci_reg_set(usci, SIM_USCI_STAT, sim_usci_reg(usci, SIM_USCI_STAT) | UCOE);
+    }
+    sim_usci_reg_set(usci, SIM_USCI_RXBUF, byte);
+    sim_usci_reg_set(usci, SIM_USCI_IFG, ifg | UCRXIFG);
+}
+
+// ***************************************************************** Timers
+
+#define SIM_TIMER_CTL   0x00
+#define SIM_TIMER_CCTL  0x02
+#define SIM_TIMER_R     0x10
+#define SIM_TIMER_CCR   0x12
+#define SIM_TIMER_EX0   0x20
+#define SIM_TIMER_IV    0x2E
+
+typedef struct {
+    uint16_t base;
+    int channels;
+    void (*isr0)(void);
+    void (*isr1)(void);
+
+    // counting origin: at time t0 the counter was count0, ticks before k_done are processed
+    uint16_t shadow_ctl;
+    uint16_t shadow_ccr0;
+    uint16_t shadow_ex0;
+    sim_time t0;
+    uint32_t count0;
+    uint64_t k_done;
+} sim_timer;
+
+typedef enum {
+    SIM_TA0,
+    SIM_TA1,
+    SIM_TB0,
+    SIM_TIMERS
+} sim_timer_id;
+
+static sim_timer sim_timers[SIM_TIMERS];
+
+static uint16_t sim_timer_reg(sim_timer *timer, uint16_t offset) {
+    return sim_reg16(timer->base + offset);
+}
+
+static void sim_timer_reg_set(sim_timer *timer, uint16_t offset, uint16_t value) {
+    sim_reg16_set(timer->base + offset, value);
+}
+
+static uint32_t sim_timer_frequency(sim_timer *timer) {
+    uint16_t ctl;
+    uint32_t clock;
+
+    ctl = timer->shadow_ctl;
+    switch (ctl & TASSEL_3) {
+    case TASSEL_1:
+        clock = SIM_ACLK;
+        break;
+    case TASSEL_2:
+        clock = sim_mcu_smclk();
+        break;
+    default:
+        return 0;
+    }
+    return clock / (1 << ((ctl >> 6) & 3)) / ((timer->shadow_ex0 & 7) + 1);
+}
+
+static uint32_t sim_timer_modulo(sim_timer *timer) {
+    switch (timer->shadow_ctl & MC_3) {
+    case MC_1:
+    case MC_3:
+        return (uint32_t) timer->shadow_ccr0 + 1;
+    default:
+        return 0x10000;
+    }
+}
+
+static int sim_timer_running(sim_timer *timer) {
+    return (timer->shadow_ctl & MC_3) != MC_0 && sim_timer_frequency(timer) != 0;
+}
+
+/* Number of timer ticks elapsed between t0 and t */
+static uint64_t sim_timer_ticks(sim_timer *timer, sim_time t) {
+    return (uint64_t) ((unsigned __int128) (t - timer->t0) * sim_timer_frequency(timer) / SIM_S(1));
+}
+
+/* Time of the k-th tick after t0 */
+static sim_time sim_timer_tick_time(sim_timer *timer, uint64_t k) {
+    unsigned __int128 f = sim_timer_frequency(timer);
+    return timer->t0 + (sim_time) (((unsigned __int128) k * SIM_S(1) + f - 1) / f);
+}
+
+static uint32_t sim_timer_count(sim_timer *timer, sim_time t) {
+    if (!sim_timer_running(timer)) {
+        return timer->count0;
+    }
+    return (uint32_t) ((timer->count0 + sim_timer_ticks(timer, t)) % sim_timer_modulo(timer));
+}
+
+static void sim_timer_sync(sim_timer *timer) {
+    uint16_t ctl, ccr0, ex0;
+
+    ctl = sim_timer_reg(timer, SIM_TIMER_CTL);
+    ccr0 = sim_timer_reg(timer, SIM_TIMER_CCR);
+    ex0 = sim_timer_reg(timer, SIM_TIMER_EX0);
+
+    if (((ctl ^ timer->shadow_ctl) & ~(TAIFG | TAIE)) || ccr0 != timer->shadow_ccr0 || ex0 != timer->shadow_ex0) {
+        // configuration changed: restarts counting from the current value
+        timer->count0 = sim_timer_count(timer, sim_now);
+        if (ctl & TACLR) {
+            ctl &= ~TACLR;
+            sim_timer_reg_set(timer, SIM_TIMER_CTL, ctl);
+            timer->count0 = 0;
+        }
+        timer->shadow_ctl = ctl;
+        timer->shadow_ccr0 = ccr0;
+        timer->shadow_ex0 = ex0;
+        if (timer->count0 >= sim_timer_modulo(timer)) {
+            timer->count0 = 0;
+        }
+        timer->t0 = sim_now;
+        timer->k_done = 0;
+    }
+    timer->shadow_ctl = (timer->shadow_ctl & ~(TAIFG | TAIE)) | (ctl & (TAIFG | TAIE));
+}
+
+/* Next tick index, after k_done, at which the counter equals value */
+static uint64_t sim_timer_next_match(sim_timer *timer, uint32_t value) {
+    uint32_t modulo, count;
+    uint64_t distance;
+
+    modulo = sim_timer_modulo(timer);
+    if (value >= modulo) {
+        return UINT64_MAX;
+    }
+    count = (uint32_t) ((timer->count0 + timer->k_done) % modulo);
+    distance = (value + modulo - count) % modulo;
+    if (distance == 0) {
+        distance = modulo;
+    }
+    return timer->k_done + distance;
+}
+
+static sim_time sim_timer_next_event(sim_timer *timer) {
+    uint64_t next, k;
+    uint16_t cctl;
+    int i;
+
+    if (!sim_timer_running(timer)) {
+        return SIM_TIME_NEVER;
+    }
+    next = UINT64_MAX;
+    for (i = 0; i < timer->channels; i++) {
+        cctl = sim_timer_reg(timer, SIM_TIMER_CCTL + 2 * i);
+        if ((cctl & CCIE) && !(cctl & CAP)) {
+            k = sim_timer_next_match(timer, sim_timer_reg(timer, SIM_TIMER_CCR + 2 * i));
+            next = k < next ? k : next;
+        }
+    }
+    if (timer->shadow_ctl & TAIE) {
+        k = sim_timer_next_match(timer, 0);
+        next = k < next ? k : next;
+    }
+    return next == UINT64_MAX ? SIM_TIME_NEVER : sim_timer_tick_time(timer, next);
+}
+
+static void sim_timer_fire(sim_timer *timer) {
+    uint64_t k;
+    uint16_t cctl;
+    int i;
+
+    if (!sim_timer_running(timer)) {
+        return;
+    }
+    k = sim_timer_ticks(timer, sim_now);
+    if (k <= timer->k_done) {
+        return;
+    }
+
+    // every match since the last firing counts, even if time jumped over it
+    for (i = 0; i < timer->channels; i++) {
+        cctl = sim_timer_reg(timer, SIM_TIMER_CCTL + 2 * i);
+        if (!(cctl & CAP) && sim_timer_next_match(timer, sim_timer_reg(timer, SIM_TIMER_CCR + 2 * i)) <= k) {
+            sim_timer_reg_set(timer, SIM_TIMER_CCTL + 2 * i, cctl | CCIFG);
+        }
+    }
+    if (sim_timer_next_match(timer, 0) <= k) {
+        sim_timer_reg_set(timer, SIM_TIMER_CTL, sim_timer_reg(timer, SIM_TIMER_CTL) | TAIFG);
+    }
+    timer->k_done = k;
+}
+
+static int sim_timer_pending1(sim_timer *timer) {
+    uint16_t cctl;
+    int i;
+
+    for (i = 1; i < timer->channels; i++) {
+        cctl = sim_timer_reg(timer, SIM_TIMER_CCTL + 2 * i);
+        if ((cctl & CCIE) && (cctl & CCIFG)) {
+            return 2 * i;
+        }
+    }
+    if ((sim_timer_reg(timer, SIM_TIMER_CTL) & (TAIE | TAIFG)) == (TAIE | TAIFG)) {
+        return 0x0E;
+    }
+    return 0;
+}
+
+static void sim_timer_access(sim_timer *timer, uint16_t offset) {
+    int vector;
+
+    sim_timer_sync(timer);
+    switch (offset) {
+    case SIM_TIMER_R:
+        sim_timer_reg_set(timer, SIM_TIMER_R, (uint16_t) sim_timer_count(timer, sim_now));
+        break;
+
+    case SIM_TIMER_IV:
+        vector = sim_timer_pending1(timer);
+        sim_timer_reg_set(timer, SIM_TIMER_IV, vector);
+        if (vector == 0x0E) {
+            sim_timer_reg_set(timer, SIM_TIMER_CTL, sim_timer_reg(timer, SIM_TIMER_CTL) & ~TAIFG);
+        } else if (vector) {
+            sim_timer_reg_set(timer, SIM_TIMER_CCTL + vector, sim_timer_reg(timer, SIM_TIMER_CCTL + vector) & ~CCIFG);
+        }
+        break;
+    }
+}
+
+void sim_ta0_capture(int ccr, int rising) {
+    sim_timer *timer;
+    uint16_t cctl, mode;
+
+    timer = &sim_timers[SIM_TA0];
+    sim_timer_sync(timer);
+
+    cctl = sim_timer_reg(timer, SIM_TIMER_CCTL + 2 * ccr);
+    cctl = rising ? (cctl | CCI) : (cctl & ~CCI);
+    mode = cctl & CM_3;
+    if ((cctl & CAP) && (cctl & CCIS_3) == CCIS_0 && ((mode == CM_1 && rising) || (mode == CM_2 && !rising) || mode == CM_3)) {
+        if (cctl & CCIFG) {
+            cctl |= COV;
+        }
+        cctl |= CCIFG;
+        sim_timer_reg_set(timer, SIM_TIMER_CCR + 2 * ccr, (uint16_t) sim_timer_count(timer, sim_now));
+    }
+    sim_timer_reg_set(timer, SIM_TIMER_CCTL + 2 * ccr, cctl);
+}
+
+// ***************************************************************** MCU
+
+void sim_mcu_reset() {
+    static void (*const usci_isrs[SIM_USCI_MODULES])(void) = { SIM_VECTOR_USCI_A0, SIM_VECTOR_USCI_A1 };
+    static const uint16_t usci_bases[SIM_USCI_MODULES] = { 0x05C0, 0x0600 };
+    int i;
+
+    memset(&sim_sfr, 0, sizeof(sim_sfr));
+
+    sim_reg16_set(0x015C, 0x6904); // WDTCTL
+    sim_reg16_set(0x0140, 0x9600); // FCTL1
+    sim_reg16_set(0x0144, 0x9658); // FCTL3: locked
+    sim_reg16_set(0x0160, 0x0000); // UCSCTL0
+    sim_reg16_set(0x0162, 0x0020); // UCSCTL1
+    sim_reg16_set(0x0164, 0x101F); // UCSCTL2: DCOCLKDIV = 32 * 32768Hz ~ 1MHz
+    sim_reg16_set(0x0166, 0x0000); // UCSCTL3
+
+    for (i = 0; i < SIM_USCI_MODULES; i++) {
+        memset(&sim_uscis[i], 0, sizeof(sim_usci));
+        sim_uscis[i].base = usci_bases[i];
+        sim_uscis[i].isr = usci_isrs[i];
+        sim_uscis[i].shadow_ctl1 = UCSWRST;
+        sim_event_init(&sim_uscis[i].tx_done, sim_usci_on_tx_done, &sim_uscis[i]);
+        sim_usci_reg_set(&sim_uscis[i], SIM_USCI_CTL1, UCSWRST);
+        sim_usci_reg_set(&sim_uscis[i], SIM_USCI_IFG, UCTXIFG);
+    }
+
+    memset(sim_timers, 0, sizeof(sim_timers));
+    sim_timers[SIM_TA0] = (sim_timer) { .base = 0x0340, .channels = 5, .isr0 = SIM_VECTOR_TIMER0_A0, .isr1 = SIM_VECTOR_TIMER0_A1 };
+    sim_timers[SIM_TA1] = (sim_timer) { .base = 0x0380, .channels = 3, .isr0 = SIM_VECTOR_TIMER1_A0, .isr1 = SIM_VECTOR_TIMER1_A1 };
+    sim_timers[SIM_TB0] = (sim_timer) { .base = 0x03C0, .channels = 7, .isr0 = SIM_VECTOR_TIMER0_B0, .isr1 = SIM_VECTOR_TIMER0_B1 };
+}
+
+sim_time sim_mcu_next_event() {
+    sim_time next, t;
+    int i;
+
+    next = SIM_TIME_NEVER;
+    for (i = 0; i < SIM_TIMERS; i++) {
+        t = sim_timer_next_event(&sim_timers[i]);
+        next = t < next ? t : next;
+    }
+    return next;
+}
+
+void sim_mcu_fire() {
+    int i;
+
+    for (i = 0; i < SIM_TIMERS; i++) {
+        sim_timer_fire(&sim_timers[i]);
+    }
+}
+
+void sim_mcu_sync(int from_tick) {
+    int i;
+
+    if (from_tick) {
+        sim_tick_epoch++;
+    }
+    for (i = 0; i < SIM_USCI_MODULES; i++) {
+        sim_usci_sync(&sim_uscis[i]);
+    }
+    for (i = 0; i < SIM_TIMERS; i++) {
+        sim_timer_sync(&sim_timers[i]);
+    }
+}
+
+void sim_mcu_dispatch() {
+    sim_usci *usci;
+    sim_timer *timer;
+    int i, rounds, dispatched;
+
+    for (rounds = 0; rounds < 64; rounds++) {
+        if (!sim_mcu_gie()) {
+            return;
+        }
+        dispatched = 0;
+
+        // vectors in priority order
+        for (i = 0; i < SIM_TIMERS && !dispatched; i++) {
+            timer = &sim_timers[i];
+            sim_timer_sync(timer);
+            if ((sim_timer_reg(timer, SIM_TIMER_CCTL) & (CCIE | CCIFG)) == (CCIE | CCIFG) && timer->isr0) {
+                // the CCR0 flag is reset automatically when its ISR is served
+                sim_timer_reg_set(timer, SIM_TIMER_CCTL, sim_timer_reg(timer, SIM_TIMER_CCTL) & ~CCIFG);
+                sim_isr_call(timer->isr0);
+                dispatched = 1;
+            } else if (sim_timer_pending1(timer) && timer->isr1) {
+                sim_isr_call(timer->isr1);
+                dispatched = 1;
+            }
+        }
+        for (i = 0; i < SIM_USCI_MODULES && !dispatched; i++) {
+            usci = &sim_uscis[i];
+            sim_usci_sync(usci);
+            if ((sim_usci_reg(usci, SIM_USCI_IFG) & sim_usci_reg(usci, SIM_USCI_IE) & (UCRXIFG | UCTXIFG)) && usci->isr) {
+                sim_isr_call(usci->isr);
+                // bytes written by the ISR are committed as soon as it returns
+                sim_usci_sync(usci);
+                dispatched = 1;
+            }
+        }
+
+        if (!dispatched) {
+            return;
+        }
+    }
+}
+
+// ***************************************************************** Register access
+
+static void sim_sfr_access(uint16_t address) {
+    int i;
+
+    for (i = 0; i < SIM_USCI_MODULES; i++) {
+        if (address >= sim_uscis[i].base && address < sim_uscis[i].base + 0x20) {
+            sim_usci_access(&sim_uscis[i], address - sim_uscis[i].base);
+            return;
+        }
+    }
+    for (i = 0; i < SIM_TIMERS; i++) {
+        if (address >= sim_timers[i].base && address < sim_timers[i].base + 0x30) {
+            sim_timer_access(&sim_timers[i], address - sim_timers[i].base);
+            return;
+        }
+    }
+}
+
+volatile uint8_t *sim_sfr8(uint16_t address) {
+    sim_enter();
+    if (!sim_in_isr()) {
+        sim_mcu_sync(0);
+    }
+    sim_sfr_access(address);
+    sim_leave();
+    return &sim_sfr.bytes[address % SIM_SFR_SPACE];
+}
+
+volatile uint16_t *sim_sfr16(uint16_t address) {
+    sim_enter();
+    if (!sim_in_isr()) {
+        sim_mcu_sync(0);
+    }
+    sim_sfr_access(address & ~1);
+    sim_leave();
+    return &sim_sfr.words[(address % SIM_SFR_SPACE) >> 1];
+}
@@ -0,0 +1,102 @@
+#include "sim.h"
+
+#include <stdio.h>
+
+sim_stats sim_statistics;
+
+static double sim_seconds(sim_time time) {
+    return (double) time / SIM_S(1);
+}
+
+void sim_stats_account(sim_time duration, sim_activity activity) {
+    sim_statistics.endpoints[sim_hub_endpoint()].time[activity] += duration;
+}
+
+void sim_stats_publish() {
+    sim_time cycle;
+
+    if (sim_statistics.publishes == 0) {
+        sim_statistics.first_publish = sim_now;
+    } else {
+        cycle = sim_now - sim_statistics.last_publish;
+        if (sim_statistics.publishes == 1 || cycle < sim_statistics.min_cycle) {
+            sim_statistics.min_cycle = cycle;
+        }
+        if (cycle > sim_statistics.max_cycle) {
+            sim_statistics.max_cycle = cycle;
+        }
+    }
+    sim_statistics.last_publish = sim_now;
+    sim_statistics.publishes++;
+
+    if (sim_config.publishes && sim_statistics.publishes >= sim_config.publishes) {
+        sim_stop("publish count reached");
+    }
+}
+
+void sim_stats_report() {
+    const sim_stats *s = &sim_statistics;
+    sim_time total[SIM_ACTIVITIES] = { 0 };
+    int i, j;
+
+    fprintf(stderr, "\n===================================== pmcu-sim report\n");
+    fprintf(stderr, "virtual time           %12.3f s\n", sim_seconds(sim_now));
+    fprintf(stderr, "publishes              %12llu\n", (unsigned long long) s->publishes);
+    if (s->publishes) {
+        fprintf(stderr, "boot to first publish  %12.3f s\n", sim_seconds(s->first_publish));
+    }
+    if (s->publishes > 1) {
+        fprintf(stderr, "cycle time min/avg/max %8.3f / %.3f / %.3f s\n",
+                sim_seconds(s->min_cycle),
+                sim_seconds(s->last_publish - s->first_publish) / (s->publishes - 1),
+                sim_seconds(s->max_cycle));
+    }
+
+    fprintf(stderr, "\nphase (hub endpoint)   running      delay      sleep   switches   tx bytes   rx bytes\n");
+    for (i = 0; i < SIM_ENDPOINTS; i++) {
+        const sim_endpoint_stats *e = &s->endpoints[i];
+        fprintf(stderr, "%-16s %11.3f %10.3f %10.3f %10llu %10llu %10llu\n",
+                sim_endpoint_names[i],
+                sim_seconds(e->time[SIM_ACTIVITY_RUNNING]),
+                sim_seconds(e->time[SIM_ACTIVITY_DELAY]),
+                sim_seconds(e->time[SIM_ACTIVITY_SLEEP]),
+                (unsigned long long) e->switches,
+                (unsigned long long) e->tx_bytes,
+                (unsigned long long) e->rx_bytes);
+        for (j = 0; j < SIM_ACTIVITIES; j++) {
+            total[j] += e->time[j];
+        }
+    }
+    fprintf(stderr, "%-16s %11.3f %10.3f %10.3f\n", "total",
+            sim_seconds(total[SIM_ACTIVITY_RUNNING]),
+            sim_seconds(total[SIM_ACTIVITY_DELAY]),
+            sim_seconds(total[SIM_ACTIVITY_SLEEP]));
+    fprintf(stderr, "(running and delay are both spent by the CPU blocked on busy-waits)\n");
+
+    fprintf(stderr, "\nconsole bytes          %12llu\n", (unsigned long long) s->console_bytes);
+    fprintf(stderr, "framing errors         %12llu\n", (unsigned long long) s->framing_errors);
+    fprintf(stderr, "rx overruns            %12llu\n", (unsigned long long) s->overruns);
+    fprintf(stderr, "flash erases/max       %12llu / %lu per segment\n", (unsigned long long) s->flash_erases, (unsigned long) sim_flash_max_erases());
+    fprintf(stderr, "flash bytes written    %12llu\n", (unsigned long long) s->flash_writes);
+    fprintf(stderr, "flash violations       %12llu\n", (unsigned long long) s->flash_violations);
+    fprintf(stderr, "SPS30 measuring        %12.3f s (%.1f %%)\n", sim_seconds(sim_sps30_measuring()),
+            sim_now ? 100.0 * sim_sps30_measuring() / sim_now : 0.0);
+    fprintf(stderr, "SPS30 fan cleanings    %12llu\n", (unsigned long long) s->sps30_cleanings);
+    fprintf(stderr, "DHT22 answers damaged  %12llu (short preamble %llu, glitch %llu, spike %llu)\n",
+            (unsigned long long) (s->dht22_damaged[SIM_DHT22_SHORT_PREAMBLE] + s->dht22_damaged[SIM_DHT22_GLITCH]
+                                  + s->dht22_damaged[SIM_DHT22_SPIKE]),
+            (unsigned long long) s->dht22_damaged[SIM_DHT22_SHORT_PREAMBLE],
+            (unsigned long long) s->dht22_damaged[SIM_DHT22_GLITCH],
+            (unsigned long long) s->dht22_damaged[SIM_DHT22_SPIKE]);
+    fprintf(stderr, "AT commands            %12llu\n", (unsigned long long) s->at_commands);
+    fprintf(stderr, "TCP connections        %12llu\n", (unsigned long long) s->tcp_connections);
+    fprintf(stderr, "GPRS bytes up/down     %12llu / %llu (%llu segments)\n",
+            (unsigned long long) s->gprs_up_bytes,
+            (unsigned long long) s->gprs_down_bytes,
+            (unsigned long long) s->gprs_segments);
+    fprintf(stderr, "MQTT packets           %12llu\n", (unsigned long long) s->mqtt_packets);
+    fprintf(stderr, "duplicate publishes    %12llu\n", (unsigned long long) s->publish_duplicates);
+    fprintf(stderr, "publish payload bytes  %12llu\n", (unsigned long long) s->publish_payload_bytes);
+    fprintf(stderr, "records received       %12llu\n", (unsigned long long) s->records_received);
+    fprintf(stderr, "records malformed      %12llu\n", (unsigned long long) s->records_malformed);
+}
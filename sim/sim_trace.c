@@ -0,0 +1,147 @@
+/*
+ * Console of the firmware, out of USCI_A1: the binary trace (trace.h) decoded back into its messages,
+ * as tools/trace.py does. What isn't a frame, e.g. the text of a fatal error, is printed as is.
+ */
+#include "sim.h"
+#include "../error.h"
+#include "../trace.h"
+#include "../at_automaton.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_TRACE_MESSAGE(ENUM, MESSAGE) MESSAGE,
+
+static const char *const sim_trace_messages[] = { TRACE_ALL_EVENTS(SIM_TRACE_MESSAGE) };
+static const char *const sim_error_names[] = { PMCU_ALL_ERRORS(GENERATE_STRING) };
+
+#define SIM_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static void sim_console_print(sim_time at, const char *line) {
+    printf("%10.6f | %s\n", (double) at / SIM_S(1), line);
+}
+
+/* A varint of the body, 0 if cut short */
+static uint32_t sim_trace_varint(const uint8_t *body, size_t length, size_t *pos) {
+    uint32_t value = 0;
+    unsigned shift = 0;
+
+    while (*pos < length && shift < 35) {
+        value |= (uint32_t) (body[*pos] & 0x7F) << shift;
+        shift += 7;
+        if (!(body[(*pos)++] & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+static void sim_trace_decode(sim_time at, const uint8_t *body, size_t length) {
+    char line[256];
+    const char *message;
+    size_t pos, out;
+    uint32_t timestamp, value;
+    int32_t number;
+
+    if (body[0] >= SIM_COUNT(sim_trace_messages)) {
+        snprintf(line, sizeof(line), "unknown trace event %u", body[0]);
+        sim_console_print(at, line);
+        return;
+    }
+
+    pos = 1;
+    timestamp = sim_trace_varint(body, length, &pos);
+    out = snprintf(line, sizeof(line), "[%u.%03u] ", timestamp / 1000, timestamp % 1000);
+
+    for (message = sim_trace_messages[body[0]]; *message && out < sizeof(line) - 1; message++) {
+        if (*message != '%' || !message[1]) {
+            line[out++] = *message;
+            continue;
+        }
+
+        message++;
+        if (*message == 's') {
+            for (; pos < length && out < sizeof(line) - 1; pos++) {
+                line[out++] = (body[pos] >= 0x20 && body[pos] < 0x7F) ? (char) body[pos] : '.';
+            }
+            continue;
+        }
+
+        value = sim_trace_varint(body, length, &pos);
+        number = (int32_t) ((value >> 1) ^ -(value & 1)); // zigzag
+        if (*message == 'e' && (uint32_t) number < SIM_COUNT(sim_error_names)) {
+            out += snprintf(&line[out], sizeof(line) - out, "%s", sim_error_names[number]);
+        } else if (*message == 'r' && number >= AT_NONE && number <= AT_NO_CARRIER) {
+            out += snprintf(&line[out], sizeof(line) - out, "%s", at_result_names[number]);
+        } else if (*message == 'd') {
+            out += snprintf(&line[out], sizeof(line) - out, "%d", number);
+        } else {
+            out += snprintf(&line[out], sizeof(line) - out, "%u", (uint32_t) number);
+        }
+        if (out > sizeof(line) - 1) {
+            out = sizeof(line) - 1;
+        }
+    }
+    line[out] = '\0';
+    sim_console_print(at, line);
+}
+
+void sim_console_receive(uint8_t byte) {
+    static FILE *raw;
+    static char text[256];
+    static size_t text_length = 0;
+    static sim_time text_at = 0;
+    static uint8_t frame[258];
+    static size_t frame_length = 0; // 0: not in a frame
+    static sim_time frame_at = 0;
+    uint8_t sum;
+    size_t i;
+
+    sim_statistics.console_bytes++;
+    if (sim_config.console && !raw && !(raw = fopen(sim_config.console, "wb"))) {
+        perror(sim_config.console);
+        sim_config.console = NULL;
+    }
+    if (raw) {
+        fputc(byte, raw);
+        fflush(raw);
+    }
+    if (sim_config.quiet) {
+        return;
+    }
+
+    if (frame_length == 0 && byte == TRACE_SYNC) {
+        frame_at = sim_now;
+        frame[frame_length++] = byte;
+        return;
+    }
+    if (frame_length > 0) {
+        frame[frame_length++] = byte;
+        if (frame_length == 2 && byte == 0) {
+            frame_length = 0; // no event is empty
+        } else if (frame_length > 2 && frame_length == (size_t) frame[1] + 3) {
+            sum = 0;
+            for (i = 2; i < frame_length - 1; i++) {
+                sum += frame[i];
+            }
+            if (sum == byte) {
+                sim_trace_decode(frame_at, &frame[2], frame[1]);
+            } else {
+                sim_console_print(frame_at, "corrupted trace frame");
+            }
+            frame_length = 0;
+        }
+        return;
+    }
+
+    if (text_length == 0) {
+        text_at = sim_now;
+    }
+    if (byte == '\n' || text_length == sizeof(text) - 1) {
+        text[text_length] = '\0';
+        sim_console_print(text_at, text);
+        text_length = 0;
+    } else if (byte != '\r') {
+        text[text_length++] = (byte >= 0x20 && byte < 0x7F) ? (char) byte : '.';
+    }
+}
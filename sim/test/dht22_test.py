@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+"""
+Checks that the firmware rejects every DHT22 answer the simulator damaged (--dht22-glitches), from
+the console and the report of a run: a short preamble or a spike overrunning the capture must end in
+DHT22_WRONG_PREAMBLE, a glitch in a bit in DHT22_WRONG_PULSE, and no other answer may fail.
+
+    build/pmcu-sim -p 6 -t 3000 --dht22-glitches 3 2>&1 | python3 test/dht22_test.py
+"""
+
+import re
+import sys
+
+
+def main():
+    errors, damaged = {}, None
+    for line in sys.stdin:
+        match = re.search(r"Error during DHT22 data reading: (\w+)", line)
+        if match:
+            errors[match.group(1)] = errors.get(match.group(1), 0) + 1
+        match = re.match(r"DHT22 answers damaged +(\d+) \(short preamble (\d+), glitch (\d+), spike (\d+)\)", line)
+        if match:
+            damaged = [int(n) for n in match.groups()]
+
+    if damaged is None:
+        print("no report of the DHT22 answers damaged")
+        return 1
+    total, preamble, glitch, spike = damaged
+    expected = {"DHT22_WRONG_PREAMBLE": preamble + spike, "DHT22_WRONG_PULSE": glitch}
+    expected = {error: count for error, count in expected.items() if count}
+
+    print("%d DHT22 answers damaged (short preamble %d, glitch %d, spike %d), rejected: %s"
+          % (total, preamble, glitch, spike, ", ".join("%s %d" % e for e in sorted(errors.items())) or "none"))
+    if not (preamble and glitch and spike):
+        print("not every damage was run")
+        return 1
+    if errors != expected:
+        print("expected %s" % ", ".join("%s %d" % e for e in sorted(expected.items())))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,114 @@
+/*
+ * The GPS decoders (nmea.c, ubx.c) against a NEO-6M stream: every byte of neo6m.ubx is fed to both,
+ * as gps_on_rx() does. The fix each one is left with must be the one of the last second of the
+ * stream, the frames cut by line noise in it being dropped. neo6m.py writes the stream.
+ *
+ *   build/test/gps_test test/neo6m.ubx
+ */
+#include "nmea.h"
+#include "ubx.h"
+
+#include <stdio.h>
+
+#define TEST_SECONDS 6
+#define TEST_NO_FIX  2 // the first seconds
+
+static int test_failed;
+
+static void test_field(const char *decoder, const char *name, long value, long expected) {
+    if (value != expected) {
+        printf("%s: %s %ld, expected %ld\n", decoder, name, value, expected);
+        test_failed = 1;
+    }
+}
+
+static void test_count(const char *message, unsigned count, unsigned expected) {
+    if (count != expected) {
+        printf("%s: %u decoded, expected %u\n", message, count, expected);
+        test_failed = 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    nmea_Parser parser;
+    ubx_Decoder decoder;
+    unsigned gga, rmc, gsa, posllh, sol, sol_fixed, dop, timeutc;
+    unsigned long bytes;
+    uint16_t message;
+    FILE *stream;
+    int byte;
+
+    if (argc != 2 || !(stream = fopen(argv[1], "rb"))) {
+        printf("usage: gps_test neo6m.ubx\n");
+        return 1;
+    }
+
+    nmea_init(&parser);
+    ubx_init(&decoder);
+    gga = rmc = gsa = posllh = sol = sol_fixed = dop = timeutc = 0;
+    bytes = 0;
+
+    while ((byte = fgetc(stream)) != EOF) {
+        bytes++;
+        switch (nmea_parse(&parser, byte)) {
+        case GPS_GGA: gga++; break;
+        case GPS_RMC: rmc++; break;
+        case GPS_GSA: gsa++; break;
+        }
+        switch (message = ubx_decode(&decoder, byte)) {
+        case (UBX_NAV << 8) | UBX_NAV_POSLLH: posllh++; break;
+        case (UBX_NAV << 8) | UBX_NAV_SOL: sol++; sol_fixed += decoder.fix.quality; break;
+        case (UBX_NAV << 8) | UBX_NAV_DOP: dop++; break;
+        case (UBX_NAV << 8) | UBX_NAV_TIMEUTC: timeutc++; break;
+        case 0: break;
+        default:
+            printf("ubx: unexpected message %04x\n", message);
+            test_failed = 1;
+        }
+    }
+    fclose(stream);
+
+    // one of each a second: not the noisy GGA and NAV-POSLLH, nor NAV-SVINFO, too long to be kept
+    test_count("GGA", gga, TEST_SECONDS);
+    test_count("RMC", rmc, TEST_SECONDS);
+    test_count("GSA", gsa, TEST_SECONDS);
+    test_count("NAV-POSLLH", posllh, TEST_SECONDS);
+    test_count("NAV-SOL", sol, TEST_SECONDS);
+    test_count("NAV-SOL with a fix", sol_fixed, TEST_SECONDS - TEST_NO_FIX);
+    test_count("NAV-DOP", dop, TEST_SECONDS);
+    test_count("NAV-TIMEUTC", timeutc, TEST_SECONDS);
+
+    // 10:26:14 UTC on 2026-10-17, 45.4646691 N 9.1903422 E, 122.812 m, 8 satellites
+    test_field("nmea", "parts", parser.fix.parts, GPS_GGA | GPS_RMC | GPS_GSA);
+    test_field("nmea", "time", parser.fix.time, 37574);
+    test_field("nmea", "date", parser.fix.date, 9786);
+    test_field("nmea", "status", parser.fix.status, 'A');
+    test_field("nmea", "latitude", parser.fix.latitude, 454646691); // 4527.88015
+    test_field("nmea", "longitude", parser.fix.longitude, 91903421); // 00911.42053, truncated
+    test_field("nmea", "altitude", parser.fix.altitude, 1228);
+    test_field("nmea", "quality", parser.fix.quality, 1);
+    test_field("nmea", "satellites", parser.fix.satellites, 8);
+    test_field("nmea", "mode", parser.fix.mode, 3);
+    test_field("nmea", "hdop", parser.fix.hdop, 10);
+    test_field("nmea", "pdop", parser.fix.pdop, 19);
+    test_field("nmea", "vdop", parser.fix.vdop, 16);
+
+    test_field("ubx", "parts", decoder.fix.parts, GPS_NAV_POSLLH | GPS_NAV_SOL | GPS_NAV_DOP | GPS_NAV_TIMEUTC);
+    test_field("ubx", "time", decoder.fix.time, 37574);
+    test_field("ubx", "date", decoder.fix.date, 9786);
+    test_field("ubx", "latitude", decoder.fix.latitude, 454646691);
+    test_field("ubx", "longitude", decoder.fix.longitude, 91903422);
+    test_field("ubx", "altitude", decoder.fix.altitude, 1228);
+    test_field("ubx", "quality", decoder.fix.quality, 1);
+    test_field("ubx", "satellites", decoder.fix.satellites, 8);
+    test_field("ubx", "mode", decoder.fix.mode, 3);
+    test_field("ubx", "hdop", decoder.fix.hdop, 10);
+    test_field("ubx", "pdop", decoder.fix.pdop, 19);
+    test_field("ubx", "vdop", decoder.fix.vdop, 16);
+    test_field("ubx", "horizontal accuracy", decoder.fix.horizontal_accuracy, 23);
+    test_field("ubx", "vertical accuracy", decoder.fix.vertical_accuracy, 37);
+
+    printf("%s: %lu bytes, %u NMEA sentences, %u UBX messages: %s\n", argv[1], bytes,
+           gga + rmc + gsa, posllh + sol + dop + timeutc, test_failed ? "FAILED" : "ok");
+    return test_failed;
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Writes neo6m.ubx: 6 seconds of a NEO-6M (protocol 7, u-blox 6) at 9600 baud, with its default NMEA
+sentences and the NAV messages the firmware polls, as u-center logs them. The receiver has no fix
+for 2 seconds, then a 3D fix drifting by a few centimetres. The last second has a NAV-POSLLH and a
+GGA cut by line noise, their checksums wrong, after the good ones: gps_test.c checks the fix they
+all leave against the values of that second.
+
+    python3 test/neo6m.py test/neo6m.ubx
+"""
+
+import math
+import struct
+import sys
+
+START = 10 * 3600 + 26 * 60 + 9  # 10:26:09 UTC
+DAY = 6  # 2026-10-17 is a Saturday
+WEEK = 2441
+LEAP_SECONDS = 18
+
+
+def nmea(body):
+    checksum = 0
+    for c in body.encode():
+        checksum ^= c
+    return b"$%s*%02X\r\n" % (body.encode(), checksum)
+
+
+def ubx(message_id, payload):
+    frame = struct.pack("<BBH", 0x01, message_id, len(payload)) + payload
+    ck_a = ck_b = 0
+    for byte in frame:
+        ck_a = (ck_a + byte) & 0xFF
+        ck_b = (ck_b + ck_a) & 0xFF
+    return b"\xb5\x62" + frame + bytes((ck_a, ck_b))
+
+
+def ecef(latitude, longitude, height):
+    a, e2 = 6378137.0, 6.69437999014e-3
+    phi, lam = math.radians(latitude), math.radians(longitude)
+    n = a / math.sqrt(1 - e2 * math.sin(phi) ** 2)
+    return (round((n + height) * math.cos(phi) * math.cos(lam) * 100),
+            round((n + height) * math.cos(phi) * math.sin(lam) * 100),
+            round((n * (1 - e2) + height) * math.sin(phi) * 100))
+
+
+def minutes(value, degrees_digits):
+    degrees = int(value)
+    return "%0*d%08.5f" % (degrees_digits, degrees, (value - degrees) * 60)
+
+
+def second(k):
+    t = START + k
+    itow = ((DAY * 86400 + t + LEAP_SECONDS) * 1000) & 0xFFFFFFFF
+    hms = "%02d%02d%02d.00" % (t // 3600, t // 60 % 60, t % 60)
+    fix = k >= 2
+    out = b""
+
+    if k == 0:
+        out += nmea("GPTXT,01,01,02,u-blox ag - www.u-blox.com")
+        out += nmea("GPTXT,01,01,02,ROM CORE 7.03 (45969) Mar 17 2011 16:18:34")
+
+    # the position of the last second is given in 1e-7 °, mm and 0.01 as the messages carry it
+    lat = 454646691 - (5 - k) * 9
+    lon = 91903422 + (5 - k) * 6
+    hmsl = 122812 - (5 - k) * 41
+    height = hmsl + 47500
+
+    if fix:
+        latitude, longitude = lat / 1e7, lon / 1e7
+        rmc_lat = "%s,N" % minutes(latitude, 2)
+        rmc_lon = "%s,E" % minutes(longitude, 3)
+        out += nmea("GPRMC,%s,A,%s,%s,0.041,,171026,,,A" % (hms, rmc_lat, rmc_lon))
+        out += nmea("GPVTG,,T,,M,0.041,N,0.076,K,A")
+        gga = "GPGGA,%s,%s,%s,1,08,1.09,%.1f,M,47.5,M,," % (hms, rmc_lat, rmc_lon, hmsl / 1000)
+        out += nmea(gga)
+        if k == 5:
+            noisy = nmea(gga.replace(rmc_lat, "4527.98015,N"))
+            out += noisy[:-5] + nmea(gga)[-5:]  # the checksum of the sentence before the noise
+        out += nmea("GPGSA,A,3,05,13,15,18,20,24,29,30,,,,,1.98,1.09,1.65")
+        out += nmea("GPGSV,3,1,11,05,32,301,33,13,52,058,39,15,71,174,41,18,24,265,31")
+        out += nmea("GPGSV,3,2,11,20,42,101,36,24,17,046,28,29,11,315,26,30,05,130,21")
+        out += nmea("GPGSV,3,3,11,41,33,221,,44,28,147,,48,36,213,")
+        out += nmea("GPGLL,%s,%s,%s,A,A" % (rmc_lat, rmc_lon, hms))
+    else:
+        out += nmea("GPRMC,%s,V,,,,,,,171026,,,N" % hms)
+        out += nmea("GPVTG,,,,,,,,,N")
+        out += nmea("GPGGA,%s,,,,,0,03,4.37,,,,,," % hms)
+        out += nmea("GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99")
+        out += nmea("GPGSV,2,1,06,05,32,301,24,13,52,058,31,15,71,174,33,18,24,265,")
+        out += nmea("GPGSV,2,2,06,20,42,101,,24,17,046,")
+        out += nmea("GPGLL,,,,,%s,V,N" % hms)
+
+    if fix:
+        posllh = struct.pack("<IiiiiII", itow, lon, lat, height, hmsl, 2315 + (5 - k) * 140, 3720 + (5 - k) * 210)
+        x, y, z = ecef(lat / 1e7, lon / 1e7, height / 1000)
+        sol = struct.pack("<IihBBiiiIiiiIHBBI", itow, -21784, WEEK, 3, 0x0D, x, y, z, 1247, 3, -2, 1, 51, 198, 2, 8, 0x0000E1F8)
+        dop = struct.pack("<IHHHHHHH", itow, 231, 198, 118, 165, 109, 87, 66)
+        timeutc = struct.pack("<IIiHBBBBBB", itow, 31, -21784, 2026, 10, 17, t // 3600, t // 60 % 60, t % 60, 0x07)
+    else:
+        posllh = struct.pack("<IiiiiII", itow, 0, 0, 0, -17000, 4294967295, 3750000000)
+        sol = struct.pack("<IihBBiiiIiiiIHBBI", itow, 0, WEEK, 0, 0x0C, 637813700, 0, 0, 650000000, 0, 0, 0, 2000, 9999, 2, 3, 0x0000E1F8)
+        dop = struct.pack("<IHHHHHHH", itow, 9999, 9999, 9999, 9999, 9999, 9999, 9999)
+        timeutc = struct.pack("<IIiHBBBBBB", itow, 4294967295, 0, 2026, 10, 17, t // 3600, t // 60 % 60, t % 60, 0x03)
+
+    out += ubx(0x02, posllh)
+    if k == 5:
+        noisy = bytearray(ubx(0x02, struct.pack("<IiiiiII", itow, lon, 454700000, height, hmsl, 2315, 3720)))
+        noisy[-2:] = ubx(0x02, posllh)[-2:]
+        out += bytes(noisy)
+    out += ubx(0x06, sol)
+    out += ubx(0x04, dop)
+    out += ubx(0x21, timeutc)
+
+    # NAV-SVINFO, longer than what the decoder keeps: it must be skipped
+    channels = [(5, 33), (13, 39), (15, 41), (18, 31), (20, 36), (24, 28), (29, 26), (30, 21), (41, 0), (44, 0)]
+    svinfo = struct.pack("<IBBH", itow, len(channels), 1, 0)
+    for i, (sv, cno) in enumerate(channels):
+        used = fix and cno > 0
+        svinfo += struct.pack("<BBBBBbhi", i, sv, 0x0D if used else 0x04, 0x07 if used else 0x01, cno, 30, 180, 0)
+    out += ubx(0x30, svinfo)
+    return out
+
+
+def main():
+    with open(sys.argv[1], "wb") as f:
+        for k in range(6):
+            f.write(second(k))
+
+
+if __name__ == "__main__":
+    main()
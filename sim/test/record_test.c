@@ -0,0 +1,191 @@
+/*
+ * Round trip of the record encoding (record.c): batches of edge cases are encoded and decoded back
+ * by record_decode, and the malformed records must be rejected. Every batch is then printed for
+ * record_test.py, which checks tools/record.py against the same samples:
+ *
+ *   P <payload in hex>              a batch, as published
+ *   R <sensors> <22 fields>         the fields of each of its records, in encoding order
+ *   M <record in hex>               a malformed record
+ */
+#include "record.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_FIELDS 22
+
+void record_get_fields(const record_Sample *sample, int32_t *fields);
+void record_set_fields(record_Sample *sample, const int32_t *fields);
+
+static int test_failed;
+
+static record_Sample test_sample(uint8_t sensors, const int32_t *fields) {
+    record_Sample sample;
+
+    memset(&sample, 0, sizeof(sample));
+    record_set_fields(&sample, fields);
+    sample.sensors = sensors;
+    return sample;
+}
+
+static void test_print_hex(char kind, const uint8_t *bytes, size_t length) {
+    size_t i;
+
+    printf("%c ", kind);
+    for (i = 0; i < length; i++) {
+        printf("%02x", bytes[i]);
+    }
+    printf("\n");
+}
+
+/* Whether the fields of the sensors read are the same */
+static int test_same(const record_Sample *a, const record_Sample *b) {
+    static const uint8_t sensors[TEST_FIELDS] = {
+        RECORD_DHT22, RECORD_DHT22,
+        RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS, RECORD_GPS,
+        RECORD_LOCATION, RECORD_LOCATION, RECORD_LOCATION,
+        RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30,
+        RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30, RECORD_SPS30,
+    };
+    int32_t fields_a[TEST_FIELDS], fields_b[TEST_FIELDS];
+    size_t i;
+
+    if (a->sensors != b->sensors) {
+        return 0;
+    }
+    record_get_fields(a, fields_a);
+    record_get_fields(b, fields_b);
+    for (i = 0; i < TEST_FIELDS; i++) {
+        if ((a->sensors & sensors[i]) && fields_a[i] != fields_b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Encodes the samples as a batch, decodes it back and prints it. Returns the length of the last record */
+static size_t test_batch(const char *name, const record_Sample *samples, size_t count) {
+    uint8_t payload[1024];
+    record_Sample decoded, previous;
+    int32_t fields[TEST_FIELDS];
+    size_t i, j, length, pos;
+
+    payload[0] = RECORD_VERSION;
+    payload[1] = count;
+    pos = 2;
+    length = 0;
+    for (i = 0; i < count; i++) {
+        length = record_encode(&payload[pos + 1], &samples[i], i ? &samples[i - 1] : NULL);
+        if (length > RECORD_LENGTH) {
+            printf("# %s: record %zu takes %zu bytes, more than RECORD_LENGTH\n", name, i, length);
+            test_failed = 1;
+        }
+        payload[pos] = length;
+        pos += 1 + length;
+    }
+
+    test_print_hex('P', payload, pos);
+    for (i = 0; i < count; i++) {
+        record_get_fields(&samples[i], fields);
+        printf("R %u", samples[i].sensors);
+        for (j = 0; j < TEST_FIELDS; j++) {
+            printf(" %ld", (long) fields[j]);
+        }
+        printf("\n");
+    }
+
+    pos = 2;
+    for (i = 0; i < count; i++) {
+        length = payload[pos];
+        if (record_decode(&payload[pos + 1], length, &decoded, i ? &previous : NULL) != length
+                || !test_same(&decoded, &samples[i])) {
+            printf("# %s: record %zu decoded wrong by record_decode\n", name, i);
+            test_failed = 1;
+        }
+        previous = decoded;
+        pos += 1 + length;
+    }
+    return length;
+}
+
+static void test_malformed(const char *name, const uint8_t *record, size_t length) {
+    record_Sample sample;
+
+    if (record_decode(record, length, &sample, NULL) == length) {
+        printf("# %s: malformed record accepted by record_decode\n", name);
+        test_failed = 1;
+    }
+    test_print_hex('M', record, length);
+}
+
+int main() {
+    // humidity, temperature, GPS time, latitude, longitude, altitude, HDOP, fix, satellites,
+    // location time, latitude, longitude, PM mass 1.0 to 10, PM number 0.5 to 10, size
+    static const int32_t typical[TEST_FIELDS] = {
+        553, 217, 45296, 452123456, 76543210, 2451, 9, 1, 8, 812345678, 452120000, 76540000,
+        52, 61, 66, 70, 351, 412, 420, 421, 422, 612,
+    };
+    static const int32_t falling[TEST_FIELDS] = {
+        401, -400, 45301, 452123400, 76543100, -125, 8, 1, 7, 812345600, 452110000, 76530000,
+        12, 13, 14, 15, 101, 102, 103, 104, 105, 420,
+    };
+    static const int32_t highest[TEST_FIELDS] = {
+        32767, 32767, (int32_t) 0xFFFFFFFFUL, INT32_MAX, INT32_MAX, 32767, 255, 255, 255,
+        (int32_t) 0xFFFFFFFFUL, INT32_MAX, INT32_MAX,
+        65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535,
+    };
+    static const int32_t lowest[TEST_FIELDS] = {
+        -32768, -32768, INT32_MIN, INT32_MIN, INT32_MIN, -32768, 0, 0, 0, INT32_MIN, INT32_MIN, INT32_MIN,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    };
+    static const int32_t longest[TEST_FIELDS] = {
+        -32768, -32768, INT32_MIN, INT32_MIN, INT32_MIN, -32768, 255, 255, 255, INT32_MIN, INT32_MIN, INT32_MIN,
+        65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535,
+    };
+    static const int32_t varint_max[TEST_FIELDS] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, INT32_MIN, INT32_MAX,
+    };
+    static const uint8_t unknown_sensor[] = { 0x10 };
+    static const uint8_t cut_short[] = { RECORD_DHT22, 0x80 };
+    static const uint8_t varint_too_long[] = { RECORD_DHT22, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0x00 };
+    static const uint8_t bytes_left[] = { RECORD_DHT22, 0x02, 0x04, 0x00 };
+    record_Sample samples[8];
+    const uint8_t all = RECORD_DHT22 | RECORD_GPS | RECORD_LOCATION | RECORD_SPS30;
+
+    // negative deltas, then sensors missing and back (their deltas start over from 0)
+    samples[0] = test_sample(all, typical);
+    samples[1] = test_sample(all, falling);
+    samples[2] = test_sample(RECORD_DHT22 | RECORD_LOCATION, typical);
+    samples[3] = test_sample(RECORD_GPS | RECORD_SPS30, falling);
+    samples[4] = test_sample(0, typical);
+    samples[5] = test_sample(all, typical);
+    test_batch("deltas", samples, 6);
+
+    // the extremes of every field, and the deltas between them wrapping around 32 bits
+    samples[0] = test_sample(all, highest);
+    samples[1] = test_sample(all, lowest);
+    samples[2] = test_sample(all, highest);
+    samples[3] = test_sample(all, lowest);
+    test_batch("extremes", samples, 4);
+
+    // INT32_MIN and INT32_MAX after 0 zigzag to 0xFFFFFFFF and 0xFFFFFFFE: 5 bytes each
+    samples[0] = test_sample(RECORD_LOCATION, varint_max);
+    if (test_batch("varint", samples, 1) != 1 + 1 + 5 + 5) {
+        printf("# varint: not 5 bytes\n");
+        test_failed = 1;
+    }
+
+    // the longest record there is, alone and after the opposite extremes
+    samples[0] = test_sample(all, longest);
+    test_batch("longest", samples, 1);
+    samples[0] = test_sample(all, highest);
+    samples[1] = test_sample(all, longest);
+    test_batch("longest after", samples, 2);
+
+    test_malformed("unknown sensor", unknown_sensor, sizeof(unknown_sensor));
+    test_malformed("cut short", cut_short, sizeof(cut_short));
+    test_malformed("varint too long", varint_too_long, sizeof(varint_too_long));
+    test_malformed("bytes left", bytes_left, sizeof(bytes_left));
+
+    return test_failed;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Checks tools/record.py against the batches of record_test.c: each one must decode to the fields
+record_test encoded, and each malformed record must be rejected.
+
+    build/test/record_test | python3 test/record_test.py
+"""
+
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+
+import record  # noqa: E402
+
+
+def main():
+    failed, payloads, expected = 0, 0, []
+
+    def check():
+        nonlocal failed
+        if payload is None:
+            return
+        try:
+            decoded = record.decode_payload(payload)
+        except record.Malformed as error:
+            print("payload %d: %s" % (payloads, error))
+            failed = 1
+            return
+        if len(decoded) != len(expected):
+            print("payload %d: %d records, %d expected" % (payloads, len(decoded), len(expected)))
+            failed = 1
+            return
+        for i, (fields, (sensors, values)) in enumerate(zip(decoded, expected)):
+            wanted = {"sensors": sensors}
+            for (name, sensor, _), value in zip(record.FIELDS, values):
+                if sensors & sensor:
+                    wanted[name] = value
+            if fields != wanted:
+                print("payload %d, record %d: %s, %s expected" % (payloads, i, fields, wanted))
+                failed = 1
+
+    payload = None
+    for line in sys.stdin:
+        kind, _, rest = line.strip().partition(" ")
+        if kind == "P":
+            check()
+            payload, expected = bytes.fromhex(rest), []
+            payloads += 1
+        elif kind == "R":
+            numbers = [int(number) for number in rest.split()]
+            expected.append((numbers[0], numbers[1:]))
+        elif kind == "M":
+            data = bytes.fromhex(rest)
+            try:
+                record.decode_payload(bytes([record.VERSION, 1, len(data)]) + data)
+            except record.Malformed:
+                continue
+            print("malformed record %s accepted" % rest)
+            failed = 1
+        else:
+            print(line.strip())  # a failure of record_test itself
+            failed = 1
+    check()
+
+    print("%d payloads checked against tools/record.py: %s" % (payloads, "FAILED" if failed else "ok"))
+    return failed
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,200 @@
+/*
+ * Stress test of the ring buffer (ring_buffer.c), with one side in the main context and the other in a
+ * simulated ISR: a host timer signal preempts the main context at arbitrary points, as an interrupt does,
+ * and never the other way round. Both directions are run, the ISR producing (a UART RX) then consuming
+ * (a UART TX), through every read and write of the API. The bytes must come out as they went in, and
+ * the runs must have wrapped the storage, filled it and emptied it.
+ */
+#include "ring_buffer.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define TEST_BYTES 1000000UL // per direction and size
+
+RING_BUFFER(test_ring_small, 16);
+RING_BUFFER(test_ring_large, 256);
+
+static ring_buffer *test_ring;
+static volatile sig_atomic_t test_isr_producing;
+
+// the byte sequence, which a lost, repeated or swapped byte breaks
+static volatile unsigned long test_produced, test_consumed;
+static volatile sig_atomic_t test_failed;
+static unsigned long test_failed_at;
+
+static volatile unsigned long test_fulls, test_empties, test_wraps, test_ticks;
+
+static uint8_t test_byte(unsigned long n) {
+    return (uint8_t) (n % 251);
+}
+
+static uint32_t test_next(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/* Writes up to length bytes of the sequence, through one of the two writes */
+static void test_produce(size_t length, int span) {
+    uint8_t bytes[512];
+    size_t i, written;
+    uint16_t head;
+
+    if (length > TEST_BYTES - test_produced) {
+        length = TEST_BYTES - test_produced;
+    }
+    if (length == 0) {
+        return;
+    }
+    for (i = 0; i < length; i++) {
+        bytes[i] = test_byte(test_produced + i);
+    }
+
+    head = test_ring->head;
+    if (span) {
+        written = ring_buffer_write_span(test_ring, bytes, length);
+    } else {
+        for (written = 0; written < length && ring_buffer_write(test_ring, bytes[written]); written++);
+    }
+    if (written < length) {
+        test_fulls++;
+    }
+    if (written > 0 && ((head + written - 1) & test_ring->mask) < (head & test_ring->mask)) {
+        test_wraps++;
+    }
+    test_produced += written;
+}
+
+static void test_check(const uint8_t *bytes, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        if (bytes[i] != test_byte(test_consumed + i) && !test_failed) {
+            test_failed = 1;
+            test_failed_at = test_consumed + i;
+        }
+    }
+    test_consumed += length;
+}
+
+/* Reads up to length bytes, through one of the four reads */
+static void test_consume(size_t length, int kind) {
+    uint8_t bytes[512];
+    const uint8_t *span;
+    size_t read;
+
+    switch (kind) {
+    case 0:
+        for (read = 0; read < length && ring_buffer_read(test_ring, &bytes[read]); read++);
+        break;
+    case 1:
+        read = ring_buffer_read_span(test_ring, bytes, length);
+        break;
+    case 2:
+        read = ring_buffer_peek_span(test_ring, &span);
+        if (read > length) {
+            read = length;
+        }
+        memcpy(bytes, span, read);
+        ring_buffer_consume(test_ring, read);
+        break;
+    default:
+        // as the AT engine scans ahead of the tail, the count seen again before each byte
+        for (read = 0; read < length && read < ring_buffer_count(test_ring); read++) {
+            bytes[read] = ring_buffer_peek_at(test_ring, read);
+        }
+        ring_buffer_consume(test_ring, read);
+        break;
+    }
+    if (read < length) {
+        test_empties++;
+    }
+    test_check(bytes, read);
+}
+
+static void test_isr(int signal) {
+    static uint32_t seed = 7;
+    size_t length;
+
+    (void) signal;
+
+    test_ticks++;
+    length = test_next(&seed) % (2 * (test_ring->mask + 1)) + 1;
+    if (test_isr_producing) {
+        if (test_produced < TEST_BYTES) {
+            test_produce(length, test_next(&seed) & 1);
+        }
+    } else {
+        test_consume(length, test_next(&seed) % 4);
+    }
+}
+
+static int test_run(ring_buffer *ring, int isr_producing) {
+    static uint32_t seed = 3;
+    sigset_t alarm;
+    size_t length;
+
+    // interrupts disabled meanwhile
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &alarm, NULL);
+
+    test_ring = ring;
+    ring_buffer_clear(ring);
+    test_produced = test_consumed = 0;
+    test_fulls = test_empties = test_wraps = test_ticks = 0;
+    test_failed = 0;
+    test_isr_producing = isr_producing;
+
+    sigprocmask(SIG_UNBLOCK, &alarm, NULL);
+
+    while (test_consumed < TEST_BYTES && !test_failed) {
+        // smaller steps than the ISR, so that it often finds the other side half-way
+        length = test_next(&seed) % (ring->mask + 1) + 1;
+        if (isr_producing) {
+            test_consume(length, test_next(&seed) % 4);
+        } else if (test_produced < TEST_BYTES) {
+            test_produce(length, test_next(&seed) & 1);
+        }
+    }
+
+    printf("%-14s %3u bytes: %lu ticks, %lu wraps, %lu full, %lu empty",
+           isr_producing ? "ISR producer" : "ISR consumer", ring->mask + 1,
+           (unsigned long) test_ticks, (unsigned long) test_wraps, (unsigned long) test_fulls, (unsigned long) test_empties);
+    if (test_failed) {
+        printf(": FAILED, wrong byte %lu\n", test_failed_at);
+        return 1;
+    }
+    if (!ring_buffer_is_empty(ring) || !test_wraps || !test_fulls || !test_empties) {
+        printf(": FAILED, runs not covered\n");
+        return 1;
+    }
+    printf(": ok\n");
+    return 0;
+}
+
+int main() {
+    struct sigaction action;
+    struct itimerval timer;
+    int failed;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = test_isr;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, NULL);
+
+    memset(&timer, 0, sizeof(timer));
+    timer.it_interval.tv_usec = 20;
+    timer.it_value.tv_usec = 20;
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    failed = 0;
+    failed |= test_run(&test_ring_small, 1);
+    failed |= test_run(&test_ring_large, 1);
+    failed |= test_run(&test_ring_small, 0);
+    failed |= test_run(&test_ring_large, 0);
+    return failed;
+}
@@ -1,6 +1,11 @@
 #include "sps30.h"
 
 #include <msp430.h>
+#include <string.h>
+
+#include "shdlc.h"
+#include "timer.h"
+#include "uart_hub.h"
 
 //MSP to SPS30 packet structure
 //START + ADDRESS + CMD + LENGTH + ...bytes... + CHECKSUM + STOP
@@ -8,22 +13,23 @@
 //SPS30 to MSP packet structure
 //START + ADDRESS + CMD + STATE + LENGTH + ...bytes... + CHECKSUM + STOP
 
-//NOTE: for sure the second has got at least 1 more byte than the first
-
-//ARRAY LENGTHS
-#define MEASURED_DATA_LENGTH 47
-#define START_ACK_LENGTH 7
-#define STOP_ACK_LENGTH 7
-
 //COMMAND CODES
 #define START 0x00
 #define STOP 0x01
 #define READ 0x03
+#define SLEEP 0x10
+#define WAKE_UP 0x11
 #define INFO_CLEAN 0x80
 #define CLEAN 0x56
 #define INFO 0xD0
+#define VERSION 0xD1
+#define STATUS 0xD2
 #define RESET 0xD3
 
+//DEVICE INFORMATION
+#define INFO_PRODUCT_TYPE 0x00
+#define INFO_SERIAL 0x03
+
 //STATE CODES
 #define NO_ERROR 0x00
 #define WRONG_DATA_LENGTH 0x01
@@ -36,223 +42,209 @@
 //UART SPS30 ADDRESS
 #define ADDRESS 0x00
 
-//START AND STOP BYTES
-#define START_BYTE 0x7E
-#define STOP_BYTE 0x7E
-
 //COMMANDS
 
-void write_byte(uint8_t byte) {
-    uint8_t tmp = byte;
-    switch (byte) {
-    case 0x7E:
-        byte = 0x5E;
-        break;
-    case 0x7D:
-        byte = 0x5D;
-        break;
-    case 0x11:
-        byte = 0x31;
-        break;
-    case 0x13:
-        byte = 0x33;
-        break;
-    }
-    if (tmp != byte) {
-        uart_write(UART_A0, 0x7D);
-    }
-    uart_write(UART_A0, byte);
-}
+shdlc_Decoder sps30_decoder;
+volatile uint8_t sps30_received; // a frame has been posted by the decoder
+timer_Task sps30_timeout;
+uint8_t sps30_frame[SHDLC_FRAME_LENGTH(5)]; // the longest command: write auto cleaning interval
 
-void write_buffer(uint8_t *command, size_t length) {
-    size_t i;
-    for (i = 0; i < length; i++) {
-        write_byte(command[i]);
+int sps30_on_rx(unsigned char byte) {
+    if (shdlc_decode(&sps30_decoder, byte)) {
+        sps30_received = 1;
+        return 1;
     }
+    return 0; // nothing to wake up for
 }
 
-PMCU_Error read_byte(uint8_t *byte) {
-    uart_read(UART_A0, byte, SPS30_TIMEOUT);
-    if (*byte == 0x7D) {
-        uart_read(UART_A0, byte, SPS30_TIMEOUT);
-        switch (*byte) {
-        case 0x5E:
-            *byte = 0x7E;
-            break;
-        case 0x5D:
-            *byte = 0x7D;
-            break;
-        case 0x31:
-            *byte = 0x11;
-            break;
-        case 0x33:
-            *byte = 0x13;
-            break;
-        default:
-            return SPS30_INVALID_STUFFED_BYTE;
-        }
+PMCU_Error sps30_state_error(uint8_t state) {
+    switch (state) {
+    case NO_ERROR: return PMCU_OK;
+    case WRONG_DATA_LENGTH: return SPS30_WRONG_DATA_LENGTH;
+    case UNKNOWN_CMD: return SPS30_UNKNOWN_COMMAND;
+    case FORBIDDEN_CMD: return SPS30_NO_ACCESS_RIGHT_FOR_COMMAND;
+    case ILLEGAL_PARAMETER: return SPS30_ILLEGAL_COMMAND_PARAMETER;
+    case ARG_OUT_OF_RANGE: return SPS30_INTERNAL_FUNCTION_ARGUMENT_OUT_OF_RANGE;
+    case CMD_NOT_IN_STATE: return SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE;
     }
-    return PMCU_OK;
+    return SPS30_UNKNOWN_STATE;
 }
 
-PMCU_Error send_shdlc_frame(uint8_t command, const uint8_t *payload, size_t payload_length) {
-    size_t i;
-    uint8_t checksum;
+/*
+ * Sends the command, and waits for its response frame, decoded on the way in by the RX interrupt:
+ * its payload is then in sps30_decoder. The hub must be on the SPS30.
+ */
+PT_THREAD(sps30_execute_pt(pt *thread, uint8_t command, const uint8_t *payload, uint8_t length, PMCU_Error *error)) {
+    PT_BEGIN(thread);
+
+    uart_discard(UART_A0);
+    shdlc_init(&sps30_decoder);
+    sps30_received = 0;
+    uart_subscribe_rx_listener(UART_A0, sps30_on_rx);
+
+    uart_write_buffer(UART_A0, sps30_frame, shdlc_frame(sps30_frame, ADDRESS, command, payload, length));
+
+    timer_task_start(&sps30_timeout, SPS30_TIMEOUT);
+    PT_WAIT_UNTIL(thread, sps30_received || sps30_timeout.satisfied);
+    timer_task_cancel(&sps30_timeout);
+
+    uart_subscribe_rx_listener(UART_A0, NULL);
+    uart_discard(UART_A0); // already decoded
+
+    if (!sps30_received) {
+        *error = UART_TIMEOUT_ERROR;
+    } else if (sps30_decoder.error != PMCU_OK) {
+        *error = sps30_decoder.error;
+    } else if (sps30_decoder.address != ADDRESS || sps30_decoder.command != command) {
+        *error = SPS30_UNEXPECTED_RESPONSE;
+    } else {
+        *error = sps30_state_error(sps30_decoder.status);
+    }
 
-    // start
-    uart_write(UART_A0, 0x7E);
+    PT_END(thread);
+}
 
-    // address
-    uart_write(UART_A0, 0x00);
-    checksum = 0x00;
+PMCU_Error sps30_execute(uint8_t command, const uint8_t *payload, uint8_t length) {
+    PMCU_Error error;
+    pt thread;
 
-    // command
-    uart_write(UART_A0, command);
-    checksum += command;
+    PT_INIT(&thread);
+    PT_RUN(sps30_execute_pt(&thread, command, payload, length, &error));
 
-    // length
-    payload_length = payload_length & 0xff;
-    uart_write(UART_A0, payload_length);
-    checksum += payload_length;
+    return error;
+}
 
-    // payload
-    for (i = 0; i < payload_length; i++) {
-        write_byte(payload[i]);
-        checksum += payload[i];
+/* Executes the command, whose response must hold at least length bytes */
+PMCU_Error sps30_query(uint8_t command, const uint8_t *payload, uint8_t payload_length, uint8_t length) {
+    __pmcu_handle(sps30_execute(command, payload, payload_length));
+    if (sps30_decoder.length < length) {
+        return SPS30_WRONG_FRAME_LENGTH;
     }
-
-    // checksum
-    checksum = ~checksum;
-    uart_write(UART_A0, checksum);
-
-    // stop
-    uart_write(UART_A0, 0x7E);
-
     return PMCU_OK;
 }
 
-/**
- * Receives an SHDLC frame and saves the payload on a given buffer.
- * - buffer: the array where to store results
- * - buffer_length: the length of the given buffer (just for test purposes)
- * - payload_length: a pointer to a variable where the real payload length will be saved
- */
-PMCU_Error recv_shdlc_frame(uint8_t *buffer, size_t buffer_length, size_t *payload_length) {
-    uint8_t byte, state, length, i, checksum;
-    PMCU_Error error;
+uint32_t sps30_u32(const uint8_t *data) {
+    return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
 
-    // start
-    uart_read(UART_A0, &byte, SPS30_TIMEOUT);
-    if (byte != 0x7E) {
-        return SPS30_START_BYTE_EXPECTED;
-    }
+PMCU_Error sps30_start_measurement(uint8_t format) {
+    const uint8_t payload[] = {0x01, format}; // sub-command, output format
+    return sps30_execute(START, payload, 2);
+}
 
-    // address
-    uart_read(UART_A0, &byte, SPS30_TIMEOUT);
-    checksum = byte;
+PMCU_Error sps30_stop_measurement() {
+    return sps30_execute(STOP, NULL, 0);
+}
 
-    // command
-    uart_read(UART_A0, &byte, SPS30_TIMEOUT);
-    checksum += byte;
+pt sps30_execute_thread;
 
-    // state
-    uart_read(UART_A0, &state, SPS30_TIMEOUT);
-    checksum += state;
+PT_THREAD(sps30_read_measured_values_pt(pt *thread, uint8_t *buffer, size_t buffer_length, size_t *payload_length, PMCU_Error *error)) {
+    PT_BEGIN(thread);
 
-    // length
-    uart_read(UART_A0, &length, SPS30_TIMEOUT);
-    checksum += length;
-    *payload_length = length;
+    PT_WAIT_UNTIL(thread, uart_hub_acquire(UART_HUB_SPS30));
 
-    if (buffer && length > buffer_length) {
-        return SPS30_BUFFER_TOO_SMALL;
-    }
+    PT_SPAWN(thread, &sps30_execute_thread, sps30_execute_pt(&sps30_execute_thread, READ, NULL, 0, error));
 
-    // payload
-    for (i = 0; i < length; i++) {
-        if ((error = read_byte(&byte)) != PMCU_OK) {
-            return error;
-        }
-        checksum += byte;
-        if (buffer) {
-            buffer[i] = byte;
+    if (*error == PMCU_OK) {
+        if (sps30_decoder.length > buffer_length) {
+            *error = SPS30_BUFFER_TOO_SMALL;
+        } else {
+            memcpy(buffer, sps30_decoder.payload, sps30_decoder.length);
+            *payload_length = sps30_decoder.length;
         }
     }
 
-    // checksum
-    uart_read(UART_A0, &byte, SPS30_TIMEOUT);
-    checksum = ~checksum;
-    if (checksum != byte) {
-        return SPS30_WRONG_CHECKSUM;
-    }
+    uart_hub_release();
 
-    // stop
-    uart_read(UART_A0, &byte, SPS30_TIMEOUT);
-    if (byte != 0x7E) {
-        return SPS30_STOP_BYTE_EXPECTED;
-    }
+    PT_END(thread);
+}
 
-    if (state != 0x00) {
-        switch (state) {
-        case 0x01: return SPS30_WRONG_DATA_LENGTH;
-        case 0x02: return SPS30_UNKNOWN_COMMAND;
-        case 0x03: return SPS30_NO_ACCESS_RIGHT_FOR_COMMAND;
-        case 0x04: return SPS30_ILLEGAL_COMMAND_PARAMETER;
-        case 0x28: return SPS30_INTERNAL_FUNCTION_ARGUMENT_OUT_OF_RANGE;
-        case 0x43: return SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE;
-        }
-    }
+PMCU_Error sps30_read_measured_values(uint8_t *buffer, size_t buffer_length, size_t *payload_length) {
+    PMCU_Error error;
+    pt thread;
 
-    return PMCU_OK;
+    PT_INIT(&thread);
+    PT_RUN(sps30_read_measured_values_pt(&thread, buffer, buffer_length, payload_length, &error));
+
+    return error;
+}
+
+PMCU_Error sps30_sleep() {
+    return sps30_execute(SLEEP, NULL, 0);
 }
 
-inline PMCU_Error skip_shdlc_frame() {
-    return recv_shdlc_frame(NULL, NULL, NULL);
+PMCU_Error sps30_wake_up() {
+    // the first byte, a low pulse on its RX, wakes the UART of the SPS30 up: the command is then understood
+    uart_write(UART_A0, 0xFF);
+    return sps30_execute(WAKE_UP, NULL, 0);
 }
 
-PMCU_Error sps30_start_measurement() {
-    const uint8_t command[] = {0x01, 0x03};
-    send_shdlc_frame(0x00, command, 2);
-    return skip_shdlc_frame();
+PMCU_Error sps30_start_fan_cleaning() {
+    return sps30_execute(CLEAN, NULL, 0);
 }
 
-PMCU_Error sps30_read_measured_values(uint8_t* buffer, size_t buffer_length, size_t *payload_length) {
-    send_shdlc_frame(0x03, NULL, NULL);
-    return recv_shdlc_frame(buffer, buffer_length, payload_length);
+PMCU_Error sps30_read_cleaning_interval(uint32_t *interval) {
+    const uint8_t payload[] = {0x00}; // sub-command
+
+    __pmcu_handle(sps30_query(INFO_CLEAN, payload, 1, 4));
+    *interval = sps30_u32(sps30_decoder.payload);
+    return PMCU_OK;
+}
+
+PMCU_Error sps30_write_cleaning_interval(uint32_t interval) {
+    uint8_t payload[5];
+
+    payload[0] = 0x00; // sub-command
+    payload[1] = interval >> 24;
+    payload[2] = interval >> 16;
+    payload[3] = interval >> 8;
+    payload[4] = interval;
+    return sps30_execute(INFO_CLEAN, payload, 5);
 }
 
-int sps30_stop_measurement() {
-    uint8_t command[] = {0x7E, 0x00, 0x01, 0x00, 0xFE, 0x7E};
-    uart_write_buffer(UART_A0, command, 6);
+/* The string of a device information, cut to the buffer */
+PMCU_Error sps30_read_information(uint8_t kind, char *buffer, size_t length) {
+    size_t copied;
 
-    uart_read_buffer(UART_A0, command, 7, SPS30_TIMEOUT); // ACK
-    return 0;
+    __pmcu_handle(sps30_execute(INFO, &kind, 1));
+    if (length == 0) {
+        return SPS30_BUFFER_TOO_SMALL;
+    }
+    copied = sps30_decoder.length < length - 1 ? sps30_decoder.length : length - 1;
+    memcpy(buffer, sps30_decoder.payload, copied);
+    buffer[copied] = '\0'; // the NUL of the SPS30 may have been cut
+    return PMCU_OK;
 }
 
-int sps30_ask_measured_values() {
-    return 0;
+PMCU_Error sps30_read_product_type(char *buffer, size_t length) {
+    return sps30_read_information(INFO_PRODUCT_TYPE, buffer, length);
 }
 
-//TODO: check if length is right
-int sps30_ask_cleaning_interval() {
-    unsigned char array[] = {0x7E, 0x00, 0x80, 0x01, 0x00, 0x7D, 0x5E, 0x7E};
-    uart_write_buffer(UART_A0, array, 8);
-    return 0;
+PMCU_Error sps30_read_serial(char *buffer, size_t length) {
+    return sps30_read_information(INFO_SERIAL, buffer, length);
 }
 
-int sps30_read_cleaning_interval() {
-    unsigned char array[11];
-    uart_read_buffer(UART_A0, array, 11, SPS30_TIMEOUT);
-    return 0;
+PMCU_Error sps30_read_version(sps30_Version *version) {
+    const uint8_t *payload;
+
+    __pmcu_handle(sps30_query(VERSION, NULL, 0, 7));
+    payload = sps30_decoder.payload;
+    version->firmware_major = payload[0];
+    version->firmware_minor = payload[1];
+    version->hardware = payload[3]; // 2 and 4 are reserved
+    version->shdlc_major = payload[5];
+    version->shdlc_minor = payload[6];
+    return PMCU_OK;
 }
 
-int sps30_start_fan_cleaning() {
-    unsigned char array[] = {0x7E, 0x00, 0x56, 0x00, 0xA9, 0x7E};
-    uart_write_buffer(UART_A0, array, 6);
-    return 0;
+PMCU_Error sps30_read_device_status_register(uint32_t *status, int clear) {
+    const uint8_t payload[] = {clear ? 0x01 : 0x00};
+
+    __pmcu_handle(sps30_query(STATUS, payload, 1, 4));
+    *status = sps30_u32(sps30_decoder.payload); // then a reserved byte
+    return PMCU_OK;
 }
 
-int sps30_read_fan_ack(unsigned char* buff) {
-    uart_read_buffer(UART_A0, buff, 7, SPS30_TIMEOUT);
-    return 0;
+PMCU_Error sps30_reset() {
+    return sps30_execute(RESET, NULL, 0);
 }
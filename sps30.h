@@ -3,55 +3,108 @@
 
 #include "uart.h"
 #include "error.h"
+#include "pt.h"
 
-#define SPS30_TIMEOUT 5
+#define SPS30_TIMEOUT 100 // ms, the sensor answers within 20ms
 
-/**
- * This must be used as the very first command.
- * It switches the state of SPS30 from IDLE-MODE to MEASURING-MODE.
+/*
+ * Output format of the measured values: 10 big endian values, mass PM1.0 to PM10, number PM0.5 to PM10
+ * and typical particle size.
+ * - float: IEEE-754, µg/m³, #/cm³ and µm, 40 bytes.
+ * - uint16: µg/m³, #/cm³ and nm, 20 bytes, from firmware 2.0 on.
+ * SPS30_FORMAT is the one asked for at boot, the float one is the fallback of an older firmware.
  */
-PMCU_Error sps30_start_measurement();
+#define SPS30_FORMAT_FLOAT  0x03
+#define SPS30_FORMAT_UINT16 0x05
+
+#ifndef SPS30_FORMAT
+#define SPS30_FORMAT SPS30_FORMAT_UINT16
+#endif
+
+#define SPS30_MEASURED_VALUES_LENGTH 40 // at most, in the float format
+
+#define SPS30_SERIAL_LENGTH 32 // ASCII, NUL terminated
+
+// bits of the device status register
+#define SPS30_STATUS_SPEED (1UL << 21) // fan speed out of range, too high or too low
+#define SPS30_STATUS_LASER (1UL << 5)  // laser current out of range
+#define SPS30_STATUS_FAN   (1UL << 4)  // fan on, but at 0 rpm
+
+typedef struct {
+    uint8_t firmware_major;
+    uint8_t firmware_minor;
+    uint8_t hardware;
+    uint8_t shdlc_major;
+    uint8_t shdlc_minor;
+} sps30_Version;
 
 /*
- This should be used as the second command.
- Receive the confirm of switching the state.
- It is a debug version of the command because stores the response in an array (buff).
- Recommended length: 8
+ * Every command waits for the response of the SPS30 (at most SPS30_TIMEOUT): the hub must be on it.
+ * An error state in the response is returned as its PMCU_Error, e.g. SPS30_COMMAND_NOT_ALLOWED_IN_CURRENT_STATE.
  */
-int sps30_read_start_ack(unsigned char* buff);
 
+/*
+ * From IDLE-MODE to MEASURING-MODE, the values coming out in the given format (SPS30_FORMAT_...).
+ * A new measurement is ready every second.
+ */
+PMCU_Error sps30_start_measurement(uint8_t format);
 
+/*
+ * Back to IDLE-MODE: fan and laser off.
+ */
+PMCU_Error sps30_stop_measurement();
 
 /*
- This command turns the state of SPS30 to IDLE-MODE, which uses less power
+ * Reads the measured values, as a protothread that acquires the hub: the error is set once it ends.
+ * The payload is empty if there's no new measurement since the last read, otherwise it's 40 bytes
+ * (float format) or 20 bytes (uint16 format).
  */
-int sps30_stop_measurement();
+PT_THREAD(sps30_read_measured_values_pt(pt *thread, uint8_t *buffer, size_t buffer_length, size_t *payload_length, PMCU_Error *error));
+
+PMCU_Error sps30_read_measured_values(uint8_t *buffer, size_t buffer_length, size_t *payload_length);
 
 /*
- This should be used to receive confirm of switching the state to IDLE-MODE, after stopping the measurement.
- It is a debug version, indeed involves an array (buff) as a parameter, in it will be stored the response.
- Recommended length: 8
+ * From IDLE-MODE to SLEEP-MODE, where the SPS30 draws less than 50 µA, and back to IDLE-MODE.
+ * From firmware 2.0 on.
  */
-int sps30_read_stop_ack(unsigned char* buff);
+PMCU_Error sps30_sleep();
+
+PMCU_Error sps30_wake_up();
 
 /*
- This should be used to ask the SPS30 to send the measures. NOTE: do not ask more than once per second.
+ * Cleans the fan at full speed for 10 s, in MEASURING-MODE only: the values are not updated meanwhile.
  */
-int sps30_ask_measured_values();
+PMCU_Error sps30_start_fan_cleaning();
 
-PMCU_Error sps30_read_measured_values(uint8_t* buffer, size_t buffer_length, size_t *payload_length);
+/*
+ * Interval of the automatic fan cleaning, in s (0 disables it, the default is 604800: a week of
+ * continuous measurement). A new interval applies from the next start of the measurement.
+ */
+PMCU_Error sps30_read_cleaning_interval(uint32_t *interval);
 
+PMCU_Error sps30_write_cleaning_interval(uint32_t interval);
 
 /*
- Execute manually the fan cleaning (to be done periodically in order to guarantee the quality of the measures).
- Default fan-cleaning interval: 160 hours (too much!)
+ * The product type ("00080000") and the serial number, NUL terminated strings: length is the size of the buffer.
  */
-int sps30_start_fan_cleaning();
+PMCU_Error sps30_read_product_type(char *buffer, size_t length);
+
+PMCU_Error sps30_read_serial(char *buffer, size_t length);
 
 /*
- Receive the confirm of the start of fan-cleaning.
+ * Versions of the firmware, hardware and SHDLC protocol.
  */
-int sps30_read_fan_ack(unsigned char* buff);
+PMCU_Error sps30_read_version(sps30_Version *version);
 
-#endif
+/*
+ * Device status register (SPS30_STATUS_... bits), cleared after the read if clear is set.
+ * From firmware 2.2 on.
+ */
+PMCU_Error sps30_read_device_status_register(uint32_t *status, int clear);
 
+/*
+ * Restarts the SPS30, back to IDLE-MODE.
+ */
+PMCU_Error sps30_reset();
+
+#endif
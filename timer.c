@@ -2,69 +2,203 @@
 
 #include <msp430.h>
 
-#define TIMER_TASKS_RLENGTH 16
-#define TIMER_TASKS_LENGTH (TIMER_TASKS_RLENGTH - 1)
+#include "lpm.h"
 
-timer_Task *timer_tasks[TIMER_TASKS_RLENGTH];
-uint32_t timer_counter;
+/*
+ * TA1 runs continuously on ACLK (32768Hz): a tick every 30.5us, an overflow every 2s.
+ * The overflows extend the counter to 32 bits, and CCR0 is set on the earliest deadline of the queue,
+ * so the CPU is only woken up when a task is due (or at the overflows).
+ */
+#define TIMER_TICKS(ms) (((ms) * 4096 + 124) / 125) // 32768 / 1000 = 4096 / 125, rounded up
+
+/*
+ * Deadlines closer than this are considered reached: CCR0 could be set after TA1R passed it.
+ */
+#define TIMER_MIN_LEAD 2
+
+/*
+ * The deadline queue: a doubly linked list, sorted by deadline, of slots holding the running tasks.
+ * Slot 0 is the list head, the free slots are linked through next.
+ */
+typedef struct {
+    timer_Task *task;
+    uint8_t prev;
+    uint8_t next;
+} timer_Slot;
+
+timer_Slot timer_slots[TIMER_TASKS_LENGTH + 1];
+uint8_t timer_free_slots;
+volatile uint32_t timer_overflows;
+
+/*
+ * ACLK ticks elapsed since timer_init. Runs with interrupts disabled.
+ */
+uint64_t timer_ticks() {
+    uint32_t high;
+    uint16_t low;
+
+    high = timer_overflows;
+    low = TA1R;
+    if ((TA1CTL & TAIFG) && low < 0x8000) { // overflowed, the ISR has not run yet
+        high++;
+    }
+    return ((uint64_t) high << 16) | low;
+}
 
 void timer_init() {
     uint8_t i;
-    for (i = 0; i < TIMER_TASKS_RLENGTH; i++) {
-        timer_tasks[i] = 0;
-    }
 
-    timer_counter = 0;
+    timer_slots[0].task = 0;
+    timer_slots[0].prev = 0;
+    timer_slots[0].next = 0;
 
-    // aclk = 32768hz
-    // 1/32768hz * 8 * x = 1s - values to have every second timer
-    // x = 4096
-    TA1CCR0 = 4096;
+    for (i = 1; i <= TIMER_TASKS_LENGTH; i++) {
+        timer_slots[i].task = 0;
+        timer_slots[i].next = i < TIMER_TASKS_LENGTH ? i + 1 : 0;
+    }
+    timer_free_slots = 1;
+    timer_overflows = 0;
 
-    TA1CTL = TASSEL__ACLK | MC__UP | ID__8;
-    TA1CCTL0 &= ~CCIFG;
-    TA1CCTL0 |= CCIE;
+    TA1CCTL0 = 0;
+    TA1CTL = TASSEL__ACLK | MC__CONTINUOUS | ID__1 | TACLR | TAIE;
 }
 
 uint64_t timer_timestamp() {
-    return timer_counter;
+    uint64_t ticks;
+    unsigned int gie;
+
+    gie = __get_SR_register() & GIE;
+    __disable_interrupt();
+    ticks = timer_ticks();
+    if (gie) {
+        __enable_interrupt();
+    }
+
+    return (ticks * 1000) >> 15;
 }
 
-void timer_task_start(timer_Task *task, uint32_t delay) {
-    uint8_t next_id;
+/*
+ * Satisfies the due tasks and sets CCR0 on the next deadline. Runs with interrupts disabled.
+ * Returns whether some task has been satisfied.
+ */
+int timer_schedule() {
+    timer_Slot *head;
+    uint32_t now;
+    int32_t lead;
+    uint8_t slot;
+    int satisfied;
+
+    satisfied = 0;
+    now = (uint32_t) timer_ticks(); // deadlines are compared modulo 2^32 ticks (36 hours)
 
-    for (next_id = 1; next_id < TIMER_TASKS_RLENGTH; next_id++) {
-        if (!timer_tasks[next_id]) {
-            break;
+    while ((slot = timer_slots[0].next) != 0) {
+        head = &timer_slots[slot];
+        lead = (int32_t) (head->task->deadline - now);
+        if (lead >= TIMER_MIN_LEAD) {
+            if (lead <= 0xffff) {
+                TA1CCR0 = (uint16_t) head->task->deadline;
+                TA1CCTL0 = CCIE;
+            } else {
+                TA1CCTL0 = 0; // too far, the overflows will get closer
+            }
+            return satisfied;
         }
+
+        head->task->satisfied = 1;
+        timer_task_cancel(head->task);
+        satisfied = 1;
     }
-    if (next_id == TIMER_TASKS_LENGTH) {
-        return; // no position available (we will never create TIMER_TASKS_LENGTH tasks)
+
+    TA1CCTL0 = 0;
+    return satisfied;
+}
+
+PMCU_Error timer_task_start(timer_Task *task, uint32_t delay) {
+    unsigned int gie;
+    uint8_t slot, next;
+
+    timer_task_cancel(task); // restarted while still queued: it must not be linked twice
+
+    if (delay > TIMER_MAX_DELAY) {
+        delay = TIMER_MAX_DELAY;
     }
-    task->id = next_id;
-    task->delay = delay;
-    task->started_at = timer_counter;
+
+    gie = __get_SR_register() & GIE;
+    __disable_interrupt();
+
     task->satisfied = 0;
-    timer_tasks[task->id] = task;
+
+    if ((slot = timer_free_slots) == 0) {
+        task->satisfied = 1;
+        if (gie) {
+            __enable_interrupt();
+        }
+        return TIMER_NO_SLOT_AVAILABLE;
+    }
+    timer_free_slots = timer_slots[slot].next;
+
+    task->deadline = (uint32_t) timer_ticks() + TIMER_TICKS(delay);
+    task->slot = slot;
+    timer_slots[slot].task = task;
+
+    // keeps the queue sorted, equal deadlines in start order
+    next = timer_slots[0].next;
+    while (next != 0 && (int32_t) (timer_slots[next].task->deadline - task->deadline) <= 0) {
+        next = timer_slots[next].next;
+    }
+    timer_slots[slot].next = next;
+    timer_slots[slot].prev = timer_slots[next].prev;
+    timer_slots[timer_slots[next].prev].next = slot;
+    timer_slots[next].prev = slot;
+
+    if (timer_slots[0].next == slot) {
+        timer_schedule(); // the earliest deadline changed
+    }
+
+    if (gie) {
+        __enable_interrupt();
+    }
+    return PMCU_OK;
 }
 
 void timer_task_cancel(timer_Task *task) {
-    timer_tasks[task->id] = 0;
-    task->id = 0;
+    unsigned int gie;
+    uint8_t slot;
+
+    gie = __get_SR_register() & GIE;
+    __disable_interrupt();
+
+    if ((slot = task->slot) != 0) {
+        timer_slots[timer_slots[slot].prev].next = timer_slots[slot].next;
+        timer_slots[timer_slots[slot].next].prev = timer_slots[slot].prev;
+
+        timer_slots[slot].task = 0;
+        timer_slots[slot].next = timer_free_slots;
+        timer_free_slots = slot;
+
+        task->slot = 0;
+    }
+
+    if (gie) {
+        __enable_interrupt();
+    }
 }
 
 #pragma vector=TIMER1_A0_VECTOR // interrupt for TA1CCR0
 __interrupt void timer_on_tick() {
-    uint8_t i;
-
-    timer_counter++;
+    if (timer_schedule()) {
+        lpm_wake_on_exit(); // wakes up who's waiting for the task
+    }
+}
 
-    for (i = 1; i < TIMER_TASKS_RLENGTH; i++) {
-        if (timer_tasks[i] && (timer_counter - timer_tasks[i]->started_at) >= timer_tasks[i]->delay) {
-            timer_tasks[i]->satisfied = 1;
-            timer_tasks[i] = 0;
+#pragma vector=TIMER1_A1_VECTOR // interrupt for TA1CCR1, TA1CCR2 and the overflow
+__interrupt void timer_on_overflow() {
+    switch (__even_in_range(TA1IV, TA1IV_TA1IFG)) {
+    case TA1IV_TA1IFG:
+        timer_overflows++;
+        if (timer_schedule()) {
+            lpm_wake_on_exit();
         }
+        break;
     }
-
-    TA1CCTL0 &= ~CCIFG;
 }
@@ -4,22 +4,44 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "error.h"
+
+/*
+ * Maximum number of tasks running at the same time.
+ */
+#define TIMER_TASKS_LENGTH 16
+
+/*
+ * Longest delay of a task, in ms: about 17 minutes.
+ */
+#define TIMER_MAX_DELAY 1048575
+
 typedef struct {
-    uint8_t id;
+    uint8_t slot; // position in the deadline queue, 0 when not queued
 
-    uint32_t started_at;
-    uint32_t delay;
+    uint32_t deadline; // in ACLK ticks
 
-    uint8_t satisfied;
+    volatile uint8_t satisfied;
 
 } timer_Task;
 
 void timer_init();
 
+/*
+ * Milliseconds elapsed since timer_init.
+ */
 uint64_t timer_timestamp();
 
-void timer_task_start(timer_Task *task, uint32_t delay);
+/*
+ * Starts the task, which gets satisfied after delay ms.
+ * When every slot is taken the task is satisfied straight away, so that nobody waits on it forever,
+ * and TIMER_NO_SLOT_AVAILABLE is returned.
+ */
+PMCU_Error timer_task_start(timer_Task *task, uint32_t delay);
 
+/*
+ * Removes the task from the queue, if still there.
+ */
 void timer_task_cancel(timer_Task *task);
 
 #endif
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Generates the Aho-Corasick automaton matching the final result codes of the SIM800L AT commands,
+as constant tables placed in flash.
+
+    python3 tools/at_automaton.py header > at_automaton.h
+    python3 tools/at_automaton.py source > at_automaton.c
+
+The states are numbered breadth first, so the children of every state are contiguous.
+"""
+
+import sys
+from collections import deque
+
+# (result, pattern): the whole response line, with its surrounding line terminators.
+PATTERNS = [
+    ("AT_OK", "\r\nOK\r\n"),
+    ("AT_ERROR", "\r\nERROR\r\n"),
+    ("AT_CME_ERROR", "\r\n+CME ERROR: "),  # followed by the error text and the line terminator
+    ("AT_PROMPT", "\r\n> "),
+    ("AT_SEND_OK", "\r\nSEND OK\r\n"),
+    ("AT_SEND_FAIL", "\r\nSEND FAIL\r\n"),
+    ("AT_CONNECT_OK", "\r\nCONNECT OK\r\n"),
+    ("AT_CONNECT_FAIL", "\r\nCONNECT FAIL\r\n"),
+    ("AT_CLOSED", "\r\nCLOSED\r\n"),
+    ("AT_SHUT_OK", "\r\nSHUT OK\r\n"),
+    ("AT_CLOSE_OK", "\r\nCLOSE OK\r\n"),
+    ("AT_DATA_ACCEPT", "\r\nDATA ACCEPT:"),  # AT+CIPQSEND=1, followed by the length and the line terminator
+    ("AT_IPD", "\r\n+IPD,"),  # AT+CIPHEAD=1, followed by the length, ':' and the data received
+    ("AT_CONNECT", "\r\nCONNECT\r\n"),  # AT+CIPMODE=1, the data mode is entered
+    ("AT_NO_CARRIER", "\r\nNO CARRIER\r\n"),
+]
+
+
+def build():
+    # trie, breadth first
+    children = [{}]
+    result = [None]
+    depth = [0]
+    queue = deque([(0, [(r, p) for r, p in PATTERNS])])
+    char = [""]
+    while queue:
+        state, group = queue.popleft()
+        for r, p in group:
+            if len(p) == depth[state]:
+                result[state] = r
+        nexts = {}
+        for r, p in group:
+            if len(p) > depth[state]:
+                nexts.setdefault(p[depth[state]], []).append((r, p))
+        for c in sorted(nexts):
+            children.append({})
+            result.append(None)
+            depth.append(depth[state] + 1)
+            char.append(c)
+            children[state][c] = len(children) - 1
+            queue.append((len(children) - 1, nexts[c]))
+
+    # failure links, breadth first
+    fail = [0] * len(children)
+    for state in range(len(children)):
+        for c, child in children[state].items():
+            if state == 0:
+                continue
+            f = fail[state]
+            while f and c not in children[f]:
+                f = fail[f]
+            fail[child] = children[f].get(c, 0)
+            if result[child] is None:
+                result[child] = result[fail[child]]
+    return children, result, fail, char
+
+
+def literal(c):
+    return {"\r": "'\\r'", "\n": "'\\n'", "'": "'\\''", "\\": "'\\\\'"}.get(c, "'%s'" % c)
+
+
+def header(states):
+    print("""#ifndef AT_AUTOMATON_H_
+#define AT_AUTOMATON_H_
+
+/*
+ * Generated by tools/at_automaton.py, do not edit.
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    AT_NONE,""")
+    for r, _ in PATTERNS:
+        print("    %s," % r)
+    print("""} at_Result;
+
+typedef struct {
+    char byte;          // the byte leading to the state
+    uint8_t fail;       // the state of the longest proper suffix that is also a prefix
+    uint8_t children;   // first child state, the children are contiguous
+    uint8_t count;      // number of children
+    uint8_t result;     // at_Result matched once the state is reached
+} at_State;
+
+#define AT_AUTOMATON_STATES %d
+
+extern const at_State at_automaton[AT_AUTOMATON_STATES];
+
+extern const char *const at_result_names[];
+
+#endif""" % states)
+
+
+def source(children, result, fail, char):
+    print("""/*
+ * Generated by tools/at_automaton.py, do not edit.
+ */
+
+#include "at_automaton.h"
+
+const at_State at_automaton[AT_AUTOMATON_STATES] = {""")
+    for state in range(len(children)):
+        kids = sorted(children[state].values())
+        print("    { %-6s %3d, %3d, %d, %-16s },  // %3d" % (
+            (literal(char[state]) if state else "0") + ",", fail[state],
+            kids[0] if kids else 0, len(kids), result[state] or "AT_NONE", state))
+    print("""};
+
+const char *const at_result_names[] = {
+    "",""")
+    for _, p in PATTERNS:
+        print('    "%s",' % p.strip())
+    print("};")
+
+
+def main():
+    children, result, fail, char = build()
+    assert len(children) < 256
+
+    if sys.argv[1:] == ["header"]:
+        header(len(children))
+    elif sys.argv[1:] == ["source"]:
+        source(children, result, fail, char)
+    else:
+        sys.exit("usage: at_automaton.py header|source")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+Reference decoder of the PMCU payloads (record.h), for the subscribers of the pmcu/<id> topics.
+Reads the payloads in hex, one per line, and prints every record as a JSON object:
+
+    sim/build/pmcu-sim --payloads payloads.txt
+    python3 tools/record.py payloads.txt
+
+Exits with 1 if a payload is malformed.
+"""
+
+import datetime
+import json
+import sys
+
+VERSION = 1
+
+DHT22, GPS, LOCATION, SPS30 = 0x01, 0x02, 0x04, 0x08
+
+# (name, sensor, scale), in encoding order
+FIELDS = [
+    ("humidity", DHT22, 0.1),
+    ("temperature", DHT22, 0.1),
+    ("gps_time", GPS, None),
+    ("gps_latitude", GPS, 1e-7),
+    ("gps_longitude", GPS, 1e-7),
+    ("gps_altitude", GPS, 0.1),
+    ("gps_hdop", GPS, 0.1),
+    ("gps_fix", GPS, 1),
+    ("gps_satellites", GPS, 1),
+    ("location_time", LOCATION, None),
+    ("location_latitude", LOCATION, 1e-7),
+    ("location_longitude", LOCATION, 1e-7),
+    ("pm1_0_mass", SPS30, 0.1),
+    ("pm2_5_mass", SPS30, 0.1),
+    ("pm4_0_mass", SPS30, 0.1),
+    ("pm10_mass", SPS30, 0.1),
+    ("pm0_5_number", SPS30, 0.1),
+    ("pm1_0_number", SPS30, 0.1),
+    ("pm2_5_number", SPS30, 0.1),
+    ("pm4_0_number", SPS30, 0.1),
+    ("pm10_number", SPS30, 0.1),
+    ("pm_size", SPS30, 0.001),
+]
+
+EPOCH = datetime.datetime(2000, 1, 1, tzinfo=datetime.timezone.utc)
+
+
+class Malformed(Exception):
+    pass
+
+
+def varint(data, pos):
+    value, shift = 0, 0
+    while True:
+        if pos >= len(data) or shift > 28:
+            raise Malformed("varint cut short")
+        value |= (data[pos] & 0x7F) << shift
+        shift += 7
+        pos += 1
+        if not data[pos - 1] & 0x80:
+            return value, pos
+
+
+def decode_record(data, previous):
+    """The raw fields of a record, as integers: missing sensors are absent."""
+    sensors = data[0]
+    if sensors & ~(DHT22 | GPS | LOCATION | SPS30):
+        raise Malformed("unknown sensors 0x%02x" % sensors)
+    fields, pos = {"sensors": sensors}, 1
+    for name, sensor, _ in FIELDS:
+        if not sensors & sensor:
+            continue
+        delta, pos = varint(data, pos)
+        delta = (delta >> 1) ^ -(delta & 1)  # zigzag
+        base = previous[name] if previous and previous["sensors"] & sensor else 0
+        value = (base + delta) & 0xFFFFFFFF
+        fields[name] = value - (1 << 32) if value & 0x80000000 else value
+    if pos != len(data):
+        raise Malformed("%d bytes left in a record" % (len(data) - pos))
+    return fields
+
+
+def decode_payload(payload):
+    """The raw records of a batch."""
+    if len(payload) < 2 or payload[0] != VERSION:
+        raise Malformed("not a version %d batch" % VERSION)
+    records, previous, pos = [], None, 2
+    for _ in range(payload[1]):
+        if pos >= len(payload) or pos + 1 + payload[pos] > len(payload):
+            raise Malformed("record cut short")
+        previous = decode_record(payload[pos + 1:pos + 1 + payload[pos]], previous)
+        records.append(previous)
+        pos += 1 + payload[pos]
+    if pos != len(payload):
+        raise Malformed("%d bytes after the records" % (len(payload) - pos))
+    return records
+
+
+def readable(fields):
+    """The record in plain units."""
+    record = {}
+    for name, sensor, scale in FIELDS:
+        if name not in fields:
+            continue
+        if name == "gps_time":
+            value = fields[name]
+            record[name] = "%02d:%02d:%02d" % (value // 3600, value // 60 % 60, value % 60)
+        elif name == "location_time":
+            record[name] = (EPOCH + datetime.timedelta(seconds=fields[name])).isoformat()
+        else:
+            record[name] = round(fields[name] * scale, 7)
+    return record
+
+
+def main():
+    status = 0
+    for path in sys.argv[1:] or ["-"]:
+        lines = sys.stdin if path == "-" else open(path)
+        for number, line in enumerate(lines, 1):
+            if not line.strip():
+                continue
+            try:
+                for fields in decode_payload(bytes.fromhex(line.strip())):
+                    print(json.dumps(readable(fields)))
+            except (Malformed, ValueError) as error:
+                print("%s:%d: %s" % (path, number, error), file=sys.stderr)
+                status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+Decoder of the PMCU trace (trace.h), the binary stream out of the console UART (USCI_A1, 9600 baud).
+Reads the raw bytes, of a capture or of the serial port itself, and prints every event with its message:
+
+    sim/build/pmcu-sim --console console.bin
+    python3 tools/trace.py console.bin
+    python3 tools/trace.py /dev/ttyACM0
+
+The messages, errors and AT results are read from trace.h, error.h and at_automaton.c, so the decoder
+follows the firmware it sits next to. What isn't a frame (the text of a fatal error) is printed as is.
+Exits with 1 if a frame is corrupted.
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+
+def source(name):
+    with open(os.path.join(ROOT, name)) as file:
+        return file.read()
+
+
+def x_macro(text, name):
+    """The body of the X-macro list called name, its continuation lines joined."""
+    match = re.search(r"#define %s\(ACTION\)((?:.*\\\n)*.*)" % name, text)
+    return match.group(1)
+
+
+SYNC = int(re.search(r"#define TRACE_SYNC (\w+)", source("trace.h")).group(1), 0)
+MESSAGES = [
+    message.encode().decode("unicode_escape")
+    for message in re.findall(r'ACTION\(\w+, "((?:[^"\\]|\\.)*)"\)', x_macro(source("trace.h"), "TRACE_ALL_EVENTS"))
+]
+ERRORS = re.findall(r"ACTION\((\w+)\)", x_macro(source("error.h"), "PMCU_ALL_ERRORS"))
+RESULTS = re.findall(
+    r'"((?:[^"\\]|\\.)*)"', re.search(r"at_result_names\[\] = \{(.*?)\};", source("at_automaton.c"), re.S).group(1)
+)
+
+
+def varint(body, pos):
+    value, shift = 0, 0
+    while pos < len(body) and shift <= 28:
+        value |= (body[pos] & 0x7F) << shift
+        shift += 7
+        pos += 1
+        if not body[pos - 1] & 0x80:
+            break
+    return value, pos
+
+
+def decode_event(body):
+    """The timestamp (ms) and the message of an event."""
+    if body[0] >= len(MESSAGES):
+        return None, "unknown trace event %d" % body[0]
+    timestamp, pos = varint(body, 1)
+
+    def expand(match):
+        nonlocal pos
+        kind = match.group(1)
+        if kind == "s":
+            text = body[pos:].decode("ascii", "replace")
+            pos = len(body)
+            return text
+        value, pos = varint(body, pos)
+        value = (value >> 1) ^ -(value & 1)  # zigzag
+        if kind == "e" and 0 <= value < len(ERRORS):
+            return ERRORS[value]
+        if kind == "r" and 0 <= value < len(RESULTS):
+            return RESULTS[value]
+        return str(value if kind == "d" else value & 0xFFFFFFFF)
+
+    return timestamp, re.sub(r"%([uders])", expand, MESSAGES[body[0]])
+
+
+def decode_stream(stream):
+    """Yields (timestamp, message) of every event, (None, line) of the text in between."""
+    status, text = 0, bytearray()
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            break
+        if byte[0] != SYNC:
+            if byte == b"\n":
+                yield None, text.decode("ascii", "replace").rstrip("\r")
+                text.clear()
+            else:
+                text += byte
+            continue
+        length = stream.read(1)
+        if not length or not length[0]:
+            continue
+        frame = stream.read(length[0] + 1)
+        if len(frame) < length[0] + 1:
+            break
+        body, total = frame[:-1], frame[-1]
+        if sum(body) & 0xFF != total:
+            yield None, "corrupted trace frame"
+            status = 1
+            continue
+        yield decode_event(body)
+    if text:
+        yield None, text.decode("ascii", "replace")
+    return status
+
+
+def main():
+    status = 0
+    for path in sys.argv[1:] or ["-"]:
+        stream = sys.stdin.buffer if path == "-" else open(path, "rb")
+        events = decode_stream(stream)
+        while True:
+            try:
+                timestamp, message = next(events)
+            except StopIteration as stop:
+                status |= stop.value
+                break
+            if timestamp is None:
+                print(message)
+            else:
+                print("[%d.%03d] %s" % (timestamp // 1000, timestamp % 1000, message))
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
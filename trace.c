@@ -0,0 +1,83 @@
+#include "trace.h"
+
+#include "timer.h"
+#include "uart.h"
+
+uint8_t trace_body[TRACE_BODY_LENGTH]; // of the event being recorded
+size_t trace_body_length;
+uint32_t trace_dropped; // events with no room, since the last one queued
+
+void trace_put(uint8_t byte) {
+    if (trace_body_length < TRACE_BODY_LENGTH) {
+        trace_body[trace_body_length++] = byte;
+    }
+}
+
+void trace_put_varint(uint32_t value) {
+    while (value >= 0x80) {
+        trace_put((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    trace_put(value);
+}
+
+/*
+ * Queues the frame of the body, whole or not at all. Returns whether it was.
+ */
+int trace_queue(const uint8_t *body, size_t length) {
+    uint8_t header[2], sum;
+    size_t i;
+
+    if (uart_write_room(UART_A1) < length + 3) {
+        return 0;
+    }
+
+    sum = 0;
+    for (i = 0; i < length; i++) {
+        sum += body[i];
+    }
+
+    header[0] = TRACE_SYNC;
+    header[1] = length;
+    uart_write_buffer(UART_A1, header, 2);
+    uart_write_buffer(UART_A1, body, length);
+    uart_write(UART_A1, sum);
+    return 1;
+}
+
+void trace_start(trace_Event event) {
+    trace_body_length = 0;
+    trace_put(event);
+    trace_put_varint(timer_timestamp());
+}
+
+void trace_begin(trace_Event event) {
+    if (trace_dropped) {
+        // tells what's missing first
+        trace_start(TRACE_DROPPED);
+        trace_append_number(trace_dropped);
+        if (trace_queue(trace_body, trace_body_length)) {
+            trace_dropped = 0;
+        }
+    }
+    trace_start(event);
+}
+
+void trace_append_number(int32_t number) {
+    uint32_t value;
+
+    value = number;
+    trace_put_varint((value << 1) ^ ((value & 0x80000000UL) ? 0xFFFFFFFFUL : 0)); // zigzag
+}
+
+void trace_append_bytes(const uint8_t *bytes, size_t length) {
+    while (length-- > 0) {
+        trace_put(*bytes++);
+    }
+}
+
+void trace_end() {
+    if (!trace_queue(trace_body, trace_body_length)) {
+        trace_dropped++;
+    }
+}
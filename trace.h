@@ -0,0 +1,154 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Binary trace of the firmware, out of USCI_A1 in place of a text log. An event is recorded as its id,
+ * its timestamp and a few numbers (or a short text), framed and queued in the RAM ring of the UART,
+ * which the TX interrupt drains in the background: recording never waits, an event with no room is
+ * dropped (and counted). The messages are only here, in TRACE_ALL_EVENTS: they are not built in the
+ * firmware, the host decodes the stream back into them (tools/trace.py, the simulation console).
+ *
+ * A frame is TRACE_SYNC, the length of the body, the body, the 8-bit sum of the body. The body is the
+ * event id, the timestamp in ms and every number of the message (zigzag then LEB128 varint encoded),
+ * then the bytes of its text, if any.
+ */
+#define TRACE_SYNC 0x7E
+#define TRACE_BODY_LENGTH 48 // the text is cut to what's left
+
+#define TRACE_ERROR 1
+#define TRACE_INFO  2
+#define TRACE_DEBUG 3
+
+/*
+ * Verbosity of each module, set at compile time (e.g. -DTRACE_LEVEL_AT=TRACE_DEBUG): the events of the
+ * levels above cost nothing, not even the evaluation of their arguments. 0 disables a module.
+ */
+#ifndef TRACE_LEVEL_MAIN
+#define TRACE_LEVEL_MAIN TRACE_INFO
+#endif
+#ifndef TRACE_LEVEL_MODEM
+#define TRACE_LEVEL_MODEM TRACE_INFO
+#endif
+#ifndef TRACE_LEVEL_AT
+#define TRACE_LEVEL_AT TRACE_INFO // every line received but the URCs and responses is TRACE_DEBUG
+#endif
+#ifndef TRACE_LEVEL_MQTT
+#define TRACE_LEVEL_MQTT TRACE_INFO
+#endif
+#ifndef TRACE_LEVEL_FLASH
+#define TRACE_LEVEL_FLASH TRACE_INFO
+#endif
+
+/*
+ * Every event and its message, in id order. The message takes its numbers in turn: %u unsigned,
+ * %d signed, %e a PMCU_Error, %r an at_Result, then %s the text.
+ */
+#define TRACE_ALL_EVENTS(ACTION) \
+    ACTION(TRACE_DROPPED, "%u trace events dropped") \
+    ACTION(TRACE_MAIN_BOOT, "+++ PMCU v1.0 +++") \
+    ACTION(TRACE_MAIN_FLASH_PENDING, "Records left in flash, to be published") \
+    ACTION(TRACE_MAIN_SPS30_INIT, "Initializing SPS30...") \
+    ACTION(TRACE_MAIN_SPS30_VERSION, "SPS30 firmware %u.%u, hardware %u") \
+    ACTION(TRACE_MAIN_SPS30_SERIAL, "SPS30 serial number: %s") \
+    ACTION(TRACE_MAIN_SPS30_STATUS, "SPS30 device status register: %u") \
+    ACTION(TRACE_MAIN_SPS30_FLOAT, "SPS30 firmware without the uint16 format, measuring in floats") \
+    ACTION(TRACE_MAIN_SPS30_WAKE_UP, "SPS30 woken up, measuring") \
+    ACTION(TRACE_MAIN_SPS30_WAKE_UP_FAILED, "Error during SPS30 wake-up: %e") \
+    ACTION(TRACE_MAIN_SPS30_SLEEP, "SPS30 sampled, sleeping") \
+    ACTION(TRACE_MAIN_SPS30_IDLE, "SPS30 sampled, idle: its firmware has no sleep mode") \
+    ACTION(TRACE_MAIN_SPS30_SLEEP_FAILED, "Error while putting SPS30 to sleep: %e") \
+    ACTION(TRACE_MAIN_SPS30_CLEANING, "SPS30 fan cleaning") \
+    ACTION(TRACE_MAIN_SPS30_CLEANING_FAILED, "Error during SPS30 fan cleaning: %e") \
+    ACTION(TRACE_MAIN_GPS_INIT, "Configuring GPS...") \
+    ACTION(TRACE_MAIN_GPS_NMEA, "GPS not configured (%e), parsing its NMEA sentences instead") \
+    ACTION(TRACE_MAIN_MODEM_INIT, "Initializing modem...") \
+    ACTION(TRACE_MAIN_MODEM_SYNC, "Syncing & resetting modem...") \
+    ACTION(TRACE_MAIN_MODEM_ATTACH, "Attaching GPRS service to modem...") \
+    ACTION(TRACE_MAIN_ID, "PMCU id: %s") \
+    ACTION(TRACE_MAIN_LOOPING, "LOOPING") \
+    ACTION(TRACE_MAIN_PING_FAILED, "Error occured during MQTT PINGREQ packet: %e") \
+    ACTION(TRACE_MAIN_MEASURING, "Measuring & packing") \
+    ACTION(TRACE_MAIN_READING, "Reading from DHT22, GY-GPSM6V2, SIM800L and SPS30...") \
+    ACTION(TRACE_MAIN_DHT22_FAILED, "Error during DHT22 data reading: %e") \
+    ACTION(TRACE_MAIN_GPS_FAILED, "Error during GY-GPSM6V2 data reading: %e") \
+    ACTION(TRACE_MAIN_LOCATION_FAILED, "Error during SIM800L location reading: %e") \
+    ACTION(TRACE_MAIN_SPS30_FAILED, "Error during SPS30 data reading: %e") \
+    ACTION(TRACE_MAIN_APPEND_FAILED, "Error occured during flash log append: %e") \
+    ACTION(TRACE_MAIN_RECORD_VERSION, "Flash log record of another version, dropping it") \
+    ACTION(TRACE_MAIN_BROKER_UNREACHABLE, "Broker unreachable, records kept in flash: %e") \
+    ACTION(TRACE_MAIN_PUBLISHING, "Publishing") \
+    ACTION(TRACE_MAIN_PUBLISH_FAILED, "Error occured during MQTT PUBLISH packet: %e") \
+    ACTION(TRACE_MAIN_PUBACK_FAILED, "Error occured while waiting for MQTT PUBACK packets: %e") \
+    ACTION(TRACE_MODEM_SYNC, "MODEM sync in %u ms") \
+    ACTION(TRACE_MODEM_SETUP, "MODEM setup in %u ms") \
+    ACTION(TRACE_MODEM_REGISTRATION, "MODEM network registration in %u ms") \
+    ACTION(TRACE_MODEM_GPRS_ATTACH, "MODEM GPRS attach in %u ms") \
+    ACTION(TRACE_MODEM_BEARER, "MODEM bearer in %u ms") \
+    ACTION(TRACE_MODEM_PDP_CONTEXT, "MODEM PDP context in %u ms") \
+    ACTION(TRACE_MODEM_ESCAPE, "MODEM AT> +++") \
+    ACTION(TRACE_MODEM_ESCAPE_FAILED, "Transparent connection not escaped, dropped") \
+    ACTION(TRACE_AT_COMMAND, "MODEM AT> %s") \
+    ACTION(TRACE_AT_RESULT, "MODEM AT< %r") \
+    ACTION(TRACE_AT_CME_ERROR, "MODEM AT< +CME ERROR: %s") \
+    ACTION(TRACE_AT_URC, "MODEM AT< %s") \
+    ACTION(TRACE_AT_RESPONSE, "MODEM AT< %s") \
+    ACTION(TRACE_AT_LINE, "MODEM AT< %s") \
+    ACTION(TRACE_MQTT_RETRANSMIT, "Retransmitting unacknowledged publish") \
+    ACTION(TRACE_MQTT_CONNECTING, "Connecting to broker") \
+    ACTION(TRACE_MQTT_PINGING, "Pinging broker") \
+    ACTION(TRACE_FLASH_FULL, "Flash log full, dropping the oldest records") \
+    ACTION(TRACE_FLASH_CORRUPTED, "Flash log record corrupted, dropping it")
+
+#define GENERATE_TRACE_ENUM(ENUM, MESSAGE) ENUM,
+
+typedef enum {
+    TRACE_ALL_EVENTS(GENERATE_TRACE_ENUM)
+} trace_Event;
+
+#define TRACE_ENABLED(module, level) (TRACE_LEVEL_##module >= (level))
+
+#define TRACE(module, level, event) \
+    do { \
+        if (TRACE_ENABLED(module, level)) { \
+            trace_begin(event); \
+            trace_end(); \
+        } \
+    } while (0)
+
+#define TRACE1(module, level, event, a) \
+    do { \
+        if (TRACE_ENABLED(module, level)) { \
+            trace_begin(event); \
+            trace_append_number(a); \
+            trace_end(); \
+        } \
+    } while (0)
+
+#define TRACE_TEXT(module, level, event, text, length) \
+    do { \
+        if (TRACE_ENABLED(module, level)) { \
+            trace_begin(event); \
+            trace_append_bytes((const uint8_t *) (text), length); \
+            trace_end(); \
+        } \
+    } while (0)
+
+/*
+ * An event recorded in pieces: begin, its numbers, its text, end. One at a time, never from an ISR:
+ * the macros above are the way to go, an event of a disabled level costs nothing.
+ */
+void trace_begin(trace_Event event);
+
+void trace_append_number(int32_t number);
+
+void trace_append_bytes(const uint8_t *bytes, size_t length);
+
+/*
+ * Queues the frame of the event, if there's room for it.
+ */
+void trace_end();
+
+#endif
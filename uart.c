@@ -1,8 +1,17 @@
 #include "uart.h"
 
-#include "circular_buffer.h"
 #include "string.h"
 
+#include "lpm.h"
+
+RING_BUFFER(uart_read_buf_a0, 256);
+RING_BUFFER(uart_read_buf_a1, 64);
+
+RING_BUFFER(uart_write_buf_a0, 256);
+RING_BUFFER(uart_write_buf_a1, 512); // the trace, drained at 9600 baud
+
+uint16_t uart_discards_a0;
+
 uart_rx_listener uart_rx_listener_a0 = NULL;
 uart_rx_listener uart_rx_listener_a1 = NULL;
 
@@ -47,11 +56,19 @@ void uart_set_baud_rate_115200_smclk_12mhz(uart_module module) {
 }
 
 void uart_setup(uart_module module, uart_settings settings) {
-    circular_buffer_init(module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1);
+    // Bytes still queued would be lost (or sent with the new settings)
+    uart_flush(module, UART_WRITE_TIMEOUT);
 
-    // Halts state-machine operation
+    // Halts state-machine operation (also disables the interrupts)
     UART_REGISTER(module, UART_CTL1) |= UCSWRST;
 
+    // Nobody is using the buffers now
+    ring_buffer_clear(module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1);
+    if (module == UART_A0) {
+        uart_discards_a0++;
+    }
+    ring_buffer_clear(module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1);
+
     // Applies settings
     UART_REGISTER(module, UART_CTL0) = settings & 0xF8;
 
@@ -97,113 +114,178 @@ void uart_setup(uart_module module, uart_settings settings) {
     UART_REGISTER(module, UART_IE) |= UCRXIE;
 }
 
-void uart_write(uart_module module, uint8_t byte) {
-    while (!(UART_REGISTER(module, UART_IFG) & UCTXIFG));
+/*
+ * Moves the next queued byte to TXBUF, or stops the TX interrupt if there's none.
+ * Called when TXBUF is empty. Returns whether to wake the CPU up: the ring has emptied,
+ * or is down to half, which a writer waiting for room or for the flush sleeps on.
+ */
+int uart_transmit_next(uart_module module) {
+    ring_buffer *w_buf;
+    uint8_t byte;
+    uint16_t count;
+
+    w_buf = module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1;
+    if (!ring_buffer_read(w_buf, &byte)) {
+        UART_REGISTER(module, UART_IE) &= ~UCTXIE;
+        return 0;
+    }
     UART_REGISTER(module, UART_TXBUF) = byte;
+
+    count = ring_buffer_count(w_buf);
+    return count == 0 || count == (w_buf->mask + 1) / 2;
 }
 
-void uart_write_buffer(uart_module module, const uint8_t *buffer, size_t buffer_length) {
-    size_t i;
-    for (i = 0; i < buffer_length; i++) {
-        uart_write(module, buffer[i]);
+int uart_has_room(const void *w_buf) {
+    return !ring_buffer_is_full(w_buf);
+}
+
+/*
+ * Waits for room in the write buffer, in LPM0 (SMCLK clocks the UART).
+ */
+void uart_wait_room(uart_module module, ring_buffer *w_buf) {
+    // With interrupts disabled (e.g. called from an ISR) nobody drains the buffer: polls TXIFG
+    if (!(__get_SR_register() & GIE)) {
+        while (ring_buffer_is_full(w_buf)) {
+            if (UART_REGISTER(module, UART_IFG) & UCTXIFG) {
+                uart_transmit_next(module);
+            }
+        }
+        return;
     }
+    lpm_wait(uart_has_room, w_buf, LPM0_bits, 0);
+}
+
+void uart_write(uart_module module, uint8_t byte) {
+    ring_buffer *w_buf;
+
+    w_buf = module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1;
+
+    uart_wait_room(module, w_buf);
+    ring_buffer_write(w_buf, byte);
+    UART_REGISTER(module, UART_IE) |= UCTXIE;
+}
+
+size_t uart_write_room(uart_module module) {
+    return ring_buffer_room(module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1);
 }
 
-int uart_write_string(uart_module module, const char *string) {
-    while (*string != '\0') {
-        uart_write(module, *string);
-        string++;
+void uart_write_buffer(uart_module module, const uint8_t *buffer, size_t buffer_length) {
+    ring_buffer *w_buf;
+    size_t written;
+
+    w_buf = module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1;
+
+    while (buffer_length > 0) {
+        uart_wait_room(module, w_buf);
+        written = ring_buffer_write_span(w_buf, buffer, buffer_length);
+        UART_REGISTER(module, UART_IE) |= UCTXIE;
+
+        buffer += written;
+        buffer_length -= written;
     }
-    return 0;
 }
 
-PMCU_Error uart_read(uart_module module, uint8_t *byte, uint32_t timeout_delay) {
-    circular_buffer *r_buf;
-    timer_Task timeout;
+void uart_write_string(uart_module module, const char *string) {
+    uart_write_buffer(module, (const uint8_t *) string, strlen(string));
+}
 
-    r_buf = module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1;
+int uart_is_drained(const void *w_buf) {
+    return ring_buffer_is_empty(w_buf);
+}
+
+PMCU_Error uart_flush(uart_module module, uint32_t timeout_delay) {
+    ring_buffer *w_buf;
+
+    w_buf = module == UART_A0 ? &uart_write_buf_a0 : &uart_write_buf_a1;
 
-    if (timeout_delay) {
-        timer_task_start(&timeout, timeout_delay);
+    // sleeps in LPM0 until the TX interrupt has taken the last byte out of the buffer
+    if (!lpm_wait(uart_is_drained, w_buf, LPM0_bits, timeout_delay)) {
+        return UART_TIMEOUT_ERROR;
     }
 
-    while (1) {
-        if ((r_buf->count > 0) || (timeout_delay && timeout.satisfied)) {
-            break;
-        }
+    // then it is shifted out, with the one before it: no interrupt tells, but it takes a couple of byte times,
+    // slept through in LPM0 too (UCBUSY is also set while a byte comes in: it is not waited on further)
+    if (UART_REGISTER(module, UART_STAT) & UCBUSY) {
+        lpm_wait(NULL, NULL, LPM0_bits, UART_SHIFT_DELAY);
     }
+    return PMCU_OK;
+}
 
-    if (timeout_delay) {
-        timer_task_cancel(&timeout);
+int uart_has_data(const void *r_buf) {
+    return !ring_buffer_is_empty(r_buf);
+}
 
-        if (timeout.satisfied) {
-            return UART_TIMEOUT_ERROR;
-        }
+/*
+ * Waits, in LPM0, until the read buffer holds at least a byte.
+ */
+PMCU_Error uart_wait_data(ring_buffer *r_buf, uint32_t timeout_delay) {
+    if (!lpm_wait(uart_has_data, r_buf, LPM0_bits, timeout_delay)) {
+        return UART_TIMEOUT_ERROR;
     }
+    return PMCU_OK;
+}
 
-    circular_buffer_read(r_buf, byte);
+PMCU_Error uart_read(uart_module module, uint8_t *byte, uint32_t timeout_delay) {
+    ring_buffer *r_buf;
+    PMCU_Error error;
+
+    r_buf = module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1;
+
+    if ((error = uart_wait_data(r_buf, timeout_delay)) != PMCU_OK) {
+        return error;
+    }
+    ring_buffer_read(r_buf, byte);
     return PMCU_OK;
 }
 
+int uart_try_read(uart_module module, uint8_t *byte) {
+    return ring_buffer_read(module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1, byte);
+}
+
 PMCU_Error uart_read_buffer(uart_module module, uint8_t *buffer, size_t buffer_length, uint32_t timeout_delay) {
-    size_t i;
+    ring_buffer *r_buf;
     PMCU_Error error;
+    size_t read;
 
-    for (i = 0; i < buffer_length; i++) {
-        if ((error = uart_read(module, &buffer[i], timeout_delay)) != PMCU_OK) {
+    r_buf = module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1;
+
+    while (buffer_length > 0) {
+        if ((error = uart_wait_data(r_buf, timeout_delay)) != PMCU_OK) {
             return error;
         }
+        read = ring_buffer_read_span(r_buf, buffer, buffer_length);
+
+        buffer += read;
+        buffer_length -= read;
     }
     return PMCU_OK;
 }
 
-PMCU_Error uart_match_string(uart_module module, const char *sample, uint32_t timeout_delay) {
+PMCU_Error uart_peek(uart_module module, const uint8_t **span, size_t *span_length, uint32_t timeout_delay) {
+    ring_buffer *r_buf;
     PMCU_Error error;
 
-    char byte;
-    while (*sample != '\0') {
-        if ((error = uart_read(module, (uint8_t *) &byte, timeout_delay)) != PMCU_OK) {
-            return error;
-        }
-        if (byte != *sample) {
-            return UART_UNEXPECTED_BYTE_ERROR;
-        }
-        sample++;
+    r_buf = module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1;
+
+    if ((error = uart_wait_data(r_buf, timeout_delay)) != PMCU_OK) {
+        return error;
     }
+    *span_length = ring_buffer_peek_span(r_buf, span);
     return PMCU_OK;
 }
 
-PMCU_Error uart_read_until_string(uart_module module, const char *sample, char *buffer, size_t buffer_length, uint32_t timeout_delay) {
-    size_t i, j;
-    char fallback;
-    PMCU_Error err;
-
-    if (!buffer) {
-       buffer = &fallback;
-       buffer_length = 0;
-    }
-    i = 0;
-    j = 0;
-    while (1) {
-       if ((err = uart_read(module, (uint8_t *) &buffer[i], timeout_delay)) != PMCU_OK) {
-           return err;
-       }
-       if (buffer[i] == sample[j]) {
-           j++;
-       } else if (j > 0) {
-           j = 0;
-       }
-       if (sample[j] == '\0') {
-           break;
-       }
-       if (buffer_length) { // if the buffer exists
-           ++i;
-           if (i >= buffer_length) {
-               return UART_BUFFER_TOO_SMALL_ERROR;
-           }
-       }
+void uart_consume(uart_module module, size_t length) {
+    ring_buffer_consume(module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1, length);
+}
+
+void uart_discard(uart_module module) {
+    ring_buffer *r_buf;
+
+    r_buf = module == UART_A0 ? &uart_read_buf_a0 : &uart_read_buf_a1;
+    ring_buffer_consume(r_buf, ring_buffer_count(r_buf)); // from the consumer side, the ISR may be writing
+    if (module == UART_A0) {
+        uart_discards_a0++;
     }
-    return PMCU_OK;
 }
 
 void uart_subscribe_rx_listener(uart_module module, uart_rx_listener listener) {
@@ -212,23 +294,29 @@ void uart_subscribe_rx_listener(uart_module module, uart_rx_listener listener) {
 }
 
 #pragma vector=USCI_A0_VECTOR
-__interrupt void uart_on_a0_rx() {
+__interrupt void uart_on_a0() {
     if (UCA0IFG & UCRXIFG) {
         volatile unsigned char tmp = UCA0RXBUF;
-        circular_buffer_write(&uart_read_buf_a0, tmp);
-        if (uart_rx_listener_a0) {
-            uart_rx_listener_a0(tmp);
+        ring_buffer_write(&uart_read_buf_a0, tmp);
+        if (!uart_rx_listener_a0 || uart_rx_listener_a0(tmp)) {
+            lpm_wake_on_exit(); // wakes up who's waiting for data
         }
     }
+    if ((UCA0IE & UCTXIE) && (UCA0IFG & UCTXIFG) && uart_transmit_next(UART_A0)) {
+        lpm_wake_on_exit(); // wakes up who's waiting for room or for the flush
+    }
 }
 
 #pragma vector=USCI_A1_VECTOR
-__interrupt void uart_on_a1_rx() {
+__interrupt void uart_on_a1() {
     if (UCA1IFG & UCRXIFG) {
         volatile unsigned char tmp = UCA1RXBUF;
-        circular_buffer_write(&uart_read_buf_a1, tmp);
-        if (uart_rx_listener_a1) {
-            uart_rx_listener_a1(tmp);
+        ring_buffer_write(&uart_read_buf_a1, tmp);
+        if (!uart_rx_listener_a1 || uart_rx_listener_a1(tmp)) {
+            lpm_wake_on_exit(); // wakes up who's waiting for data
         }
     }
+    if ((UCA1IE & UCTXIE) && (UCA1IFG & UCTXIFG) && uart_transmit_next(UART_A1)) {
+        lpm_wake_on_exit(); // wakes up who's waiting for room or for the flush
+    }
 }
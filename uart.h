@@ -6,12 +6,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 
-#include "circular_buffer.h"
+#include "ring_buffer.h"
 #include "timer.h"
 #include "error.h"
 
-circular_buffer uart_read_buf_a0;
-circular_buffer uart_read_buf_a1;
+extern ring_buffer uart_read_buf_a0;
+extern ring_buffer uart_read_buf_a1;
+
+extern ring_buffer uart_write_buf_a0;
+extern ring_buffer uart_write_buf_a1;
+
+// times what UART_A0 received has been dropped (uart_discard(), uart_setup()): a reader peeking ahead starts over
+extern uint16_t uart_discards_a0;
 
 /*
  * A type representing the UART module.
@@ -39,7 +45,9 @@ typedef uint16_t uart_module;
 #define UART_IFG   0x1D
 #define UART_IV    0x1E
 
+#ifndef UART_REGISTER // the host simulation provides its own register file
 #define UART_REGISTER(module, offset) *((volatile unsigned char *) (module + offset))
+#endif
 
 /*
  * A type representing the UART settings.
@@ -61,10 +69,17 @@ typedef uint8_t uart_settings;
 #define UART_BAUD_RATE_115200_SMCLK_12MHZ 0b100
 #define UART_BAUD_RATE_115200_SMCLK_1MHZ  0b101
 
-#define UART_WRITE_TIMEOUT 10
-#define UART_READ_TIMEOUT  10
+// every timeout_delay is in ms, 0 waits forever
+#define UART_WRITE_TIMEOUT 10000
+#define UART_READ_TIMEOUT  10000
 
-typedef void (*uart_rx_listener)(unsigned char);
+#define UART_SHIFT_DELAY 3 // ms, the last two bytes out of TXBUF and the shift register, at 9600 baud
+
+/*
+ * Decodes a received byte in the RX interrupt, e.g. a frame in place of its reader: returns whether
+ * it completed something awaited, the CPU is then woken up (only then, while there is a listener).
+ */
+typedef int (*uart_rx_listener)(unsigned char);
 
 /*
  * Sets up the given UART module.
@@ -72,28 +87,54 @@ typedef void (*uart_rx_listener)(unsigned char);
 void uart_setup(uart_module module, uart_settings settings);
 
 /*
- * Writes the byte out of the given UART module.
+ * Queues the byte to be written out of the given UART module by the TX interrupt.
+ * Returns right away, unless the write buffer is full: then waits for room.
  */
 void uart_write(uart_module module, uint8_t byte);
 
 /*
- * Writes the bytes buffer out of the given UART module.
+ * Bytes that can be queued right now without waiting.
+ */
+size_t uart_write_room(uart_module module);
+
+/*
+ * Queues the bytes buffer to be written out of the given UART module.
  */
 void uart_write_buffer(uart_module module, const uint8_t *buffer, size_t buffer_length);
 
 /*
- * Writes the string out of the given UART module.
- * Returns the number of bytes written, < of strlen(string) if timed out.
+ * Queues the string, without its '\0', as uart_write_buffer() does.
+ */
+void uart_write_string(uart_module module, const char *string);
+
+/*
+ * Waits until every queued byte has been shifted out of the given UART module.
  */
-int uart_write_string(uart_module module, const char *string);
+PMCU_Error uart_flush(uart_module module, uint32_t timeout_delay);
 
 PMCU_Error uart_read(uart_module module, uint8_t *byte, uint32_t timeout_delay);
 
+/*
+ * Reads a byte without waiting, returns whether there was one.
+ */
+int uart_try_read(uart_module module, uint8_t *byte);
+
 PMCU_Error uart_read_buffer(uart_module module, uint8_t *buffer, size_t buffer_length, uint32_t timeout_delay);
 
-PMCU_Error uart_match_string(uart_module module, const char *sample, uint32_t timeout_delay);
+/*
+ * Waits for received bytes and points span to the contiguous run of them, without consuming them.
+ */
+PMCU_Error uart_peek(uart_module module, const uint8_t **span, size_t *span_length, uint32_t timeout_delay);
 
-PMCU_Error uart_read_until_string(uart_module module, const char *sample, char *buffer, size_t buffer_length, uint32_t timeout_delay);
+/*
+ * Consumes the given number of received bytes, e.g. after having peeked them.
+ */
+void uart_consume(uart_module module, size_t length);
+
+/*
+ * Drops every byte received so far.
+ */
+void uart_discard(uart_module module);
 
 void uart_subscribe_rx_listener(uart_module module, uart_rx_listener listener);
 
@@ -1,5 +1,27 @@
+#include "uart_hub.h"
+
 #include <msp430.h>
 
+#include "lpm.h"
+
+#define UART_HUB_ANY_SETTINGS 0xff
+
+typedef struct {
+    uart_settings settings;
+    uint16_t settle_time;
+} uart_hub_Device;
+
+const uart_hub_Device uart_hub_devices[] = {
+    { UART_HUB_ANY_SETTINGS, 0 }, // UART_HUB_NONE
+    { UART_BAUD_RATE_9600_SMCLK_12MHZ, UART_HUB_SETTLE_TIME_SIM800L },
+    { UART_BAUD_RATE_9600_SMCLK_12MHZ, UART_HUB_SETTLE_TIME_GPS },
+    { UART_BAUD_RATE_115200_SMCLK_12MHZ, UART_HUB_SETTLE_TIME_SPS30 },
+};
+
+uart_hub_endpoint uart_hub_current;
+uart_settings uart_hub_settings;
+uint8_t uart_hub_taken;
+
 void uart_hub_init() {
     P4DIR |= BIT2;
     P4SEL &= ~BIT2;
@@ -8,9 +30,45 @@ void uart_hub_init() {
     P4DIR |= BIT1;
     P4SEL &= ~BIT1;
     P4OUT &= ~BIT1;
+
+    uart_hub_current = UART_HUB_NONE;
+    uart_hub_settings = UART_HUB_ANY_SETTINGS; // UART_A0 has not been set up yet
+    uart_hub_taken = 0;
+}
+
+void uart_hub_select(uart_hub_endpoint endpoint) {
+    const uart_hub_Device *device;
+
+    if (endpoint == uart_hub_current) {
+        return;
+    }
+    device = &uart_hub_devices[endpoint];
+
+    uart_flush(UART_A0, UART_WRITE_TIMEOUT); // queued bytes belong to the current device
+
+    P4OUT = (P4OUT & 0b11111001) | (endpoint << 1 & 0b00000110);
+    uart_hub_current = endpoint;
+
+    if (device->settings != UART_HUB_ANY_SETTINGS && device->settings != uart_hub_settings) {
+        uart_setup(UART_A0, device->settings);
+        uart_hub_settings = device->settings;
+    }
+
+    if (device->settle_time) {
+        lpm_wait(NULL, NULL, LPM0_bits, device->settle_time);
+    }
+    uart_discard(UART_A0);
+}
+
+int uart_hub_acquire(uart_hub_endpoint endpoint) {
+    if (uart_hub_taken) {
+        return 0;
+    }
+    uart_hub_select(endpoint);
+    uart_hub_taken = 1;
+    return 1;
 }
 
-void uart_hub_select(unsigned int device) {
-    P4OUT = (P4OUT & 0b11111001) | (device << 1 & 0b00000110);
-    __delay_cycles(12880000); // waits 1 second after changing destination
+void uart_hub_release() {
+    uart_hub_taken = 0;
 }
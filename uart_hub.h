@@ -1,8 +1,50 @@
 #ifndef UART_HUB_H
 #define UART_HUB_H
 
+#include "uart.h"
+
+/*
+ * The devices multiplexed on UART_A0, selected by P4.1 and P4.2.
+ */
+typedef enum {
+    UART_HUB_NONE,
+    UART_HUB_SIM800L,
+    UART_HUB_GPS,
+    UART_HUB_SPS30,
+} uart_hub_endpoint;
+
+/*
+ * Time (in ms) the line of each device is given to settle after a switch: bytes received meanwhile
+ * are discarded, as they could be garbage or leftovers of the previous device.
+ * Derived from the baud rate, not measured: two byte times (10 bits each), rounded up, for a frame
+ * in flight to end. To be raised if a device is seen to need longer.
+ */
+#ifndef UART_HUB_SETTLE_TIME_SIM800L
+#define UART_HUB_SETTLE_TIME_SIM800L 3 // 9600 baud: 2.08ms
+#endif
+#ifndef UART_HUB_SETTLE_TIME_GPS
+#define UART_HUB_SETTLE_TIME_GPS     3 // 9600 baud: 2.08ms
+#endif
+#ifndef UART_HUB_SETTLE_TIME_SPS30
+#define UART_HUB_SETTLE_TIME_SPS30   1 // 115200 baud: 0.17ms
+#endif
+
+extern uart_hub_endpoint uart_hub_current;
+
 void uart_hub_init();
 
-void uart_hub_select(unsigned int endpoint);
+/*
+ * Routes UART_A0 to the given device, with its baud rate.
+ * Selecting the current device does nothing.
+ */
+void uart_hub_select(uart_hub_endpoint endpoint);
+
+/*
+ * For threads sharing the hub: selects the device and takes the hub, unless another thread holds it.
+ * Returns whether the hub has been taken, to be released when done with the device.
+ */
+int uart_hub_acquire(uart_hub_endpoint endpoint);
+
+void uart_hub_release();
 
 #endif
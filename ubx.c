@@ -0,0 +1,199 @@
+#include "ubx.h"
+
+#include <string.h>
+
+#include "nmea.h"
+
+#define UBX_IDLE      0 // up to the first sync char
+#define UBX_SYNC      1
+#define UBX_CLASS     2
+#define UBX_ID        3
+#define UBX_LENGTH_1  4
+#define UBX_LENGTH_2  5
+#define UBX_PAYLOAD   6
+#define UBX_CK_A      7
+#define UBX_CK_B      8
+
+void ubx_init(ubx_Decoder *decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+size_t ubx_frame(uint8_t *buffer, uint8_t class, uint8_t id, const uint8_t *payload, uint16_t length) {
+    uint8_t ck_a, ck_b;
+    size_t i;
+
+    buffer[0] = UBX_SYNC_1;
+    buffer[1] = UBX_SYNC_2;
+    buffer[2] = class;
+    buffer[3] = id;
+    buffer[4] = length & 0xff;
+    buffer[5] = length >> 8;
+    memcpy(&buffer[6], payload, length);
+
+    ck_a = ck_b = 0;
+    for (i = 2; i < 6 + length; i++) {
+        ck_a += buffer[i];
+        ck_b += ck_a;
+    }
+    buffer[6 + length] = ck_a;
+    buffer[7 + length] = ck_b;
+
+    return UBX_FRAME_OVERHEAD + length;
+}
+
+uint32_t ubx_u4(const uint8_t *payload) {
+    return payload[0] | ((uint16_t) payload[1] << 8) | ((uint32_t) payload[2] << 16) | ((uint32_t) payload[3] << 24);
+}
+
+uint16_t ubx_u2(const uint8_t *payload) {
+    return payload[0] | ((uint16_t) payload[1] << 8);
+}
+
+/* From 0.01 to 0.1, saturated */
+uint8_t ubx_dop(const uint8_t *payload) {
+    uint16_t dop;
+
+    dop = ubx_u2(payload) / 10;
+    return dop > UINT8_MAX ? UINT8_MAX : dop;
+}
+
+/* From mm to 0.1 m, saturated */
+uint16_t ubx_accuracy(const uint8_t *payload) {
+    uint32_t accuracy;
+
+    accuracy = ubx_u4(payload) / 100;
+    return accuracy > UINT16_MAX ? UINT16_MAX : accuracy;
+}
+
+/* Folds the message just received into the fix */
+uint8_t ubx_fold(ubx_Decoder *decoder) {
+    const uint8_t *payload;
+    gps_Fix *fix;
+    int32_t altitude;
+
+    payload = decoder->payload;
+    fix = &decoder->fix;
+
+    if (decoder->class == UBX_ACK && decoder->length == 2) {
+        decoder->ack = decoder->id;
+        decoder->ack_class = payload[0];
+        decoder->ack_id = payload[1];
+        return 1;
+    }
+    if (decoder->class != UBX_NAV) {
+        return 0;
+    }
+
+    switch (decoder->id) {
+    case UBX_NAV_POSLLH:
+        if (decoder->length != 28) {
+            return 0;
+        }
+        fix->longitude = ubx_u4(&payload[4]);
+        fix->latitude = ubx_u4(&payload[8]);
+        altitude = (int32_t) ubx_u4(&payload[16]) / 100; // mm above mean sea level
+        fix->altitude = altitude < INT16_MIN ? INT16_MIN : (altitude > INT16_MAX ? INT16_MAX : altitude);
+        fix->horizontal_accuracy = ubx_accuracy(&payload[20]);
+        fix->vertical_accuracy = ubx_accuracy(&payload[24]);
+        fix->parts |= GPS_NAV_POSLLH;
+        return 1;
+
+    case UBX_NAV_SOL:
+        if (decoder->length != 52) {
+            return 0;
+        }
+        fix->mode = payload[10];
+        // gpsFixOk, with a 2D, 3D or dead reckoning combined fix: as GGA quality 1
+        fix->quality = (payload[11] & 0x01) && payload[10] >= 2 && payload[10] <= 4;
+        fix->pdop = ubx_dop(&payload[44]);
+        fix->satellites = payload[47];
+        fix->parts |= GPS_NAV_SOL;
+        return 1;
+
+    case UBX_NAV_DOP:
+        if (decoder->length != 18) {
+            return 0;
+        }
+        fix->pdop = ubx_dop(&payload[6]);
+        fix->vdop = ubx_dop(&payload[10]);
+        fix->hdop = ubx_dop(&payload[12]);
+        fix->parts |= GPS_NAV_DOP;
+        return 1;
+
+    case UBX_NAV_TIMEUTC:
+        if (decoder->length != 20) {
+            return 0;
+        }
+        if (payload[19] & 0x04) { // validUTC
+            fix->date = nmea_days(ubx_u2(&payload[12]), payload[14], payload[15]);
+            fix->time = (uint32_t) payload[16] * 3600 + payload[17] * 60 + payload[18];
+        }
+        fix->parts |= GPS_NAV_TIMEUTC;
+        return 1;
+    }
+    return 0;
+}
+
+uint16_t ubx_decode(ubx_Decoder *decoder, uint8_t byte) {
+    switch (decoder->state) {
+    case UBX_IDLE:
+        if (byte == UBX_SYNC_1) {
+            decoder->state = UBX_SYNC;
+        }
+        break;
+
+    case UBX_SYNC:
+        decoder->state = byte == UBX_SYNC_2 ? UBX_CLASS : (byte == UBX_SYNC_1 ? UBX_SYNC : UBX_IDLE);
+        break;
+
+    case UBX_CLASS:
+        decoder->class = byte;
+        decoder->ck_a = byte;
+        decoder->ck_b = byte;
+        decoder->state = UBX_ID;
+        break;
+
+    case UBX_ID:
+    case UBX_LENGTH_1:
+    case UBX_LENGTH_2:
+        if (decoder->state == UBX_ID) {
+            decoder->id = byte;
+        } else if (decoder->state == UBX_LENGTH_1) {
+            decoder->length = byte;
+        } else {
+            decoder->length |= (uint16_t) byte << 8;
+            decoder->received = 0;
+        }
+        decoder->ck_a += byte;
+        decoder->ck_b += decoder->ck_a;
+
+        decoder->state++;
+        if (decoder->state == UBX_PAYLOAD && decoder->length == 0) {
+            decoder->state = UBX_CK_A;
+        }
+        break;
+
+    case UBX_PAYLOAD:
+        if (decoder->received < UBX_PAYLOAD_LENGTH) {
+            decoder->payload[decoder->received] = byte; // the rest of a longer message is only checksummed
+        }
+        decoder->ck_a += byte;
+        decoder->ck_b += decoder->ck_a;
+        if (++decoder->received == decoder->length) {
+            decoder->state = UBX_CK_A;
+        }
+        break;
+
+    case UBX_CK_A:
+        decoder->state = byte == decoder->ck_a ? UBX_CK_B : UBX_IDLE;
+        break;
+
+    case UBX_CK_B:
+        decoder->state = UBX_IDLE;
+        if (byte == decoder->ck_b && decoder->length <= UBX_PAYLOAD_LENGTH && ubx_fold(decoder)) {
+            return ((uint16_t) decoder->class << 8) | decoder->id;
+        }
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef UBX_H_
+#define UBX_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "gps_fix.h"
+
+/*
+ * The u-blox binary protocol (UBX) of the NEO-6M: a frame is the sync chars, class, id, a little
+ * endian length, the payload and a Fletcher checksum over class to payload.
+ * The decoder is fed a byte at a time, e.g. from the RX interrupt, and skips whatever isn't UBX
+ * (NMEA sentences in between).
+ */
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+
+#define UBX_NAV 0x01
+#define UBX_ACK 0x05
+#define UBX_CFG 0x06
+
+#define UBX_NAV_POSLLH  0x02
+#define UBX_NAV_DOP     0x04
+#define UBX_NAV_SOL     0x06
+#define UBX_NAV_TIMEUTC 0x21
+#define UBX_ACK_NAK     0x00
+#define UBX_ACK_ACK     0x01
+#define UBX_CFG_MSG     0x01
+#define UBX_CFG_RATE    0x08
+
+#define UBX_NMEA 0xF0 // class of the NMEA sentences, for CFG-MSG
+
+#define UBX_FRAME_OVERHEAD 8
+#define UBX_PAYLOAD_LENGTH 52 // NAV-SOL, the longest message decoded: longer ones are skipped
+
+typedef struct {
+    uint8_t state;
+    uint8_t class;
+    uint8_t id;
+    uint16_t length;
+    uint16_t received;
+    uint8_t ck_a;
+    uint8_t ck_b;
+    uint8_t payload[UBX_PAYLOAD_LENGTH];
+
+    // the last ACK-ACK or ACK-NAK
+    uint8_t ack;
+    uint8_t ack_class;
+    uint8_t ack_id;
+
+    gps_Fix fix;
+} ubx_Decoder;
+
+void ubx_init(ubx_Decoder *decoder);
+
+/*
+ * Decodes the next byte. Returns the class and id (class << 8 | id) of the message it completes,
+ * if its checksum matches: the fix or the ack have just been updated. Otherwise returns 0.
+ */
+uint16_t ubx_decode(ubx_Decoder *decoder, uint8_t byte);
+
+/*
+ * Builds a frame, UBX_FRAME_OVERHEAD + length bytes. A poll has no payload.
+ */
+size_t ubx_frame(uint8_t *buffer, uint8_t class, uint8_t id, const uint8_t *payload, uint16_t length);
+
+#endif